@@ -41,7 +41,8 @@
 // Unsupported platform
 #endif
 #elif __linux
-// linux
+#define V_LINUX 1
+#define V_CPP 1 // the Lua library of the distributions is compiled in C
 #elif __unix // all unices not caught above
 // Unix
 #elif __posix
@@ -55,6 +56,11 @@
 #include <errno.h>
 #include <time.h>
 #include <stdarg.h>
+#include <math.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
 #ifdef V_PC
 #include "stdafx.h"
 #include <ctgmath>
@@ -62,6 +68,9 @@
 #ifdef V_MAC
 #include <math.h>
 #endif
+#ifdef V_LINUX
+#include <math.h>
+#endif
 
 #ifdef V_CPP
 #include <lua.hpp>
@@ -88,6 +97,17 @@
 #include <CoreMIDI/MIDISetup.h>
 #include <CoreMIDI/MIDIThruConnection.h>
 #include <pthread.h>
+#include <mach/mach_time.h>
+#include <dispatch/dispatch.h>
+#include <unistd.h>
+#endif
+#ifdef V_LINUX
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <poll.h>
+#include <unistd.h>
+#define __cdecl // VSTCALLBACK of aeffect.h : the default calling convention
 #endif
 
 #include "aeffect.h"
@@ -96,6 +116,12 @@
 
 #include "global.h"
 #include "basslua.h"
+#include <luabasslog.h>
+#include <luabasslatency.h>
+#include "bassluascore.h"
+#ifdef V_LINUX
+#include <luabassalsa.h>
+#endif
 
 #ifdef V_PC
 // disable warning for mismatch lngth between LUA int and C int
@@ -133,7 +159,7 @@ typedef union t_midimsg
 * It groups a set of notes in a single object, to trigger event in teh LUA script.
 */
 #define SELECTORMAXPITCH 5
-#define SELECTORMAX 50
+#define SELECTORINIT 64 // initial number of selectors allocated. The table grows on demand
 typedef struct t_selector
 {
 	int luaNrAction;
@@ -147,6 +173,123 @@ typedef struct t_selector
 	char param[128];
 } T_selector;
 
+/**
+* \struct T_selector_match
+* \brief Selector which matches a data byte ( pitch, control, program ), in the index of the selectors
+*/
+typedef struct t_selector_match
+{
+	int nr_selector; /*!< the selector */
+	int m; /*!< index of the pitch for an 'or' selector, -1 for a 'between' selector */
+} T_selector_match;
+
+/**
+* \struct T_selector_bucket
+* \brief Selectors which match a data byte, in the order of the selectors
+*/
+typedef struct t_selector_bucket
+{
+	T_selector_match *matches;
+	int nb; /*!< number of matches */
+	int size; /*!< number of matches allocated */
+} T_selector_bucket;
+
+/**
+* \struct T_selector_table
+* \brief Index of the selectors for a device, a channel and a type of message, by data byte
+*/
+#define SELECTOR_NBTYPE 4 // note-on, note-off, control, program
+typedef struct t_selector_table
+{
+	T_selector_bucket buckets[MAXPITCH];
+} T_selector_table;
+
+/**
+* \struct T_callback
+* \brief LUA function resolved in the LUA registry
+*
+* The LUA functions called on events are resolved once, and not searched by name on each event.
+* Only the arguments declared by the function are pushed ( all of them for a vararg or C function ).
+*/
+typedef struct t_callback
+{
+	int ref; /*!< reference in the LUA registry. LUA_NOREF if no function */
+	int nbArg; /*!< number of arguments to push */
+} T_callback;
+
+/**
+* \struct T_prepared
+* \brief Call of a LUA function, prepared by basslua_prepare
+*
+* The signature is parsed once. The function is resolved once per LUA state in the LUA registry.
+*/
+#define PREPAREDMAXARG 32
+#define PREPAREDMAXNAME 64
+typedef struct t_prepared
+{
+	char module[PREPAREDMAXNAME];
+	char function[PREPAREDMAXNAME];
+	char args[PREPAREDMAXARG]; /*!< type of each argument ( d i b s ) */
+	int nbArg;
+	char results[PREPAREDMAXARG]; /*!< type of each result ( d i b s ) */
+	int nbResult;
+	int ref; /*!< function in the LUA registry */
+	int refResults; /*!< table in the LUA registry, which keeps the string results alive up to the next call */
+	int generation; /*!< LUA state of the references */
+} T_prepared;
+
+/**
+* \struct T_midiin_event
+* \brief Raw Midi-in message, waiting to be processed by the LUA script
+*/
+typedef struct t_midiin_event
+{
+	double time; /*!< time of the message, given by the driver */
+	long long stamp; /*!< time of the driver callback, for the latency measure. 0 if not measured */
+	DWORD length; /*!< number of bytes of the message */
+	BYTE data[4]; /*!< short message */
+	BYTE *sysex; /*!< copy of a longer message ( sysex ), in the sysex pool of the ring */
+	unsigned int sysex_end; /*!< position in the sysex pool after the copy, released by the dispatcher */
+} T_midiin_event;
+
+/**
+* \struct T_sysex_in
+* \brief Midi-in sysex of one device, assembled from the parts given by the driver
+*/
+typedef struct t_sysex_in
+{
+	bool active; /*!< a sysex is started, and not yet terminated by F7 */
+	bool overflow; /*!< the sysex is too long : it is lost */
+	double time; /*!< time of the first part */
+	DWORD length; /*!< number of bytes assembled */
+	DWORD size; /*!< number of bytes allocated */
+	BYTE *data; /*!< buffer, kept for the next sysex */
+} T_sysex_in;
+
+/**
+* \struct T_midiin_ring
+* \brief Single-producer single-consumer ring of the Midi-in messages of one device
+*
+* The driver callback pushes the messages without any lock ( head ).
+* The dispatcher thread processes them with the LUA script ( tail ).
+* The bytes of the longer messages ( sysex ) are copied in a pool, pre-allocated : the callback never allocates.
+*/
+#define MIDIIN_RING_SIZE 1024 // must be a power of two
+#define MIDIIN_SYSEX_POOL 65536 // bytes of the sysex pool of a ring, must be a power of two
+typedef struct t_midiin_ring
+{
+	T_midiin_event events[MIDIIN_RING_SIZE];
+	BYTE sysex[MIDIIN_SYSEX_POOL]; /*!< bytes of the waiting sysex. The bytes of one message are contiguous */
+	std::atomic<unsigned int> sysex_head; /*!< next byte to write in the pool, by the driver callback */
+	std::atomic<unsigned int> sysex_tail; /*!< first byte still used in the pool, released by the dispatcher */
+	std::atomic<unsigned int> sysex_overflow; /*!< number of sysex lost because the pool was full, not yet logged */
+	std::atomic<unsigned int> head; /*!< next slot to write, by the driver callback */
+	std::atomic<unsigned int> tail; /*!< next slot to read, by the dispatcher */
+	std::atomic<unsigned int> max_depth; /*!< max number of waiting messages */
+	std::atomic<unsigned int> overflow; /*!< number of messages lost because the ring was full */
+	std::atomic<unsigned int> received; /*!< number of messages received */
+} T_midiin_ring;
+
 char g_path_in_error_txt[MAXBUFCHAR] = "basslua_log_in.txt";
 #define MAXBUFERROR 64
 #define MAXLENBUFERROR 1024
@@ -155,6 +298,13 @@ char g_path_in_error_txt[MAXBUFCHAR] = "basslua_log_in.txt";
 #define timer_dt 50 // ms between two timer interrupts on LUA input
 
 #define smidiToOpen "midiinOpen" // global LUA table which contains the MIDI-in to open
+#define MIDIIN_NAME 256 // max length of a midiin device name
+#define HOTPLUG_TICKS 20 // timer ticks between two checks of the midiin enumeration
+#define SYSEXIN_MAX (1024 * 1024) // max length of a midiin sysex, assembled from its parts
+#define SYSEXIN_TRACE 32 // bytes of a midiin sysex written in the traces
+#define JOURNAL_MAGIC "BLJ1" // header of a journal of midiin messages
+#define JOURNAL_BUFFER 65536 // bytes buffered before to write the journal
+#define REPLAY_POLL 1000 // micro-seconds between two checks of the rings, when the replay waits for the dispatcher
 
 #define sinit "init" // luabass function called to init the bass midi out 
 #define sonStart "onStart" // LUA function called just after the creation of the LUA stack g_LUAstate ( e.g. to initialise the MIDI settings)
@@ -171,12 +321,42 @@ char g_path_in_error_txt[MAXBUFCHAR] = "basslua_log_in.txt";
 #define LUAFunctionPitchBend "onPitchBend" // LUA funtion to call when new midiin pitchbend
 #define LUAFunctionSystemCommon "onSystemeCommon" // LUA funtion to call when new midiin systemcommon
 #define LUAFunctionSysex "onSysex" // LUA funtion to call when new midiin sysex
+#define LUAFunctionSysexPart "onSysexPart" // LUA funtion to call with each part of a midiin sysex, as it arrives
 #define LUAFunctionActive "onActive" // LUA funtion to call when new midiin active sense
 #define LUAFunctionClock "onClock" // LUA funtion to call when midiin clock
 
 #define onTimer "onTimer" // LUA funtion to call when timer is triggered 
+#define onDeviceAdded "onDeviceAdded" // LUA function to call when a midiin device is plugged
+#define onDeviceRemoved "onDeviceRemoved" // LUA function to call when a midiin device is unplugged
 #define onSelector "onSelector" // LUA functions called with noteon noteoff event,a dn add info 
 
+#define watchedGlobals "basslua_watched" // LUA registry key of the table which holds the globals resolved as callbacks
+
+// LUA functions resolved as callbacks
+#define CB_NOTEON 0
+#define CB_NOTEOFF 1
+#define CB_KEYPRESSURE 2
+#define CB_CONTROL 3
+#define CB_PROGRAM 4
+#define CB_CHANNELPRESSURE 5
+#define CB_PITCHBEND 6
+#define CB_SYSTEMCOMMON 7
+#define CB_SYSEX 8
+#define CB_ACTIVE 9
+#define CB_CLOCK 10
+#define CB_TIMER 11
+#define CB_DEVICEADDED 12
+#define CB_DEVICEREMOVED 13
+#define CB_SYSEXPART 14
+#define CB_MAX 15
+
+// functions of an action, resolved as callbacks
+#define ACTION_CALLFUNCTION 0
+#define ACTION_CALLSCORE 1
+#define ACTION_CALLCHORD 2
+#define ACTION_CALLMAX 3
+#define ACTION_NBARG 11
+
 
 
 
@@ -186,15 +366,38 @@ char g_path_in_error_txt[MAXBUFCHAR] = "basslua_log_in.txt";
 //////////////////////////////
 
 static bool g_midiopened[MIDIIN_MAX]; // list of midiin status. true if midin is open.
+static T_sysex_in g_sysex_in[MIDIIN_MAX]; // midiin sysex in progress
+// journal of the midiin messages, for record/replay
+static FILE *g_journal = NULL; // journal in recording, NULL if none
+static long long g_journal_time = 0; // time of the previous message recorded, in micro-seconds
+static bool g_replay_measure = false; // the replay measures the time spent in LUA
+static const long g_replay_limit[BASSLUA_REPLAY_HISTO] = { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 0 }; // upper limits in micro-seconds. 0 : no limit
+static char g_module_out[MAXBUFCHAR] = moduleLuabass; // module required as luabass
+static long long g_replay_lua_us = 0; // time spent in LUA, for the message replayed
+static std::atomic<bool> g_replay_running(false); // a journal is replayed : the messages of the drivers are ignored
+static std::atomic<int> g_midiin_callbacks(0); // driver callbacks pushing in the rings ( midiin_enter )
+static T_basslua_replay *g_replay_stat = NULL; // statistics of the replay in progress, updated by the dispatcher
+static FILE *g_replay_report = NULL; // report of the replay in progress, NULL if none
+// midiin hot-plug
+static char g_midiin_name[MIDIIN_MAX][MIDIIN_NAME]; // name of the present midiin devices, "" if none
+static int g_midiin_key[MIDIIN_MAX]; // sequencer address client*256+port of the present devices on Linux, 0 elsewhere
+static char g_midiin_last[MIDIIN_MAX][MIDIIN_NAME]; // name of the last device present at each number, kept when unplugged
+static char g_midiin_scan[MIDIIN_MAX][MIDIIN_NAME]; // new enumeration of the midiin devices
+static int g_midiin_scan_key[MIDIIN_MAX]; // keys of the new enumeration
+static char g_midiin_wanted[MIDIIN_MAX][MIDIIN_NAME]; // name of the midiin devices to open, requested by LUA
+static std::atomic<bool> g_midiin_changed(false); // the OS notifies a change of the MIDI setup
+#ifndef V_LINUX
+static unsigned long g_midiin_hash = 0; // signature of the last midiin enumeration
+#endif
+#ifdef V_MAC
+static MIDIClientRef g_midiin_client = 0; // CoreMIDI client, to receive the notifications of the MIDI setup
+#endif
 
 static bool g_logMidiInEvent = false;
 static char g_chMidiInEvent[256] = "";
 
-static bool g_collectLog = false;
-static int nrOutBufLog = 0;
-static int nrInBufLog = 0;
-#define MAXNBLOGOUT 64
-static char bufLog[MAXNBLOGOUT][MAXBUFCHAR];
+static T_log g_log; // log shared with luabass
+static T_latency g_latency; // latency measure shared with luabass
 
 
 static bool g_statuspitch[MIDIIN_MAX][MAXCHANNEL][MAXPITCH]; // status of input  pitch
@@ -206,26 +409,76 @@ static bool g_process_Control, g_process_Program;
 static bool g_process_PitchBend, g_process_KeyPressure, g_process_ChannelPressure;
 static bool g_process_Sysex, g_process_SystemCommon, g_process_Clock, g_process_Activesensing;
 static bool g_process_Timer ;
-static int g_countmidiin = 0;
 
-T_selector g_selectors[SELECTORMAX];
+static const char *g_callback_name[CB_MAX] = { LUAFunctionNoteOn, LUAFunctionNoteOff, LUAFunctionKeyPressure, LUAFunctionControl,
+	LUAFunctionProgram, LUAFunctionChannelPressure, LUAFunctionPitchBend, LUAFunctionSystemCommon,
+	LUAFunctionSysex, LUAFunctionActive, LUAFunctionClock, onTimer, onDeviceAdded, onDeviceRemoved, LUAFunctionSysexPart };
+static const int g_callback_nbArg[CB_MAX] = { 5, 5, 5, 5, 4, 4, 4, 5, 3, 2, 2, 1, 2, 2, 4 }; // arguments available for each callback
+static T_callback g_callbacks[CB_MAX];
+static T_callback g_sysex_done; // luabass function to report the sysex sent
+static T_callback *g_action_callbacks = NULL; // ACTION_CALLMAX callbacks per action
+static int g_nb_action_callbacks = 0; // number of actions resolved
+static int g_size_action_callbacks = 0; // number of actions allocated
+static bool g_callback_dirty = true; // callbacks must be resolved again
+static bool g_callback_watched = false; // assignments of the globals resolved as callbacks are detected
+
+static T_prepared *g_prepared = NULL; // calls prepared by basslua_prepare
+static int g_nb_prepared = 0;
+static int g_size_prepared = 0;
+static int g_generation = 0; // incremented for each new LUA state
+static int g_countmidiin = 0; // timer ticks since the last check of the midiin enumeration
+
+T_selector *g_selectors = NULL;
 int g_selectormax = 0;
+static int g_selectorsize = 0; // number of selectors allocated
+// index of the selectors : [device+1][channel+1][type] , where device or channel 0 is "any"
+static T_selector_table *g_selector_index[MIDIIN_MAX + 1][MAXCHANNEL + 1][SELECTOR_NBTYPE];
+static bool g_selector_dirty = false; // the index must be compiled again
+static int g_selector_searching = 0; // the index is in use by a search
 
 static double g_current_t = 0.0; // time in s for the timer
 
 static int actionMode = modeChord;
 
+static T_midiin_ring g_midiin_ring[MIDIIN_MAX]; // midiin messages waiting for the dispatcher
+static std::atomic<bool> g_dispatcher_running(false);
+static unsigned long long g_next_tick = 0; // time in ms of the next timer tick
+
 #ifdef V_PC
-// timer to trigger LUA regularly
-static HANDLE g_timer = NULL;
+// dispatcher thread, which runs LUA for the midiin messages and the timer
+static HANDLE g_dispatcher = NULL;
+// event to wake-up the dispatcher
+static HANDLE g_dispatcher_event = NULL;
 // mutex to protect the input ( from GUI, timer, and Mid-in , to LUA )
 static HANDLE g_mutex_in = NULL;
 #endif
 #ifdef V_MAC
-// timer to trigger LUA regularly
-static CFRunLoopTimerRef g_timer = 0 ;
+// dispatcher thread, which runs LUA for the midiin messages and the timer
+static pthread_t g_dispatcher;
+// semaphore to wake-up the dispatcher
+static dispatch_semaphore_t g_dispatcher_event = NULL;
 // mutex to protect the access of the midiin process
 static pthread_mutex_t g_mutex_in;
+static mach_timebase_info_data_t g_clock_freq;
+#endif
+#ifdef V_LINUX
+// dispatcher thread, which runs LUA for the midiin messages and the timer
+static pthread_t g_dispatcher;
+// semaphore to wake-up the dispatcher
+static sem_t g_dispatcher_event;
+// mutex to protect the access of the midiin process
+static pthread_mutex_t g_mutex_in;
+// ALSA sequencer client for the midiin, with its virtual port and its real-time queue
+static snd_seq_t *g_alsa_seq = NULL;
+static int g_alsa_port = -1;
+static int g_alsa_queue = -1;
+static snd_midi_event_t *g_alsa_decoder = NULL;
+static unsigned long long g_alsa_start = 0; // time in us of the start of the queue
+static std::atomic<int> g_alsa_addr[MIDIIN_MAX]; // address ( client * 256 + port ) of each midiin device, -1 if none
+static int g_alsa_opened[MIDIIN_MAX]; // address of the subscribed midiin devices
+// thread which reads the midiin events from the sequencer
+static pthread_t g_alsa_reader;
+static std::atomic<bool> g_alsa_running(false);
 #endif
 
 voidcallback fcallback;
@@ -294,32 +547,25 @@ static void log_init(const char *fname)
 		strcpy(g_path_in_error_txt, fname);
 		strcat(g_path_in_error_txt, "_in.txt");
 	}
-	FILE * pFile = fopen(g_path_in_error_txt, "w");;
-	if (pFile == NULL) return;
-	fprintf(pFile, "log luabass in\n");
-	fclose(pFile);
+	if (!g_log.running.load())
+		g_log.level.store(LOG_TRACE);
+	log_path(&g_log, LOG_SOURCE_IN, g_path_in_error_txt);
+	log_start(&g_log);
 }
 int mlog(const char * format, ...)
 {
-	char msg[MAXBUFCHAR];
 	va_list args;
 	va_start(args, format);
-	vsprintf(msg, format, args);
+	log_write(&g_log, LOG_SOURCE_IN, LOG_ERROR, format, args);
+	va_end(args);
+	return -1;
+}
+static int mlogl(int level, const char * format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	log_write(&g_log, LOG_SOURCE_IN, level, format, args);
 	va_end(args);
-	FILE * pFile = fopen(g_path_in_error_txt, "a");;
-	if (pFile != NULL)
-	{
-		fprintf(pFile, "%s", msg);
-		fprintf(pFile, "\n");
-		fclose(pFile);
-	}
-	if (g_collectLog)
-	{
-		strcpy(bufLog[nrInBufLog], msg);
-		nrInBufLog++;
-		if (nrInBufLog >= MAXNBLOGOUT)
-			nrInBufLog = 0;
-	}
 	return -1;
 }
 void lock_mutex_in()
@@ -328,7 +574,7 @@ void lock_mutex_in()
 	if (g_mutex_in)
 		WaitForSingleObject(g_mutex_in, INFINITE);
 #endif
-#ifdef V_MAC
+#if defined(V_MAC) || defined(V_LINUX)
 	pthread_mutex_lock(&g_mutex_in);
 #endif
 
@@ -339,10 +585,47 @@ void unlock_mutex_in()
 	if (g_mutex_in)
 		ReleaseMutex(g_mutex_in);
 #endif
-#ifdef V_MAC
+#if defined(V_MAC) || defined(V_LINUX)
 	pthread_mutex_unlock(&g_mutex_in);
 #endif
 }
+static unsigned long long clock_ms()
+{
+	// monotonic time in ms
+#ifdef V_PC
+	return ((unsigned long long)GetTickCount64());
+#endif
+#ifdef V_MAC
+	return ((unsigned long long)((mach_absolute_time() * g_clock_freq.numer) / g_clock_freq.denom / 1000000));
+#endif
+#ifdef V_LINUX
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000 + (unsigned long long)(ts.tv_nsec / 1000000));
+#endif
+}
+static unsigned long long clock_us()
+{
+	// monotonic time in us, for the measures
+#ifdef V_PC
+	static LARGE_INTEGER freq = { 0 };
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return ((unsigned long long)((now.QuadPart / freq.QuadPart) * 1000000 + ((now.QuadPart % freq.QuadPart) * 1000000) / freq.QuadPart));
+#endif
+#ifdef V_MAC
+	if (g_clock_freq.denom == 0)
+		mach_timebase_info(&g_clock_freq);
+	return ((unsigned long long)((mach_absolute_time() * g_clock_freq.numer) / g_clock_freq.denom / 1000));
+#endif
+#ifdef V_LINUX
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000000 + (unsigned long long)(ts.tv_nsec / 1000));
+#endif
+}
 int action_table(const char *module, const char *table, const int index, const char* field, char*svalue, int *ivalue, int action)
 {
 	// if index >= 0 : works on module.table[index+1].field
@@ -607,251 +890,1104 @@ bool basslua_call(const char *module, const char *function, const char *sig, ...
 	unlock_mutex_in();
 	return retCode;
 }
-static void runAction(int nrAction,double time, int nr_selector, int nrChannel, int d1, int d2, const char *param, int index, int mediane, int whiteIndex, int whiteMediane, int sharp)
+static bool prepared_resolve(T_prepared *h)
 {
-	//mlog("runaction #%d", nrAction);
-	bool fok = false;
+	// resolve the function of a prepared call in the current LUA state
+	if (h->generation == g_generation)
+		return true;
+	h->ref = LUA_NOREF;
+	h->refResults = LUA_NOREF;
+	if (lua_getglobal(g_LUAstate, h->module) != LUA_TTABLE)
+	{
+		mlog("module %s is not available in LUA script", h->module);
+		lua_pop(g_LUAstate, 1);
+		return false;
+	}
+	if (lua_getfield(g_LUAstate, -1, h->function) != LUA_TFUNCTION)
+	{
+		mlog("basslua_invoke : function %s is not available in module %s ", h->function, h->module);
+		lua_pop(g_LUAstate, 2);
+		return false;
+	}
+	h->ref = luaL_ref(g_LUAstate, LUA_REGISTRYINDEX);
+	lua_pop(g_LUAstate, 1); // pop the module
+	lua_newtable(g_LUAstate);
+	h->refResults = luaL_ref(g_LUAstate, LUA_REGISTRYINDEX);
+	h->generation = g_generation;
+	return true;
+}
+static void callback_free(T_callback *cb)
+{
+	if ((g_LUAstate) && (cb->ref != LUA_NOREF))
+		luaL_unref(g_LUAstate, LUA_REGISTRYINDEX, cb->ref);
+	cb->ref = LUA_NOREF;
+	cb->nbArg = 0;
+}
+static bool callback_ref(T_callback *cb, int nbArgMax)
+{
+	// resolve the LUA value on top of the stack ( popped ) in the LUA registry, if it is a function
+	callback_free(cb);
+	if (lua_type(g_LUAstate, -1) != LUA_TFUNCTION)
+	{
+		lua_pop(g_LUAstate, 1);
+		return false;
+	}
+	// compact calling convention : only the arguments declared by the function will be pushed
+	lua_Debug ar;
+	lua_pushvalue(g_LUAstate, -1);
+	lua_getinfo(g_LUAstate, ">u", &ar);
+	cb->nbArg = ((ar.isvararg) || (ar.nparams > nbArgMax)) ? nbArgMax : ar.nparams;
+	cb->ref = luaL_ref(g_LUAstate, LUA_REGISTRYINDEX);
+	return true;
+}
+static void callback_reset()
+{
+	// forget the references of a closed LUA state
+	for (int n = 0; n < CB_MAX; n++)
+	{
+		g_callbacks[n].ref = LUA_NOREF;
+		g_callbacks[n].nbArg = 0;
+	}
+	g_sysex_done.ref = LUA_NOREF;
+	g_sysex_done.nbArg = 0;
+	if (g_action_callbacks)
+		free(g_action_callbacks);
+	g_action_callbacks = NULL;
+	g_nb_action_callbacks = 0;
+	g_size_action_callbacks = 0;
+	g_callback_dirty = true;
+	g_callback_watched = false;
+}
+static void filter_set()
+{
+	// resolve the LUA functions available to process the MIDI messages, and the functions of the actions
+	for (int n = 0; n < CB_MAX; n++)
+	{
+		bool registered = (g_callbacks[n].ref != LUA_NOREF);
+		lua_getglobal(g_LUAstate, g_callback_name[n]);
+		if ((callback_ref(&(g_callbacks[n]), g_callback_nbArg[n])) && (!registered))
+			mlogl(LOG_INFO, "Information : bassLUA function %s registered", g_callback_name[n]);
+	}
+	g_process_NoteOn = (g_callbacks[CB_NOTEON].ref != LUA_NOREF);
+	g_process_NoteOff = (g_callbacks[CB_NOTEOFF].ref != LUA_NOREF);
+	g_process_KeyPressure = (g_callbacks[CB_KEYPRESSURE].ref != LUA_NOREF);
+	g_process_Control = (g_callbacks[CB_CONTROL].ref != LUA_NOREF);
+	g_process_Program = (g_callbacks[CB_PROGRAM].ref != LUA_NOREF);
+	g_process_ChannelPressure = (g_callbacks[CB_CHANNELPRESSURE].ref != LUA_NOREF);
+	g_process_PitchBend = (g_callbacks[CB_PITCHBEND].ref != LUA_NOREF);
+	g_process_SystemCommon = (g_callbacks[CB_SYSTEMCOMMON].ref != LUA_NOREF);
+	g_process_Sysex = (g_callbacks[CB_SYSEX].ref != LUA_NOREF);
+	g_process_Activesensing = (g_callbacks[CB_ACTIVE].ref != LUA_NOREF);
+	g_process_Clock = (g_callbacks[CB_CLOCK].ref != LUA_NOREF);
+	g_process_Timer = (g_callbacks[CB_TIMER].ref != LUA_NOREF);
+
+	// luabass function to report the sysex sent
+	if (lua_getglobal(g_LUAstate, moduleLuabass) == LUA_TTABLE)
+	{
+		lua_getfield(g_LUAstate, -1, soutSysexDone);
+		callback_ref(&g_sysex_done, 0);
+	}
+	lua_pop(g_LUAstate, 1); // pop module luabass
+
+	// functions callFunction, callScore, callChord of the actions
+	for (int n = 0; n < g_nb_action_callbacks * ACTION_CALLMAX; n++)
+		callback_free(&(g_action_callbacks[n]));
+	g_nb_action_callbacks = 0;
 	if (lua_getglobal(g_LUAstate, tableActions) == LUA_TTABLE)
 	{
-		if (lua_geti(g_LUAstate, 1, nrAction + 1) == LUA_TTABLE)
+		int nbAction = (int)lua_rawlen(g_LUAstate, -1);
+		if (nbAction > g_size_action_callbacks)
 		{
-			bool functionOK = false;
-			if (lua_getfield(g_LUAstate, 2, fieldCallFunction) == LUA_TFUNCTION)
+			T_callback *action_callbacks = (T_callback *)realloc(g_action_callbacks, nbAction * ACTION_CALLMAX * sizeof(T_callback));
+			if (action_callbacks == NULL)
 			{
-				functionOK = true;
-				// mlog("callFunction ok");
+				mlog("Error filter_set : no memory for %d actions", nbAction);
+				nbAction = g_size_action_callbacks;
 			}
 			else
 			{
-				lua_pop(g_LUAstate, 1); // pop the bad value
-				// try with the Function<mode>
-				if (actionMode == modeScore)
-				{
-					functionOK = (lua_getfield(g_LUAstate, 2, fieldCallScore) == LUA_TFUNCTION);
-					// mlog("callScore %s", functionOK?"ok":"ko");
-
-				}
-				if (actionMode == modeChord)
-				{
-					functionOK = (lua_getfield(g_LUAstate, 2, fieldCallChord) == LUA_TFUNCTION);
-					// mlog("callChord %s", functionOK ? "ok" : "ko");
-				}
+				g_action_callbacks = action_callbacks;
+				g_size_action_callbacks = nbAction;
 			}
-			if ( functionOK )
+		}
+		for (int nrAction = 0; nrAction < nbAction; nrAction++)
+		{
+			T_callback *cb = &(g_action_callbacks[nrAction * ACTION_CALLMAX]);
+			for (int n = 0; n < ACTION_CALLMAX; n++)
 			{
-				lua_pushnumber(g_LUAstate, time);
-				int bid = nr_selector * 127 * 17 + (nrChannel+1) * 17 + d1;
-				lua_pushinteger(g_LUAstate, bid);
-				lua_pushinteger(g_LUAstate, nrChannel + 1);
-				lua_pushinteger(g_LUAstate, d1);
-				lua_pushinteger(g_LUAstate, d2);
-				if (param)
-					lua_pushstring(g_LUAstate, param);
-				else
-					lua_pushstring(g_LUAstate, "");
-				lua_pushinteger(g_LUAstate, index);
-				lua_pushinteger(g_LUAstate, mediane);
-				lua_pushinteger(g_LUAstate, whiteIndex);
-				lua_pushinteger(g_LUAstate, whiteMediane);
-				lua_pushinteger(g_LUAstate, sharp);
-				if (lua_pcall(g_LUAstate, 11, 0, 0) == LUA_OK) // call and pop function & parameters
-				{
-					fok = true ;
-					fcallback();
-				}
-				else
-				{
-					mlog("erreur call LUA %s, action= %d ", lua_tostring(g_LUAstate, -1), nrAction);
-					lua_pop(g_LUAstate, 1);
-				}
+				cb[n].ref = LUA_NOREF;
+				cb[n].nbArg = 0;
 			}
-			else
+			if (lua_rawgeti(g_LUAstate, -1, nrAction + 1) == LUA_TTABLE)
 			{
-				lua_pop(g_LUAstate, 1); // pop fcallfunction
-				mlog("erreur : no LUA function for action= %d ",  nrAction);
+				lua_getfield(g_LUAstate, -1, fieldCallFunction);
+				callback_ref(&(cb[ACTION_CALLFUNCTION]), ACTION_NBARG);
+				lua_getfield(g_LUAstate, -1, fieldCallScore);
+				callback_ref(&(cb[ACTION_CALLSCORE]), ACTION_NBARG);
+				lua_getfield(g_LUAstate, -1, fieldCallChord);
+				callback_ref(&(cb[ACTION_CALLCHORD]), ACTION_NBARG);
 			}
+			lua_pop(g_LUAstate, 1); // pop the action
 		}
-		lua_pop(g_LUAstate, 1); // pop luaAction table
+		g_nb_action_callbacks = nbAction;
 	}
 	lua_pop(g_LUAstate, 1); // pop table actions
+	g_callback_dirty = false;
 }
-void selectorSearch(double time, int nrDevice, int nrChannel, int type_msg, int d1, int d2)
+static void callback_check()
 {
-	// search a note/program/control ( in midimsg u ) , within the selectors
-	// the selectors are created with the LUA funtion selector()
-	// if this note/program/control matches a selector, it calls the LUA functions
-	//     midibetween() : for between selector
-	//			parameters :
-	//				sid : unique id of the selector ( specified in the creation )
-	//				double time
-	//              bid : unique id of the note which trigger this selector
-	//              channel : channel of the note
-	//				pitch : pitch of the note
-	//              velocity : velocity of the note ( 0 for noteff )
-	//              index : index of the note within the selector ( 1=first , 2=second, ... )
-	//              mediane : index of the note from the middle of the selector ( 0 = middle )
-	//              white-key index : index of the white_key within the selector
-	//              white-key mediane : index of the white_key from the middle of the selector
-	//              sharp : 1 for black key , else 0 
-	//     midior() : for or selector
-	//			parameters :
-	//              bid : unique id of the note which trigger ths selector
-	//              channel : channel of the note
-	//				pitch : pitch of the note
-	//              velocity : velocity of the note ( 0 for noteff )
-	//              index : index of the note within the selector ( 1=first , 2=second, ... )
-	//              0
-	//              0
-	//              0
-	//              0
-
-
-	// mlog("selectorSearch %d", d1);
-	for (int nr_selector = 0; nr_selector < g_selectormax; nr_selector++)
-	{
-		T_selector *s = &(g_selectors[nr_selector]);
-		if (((s->type_msg == type_msg) || (s->type_msg == NOTEONOFF && ((type_msg == NOTEON) || (type_msg == NOTEOFF))))
-			&& ((s->nrDevice == -1) || (s->nrDevice == nrDevice))
-			&& ((s->nrChannel == -1) || (s->nrChannel == nrChannel))
-			)
-		{
-			int sharp;
-			switch (s->op)
-			{
-			case 'b': //between
-				if ((s->nbPitch == 2) &&
-					(d1 >= s->pitch[0]) && (d1 <= s->pitch[1]))
-				{
-					int v = pitch_to_white_key(d1, s->pitch[0], &sharp);
-					int w = pitch_to_white_key(d1, (s->pitch[1] + s->pitch[0]) / 2, &sharp);
-					runAction(s->luaNrAction, time, nr_selector, nrChannel, d1, d2, s->param,
-						d1 - s->pitch[0] + 1, d1 - (s->pitch[1] + s->pitch[0]) / 2 + 1,
-						v, w, sharp);
-					if (s->stopOnMatch)
-						return;
-				}
-				break;
-			case 'o': //or
-				for (int m = 0; m < s->nbPitch; m++)
-				{
-					if (d1 == s->pitch[m])
-					{
-						runAction(s->luaNrAction, time, nr_selector, nrChannel, d1, d2, s->param,
-							m + 1, 0,
-							0, 0, 0);
-						if (s->stopOnMatch)
-							return;
-					}
-				}
-				break;
-			default:
-				break;
-			}
-		}
-	}
+	// resolve again the callbacks, if the LUA script has changed them
+	if ((g_callback_dirty) || (!g_callback_watched))
+		filter_set();
 }
-static void initSelector()
+static T_callback *callback_push(int nrCallback)
+{
+	// push the LUA function of the callback
+	T_callback *cb = &(g_callbacks[nrCallback]);
+	lua_rawgeti(g_LUAstate, LUA_REGISTRYINDEX, cb->ref);
+	return cb;
+}
+static bool watched_name(const char *name)
 {
-	for (int i = 0; i < SELECTORMAX; i++)
+	if (strcmp(name, tableActions) == 0)
+		return true;
+	for (int n = 0; n < CB_MAX; n++)
 	{
-		T_selector *t = &(g_selectors[i]);
-		t->luaNrAction = 0;
-		t->op = 'b';
-		t->nrDevice = -1;
-		t->nrChannel = -1;
-		t->type_msg = NOTEONOFF;
-		for (int j = 1; j < SELECTORMAXPITCH; j++)
-			t->pitch[j] = 0;
-		t->nbPitch = 0;
-		t->stopOnMatch = false;
-		t->param[0] = '\0';
+		if (strcmp(name, g_callback_name[n]) == 0)
+			return true;
 	}
-	g_selectormax = 0;
+	return false;
 }
-static void midi_init()
+static int watched_newindex(lua_State *L)
 {
-	lua_pushnil(g_LUAstate);
-	lua_setglobal(g_LUAstate, smidiToOpen);
+	// __newindex of _G : parameters are _G, key, value
+	// the watched globals are kept in a shadow table, so that each assignment reaches this function
+	if ((lua_type(L, 2) == LUA_TSTRING) && (watched_name(lua_tostring(L, 2))))
+	{
+		lua_getfield(L, LUA_REGISTRYINDEX, watchedGlobals);
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, 3);
+		lua_rawset(L, -3);
+		g_callback_dirty = true;
+		return 0;
+	}
+	lua_rawset(L, 1);
+	return 0;
 }
-static void pitch_init()
+static void watch_install()
 {
-	for (int n = 0; n < MIDIIN_MAX; n++)
+	// move the globals resolved as callbacks ( on<event>, actions ) in a shadow table, reached by the metatable of _G
+	// Any later assignment of these globals by the script invalidates the callbacks
+	lua_pushglobaltable(g_LUAstate);
+	if (lua_getmetatable(g_LUAstate, -1))
 	{
-		for (int c = 0; c < MAXCHANNEL; c++)
-		{
-			for (int p = 0; p < MAXPITCH; p++)
-				g_statuspitch[n][c][p] = false;
-		}
+		lua_pop(g_LUAstate, 2);
+		g_callback_watched = false;
+		mlogl(LOG_INFO, "Information : _G has a metatable. The callbacks are resolved on each event");
+		return;
 	}
+	lua_newtable(g_LUAstate); // shadow table
+	for (int n = 0; n <= CB_MAX; n++)
+	{
+		const char *name = (n < CB_MAX) ? g_callback_name[n] : tableActions;
+		lua_getfield(g_LUAstate, -2, name);
+		lua_setfield(g_LUAstate, -2, name);
+		lua_pushnil(g_LUAstate);
+		lua_setfield(g_LUAstate, -3, name);
+	}
+	lua_pushvalue(g_LUAstate, -1);
+	lua_setfield(g_LUAstate, LUA_REGISTRYINDEX, watchedGlobals);
+	lua_newtable(g_LUAstate); // metatable of _G
+	lua_pushvalue(g_LUAstate, -2);
+	lua_setfield(g_LUAstate, -2, "__index");
+	lua_pushcfunction(g_LUAstate, watched_newindex);
+	lua_setfield(g_LUAstate, -2, "__newindex");
+	lua_setmetatable(g_LUAstate, -3);
+	lua_pop(g_LUAstate, 2); // pop shadow table and _G
+	g_callback_watched = true;
+	g_callback_dirty = true;
 }
-void midiprocess_msg(int midinr, double time, void *buffer, DWORD length)
+int basslua_prepare(const char *module, const char *function, const char *sig)
 {
-	// process this new midiin mg with the midiin-LUA-thread , using the expected LUA-function midixxx()
-	// Construct the short MIDI message.	
-	T_midimsg u;
-	u.dwData = 0;
-	switch (length)
+	// prepare the call of module.function, with the signature syntax of basslua_call
+	// return a handle for basslua_invoke, or -1 if error
+	// The handle stays valid when the LUA script is reloaded
+	if ((strlen(module) >= PREPAREDMAXNAME) || (strlen(function) >= PREPAREDMAXNAME))
 	{
-	case 0: return;
-	case 1: u.bData[0] = ((BYTE*)buffer)[0];  break;
-	case 2: u.bData[0] = ((BYTE*)buffer)[0];  u.bData[1] = ((BYTE*)buffer)[1]; break;
-	default: u.bData[0] = ((BYTE*)buffer)[0];  u.bData[1] = ((BYTE*)buffer)[1];  u.bData[2] = ((BYTE*)buffer)[2]; break;
+		mlog("basslua_prepare : name too long %s.%s", module, function);
+		return -1;
 	}
-
-	g_current_t = time;
-
-	// mlog("receive length=%d", length);
-
-	switch (u.bData[0])
+	T_prepared h;
+	strcpy(h.module, module);
+	strcpy(h.function, function);
+	h.nbArg = 0;
+	h.nbResult = 0;
+	h.ref = LUA_NOREF;
+	h.refResults = LUA_NOREF;
+	h.generation = -1;
+	bool result = false;
+	for (const char *c = sig; *c; c++)
 	{
-	case SYSEX:
-		// sysex
-		if (! g_process_Sysex)	return; // g_process_ sysex
-		lua_getglobal(g_LUAstate, LUAFunctionSysex);
-		lua_pushinteger(g_LUAstate, midinr + 1);
-		lua_pushnumber(g_LUAstate, time);
+		switch (*c)
 		{
-			char *sysexAscii = (char*)malloc(length * 6 + 1);
-			sysexAscii[0] = '\0';
-			char s[10];
-			BYTE *ptbuf = (BYTE*)buffer;
-			for (unsigned int n = 0; n < length; n++, ptbuf++)
+		case 'd':
+		case 'i':
+		case 'b':
+		case 's':
+			if ((result ? h.nbResult : h.nbArg) >= PREPAREDMAXARG)
 			{
-				sprintf(s, "%0.2X ", *ptbuf);
-				strcat(sysexAscii, s);
+				mlog("basslua_prepare : too many arguments in %s <%s>", function, sig);
+				return -1;
 			}
-			if (g_collectLog)
+			if (result)
+				h.results[h.nbResult++] = *c;
+			else
+				h.args[h.nbArg++] = *c;
+			break;
+		case '>':
+			result = true;
+			break;
+		default:
+			mlog("basslua_prepare : Invalid argument descriptor in %s <%s>", function, sig);
+			return -1;
+		}
+	}
+
+	lock_mutex_in();
+	int handle;
+	for (handle = 0; handle < g_nb_prepared; handle++)
+	{
+		// same call already prepared
+		T_prepared *p = &(g_prepared[handle]);
+		if ((strcmp(p->module, h.module) == 0) && (strcmp(p->function, h.function) == 0)
+			&& (p->nbArg == h.nbArg) && (memcmp(p->args, h.args, h.nbArg) == 0)
+			&& (p->nbResult == h.nbResult) && (memcmp(p->results, h.results, h.nbResult) == 0))
+			break;
+	}
+	if (handle == g_nb_prepared)
+	{
+		if (g_nb_prepared >= g_size_prepared)
+		{
+			int size = (g_size_prepared == 0) ? 16 : 2 * g_size_prepared;
+			T_prepared *prepared = (T_prepared *)realloc(g_prepared, size * sizeof(T_prepared));
+			if (prepared == NULL)
 			{
-				char s[256];
-				sprintf(s, "<midiin device#%d @%f ,sysex = %s\n", midinr + 1, time, sysexAscii);
-				mlog(s);
+				mlog("Error basslua_prepare : no more memory for %d calls", size);
+				unlock_mutex_in();
+				return -1;
 			}
-			lua_pushstring(g_LUAstate, sysexAscii);
-			if (lua_pcall(g_LUAstate, 3, 0, 0) != LUA_OK)
+			g_prepared = prepared;
+			g_size_prepared = size;
+		}
+		g_prepared[g_nb_prepared] = h;
+		g_nb_prepared++;
+	}
+	unlock_mutex_in();
+	return handle;
+}
+bool basslua_invoke(int handle, ...)
+{
+	// call a function prepared with basslua_prepare. Arguments and results are given as in basslua_call,
+	// except the string results, given as const char ** : the strings stay valid up to the next call of this handle
+	lock_mutex_in();
+	bool retCode = false;
+	if ((g_LUAstate) && (handle >= 0) && (handle < g_nb_prepared) && (prepared_resolve(&(g_prepared[handle]))))
+	{
+		T_prepared *h = &(g_prepared[handle]);
+		va_list vl;
+		va_start(vl, handle);
+		luaL_checkstack(g_LUAstate, h->nbArg + h->nbResult + 2, "basslua_invoke : too many arguments");
+		lua_rawgeti(g_LUAstate, LUA_REGISTRYINDEX, h->ref);
+		for (int n = 0; n < h->nbArg; n++)
+		{
+			switch (h->args[n])
 			{
-				mlog("erreur call  LUA %s , err: %s", LUAFunctionSysex, lua_tostring(g_LUAstate, -1));
-				lua_pop(g_LUAstate, 1);
+			case 'd': lua_pushnumber(g_LUAstate, va_arg(vl, double)); break;
+			case 'i': lua_pushinteger(g_LUAstate, va_arg(vl, int)); break;
+			case 'b': lua_pushboolean(g_LUAstate, va_arg(vl, int)); break;
+			default: lua_pushstring(g_LUAstate, va_arg(vl, const char*)); break;
 			}
-			free(sysexAscii);
 		}
-		return;
-	case ACTIVESENSING:
-		if (! g_process_Activesensing) return; // g_process_ active sensing messages 
-		lua_getglobal(g_LUAstate, LUAFunctionActive);
-		lua_pushinteger(g_LUAstate, midinr + 1);
-		lua_pushnumber(g_LUAstate, time);
-		if ( lua_pcall(g_LUAstate, 2, 0, 0) != LUA_OK )
+		if (lua_pcall(g_LUAstate, h->nbArg, h->nbResult, 0) != LUA_OK)
 		{
-			mlog("erreur call  LUA %s , err: %s", LUAFunctionActive, lua_tostring(g_LUAstate, -1));
+			mlog("basslua_invoke : mlog calling LUA function %s :err=%s", h->function, lua_tostring(g_LUAstate, -1));
 			lua_pop(g_LUAstate, 1);
 		}
-		return;
+		else
+		{
+			retCode = true;
+			lua_rawgeti(g_LUAstate, LUA_REGISTRYINDEX, h->refResults);
+			for (int n = 0; n < h->nbResult; n++)
+			{
+				int nres = n - h->nbResult - 1; // results are below the table of strings
+				int isnum = 1;
+				switch (h->results[n])
+				{
+				case 'd':
+					*va_arg(vl, double *) = lua_tonumberx(g_LUAstate, nres, &isnum);
+					break;
+				case 'i':
+					*va_arg(vl, int *) = (int)lua_tointegerx(g_LUAstate, nres, &isnum);
+					break;
+				case 'b':
+					isnum = lua_isboolean(g_LUAstate, nres);
+					if (isnum)
+						*va_arg(vl, bool *) = (lua_toboolean(g_LUAstate, nres)) ? true : false;
+					else
+						va_arg(vl, bool *);
+					break;
+				default:
+				{
+					const char **ps = va_arg(vl, const char **);
+					*ps = lua_tostring(g_LUAstate, nres);
+					if (*ps == NULL)
+					{
+						isnum = 0;
+						*ps = "";
+					}
+					else
+					{
+						// the table of strings keeps the string alive, up to the next call
+						lua_pushvalue(g_LUAstate, nres);
+						lua_rawseti(g_LUAstate, -2, n + 1);
+					}
+					break;
+				}
+				}
+				if (!isnum)
+					mlog("basslua_invoke : result#%d of %s should be %c, returned type : %s", n + 1, h->function, h->results[n], lua_typename(g_LUAstate, lua_type(g_LUAstate, nres)));
+			}
+		}
+		va_end(vl);
+		lua_pop(g_LUAstate, lua_gettop(g_LUAstate)); // pop all
+	}
+	unlock_mutex_in();
+	return retCode;
+}
+static bool score_check(const char *buffer, int size)
+{
+	// check the events packed in buffer
+	const T_basslua_score_header *header = (const T_basslua_score_header *)buffer;
+	if ((size < (int)sizeof(T_basslua_score_header)) || (header->version != BASSLUA_SCORE_VERSION) || (header->sizeEvent != (int)sizeof(T_basslua_score_event)))
+	{
+		mlog("basslua_scoreEvents : invalid version of buffer");
+		return false;
+	}
+	if ((header->nbEvents < 0) || (header->nbIndexes < 0) || (header->sizeStrings < 1)
+		|| ((long long)size != (long long)sizeof(T_basslua_score_header) + (long long)header->nbEvents * (long long)sizeof(T_basslua_score_event)
+			+ (long long)header->nbIndexes * (long long)sizeof(int) + (long long)header->sizeStrings))
+	{
+		mlog("basslua_scoreEvents : invalid size of buffer");
+		return false;
+	}
+	const T_basslua_score_event *events = (const T_basslua_score_event *)(buffer + sizeof(T_basslua_score_header));
+	const int *indexes = (const int *)(events + header->nbEvents);
+	const char *strings = (const char *)(indexes + header->nbIndexes);
+	if (strings[header->sizeStrings - 1] != '\0')
+	{
+		mlog("basslua_scoreEvents : invalid strings in buffer");
+		return false;
+	}
+	int nrIndex = 0;
+	for (int nrEvent = 0; nrEvent < header->nbEvents; nrEvent++)
+	{
+		const T_basslua_score_event *e = &(events[nrEvent]);
+		if ((e->nbStarts < 0) || (e->nbStops < 0) || (nrIndex + e->nbStarts + e->nbStops > header->nbIndexes)
+			|| (e->lua < 0) || (e->lua >= header->sizeStrings))
+		{
+			mlog("basslua_scoreEvents : invalid event#%d in buffer", nrEvent + 1);
+			return false;
+		}
+		nrIndex += e->nbStarts + e->nbStops;
+	}
+	return true;
+}
+static bool score_decode(const char *buffer, int size)
+{
+	// push on the LUA stack the table of the events packed in buffer
+	if (!score_check(buffer, size))
+		return false;
+	const T_basslua_score_header *header = (const T_basslua_score_header *)buffer;
+	const T_basslua_score_event *events = (const T_basslua_score_event *)(buffer + sizeof(T_basslua_score_header));
+	const int *indexes = (const int *)(events + header->nbEvents);
+	const char *strings = (const char *)(indexes + header->nbIndexes);
+	lua_createtable(g_LUAstate, header->nbEvents, 0);
+	int nrIndex = 0;
+	for (int nrEvent = 0; nrEvent < header->nbEvents; nrEvent++)
+	{
+		const T_basslua_score_event *e = &(events[nrEvent]);
+		lua_createtable(g_LUAstate, 23, 0);
+		// starts and stops
+		lua_createtable(g_LUAstate, e->nbStarts, 0);
+		for (int n = 0; n < e->nbStarts; n++)
+		{
+			lua_pushinteger(g_LUAstate, indexes[nrIndex++]);
+			lua_rawseti(g_LUAstate, -2, n + 1);
+		}
+		lua_rawseti(g_LUAstate, -2, 1);
+		lua_createtable(g_LUAstate, e->nbStops, 0);
+		for (int n = 0; n < e->nbStops; n++)
+		{
+			lua_pushinteger(g_LUAstate, indexes[nrIndex++]);
+			lua_rawseti(g_LUAstate, -2, n + 1);
+		}
+		lua_rawseti(g_LUAstate, -2, 2);
+		// the fields, from played to stopOrder, in the order of the LUA event. The lua field is a string
+		const int field[21] = { e->played, e->visible, e->trackNr, e->pitch, e->velocity, e->delay,
+			e->dynamic, e->randomDelay, e->pedal, e->lua, e->willStopIndex, e->stopIndex,
+			e->partNr, e->measureNr, e->measureLength, e->startMeasureNr, e->startT, e->startOrder,
+			e->stopMeasureNr, e->stopT, e->stopOrder };
+		for (int n = 0; n < 21; n++)
+		{
+			if (n == 9)
+				lua_pushstring(g_LUAstate, strings + e->lua);
+			else
+				lua_pushinteger(g_LUAstate, field[n]);
+			lua_rawseti(g_LUAstate, -2, n + 3);
+		}
+		lua_rawseti(g_LUAstate, -2, nrEvent + 1);
+	}
+	return true;
+}
+bool basslua_scoreEvents(const char *module, const char *function, const void *buffer, int size)
+{
+	// decode the events packed in buffer ( cf. T_basslua_score_header ) into one LUA table,
+	// and call module.function with this table, in one locked operation
+	// if module.function is the native score engine, the buffer is given to it without LUA table
+	lock_mutex_in();
+	bool retCode = false;
+	if (g_LUAstate)
+	{
+		if (lua_getglobal(g_LUAstate, module) == LUA_TTABLE)
+		{
+			if (lua_getfield(g_LUAstate, -1, function) == LUA_TFUNCTION)
+			{
+				if (lua_tocfunction(g_LUAstate, -1) == score_addEvents)
+				{
+					if (score_check((const char *)buffer, size))
+					{
+						score_addBuffer((const char *)buffer, size);
+						retCode = true;
+					}
+				}
+				else if (score_decode((const char *)buffer, size))
+				{
+					if (lua_pcall(g_LUAstate, 1, 0, 0) != LUA_OK)
+						mlog("basslua_scoreEvents : mlog calling LUA function %s :err=%s", function, lua_tostring(g_LUAstate, -1));
+					else
+						retCode = true;
+				}
+			}
+			else
+				mlog("basslua_scoreEvents : function %s is not available in module %s ", function, module);
+		}
+		else
+			mlog("module %s is not available in LUA script", module);
+		lua_pop(g_LUAstate, lua_gettop(g_LUAstate)); // pop all
+	}
+	unlock_mutex_in();
+	return retCode;
+}
+bool basslua_scorePatch(const char *module, const char *function, int nbEvents, int first, int nbReplaced, const void *buffer, int size)
+{
+	// decode the events packed in buffer into one LUA table, and call module.function(nbEvents, first, nbReplaced, table),
+	// which returns true if the events are replaced. The native score engine takes the buffer without LUA table
+	lock_mutex_in();
+	bool retCode = false;
+	if (g_LUAstate)
+	{
+		unsigned long long t0 = clock_us();
+		if (lua_getglobal(g_LUAstate, module) == LUA_TTABLE)
+		{
+			if (lua_getfield(g_LUAstate, -1, function) == LUA_TFUNCTION)
+			{
+				if (lua_tocfunction(g_LUAstate, -1) == score_patchEvents)
+				{
+					if (score_check((const char *)buffer, size))
+						retCode = score_patchBuffer(g_LUAstate, nbEvents, first, nbReplaced, (const char *)buffer, size);
+				}
+				else
+				{
+					lua_pushinteger(g_LUAstate, nbEvents);
+					lua_pushinteger(g_LUAstate, first);
+					lua_pushinteger(g_LUAstate, nbReplaced);
+					if (score_decode((const char *)buffer, size))
+					{
+						if (lua_pcall(g_LUAstate, 4, 1, 0) != LUA_OK)
+							mlog("basslua_scorePatch : mlog calling LUA function %s :err=%s", function, lua_tostring(g_LUAstate, -1));
+						else
+							retCode = (lua_toboolean(g_LUAstate, -1) != 0);
+					}
+				}
+				if (retCode)
+				{
+					unsigned long long t1 = clock_us();
+					mlog("score patched : %d events replaced by %d from event#%d in %d us",
+						nbReplaced, ((const T_basslua_score_header *)buffer)->nbEvents, first, (int)(t1 - t0));
+				}
+			}
+			else
+				mlog("basslua_scorePatch : function %s is not available in module %s ", function, module);
+		}
+		else
+			mlog("module %s is not available in LUA script", module);
+		lua_pop(g_LUAstate, lua_gettop(g_LUAstate)); // pop all
+	}
+	unlock_mutex_in();
+	return retCode;
+}
+static int pcall_midi(int nbArg, int nbResult)
+{
+	// call LUA for a midiin message. The duration is accounted only during a measured replay
+	if (!g_replay_measure)
+		return lua_pcall(g_LUAstate, nbArg, nbResult, 0);
+	long long t0 = (long long)clock_us();
+	int ret = lua_pcall(g_LUAstate, nbArg, nbResult, 0);
+	g_replay_lua_us += (long long)clock_us() - t0;
+	return ret;
+}
+static void runAction(int nrAction,double time, int nr_selector, int nrChannel, int d1, int d2, const char *param, int index, int mediane, int whiteIndex, int whiteMediane, int sharp)
+{
+	//mlog("runaction #%d", nrAction);
+	callback_check();
+	if ((nrAction < 0) || (nrAction >= g_nb_action_callbacks))
+		return;
+	T_callback *cb = &(g_action_callbacks[nrAction * ACTION_CALLMAX + ACTION_CALLFUNCTION]);
+	if (cb->ref == LUA_NOREF)
+	{
+		// try with the Function<mode>
+		if (actionMode == modeScore)
+			cb = &(g_action_callbacks[nrAction * ACTION_CALLMAX + ACTION_CALLSCORE]);
+		if (actionMode == modeChord)
+			cb = &(g_action_callbacks[nrAction * ACTION_CALLMAX + ACTION_CALLCHORD]);
+	}
+	if (cb->ref == LUA_NOREF)
+	{
+		mlog("erreur : no LUA function for action= %d ", nrAction);
+		return;
+	}
+	lua_rawgeti(g_LUAstate, LUA_REGISTRYINDEX, cb->ref);
+	// push only the arguments declared by the function
+	int nbArg = cb->nbArg;
+	if (nbArg > 0)
+		lua_pushnumber(g_LUAstate, time);
+	if (nbArg > 1)
+	{
+		int bid = nr_selector * 127 * 17 + (nrChannel + 1) * 17 + d1;
+		lua_pushinteger(g_LUAstate, bid);
+	}
+	if (nbArg > 2)
+		lua_pushinteger(g_LUAstate, nrChannel + 1);
+	if (nbArg > 3)
+		lua_pushinteger(g_LUAstate, d1);
+	if (nbArg > 4)
+		lua_pushinteger(g_LUAstate, d2);
+	if (nbArg > 5)
+		lua_pushstring(g_LUAstate, (param) ? param : "");
+	if (nbArg > 6)
+		lua_pushinteger(g_LUAstate, index);
+	if (nbArg > 7)
+		lua_pushinteger(g_LUAstate, mediane);
+	if (nbArg > 8)
+		lua_pushinteger(g_LUAstate, whiteIndex);
+	if (nbArg > 9)
+		lua_pushinteger(g_LUAstate, whiteMediane);
+	if (nbArg > 10)
+		lua_pushinteger(g_LUAstate, sharp);
+	if (pcall_midi(nbArg, 0) == LUA_OK) // call and pop function & parameters
+	{
+		fcallback();
+	}
+	else
+	{
+		mlog("erreur call LUA %s, action= %d ", lua_tostring(g_LUAstate, -1), nrAction);
+		lua_pop(g_LUAstate, 1);
+	}
+}
+static int selector_type(int type_msg)
+{
+	// index of the type of message in the index of the selectors
+	switch (type_msg)
+	{
+	case NOTEON: return 0;
+	case NOTEOFF: return 1;
+	case CONTROL: return 2;
+	case PROGRAM: return 3;
+	default: return -1;
+	}
+}
+static void selector_free_index()
+{
+	for (int d = 0; d <= MIDIIN_MAX; d++)
+	{
+		for (int c = 0; c <= MAXCHANNEL; c++)
+		{
+			for (int t = 0; t < SELECTOR_NBTYPE; t++)
+			{
+				T_selector_table *table = g_selector_index[d][c][t];
+				if (table == NULL)
+					continue;
+				for (int p = 0; p < MAXPITCH; p++)
+				{
+					if (table->buckets[p].matches)
+						free(table->buckets[p].matches);
+				}
+				free(table);
+				g_selector_index[d][c][t] = NULL;
+			}
+		}
+	}
+}
+static bool selector_add_match(int d, int c, int t, int p, int nr_selector, int m)
+{
+	// add a match in the index, for device d, channel c, type t, and data byte p
+	T_selector_table *table = g_selector_index[d][c][t];
+	if (table == NULL)
+	{
+		table = (T_selector_table *)calloc(1, sizeof(T_selector_table));
+		if (table == NULL)
+			return false;
+		g_selector_index[d][c][t] = table;
+	}
+	T_selector_bucket *bucket = &(table->buckets[p]);
+	if (bucket->nb >= bucket->size)
+	{
+		int size = (bucket->size == 0) ? 4 : 2 * bucket->size;
+		T_selector_match *matches = (T_selector_match *)realloc(bucket->matches, size * sizeof(T_selector_match));
+		if (matches == NULL)
+			return false;
+		bucket->matches = matches;
+		bucket->size = size;
+	}
+	bucket->matches[bucket->nb].nr_selector = nr_selector;
+	bucket->matches[bucket->nb].m = m;
+	bucket->nb++;
+	return true;
+}
+static void selector_compile()
+{
+	// compile the selectors in tables indexed by device, channel, type of message, and data byte
+	selector_free_index();
+	g_selector_dirty = false;
+	bool ok = true;
+	for (int nr_selector = 0; nr_selector < g_selectormax; nr_selector++)
+	{
+		T_selector *s = &(g_selectors[nr_selector]);
+		if ((s->nrDevice < -1) || (s->nrDevice >= MIDIIN_MAX) || (s->nrChannel < -1) || (s->nrChannel >= MAXCHANNEL))
+		{
+			mlog("selector#%d : device#%d channel#%d out of range", nr_selector + 1, s->nrDevice + 1, s->nrChannel + 1);
+			continue;
+		}
+		int types[2];
+		int nbType = 0;
+		if (s->type_msg == NOTEONOFF)
+		{
+			types[nbType++] = selector_type(NOTEON);
+			types[nbType++] = selector_type(NOTEOFF);
+		}
+		else if (selector_type(s->type_msg) >= 0)
+			types[nbType++] = selector_type(s->type_msg);
+		for (int n = 0; n < nbType; n++)
+		{
+			switch (s->op)
+			{
+			case 'b': //between
+				if (s->nbPitch == 2)
+				{
+					for (int p = (s->pitch[0] < 0) ? 0 : s->pitch[0]; (p <= s->pitch[1]) && (p < MAXPITCH); p++)
+						ok = ok && selector_add_match(s->nrDevice + 1, s->nrChannel + 1, types[n], p, nr_selector, -1);
+				}
+				break;
+			case 'o': //or
+				for (int m = 0; m < s->nbPitch; m++)
+				{
+					if ((s->pitch[m] >= 0) && (s->pitch[m] < MAXPITCH))
+						ok = ok && selector_add_match(s->nrDevice + 1, s->nrChannel + 1, types[n], s->pitch[m], nr_selector, m);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	if (!ok)
+		mlog("Error selector_compile : no more memory for the index of %d selectors", g_selectormax);
+}
+static bool selector_grow(int nb)
+{
+	// allocate at least nb selectors
+	if (nb <= g_selectorsize)
+		return true;
+	int size = (g_selectorsize == 0) ? SELECTORINIT : g_selectorsize;
+	while (size < nb)
+		size *= 2;
+	T_selector *selectors = (T_selector *)realloc(g_selectors, size * sizeof(T_selector));
+	if (selectors == NULL)
+	{
+		mlog("Error selector_grow : no more memory for %d selectors", nb);
+		return false;
+	}
+	for (int i = g_selectorsize; i < size; i++)
+	{
+		T_selector *t = &(selectors[i]);
+		t->luaNrAction = 0;
+		t->op = 'b';
+		t->nrDevice = -1;
+		t->nrChannel = -1;
+		t->type_msg = NOTEONOFF;
+		for (int j = 0; j < SELECTORMAXPITCH; j++)
+			t->pitch[j] = 0;
+		t->nbPitch = 0;
+		t->stopOnMatch = false;
+		t->param[0] = '\0';
+	}
+	g_selectors = selectors;
+	g_selectorsize = size;
+	return true;
+}
+void selectorSearch(double time, int nrDevice, int nrChannel, int type_msg, int d1, int d2)
+{
+	// search a note/program/control ( in midimsg u ) , within the selectors
+	// the selectors are created with the LUA funtion selector()
+	// if this note/program/control matches a selector, it calls the LUA functions
+	//     midibetween() : for between selector
+	//			parameters :
+	//				sid : unique id of the selector ( specified in the creation )
+	//				double time
+	//              bid : unique id of the note which trigger this selector
+	//              channel : channel of the note
+	//				pitch : pitch of the note
+	//              velocity : velocity of the note ( 0 for noteff )
+	//              index : index of the note within the selector ( 1=first , 2=second, ... )
+	//              mediane : index of the note from the middle of the selector ( 0 = middle )
+	//              white-key index : index of the white_key within the selector
+	//              white-key mediane : index of the white_key from the middle of the selector
+	//              sharp : 1 for black key , else 0 
+	//     midior() : for or selector
+	//			parameters :
+	//              bid : unique id of the note which trigger ths selector
+	//              channel : channel of the note
+	//				pitch : pitch of the note
+	//              velocity : velocity of the note ( 0 for noteff )
+	//              index : index of the note within the selector ( 1=first , 2=second, ... )
+	//              0
+	//              0
+	//              0
+	//              0
+
+
+	// mlog("selectorSearch %d", d1);
+	int t = selector_type(type_msg);
+	if ((t < 0) || (nrDevice < 0) || (nrDevice >= MIDIIN_MAX) || (nrChannel < 0) || (nrChannel >= MAXCHANNEL) || (d1 < 0) || (d1 >= MAXPITCH))
+		return;
+	if ((g_selector_dirty) && (g_selector_searching == 0))
+		selector_compile();
+
+	// the matches come from the tables of this device/any device, and of this channel/any channel
+	T_selector_table *tables[4] = { g_selector_index[nrDevice + 1][nrChannel + 1][t], g_selector_index[0][nrChannel + 1][t],
+		g_selector_index[nrDevice + 1][0][t], g_selector_index[0][0][t] };
+	T_selector_bucket *buckets[4];
+	int pos[4];
+	int nbBucket = 0;
+	for (int n = 0; n < 4; n++)
+	{
+		if ((tables[n]) && (tables[n]->buckets[d1].nb > 0))
+		{
+			buckets[nbBucket] = &(tables[n]->buckets[d1]);
+			pos[nbBucket] = 0;
+			nbBucket++;
+		}
+	}
+	g_selector_searching++;
+	while (true)
+	{
+		// next match in the order of the selectors
+		int best = -1;
+		for (int n = 0; n < nbBucket; n++)
+		{
+			if ((pos[n] < buckets[n]->nb) && ((best == -1) || (buckets[n]->matches[pos[n]].nr_selector < buckets[best]->matches[pos[best]].nr_selector)))
+				best = n;
+		}
+		if (best == -1)
+			break;
+		T_selector_match *match = &(buckets[best]->matches[pos[best]]);
+		pos[best]++;
+		int nr_selector = match->nr_selector;
+		T_selector *s = &(g_selectors[nr_selector]);
+		bool stopOnMatch = s->stopOnMatch; // the LUA action could change the selectors
+		if (match->m < 0)
+		{
+			//between
+			int sharp;
+			int v = pitch_to_white_key(d1, s->pitch[0], &sharp);
+			int w = pitch_to_white_key(d1, (s->pitch[1] + s->pitch[0]) / 2, &sharp);
+			runAction(s->luaNrAction, time, nr_selector, nrChannel, d1, d2, s->param,
+				d1 - s->pitch[0] + 1, d1 - (s->pitch[1] + s->pitch[0]) / 2 + 1,
+				v, w, sharp);
+		}
+		else
+		{
+			//or
+			runAction(s->luaNrAction, time, nr_selector, nrChannel, d1, d2, s->param,
+				match->m + 1, 0,
+				0, 0, 0);
+		}
+		if (stopOnMatch)
+			break;
+	}
+	g_selector_searching--;
+}
+static void initSelector()
+{
+	g_selectormax = 0;
+	g_selector_dirty = false;
+	selector_free_index();
+	selector_grow(SELECTORINIT);
+}
+static void midi_init()
+{
+	lua_pushnil(g_LUAstate);
+	lua_setglobal(g_LUAstate, smidiToOpen);
+}
+static void pitch_init()
+{
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		for (int c = 0; c < MAXCHANNEL; c++)
+		{
+			for (int p = 0; p < MAXPITCH; p++)
+				g_statuspitch[n][c][p] = false;
+		}
+	}
+}
+static void journal_varint(unsigned long long v)
+{
+	// 7 bits per byte, the high bit set if more bytes follow
+	while (v >= 0x80)
+	{
+		putc((int)((v & 0x7F) | 0x80), g_journal);
+		v >>= 7;
+	}
+	putc((int)v, g_journal);
+}
+static bool journal_readvarint(FILE *f, unsigned long long *v)
+{
+	*v = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		int c = getc(f);
+		if (c == EOF)
+			return false;
+		*v |= ((unsigned long long)(c & 0x7F)) << shift;
+		if ((c & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+static void journal_write(int midinr, double time, const void *buffer, DWORD length)
+{
+	// record a midiin message : delta of the time in micro-seconds ( zigzag ), device, length, bytes
+	long long t = (long long)floor(time * 1000000.0 + 0.5);
+	long long dt = t - g_journal_time;
+	g_journal_time = t;
+	journal_varint((dt < 0) ? ((((unsigned long long)(-dt)) << 1) - 1) : (((unsigned long long)dt) << 1));
+	putc(midinr, g_journal);
+	journal_varint(length);
+	fwrite(buffer, 1, length, g_journal);
+}
+static bool journal_read(FILE *f, long long *t, int *midinr, BYTE **buffer, DWORD *length, DWORD *size)
+{
+	// read the next message of a journal. The buffer grows when needed
+	unsigned long long zz, len;
+	if (!journal_readvarint(f, &zz))
+		return false;
+	long long dt = (zz & 1) ? -(long long)((zz + 1) >> 1) : (long long)(zz >> 1);
+	*t += dt;
+	int c = getc(f);
+	if ((c == EOF) || (!journal_readvarint(f, &len)) || (len == 0) || (len > SYSEXIN_MAX))
+		return false;
+	*midinr = c;
+	if (len > *size)
+	{
+		BYTE *buf = (BYTE*)realloc(*buffer, (size_t)len);
+		if (buf == NULL)
+			return false;
+		*buffer = buf;
+		*size = (DWORD)len;
+	}
+	*length = (DWORD)len;
+	return (fread(*buffer, 1, (size_t)len, f) == (size_t)len);
+}
+static void journal_close()
+{
+	if (g_journal)
+		fclose(g_journal);
+	g_journal = NULL;
+}
+static void sysex_trace(int midinr, double time, const BYTE *data, DWORD length, const char *what)
+{
+	// write the beginning of a sysex in the traces, in hexa
+	char hexa[SYSEXIN_TRACE * 3 + 4];
+	static const char digits[] = "0123456789ABCDEF";
+	DWORD nb = (length < SYSEXIN_TRACE) ? length : SYSEXIN_TRACE;
+	char *pt = hexa;
+	for (DWORD n = 0; n < nb; n++)
+	{
+		*pt++ = digits[data[n] >> 4];
+		*pt++ = digits[data[n] & 0xF];
+		*pt++ = ' ';
+	}
+	if (nb < length)
+	{
+		*pt++ = '.';
+		*pt++ = '.';
+	}
+	*pt = '\0';
+	mlogl(LOG_TRACE, "<midiin device#%d @%f ,%s ( %lu bytes ) = %s", midinr + 1, time, what, (unsigned long)length, hexa);
+}
+static void sysex_call(int nrCallback, int midinr, double time, const BYTE *data, DWORD length, bool last)
+{
+	// give a sysex to LUA, as a string of bytes
+	T_callback *cb = callback_push(nrCallback);
+	lua_pushinteger(g_LUAstate, midinr + 1);
+	lua_pushnumber(g_LUAstate, time);
+	lua_pushlstring(g_LUAstate, (const char *)data, length);
+	lua_pushboolean(g_LUAstate, last);
+	lua_pop(g_LUAstate, 4 - cb->nbArg);
+	if (pcall_midi(cb->nbArg, 0) != LUA_OK)
+	{
+		mlog("erreur call  LUA %s , err: %s", g_callback_name[nrCallback], lua_tostring(g_LUAstate, -1));
+		lua_pop(g_LUAstate, 1);
+	}
+}
+static void midiin_sysex(int midinr, double time, const BYTE *data, DWORD length)
+{
+	// process a part of a sysex : the first one starts with F0, the last one ends with F7.
+	// onSysexPart receives each part as it arrives ( e.g. for sample dumps ).
+	// Otherwise the parts are assembled, and onSysex receives the whole sysex.
+	T_sysex_in *sx = &(g_sysex_in[midinr]);
+	bool last = (data[length - 1] == 0xF7);
+	if (data[0] == SYSEX)
+	{
+		if (sx->active)
+			mlogl(LOG_WARNING, "midiin device#%d : sysex not terminated, %lu bytes lost", midinr + 1, (unsigned long)(sx->length));
+		sx->active = true;
+		sx->overflow = false;
+		sx->time = time;
+		sx->length = 0;
+	}
+	if (last)
+		sx->active = false;
+	if (g_callbacks[CB_SYSEXPART].ref != LUA_NOREF)
+	{
+		if (g_log.collect.load(std::memory_order_relaxed))
+			sysex_trace(midinr, time, data, length, "sysex part");
+		sysex_call(CB_SYSEXPART, midinr, time, data, length, last);
+		return;
+	}
+	if ((!g_process_Sysex) || (sx->overflow))
+		return;
+	if (sx->length + length > sx->size)
+	{
+		DWORD size = (sx->size == 0) ? 256 : sx->size;
+		while (size < sx->length + length)
+			size *= 2;
+		BYTE *buf = (size <= SYSEXIN_MAX) ? (BYTE*)realloc(sx->data, size) : NULL;
+		if (buf == NULL)
+		{
+			mlog("midiin device#%d : sysex too long, lost", midinr + 1);
+			sx->overflow = true;
+			return;
+		}
+		sx->data = buf;
+		sx->size = size;
+	}
+	memcpy(sx->data + sx->length, data, length);
+	sx->length += length;
+	if (!last)
+		return;
+	if (g_log.collect.load(std::memory_order_relaxed))
+		sysex_trace(midinr, sx->time, sx->data, sx->length, "sysex");
+	sysex_call(CB_SYSEX, midinr, sx->time, sx->data, sx->length, true);
+}
+static void sysex_free()
+{
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		if (g_sysex_in[n].data)
+			free(g_sysex_in[n].data);
+		g_sysex_in[n].data = NULL;
+		g_sysex_in[n].size = 0;
+		g_sysex_in[n].length = 0;
+		g_sysex_in[n].active = false;
+	}
+}
+void midiprocess_msg(int midinr, double time, void *buffer, DWORD length)
+{
+	// process this new midiin mg with the midiin-LUA-thread , using the expected LUA-function midixxx()
+	// Construct the short MIDI message.	
+	T_midimsg u;
+	u.dwData = 0;
+	switch (length)
+	{
+	case 0: return;
+	case 1: u.bData[0] = ((BYTE*)buffer)[0];  break;
+	case 2: u.bData[0] = ((BYTE*)buffer)[0];  u.bData[1] = ((BYTE*)buffer)[1]; break;
+	default: u.bData[0] = ((BYTE*)buffer)[0];  u.bData[1] = ((BYTE*)buffer)[1];  u.bData[2] = ((BYTE*)buffer)[2]; break;
+	}
+
+	if ((g_journal) && (!g_replay_measure))
+		journal_write(midinr, time, buffer, length); // a message replayed is not recorded again
+	g_current_t = time;
+	callback_check();
+	T_callback *cb = NULL;
+	int nbParam = 0;
+
+	if ((u.bData[0] < 0x80) && (g_sysex_in[midinr].active))
+	{
+		// next part of a sysex
+		midiin_sysex(midinr, time, (BYTE*)buffer, length);
+		return;
+	}
+	if ((u.bData[0] < CLOCK) && (g_sysex_in[midinr].active))
+	{
+		// a status byte ( except real-time ) terminates the sysex without F7
+		mlogl(LOG_WARNING, "midiin device#%d : sysex not terminated, %lu bytes lost", midinr + 1, (unsigned long)(g_sysex_in[midinr].length));
+		g_sysex_in[midinr].active = false;
+	}
+
+	// mlog("receive length=%d", length);
+
+	switch (u.bData[0])
+	{
+	case SYSEX:
+		midiin_sysex(midinr, time, (BYTE*)buffer, length);
+		return;
+	case ACTIVESENSING:
+		if (! g_process_Activesensing) return; // g_process_ active sensing messages 
+		{
+			cb = callback_push(CB_ACTIVE);
+			lua_pushinteger(g_LUAstate, midinr + 1);
+			lua_pushnumber(g_LUAstate, time);
+			lua_pop(g_LUAstate, 2 - cb->nbArg);
+			nbParam = cb->nbArg;
+		}
+		if ( pcall_midi(nbParam, 0) != LUA_OK )
+		{
+			mlog("erreur call  LUA %s , err: %s", LUAFunctionActive, lua_tostring(g_LUAstate, -1));
+			lua_pop(g_LUAstate, 1);
+		}
+		return;
 	case CLOCK:
 		if (! g_process_Clock) return; // g_process_ clock messages 
-		lua_getglobal(g_LUAstate, LUAFunctionClock);
-		lua_pushinteger(g_LUAstate, midinr + 1);
-		lua_pushnumber(g_LUAstate, time);
-		if ( lua_pcall(g_LUAstate, 2, 0, 0)!= LUA_OK )
+		{
+			cb = callback_push(CB_CLOCK);
+			lua_pushinteger(g_LUAstate, midinr + 1);
+			lua_pushnumber(g_LUAstate, time);
+			lua_pop(g_LUAstate, 2 - cb->nbArg);
+			nbParam = cb->nbArg;
+		}
+		if ( pcall_midi(nbParam, 0) != LUA_OK )
 		{
 			mlog("erreur call  LUA %s , err: %s", LUAFunctionClock, lua_tostring(g_LUAstate, -1));
 			lua_pop(g_LUAstate, 1);
@@ -859,22 +1995,18 @@ void midiprocess_msg(int midinr, double time, void *buffer, DWORD length)
 		return;
 	default: break;
 	}
-	Byte type_msg = u.bData[0] >> 4;
-	Byte channel = u.bData[0] & 0x0F;
+	BYTE type_msg = u.bData[0] >> 4;
+	BYTE channel = u.bData[0] & 0x0F;
 	if ((type_msg == NOTEON) && (u.bData[2] == 0))
 	{
 		type_msg = NOTEOFF;
 		u.bData[0] = (NOTEOFF << 4) + channel;
 	}
 
-	if (g_collectLog)
+	if (g_log.collect.load(std::memory_order_relaxed))
 	{
 		if ((type_msg == PROGRAM) || (type_msg == CONTROL) || (type_msg == NOTEON) || (type_msg == NOTEOFF))
-		{
-			char s[256];
-			sprintf(s, "<midiin device#%d channel#%d %0.2X/%0.2d/%0.2d @%f", midinr + 1, channel +1, u.bData[0], u.bData[1], u.bData[2], time);
-			mlog(s);
-		}
+			mlogl(LOG_TRACE, "<midiin device#%d channel#%d %0.2X/%0.2d/%0.2d @%f", midinr + 1, channel +1, u.bData[0], u.bData[1], u.bData[2], time);
 	}
 
 	if (g_logMidiInEvent)
@@ -906,61 +2038,60 @@ void midiprocess_msg(int midinr, double time, void *buffer, DWORD length)
 	{
 	case CHANNELPRESSURE : 
 		if (! g_process_ChannelPressure) return;  
-		lua_getglobal(g_LUAstate, LUAFunctionChannelPressure);
+		cb = callback_push(CB_CHANNELPRESSURE);
 		break;
 	case KEYPRESSURE: 
 		if (! g_process_KeyPressure) return;  
-		lua_getglobal(g_LUAstate, LUAFunctionKeyPressure);
+		cb = callback_push(CB_KEYPRESSURE);
 		break;
 	case SYSTEMCOMMON: 
 		if (! g_process_SystemCommon) return;
-		lua_getglobal(g_LUAstate, LUAFunctionSystemCommon);
+		cb = callback_push(CB_SYSTEMCOMMON);
 		break;
 	case CONTROL:
 		selectorSearch(time, midinr, channel, type_msg, u.bData[1], u.bData[2]);
 		if (!g_process_Control) return;
-		lua_getglobal(g_LUAstate, LUAFunctionControl);
+		cb = callback_push(CB_CONTROL);
 		break;
 	case PROGRAM:
 		selectorSearch(time, midinr, channel, type_msg, u.bData[1], 0);
 		if (!g_process_Program) return;
-		lua_getglobal(g_LUAstate, LUAFunctionProgram);
+		cb = callback_push(CB_PROGRAM);
 		break;
 	case NOTEOFF :
 		if (g_statuspitch[midinr][channel][u.bData[1]] == false)
 		{
-			mlog("double note-off %d", u.bData[1]);
+			mlogl(LOG_WARNING, "double note-off %d", u.bData[1]);
 			return; 
 		}
 		g_statuspitch[midinr][channel][u.bData[1]] = false;
 		selectorSearch(time, midinr, channel, type_msg, u.bData[1], u.bData[2]);
 		if (!g_process_NoteOff) return;
-		lua_getglobal(g_LUAstate, LUAFunctionNoteOff);
+		cb = callback_push(CB_NOTEOFF);
 		break;
 	case NOTEON:
 		if (g_statuspitch[midinr][channel][u.bData[1]] == true)
 		{
-			mlog("double note-on %d", u.bData[1]);
+			mlogl(LOG_WARNING, "double note-on %d", u.bData[1]);
 			return; 
 		}
 		g_statuspitch[midinr][channel][u.bData[1]] = true;
 		selectorSearch(time, midinr, channel, type_msg, u.bData[1], u.bData[2]);
 		if (!g_process_NoteOn) return;
-		lua_getglobal(g_LUAstate, LUAFunctionNoteOn);
+		cb = callback_push(CB_NOTEON);
 		break; // return note_off for note-on with velocity==0
 	case PITCHBEND : 
 		if (! g_process_PitchBend) return; 
-		lua_getglobal(g_LUAstate, LUAFunctionPitchBend);
+		cb = callback_push(CB_PITCHBEND);
 		break;
 	default: 
-		mlog("unexpected MIDI msg %d", type_msg);
+		mlogl(LOG_WARNING, "unexpected MIDI msg %d", type_msg);
 		return;
 		break;
 	}
 
 	lua_pushinteger(g_LUAstate, midinr + 1);
 	lua_pushnumber(g_LUAstate, time);
-	int nbParam = 0;
 	switch (type_msg)
 	{
 	case SYSTEMCOMMON:
@@ -993,19 +2124,175 @@ void midiprocess_msg(int midinr, double time, void *buffer, DWORD length)
 		nbParam = 5;
 		break;
 	}
-	if (lua_pcall(g_LUAstate, nbParam, 0, 0) != LUA_OK)
+	if (cb->nbArg < nbParam)
+	{
+		// the function does not use the last arguments
+		lua_pop(g_LUAstate, nbParam - cb->nbArg);
+		nbParam = cb->nbArg;
+	}
+	if (pcall_midi(nbParam, 0) != LUA_OK)
 	{
 		mlog("erreur calling LUA on_midi_msg, err: %s", lua_tostring(g_LUAstate, -1));
 		lua_pop(g_LUAstate, 1);
 	}
 }
+static void dispatcher_wakeup()
+{
+#ifdef V_PC
+	if (g_dispatcher_event)
+		SetEvent(g_dispatcher_event);
+#endif
+#ifdef V_MAC
+	if (g_dispatcher_event)
+		dispatch_semaphore_signal(g_dispatcher_event);
+#endif
+#ifdef V_LINUX
+	if (g_dispatcher_running)
+		sem_post(&g_dispatcher_event);
+#endif
+}
+static void midiin_push(int nr_device, double time, void *buffer, DWORD length)
+{
+	// push a midiin msg in the ring of the device. Called only by the driver callback of this device
+	// It never waits, and never allocates : if the ring or its sysex pool is full, the message is counted as an
+	// overflow, and lost
+	// The caller wakes-up the dispatcher, once for a batch of messages
+	if ((nr_device < 0) || (nr_device >= MIDIIN_MAX) || (length == 0))
+		return;
+	T_midiin_ring *ring = &(g_midiin_ring[nr_device]);
+	unsigned int head = ring->head.load(std::memory_order_relaxed);
+	unsigned int depth = head - ring->tail.load(std::memory_order_acquire);
+	if (depth >= MIDIIN_RING_SIZE)
+	{
+		ring->overflow.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	T_midiin_event *ev = &(ring->events[head & (MIDIIN_RING_SIZE - 1)]);
+	ev->time = time;
+	ev->stamp = lat_stamp(&g_latency);
+	ev->length = length;
+	ev->sysex = NULL;
+	if (length <= sizeof(ev->data))
+		memcpy(ev->data, buffer, length);
+	else
+	{
+		// the bytes are contiguous : the end of the pool is skipped if the message does not fit
+		unsigned int shead = ring->sysex_head.load(std::memory_order_relaxed);
+		unsigned int pos = shead & (MIDIIN_SYSEX_POOL - 1);
+		unsigned int skip = (pos + length > MIDIIN_SYSEX_POOL) ? (MIDIIN_SYSEX_POOL - pos) : 0;
+		if ((length > MIDIIN_SYSEX_POOL) || (shead + skip + length - ring->sysex_tail.load(std::memory_order_acquire) > MIDIIN_SYSEX_POOL))
+		{
+			ring->sysex_overflow.fetch_add(1, std::memory_order_relaxed);
+			ring->overflow.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		ev->sysex = &(ring->sysex[(shead + skip) & (MIDIIN_SYSEX_POOL - 1)]);
+		memcpy(ev->sysex, buffer, length);
+		ev->sysex_end = shead + skip + length;
+		ring->sysex_head.store(ev->sysex_end, std::memory_order_relaxed);
+	}
+	ring->head.store(head + 1, std::memory_order_release);
+	ring->received.fetch_add(1, std::memory_order_relaxed);
+	if (depth + 1 > ring->max_depth.load(std::memory_order_relaxed))
+		ring->max_depth.store(depth + 1, std::memory_order_relaxed);
+}
+static bool midiin_enter()
+{
+	// entry of a driver callback which pushes in the rings. false during a replay : the message is ignored.
+	// The replay sets g_replay_running, then waits for the callbacks already entered ( midiin_leave ) :
+	// the rings have then only one producer, the replay
+	g_midiin_callbacks.fetch_add(1);
+	if (!g_replay_running.load())
+		return true;
+	g_midiin_callbacks.fetch_sub(1);
+	return false;
+}
+static void midiin_leave()
+{
+	g_midiin_callbacks.fetch_sub(1);
+}
+static void midiin_measure(int nr_device, T_midiin_event *ev)
+{
+	// process a midiin msg stamped by the driver callback, with the measure of its latency
+	// luabass measures its own stages, from the stamp given in g_latency.input
+	long long t0 = lat_now();
+	lat_add(&g_latency, LAT_DISPATCH, t0 - ev->stamp);
+	g_latency.input.store(ev->stamp, std::memory_order_relaxed);
+	midiprocess_msg(nr_device, ev->time, (ev->sysex) ? ev->sysex : ev->data, ev->length);
+	g_latency.input.store(0, std::memory_order_relaxed);
+	long long t1 = lat_now();
+	lat_add(&g_latency, LAT_LUA, t1 - t0);
+	lat_add(&g_latency, LAT_TOTAL, t1 - ev->stamp);
+}
+static long replay_outcount();
+static void replay_measure(int nr_device, T_midiin_event *ev)
+{
+	// process a midiin msg of the journal in replay, with the measure of the time spent. Called by the dispatcher
+	// The message is not recorded in the journal, and not measured in the histograms of the latency
+	long outBefore = (g_replay_report) ? replay_outcount() : 0;
+	g_replay_lua_us = 0;
+	g_replay_measure = true;
+	long long t0 = (long long)clock_us();
+	midiprocess_msg(nr_device, ev->time, (ev->sysex) ? ev->sysex : ev->data, ev->length);
+	long long dt = (long long)clock_us() - t0;
+	g_replay_measure = false;
+	T_basslua_replay *stat = g_replay_stat;
+	stat->nbEvents++;
+	stat->process_us += dt;
+	stat->lua_us += g_replay_lua_us;
+	if (dt > stat->max_us)
+		stat->max_us = dt;
+	int h = 0;
+	while ((h < BASSLUA_REPLAY_HISTO - 1) && (dt > g_replay_limit[h]))
+		h++;
+	stat->histogram[h]++;
+	if (g_replay_report)
+	{
+		long outAfter = replay_outcount();
+		fprintf(g_replay_report, "%d;%d;%.6f;%lld;%lld;%ld\n", stat->nbEvents, nr_device + 1, ev->time, dt, g_replay_lua_us,
+			((outBefore >= 0) && (outAfter >= 0)) ? outAfter - outBefore : -1L);
+	}
+}
+static void midiin_drain(bool process)
+{
+	// process ( or discard ) the midiin msg waiting in the rings. Called by the dispatcher, with the mutex
+	for (int nr_device = 0; nr_device < MIDIIN_MAX; nr_device++)
+	{
+		T_midiin_ring *ring = &(g_midiin_ring[nr_device]);
+		unsigned int lost = ring->sysex_overflow.exchange(0, std::memory_order_relaxed);
+		if (lost > 0)
+			mlogl(LOG_WARNING, "midiin device#%d : %u sysex lost, the pool of %d bytes is full", nr_device + 1, lost, MIDIIN_SYSEX_POOL);
+		unsigned int head = ring->head.load(std::memory_order_acquire);
+		unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+		while (tail != head)
+		{
+			T_midiin_event *ev = &(ring->events[tail & (MIDIIN_RING_SIZE - 1)]);
+			if ((process) && (g_replay_stat))
+				replay_measure(nr_device, ev);
+			else if ((process) && (ev->stamp))
+				midiin_measure(nr_device, ev);
+			else if (process)
+				midiprocess_msg(nr_device, ev->time, (ev->sysex) ? ev->sysex : ev->data, ev->length);
+			if (ev->sysex)
+			{
+				ring->sysex_tail.store(ev->sysex_end, std::memory_order_release);
+				ev->sysex = NULL;
+			}
+			tail++;
+			ring->tail.store(tail, std::memory_order_release);
+		}
+	}
+}
 void CALLBACK midinewmsg(DWORD device, double time, void *buffer, DWORD length, void *ptuser)
 {
-	lock_mutex_in();
+	// driver callback : the msg is processed later by the dispatcher thread, to never block the driver
     VstIntPtr intptr = (VstIntPtr)ptuser ;
     int user = (int)intptr;
-	midiprocess_msg((int)user, time, buffer, length);
-	unlock_mutex_in();
+	if (!midiin_enter())
+		return;
+	midiin_push(user, time, buffer, length);
+	midiin_leave();
+	dispatcher_wakeup();
 }
 #ifdef V_MAC
 CFStringRef EndpointName(MIDIEndpointRef endpoint, bool isExternal)
@@ -1072,8 +2359,17 @@ CFStringRef EndpointName(MIDIEndpointRef endpoint, bool isExternal)
 }
 void notifyProc(const MIDINotification *message, void *refCon)
 {
-    // event on MAC hardware config
-    // ?
+    // event on MAC hardware config : the midiin devices are compared at the next timer tick
+    switch (message->messageID)
+    {
+    case kMIDIMsgSetupChanged:
+    case kMIDIMsgObjectAdded:
+    case kMIDIMsgObjectRemoved:
+        g_midiin_changed = true;
+        break;
+    default:
+        break;
+    }
 }
 #endif
 #ifdef V_MAC
@@ -1083,15 +2379,137 @@ void completionSysex(MIDISysexSendRequest *request)
     free(request);
 }
 #endif
+#ifdef V_LINUX
+static int alsa_device(const snd_seq_addr_t *addr)
+{
+	// midiin device of a sequencer address, -1 if unknown
+	int a = addr->client * 256 + addr->port;
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		if (g_alsa_addr[n].load(std::memory_order_relaxed) == a)
+			return n;
+	}
+	return -1;
+}
+static void alsa_refresh()
+{
+	// refresh the addresses of the midiin devices, used to recognize the source of the events
+	snd_seq_addr_t addr;
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		if (alsa_port(g_alsa_seq, ALSA_CAP_IN, n, &addr, NULL) >= 0)
+			g_alsa_addr[n].store(addr.client * 256 + addr.port, std::memory_order_relaxed);
+		else
+			g_alsa_addr[n].store(-1, std::memory_order_relaxed);
+	}
+}
+static void alsa_event(snd_seq_event_t *ev)
+{
+	// push a sequencer event in the ring of its midiin device
+	if (ev->source.client == SND_SEQ_CLIENT_SYSTEM)
+	{
+		// announce of the system : a port appears, disappears or changes
+		if ((ev->type == SND_SEQ_EVENT_PORT_START) || (ev->type == SND_SEQ_EVENT_PORT_EXIT) || (ev->type == SND_SEQ_EVENT_PORT_CHANGE))
+			g_midiin_changed = true;
+		return;
+	}
+	int nr_device = alsa_device(&(ev->source));
+	if ((nr_device < 0) || (!midiin_enter()))
+		return;
+	double time;
+	if ((ev->queue == g_alsa_queue) && (snd_seq_ev_is_real(ev)))
+		time = (double)(ev->time.time.tv_sec) + (double)(ev->time.time.tv_nsec) / 1000000000.0; // timestamp of the subscription
+	else
+		time = (double)(clock_us() - g_alsa_start) / 1000000.0; // event sent directly to the port
+	if (ev->type == SND_SEQ_EVENT_SYSEX)
+		midiin_push(nr_device, time, ev->data.ext.ptr, (DWORD)(ev->data.ext.len));
+	else
+	{
+		BYTE buffer[16];
+		long length = snd_midi_event_decode(g_alsa_decoder, buffer, sizeof(buffer), ev);
+		if (length > 0)
+			midiin_push(nr_device, time, buffer, (DWORD)length);
+	}
+	midiin_leave();
+}
+static void *alsa_reader(void *info)
+{
+	// reader thread : wait for the sequencer events, and push them in the rings.
+	// All the events available are read in one batch, before to wake-up the dispatcher
+	int nfds = snd_seq_poll_descriptors_count(g_alsa_seq, POLLIN);
+	struct pollfd *fds = (struct pollfd *)malloc(nfds * sizeof(struct pollfd));
+	snd_seq_poll_descriptors(g_alsa_seq, fds, nfds, POLLIN);
+	while (g_alsa_running)
+	{
+		if (poll(fds, nfds, 100) <= 0)
+			continue;
+		int nb = 0;
+		snd_seq_event_t *ev;
+		while (snd_seq_event_input(g_alsa_seq, &ev) >= 0)
+		{
+			alsa_event(ev);
+			nb++;
+		}
+		if (nb > 0)
+			dispatcher_wakeup();
+	}
+	free(fds);
+	return NULL;
+}
+static bool alsa_in_open()
+{
+	// open the sequencer client of the midiin, with its writable port "in", and start the reader thread
+	if (g_alsa_seq)
+		return true;
+	g_alsa_seq = alsa_open("basslua", "in", ALSA_CAP_OUT, &g_alsa_port, &g_alsa_queue);
+	if (g_alsa_seq == NULL)
+	{
+		mlog("ALSA : error opening the sequencer for midiin");
+		return false;
+	}
+	snd_seq_nonblock(g_alsa_seq, 1);
+	snd_midi_event_new(16, &g_alsa_decoder);
+	snd_midi_event_no_status(g_alsa_decoder, 1);
+	g_alsa_start = clock_us();
+	alsa_refresh();
+	g_alsa_running = true;
+	if (pthread_create(&g_alsa_reader, NULL, alsa_reader, NULL) != 0)
+	{
+		g_alsa_running = false;
+		mlog("ALSA : error creating the midiin reader");
+		return false;
+	}
+	return true;
+}
+static void alsa_in_free()
+{
+	// stop the reader thread, and close the sequencer client of the midiin
+	if (g_alsa_seq == NULL)
+		return;
+	if (g_alsa_running)
+	{
+		g_alsa_running = false;
+		pthread_join(g_alsa_reader, NULL);
+	}
+	snd_midi_event_free(g_alsa_decoder);
+	g_alsa_decoder = NULL;
+	alsa_close(g_alsa_seq, g_alsa_queue);
+	g_alsa_seq = NULL;
+}
+#endif
 static void midiclose_device(int n)
 {
 	if (g_midiopened[n] )
 	{
+#ifdef V_LINUX
+		snd_seq_disconnect_from(g_alsa_seq, g_alsa_port, g_alsa_opened[n] / 256, g_alsa_opened[n] % 256);
+#else
 		//out_errori("BASS_MIDI_InStop %d\n", n);
 		BASS_MIDI_InStop(n);
 		//out_errori("BASS_MIDI_InFree %d\n", n);
 		BASS_MIDI_InFree(n);
 		//out_errori("midiinclose end %d\n", n);
+#endif
 		g_midiopened[n] = false;
 	}
 }
@@ -1104,6 +2522,38 @@ static int midiopen_device(int nr_device)
 {
 	if (g_midiopened[nr_device])
 		return nr_device; // already open
+#ifdef V_LINUX
+	// subscribe the port of the device to the port "in", with the timestamps of the real-time queue
+	if (!alsa_in_open())
+		return -1;
+	alsa_refresh();
+	snd_seq_addr_t sender, dest;
+	char name[ALSA_MAXNAME];
+	if (alsa_port(g_alsa_seq, ALSA_CAP_IN, nr_device, &sender, name) < 0)
+	{
+		mlog("ALSA : midiIn device#%d not found", nr_device + 1);
+		return -1;
+	}
+	dest.client = (unsigned char)snd_seq_client_id(g_alsa_seq);
+	dest.port = (unsigned char)g_alsa_port;
+	snd_seq_port_subscribe_t *sub;
+	snd_seq_port_subscribe_alloca(&sub);
+	snd_seq_port_subscribe_set_sender(sub, &sender);
+	snd_seq_port_subscribe_set_dest(sub, &dest);
+	snd_seq_port_subscribe_set_queue(sub, g_alsa_queue);
+	snd_seq_port_subscribe_set_time_update(sub, 1);
+	snd_seq_port_subscribe_set_time_real(sub, 1);
+	int err = snd_seq_subscribe_port(g_alsa_seq, sub);
+	if ((err < 0) && (err != -EBUSY))
+	{
+		mlog("ALSA : error subscribe midiIn device#%d <%s> ; err=%s", nr_device + 1, name, snd_strerror(err));
+		return -1;
+	}
+	g_alsa_opened[nr_device] = sender.client * 256 + sender.port;
+	g_midiopened[nr_device] = true;
+	mlogl(LOG_INFO, "Information : midiIn open device#%d <%s> : OK", nr_device + 1, name);
+	return nr_device;
+#else
     VstIntPtr intptr = nr_device ;
     void *voidptr = (void*)intptr ;
 	if (BASS_MIDI_InInit(nr_device, (MIDIINPROC *)midinewmsg, voidptr) == TRUE)
@@ -1111,7 +2561,7 @@ static int midiopen_device(int nr_device)
 		if (BASS_MIDI_InStart(nr_device) == TRUE)
 		{
 			g_midiopened[nr_device] = true;
-			mlog("Information : midiIn open device#%d : OK", nr_device + 1);
+			mlogl(LOG_INFO, "Information : midiIn open device#%d : OK", nr_device + 1);
 		}
 		else
 		{
@@ -1125,80 +2575,275 @@ static int midiopen_device(int nr_device)
 		return -1;
 	}
 	return nr_device;
+#endif
+}
+static void midiin_want(const bool *wanted)
+{
+	// open the wanted midiin devices, and close the other ones. The devices unchanged are not touched.
+	// The names are kept, to open a wanted device when it is plugged ( again ), whatever its number
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		if ((g_midiopened[n]) && (!wanted[n]))
+			midiclose_device(n);
+	}
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		g_midiin_wanted[n][0] = '\0';
+		if (!wanted[n])
+			continue;
+		if (g_midiin_name[n][0] != '\0')
+		{
+			strcpy(g_midiin_wanted[n], g_midiin_name[n]);
+			midiopen_device(n);
+		}
+		else if (g_midiin_last[n][0] != '\0')
+		{
+			// unplugged : opened by hotplug_scan when it is plugged again
+			strcpy(g_midiin_wanted[n], g_midiin_last[n]);
+			mlogl(LOG_INFO, "Information : midiIn device#%d <%s> absent, opened when plugged", n + 1, g_midiin_wanted[n]);
+		}
+		else
+			mlog("midiIn device#%d not found", n + 1);
+	}
 }
 static void midiopen_devices()
 {
+	// LUA asks for the midiin devices to open, in the table midiinOpen
 	if (lua_getglobal(g_LUAstate, smidiToOpen) == LUA_TTABLE)
 	{
-		midiclose_devices();
-		/* table is in the stack at index 1 */
+		bool wanted[MIDIIN_MAX];
+		for (int n = 0; n < MIDIIN_MAX; n++)
+			wanted[n] = false;
 		lua_pushnil(g_LUAstate);  /* first key */
-		while (lua_next(g_LUAstate, 1) != 0) 
+		while (lua_next(g_LUAstate, -2) != 0) 
 		{
 			/* uses 'key' (at index -2) and 'value' (at index -1) */
 			if (lua_isinteger(g_LUAstate, -1))
 			{
 				int nr_device = (int)lua_tointeger(g_LUAstate, -1) - 1;
-				midiopen_device(nr_device);
+				if ((nr_device >= 0) && (nr_device < MIDIIN_MAX))
+					wanted[nr_device] = true;
 			}
 			/* removes 'value'; keeps 'key' for next iteration */
 			lua_pop(g_LUAstate, 1);
 		}
+		lua_pop(g_LUAstate, 1);
+		midiin_want(wanted);
+		midi_init();
+		return;
 	}
 	lua_pop(g_LUAstate, 1);
-	midi_init();
 }
-static void filter_set()
+static void midiin_enumerate(char names[MIDIIN_MAX][MIDIIN_NAME], int keys[MIDIIN_MAX])
 {
-	// validate the LUA functions available to process the MIDI messages
-	g_process_Sysex = (lua_getglobal(g_LUAstate, LUAFunctionSysex) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_Sysex) mlog("Information : bassLUA function %s registered", LUAFunctionSysex);
-
-	g_process_Activesensing = (lua_getglobal(g_LUAstate, LUAFunctionActive) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_Activesensing) mlog("Information : bassLUA function %s registered", LUAFunctionActive);
-
-	g_process_Clock = (lua_getglobal(g_LUAstate, LUAFunctionClock) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_Clock) mlog("Information : bassLUA function %s registered", LUAFunctionClock);
-
-	g_process_ChannelPressure = (lua_getglobal(g_LUAstate, LUAFunctionChannelPressure) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_ChannelPressure) mlog("Information : bassLUA function %s registered", LUAFunctionChannelPressure);
-
-	g_process_KeyPressure = (lua_getglobal(g_LUAstate, LUAFunctionKeyPressure) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_KeyPressure) mlog("Information : bassLUA function %s registered", LUAFunctionKeyPressure);
-
-	g_process_Control = (lua_getglobal(g_LUAstate, LUAFunctionControl) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_Control) mlog("Information : bassLUA function %s registered", LUAFunctionControl);
-
-	g_process_SystemCommon = (lua_getglobal(g_LUAstate, LUAFunctionSystemCommon) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_SystemCommon) mlog("Information : bassLUA function %s registered", LUAFunctionSystemCommon);
-
-	g_process_Program = (lua_getglobal(g_LUAstate, LUAFunctionProgram) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_Program) mlog("Information : bassLUA function %s registered", LUAFunctionProgram);
-
-	g_process_NoteOff = (lua_getglobal(g_LUAstate, LUAFunctionNoteOff) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_NoteOff) mlog("Information : bassLUA function %s registered", LUAFunctionNoteOff);
-
-	g_process_NoteOn = (lua_getglobal(g_LUAstate, LUAFunctionNoteOn) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_NoteOn) mlog("Information : bassLUA function %s registered", LUAFunctionNoteOn);
-
-	g_process_PitchBend = (lua_getglobal(g_LUAstate, LUAFunctionPitchBend) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_PitchBend) mlog("Information : bassLUA function %s registered", LUAFunctionPitchBend);
-
-	g_process_Timer = (lua_getglobal(g_LUAstate, onTimer) == LUA_TFUNCTION);
-	lua_pop(g_LUAstate, 1);
-	if (g_process_Timer) mlog("Information : bassLUA function %s registered", onTimer);
-
+	// names of the present midiin devices, "" if none.
+	// With the name, the key identifies a device : its sequencer address on Linux ( a device plugged again gets a new one )
+#ifdef V_LINUX
+	alsa_refresh();
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		snd_seq_addr_t addr;
+		keys[n] = 0;
+		if (alsa_port(g_alsa_seq, ALSA_CAP_IN, n, &addr, names[n]) < 0)
+			names[n][0] = '\0';
+		else
+			keys[n] = addr.client * 256 + addr.port;
+	}
+#else
+	BASS_MIDI_DEVICEINFO info;
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		names[n][0] = '\0';
+		keys[n] = 0;
+		if (BASS_MIDI_InGetDeviceInfo(n, &info))
+		{
+			strncpy(names[n], info.name, MIDIIN_NAME - 1);
+			names[n][MIDIIN_NAME - 1] = '\0';
+		}
+	}
+#endif
+}
+#ifndef V_LINUX
+static unsigned long midiin_hash()
+{
+	// cheap signature of the midiin enumeration ( FNV-1a of the names ), without any copy
+	unsigned long h = 2166136261UL;
+	BASS_MIDI_DEVICEINFO info;
+	for (int n = 0; (n < MIDIIN_MAX) && (BASS_MIDI_InGetDeviceInfo(n, &info)); n++)
+	{
+		for (const char *c = info.name; *c; c++)
+			h = (h ^ (unsigned char)(*c)) * 16777619UL;
+		h = (h ^ 0xFF) * 16777619UL;
+	}
+	return h;
+}
+#endif
+static void hotplug_callback(int nrCallback, int nr_device, const char *name)
+{
+	// inform LUA that a midiin device is plugged or unplugged
+	callback_check();
+	if (g_callbacks[nrCallback].ref == LUA_NOREF)
+		return;
+	T_callback *cb = callback_push(nrCallback);
+	lua_pushinteger(g_LUAstate, nr_device + 1);
+	lua_pushstring(g_LUAstate, name);
+	lua_pop(g_LUAstate, 2 - cb->nbArg);
+	if (lua_pcall(g_LUAstate, cb->nbArg, 0, 0) != LUA_OK)
+	{
+		mlog("erreur calling LUA %s, err: %s", g_callback_name[nrCallback], lua_tostring(g_LUAstate, -1));
+		lua_pop(g_LUAstate, 1);
+	}
+}
+static void hotplug_scan()
+{
+	// compare the present midiin devices with the previous enumeration. A device is identified by its name and its key,
+	// not by its number : a device which gets another number, because a device before it is removed or added, stays open.
+	// Only the devices removed or added are closed or opened : the unchanged devices are never touched
+	midiin_enumerate(g_midiin_scan, g_midiin_scan_key);
+	int to[MIDIIN_MAX]; // number of the previous devices in the new enumeration, -1 if removed
+	bool found[MIDIIN_MAX]; // the device of the new enumeration was present
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		to[n] = -1;
+		found[n] = false;
+	}
+	for (int pass = 0; pass < 2; pass++)
+	{
+		// first pass : the devices at the same number. Second pass : the devices at another number
+		for (int n = 0; n < MIDIIN_MAX; n++)
+		{
+			if ((g_midiin_name[n][0] == '\0') || (to[n] >= 0))
+				continue;
+			for (int m = (pass == 0) ? n : 0; m < ((pass == 0) ? n + 1 : MIDIIN_MAX); m++)
+			{
+				if ((!found[m]) && (g_midiin_key[n] == g_midiin_scan_key[m]) && (strcmp(g_midiin_name[n], g_midiin_scan[m]) == 0))
+				{
+					to[n] = m;
+					found[m] = true;
+					break;
+				}
+			}
+		}
+	}
+	bool opened[MIDIIN_MAX];
+	for (int n = 0; n < MIDIIN_MAX; n++)
+		opened[n] = g_midiopened[n];
+#ifdef V_LINUX
+	int addr[MIDIIN_MAX];
+	for (int n = 0; n < MIDIIN_MAX; n++)
+		addr[n] = g_alsa_opened[n];
+#endif
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		// devices removed, or at another number
+		if ((g_midiin_name[n][0] == '\0') || (to[n] == n))
+			continue;
+		if (to[n] < 0)
+		{
+			midiclose_device(n);
+			mlogl(LOG_INFO, "Information : midiIn device#%d <%s> removed", n + 1, g_midiin_name[n]);
+		}
+		else
+		{
+#ifdef V_LINUX
+			// the subscription stays : the events are numbered with the new enumeration ( alsa_device )
+			g_midiopened[n] = false;
+#else
+			midiclose_device(n);
+#endif
+			mlogl(LOG_INFO, "Information : midiIn device#%d <%s> is now device#%d", n + 1, g_midiin_name[n], to[n] + 1);
+		}
+		hotplug_callback(CB_DEVICEREMOVED, n, g_midiin_name[n]);
+	}
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		strcpy(g_midiin_name[n], g_midiin_scan[n]);
+		g_midiin_key[n] = g_midiin_scan_key[n];
+		if (g_midiin_name[n][0] != '\0')
+			strcpy(g_midiin_last[n], g_midiin_name[n]);
+	}
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		// devices at another number : open again if they were open
+		int m = to[n];
+		if ((m < 0) || (m == n))
+			continue;
+		if (opened[n])
+		{
+#ifdef V_LINUX
+			g_midiopened[m] = true;
+			g_alsa_opened[m] = addr[n];
+#else
+			midiopen_device(m);
+#endif
+		}
+		hotplug_callback(CB_DEVICEADDED, m, g_midiin_name[m]);
+	}
+	for (int m = 0; m < MIDIIN_MAX; m++)
+	{
+		// devices added
+		if ((found[m]) || (g_midiin_name[m][0] == '\0'))
+			continue;
+		mlogl(LOG_INFO, "Information : midiIn device#%d <%s> added", m + 1, g_midiin_name[m]);
+		for (int w = 0; w < MIDIIN_MAX; w++)
+		{
+			// device wanted by LUA, plugged again
+			if ((g_midiin_wanted[w][0] != '\0') && (strcmp(g_midiin_wanted[w], g_midiin_name[m]) == 0))
+			{
+				midiopen_device(m);
+				break;
+			}
+		}
+		hotplug_callback(CB_DEVICEADDED, m, g_midiin_name[m]);
+	}
+}
+static void hotplug_check()
+{
+	// check if the midiin devices have changed : notifications of the OS, or signature of the enumeration
+#ifndef V_LINUX
+	g_countmidiin++;
+	if (g_countmidiin >= HOTPLUG_TICKS)
+	{
+		g_countmidiin = 0;
+		unsigned long h = midiin_hash();
+		if (h != g_midiin_hash)
+		{
+			g_midiin_hash = h;
+			g_midiin_changed = true;
+		}
+	}
+#endif
+	if (g_midiin_changed.exchange(false))
+		hotplug_scan();
+}
+static void hotplug_init()
+{
+	// first enumeration of the midiin devices, and subscription to the notifications of the OS
+	for (int n = 0; n < MIDIIN_MAX; n++)
+		g_midiin_wanted[n][0] = '\0';
+	g_midiin_changed = false;
+	g_countmidiin = 0;
+#ifdef V_LINUX
+	if (alsa_in_open())
+		snd_seq_connect_from(g_alsa_seq, g_alsa_port, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE);
+#else
+	g_midiin_hash = midiin_hash();
+#endif
+#ifdef V_MAC
+	if (g_midiin_client == 0)
+		MIDIClientCreate(CFSTR("basslua"), notifyProc, NULL, &g_midiin_client);
+#endif
+	midiin_enumerate(g_midiin_name, g_midiin_key);
+	for (int n = 0; n < MIDIIN_MAX; n++)
+		strcpy(g_midiin_last[n], g_midiin_name[n]);
+}
+static void hotplug_free()
+{
+#ifdef V_MAC
+	if (g_midiin_client)
+		MIDIClientDispose(g_midiin_client);
+	g_midiin_client = 0;
+#endif
 }
 static void init_mutex()
 {
@@ -1208,9 +2853,14 @@ static void init_mutex()
 	if (g_mutex_in == NULL)
 		mlog("CreateMutex : error init_mutex");
 #endif
-#ifdef V_MAC
-	if (pthread_mutex_init(&g_mutex_in, NULL) != 0)
+#if defined(V_MAC) || defined(V_LINUX)
+	// recursive, like the mutex of Windows : a locked function can call another one
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (pthread_mutex_init(&g_mutex_in, &attr) != 0)
 		mlog("pthread_mutex_init : error init_mutex");
+	pthread_mutexattr_destroy(&attr);
 #endif
 }
 static void free_mutex()
@@ -1218,64 +2868,160 @@ static void free_mutex()
 #ifdef V_PC
 	CloseHandle(g_mutex_in);
 #endif
-#ifdef V_MAC
+#if defined(V_MAC) || defined(V_LINUX)
 	pthread_mutex_destroy(&g_mutex_in);
 #endif
 }
 static void process_timer()
 {
+	callback_check();
 	if (g_process_Timer)
 	{
-		lua_getglobal(g_LUAstate, onTimer);
-		lua_pushnumber(g_LUAstate, g_current_t);
+		T_callback *cb = callback_push(CB_TIMER);
+		if (cb->nbArg > 0)
+			lua_pushnumber(g_LUAstate, g_current_t);
 		g_current_t = g_current_t + (float)(timer_dt) / 1000.0;
-		if (lua_pcall(g_LUAstate, 1, 0, 0) != LUA_OK)
+		if (lua_pcall(g_LUAstate, cb->nbArg, 0, 0) != LUA_OK)
 		{
 			mlog("erreur calling LUA %s, err: %s", onTimer, lua_tostring(g_LUAstate, -1));
 			lua_pop(g_LUAstate, 1);
 		}
 	}
-	if (g_countmidiin > 10)
+	midiopen_devices(); // check if LUA asks for other midiin devices
+	hotplug_check(); // check if midiin devices have been plugged or unplugged
+	if (g_sysex_done.ref != LUA_NOREF)
 	{
-		midiopen_devices(); // check if there is any new midiin device to open
-		g_countmidiin = 0;
+		// luabass reports the sysex sent to their LUA functions
+		lua_rawgeti(g_LUAstate, LUA_REGISTRYINDEX, g_sysex_done.ref);
+		if (lua_pcall(g_LUAstate, 0, 0, 0) != LUA_OK)
+		{
+			mlog("erreur calling LUA %s, err: %s", soutSysexDone, lua_tostring(g_LUAstate, -1));
+			lua_pop(g_LUAstate, 1);
+		}
 	}
-	g_countmidiin++;
 }
-#ifdef V_PC
-VOID CALLBACK timer_callback(PVOID lpParam, BOOLEAN TimerOrWaitFired)
+static int dispatcher_process()
 {
+	// process the waiting midiin msg, and the timer when it is due
+	// return the delay in ms up to the next timer tick
 	lock_mutex_in();
-	process_timer();
+	midiin_drain(true);
+	unsigned long long now = clock_ms();
+	if (now >= g_next_tick)
+	{
+		process_timer();
+		g_next_tick += timer_dt;
+		if (g_next_tick <= now)
+			g_next_tick = now + timer_dt; // too late : skip the lost ticks
+	}
 	unlock_mutex_in();
+	return ((int)(g_next_tick - now));
+}
+#ifdef V_PC
+DWORD WINAPI dispatcher(LPVOID lpParam)
+{
+	// dispatcher thread : wait for midiin msg or for the next timer tick
+	while (g_dispatcher_running)
+	{
+		int dt = dispatcher_process();
+		WaitForSingleObject(g_dispatcher_event, dt);
+	}
+	return 0;
 }
 #endif
 #ifdef V_MAC
-// void (*CFRunLoopTimerCallBack) ( CFRunLoopTimerRef timer, void *info );
-void timer_callback(CFRunLoopTimerRef timer, void *info)
+void *dispatcher(void *info)
+{
+	// dispatcher thread : wait for midiin msg or for the next timer tick
+	while (g_dispatcher_running)
+	{
+		int dt = dispatcher_process();
+		dispatch_semaphore_wait(g_dispatcher_event, dispatch_time(DISPATCH_TIME_NOW, (int64_t)dt * 1000000));
+	}
+	return NULL;
+}
+#endif
+#ifdef V_LINUX
+void *dispatcher(void *info)
 {
-    lock_mutex_in();
-    process_timer();
-    unlock_mutex_in();
+	// dispatcher thread : wait for midiin msg or for the next timer tick
+	while (g_dispatcher_running)
+	{
+		int dt = dispatcher_process();
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += dt / 1000;
+		ts.tv_nsec += (long)(dt % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		sem_timedwait(&g_dispatcher_event, &ts);
+	}
+	return NULL;
 }
 #endif
-static void timer_init()
+static void dispatcher_init()
 {
-	// create a periodic timer to flush-out the queud midiout msg
+	// create the thread which processes the midiin msg and the timer with LUA
+#ifdef V_MAC
+	mach_timebase_info(&g_clock_freq);
+#endif
+	g_next_tick = clock_ms() + timer_dt;
+	g_dispatcher_running = true;
 #ifdef V_PC
-	if (!CreateTimerQueueTimer(&g_timer, NULL, timer_callback, 0, timer_dt, timer_dt, 0))
-		mlog("mlog creating timer");
+	g_dispatcher_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	g_dispatcher = CreateThread(NULL, 0, dispatcher, NULL, 0, NULL);
+	if ((g_dispatcher_event == NULL) || (g_dispatcher == NULL))
+	{
+		g_dispatcher_running = false;
+		mlog("mlog creating dispatcher");
+		return;
+	}
+	SetThreadPriority(g_dispatcher, THREAD_PRIORITY_TIME_CRITICAL);
 #endif
 #ifdef V_MAC
-	g_timer = CFRunLoopTimerCreate(NULL, (float)(timer_dt) / 1000.0, (float)(timer_dt) / 1000.0, 0, 0, timer_callback, NULL);
-	if (g_timer == 0)
-		mlog("mlog creating timer");
+	g_dispatcher_event = dispatch_semaphore_create(0);
+	if ((g_dispatcher_event == NULL) || (pthread_create(&g_dispatcher, NULL, dispatcher, NULL) != 0))
+	{
+		g_dispatcher_running = false;
+		mlog("mlog creating dispatcher");
+		return;
+	}
+#endif
+#ifdef V_LINUX
+	sem_init(&g_dispatcher_event, 0, 0);
+	if (pthread_create(&g_dispatcher, NULL, dispatcher, NULL) != 0)
+	{
+		g_dispatcher_running = false;
+		sem_destroy(&g_dispatcher_event);
+		mlog("mlog creating dispatcher");
+		return;
+	}
 #endif
 }
-static void free_timer()
+static void free_dispatcher()
 {
+	if (!g_dispatcher_running)
+		return;
+	g_dispatcher_running = false;
+	dispatcher_wakeup();
 #ifdef V_PC
-    DeleteTimerQueueTimer(NULL, g_timer, NULL);
+	WaitForSingleObject(g_dispatcher, INFINITE);
+	CloseHandle(g_dispatcher);
+	g_dispatcher = NULL;
+	CloseHandle(g_dispatcher_event);
+	g_dispatcher_event = NULL;
+#endif
+#ifdef V_MAC
+	pthread_join(g_dispatcher, NULL);
+	dispatch_release(g_dispatcher_event);
+	g_dispatcher_event = NULL;
+#endif
+#ifdef V_LINUX
+	pthread_join(g_dispatcher, NULL);
+	sem_destroy(&g_dispatcher_event);
 #endif
 }
 static void init()
@@ -1283,15 +3029,26 @@ static void init()
 	pitch_init();
 	initSelector();
 	srand((unsigned)time(NULL));
+	watch_install();
 	filter_set();
 	init_mutex();
-	timer_init();
+	hotplug_init();
+	dispatcher_init();
 }
 static void free()
 {
-	free_timer();
-	free_mutex();
 	midiclose_devices();
+	free_dispatcher();
+	hotplug_free();
+	midiin_drain(false);
+	sysex_free();
+	free_mutex();
+	selector_free_index();
+	if (g_selectors)
+		free(g_selectors);
+	g_selectors = NULL;
+	g_selectorsize = 0;
+	g_selectormax = 0;
 }
 
 bool basslua_getMidiinEvent(char *buf)
@@ -1322,8 +3079,9 @@ void basslua_setSelector(int i, int luaNrAction, char op, int nrDevice, int nrCh
 	if (luaNrAction < 0)
 	{
 		g_selectormax = i;
+		g_selector_dirty = true;
 	}
-	else
+	else if ((i >= 0) && (selector_grow(i + 1)))
 	{
 		T_selector *t = &(g_selectors[i]);
 		t->luaNrAction = luaNrAction;
@@ -1338,6 +3096,8 @@ void basslua_setSelector(int i, int luaNrAction, char op, int nrDevice, int nrCh
 			t->type_msg = CONTROL;
 		if (strcmp(type_msg, sprogram) == 0)
 			t->type_msg = PROGRAM;
+		if (nbPitch > SELECTORMAXPITCH)
+			nbPitch = SELECTORMAXPITCH;
 		for (int j = 0; j < nbPitch; j++)
 			t->pitch[j] = pitch[j];
 		t->nbPitch = nbPitch;
@@ -1345,6 +3105,7 @@ void basslua_setSelector(int i, int luaNrAction, char op, int nrDevice, int nrCh
 		strcpy(t->param, param);
 		if (i >= g_selectormax)
 			g_selectormax = i + 1;
+		g_selector_dirty = true;
 	}
 	unlock_mutex_in();
 }
@@ -1364,6 +3125,8 @@ int basslua_table(const char *module, const char *table, const int index, const
 {
 	lock_mutex_in();
 	int retCode = action_table(module, table, index, field, svalue, ivalue, action);
+	if ((retCode & (tableSetKeyValue | tableNilKeyValue)) && ((strcmp(table, tableActions) == 0) || (strcmp(table, tableInfo) == 0)))
+		g_callback_dirty = true; // the callbacks of the actions must be resolved again
 	unlock_mutex_in();
 	return (retCode);
 
@@ -1371,42 +3134,256 @@ int basslua_table(const char *module, const char *table, const int index, const
 
 bool basslua_getLog(char *buf)
 {
-	lock_mutex_in();
-	bool retCode = false;
+	// read the next message of the log shared by basslua and luabass. No lock : the log is lock-free
+	// buf == NULL : stop the collect of the traces for the GUI
 	if (buf == NULL)
 	{
-		char bufnull[256];
-		bool r;
-		basslua_call(moduleLuabass, soutGetLog, "i>bs", 0,&r,bufnull);
-		g_collectLog = false;
+		log_collect(&g_log, false);
+		return false;
 	}
-	else
+	log_collect(&g_log, true);
+	return (log_read(&g_log, &(g_log.tail_gui), buf, NULL));
+}
+bool basslua_getMidiinStat(int nrDevice, int *depth, int *maxDepth, int *overflow, int *received)
+{
+	// statistics of the waiting queue of a midiin device. No lock : the counters are atomic
+	if ((nrDevice < 0) || (nrDevice >= MIDIIN_MAX))
+		return false;
+	T_midiin_ring *ring = &(g_midiin_ring[nrDevice]);
+	if (depth)
+		*depth = (int)(ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_acquire));
+	if (maxDepth)
+		*maxDepth = (int)(ring->max_depth.load(std::memory_order_relaxed));
+	if (overflow)
+		*overflow = (int)(ring->overflow.load(std::memory_order_relaxed));
+	if (received)
+		*received = (int)(ring->received.load(std::memory_order_relaxed));
+	return true;
+}
+void basslua_setLatency(bool enable, bool reset)
+{
+	// start or stop the latency measure of the midiin messages, up to their send by luabass
+	if (reset)
+		lat_reset(&g_latency);
+	g_latency.enabled.store(enable);
+}
+bool basslua_getLatency(int nrStage, T_basslua_latency *stat)
+{
+	// histogram of a stage of the latency measure. No lock : the counters are atomic
+	// return false if nrStage is not a stage
+	static_assert(BASSLUA_LATENCY_BUCKET == LAT_BUCKET, "buckets of T_basslua_latency");
+	if ((nrStage < 0) || (nrStage >= LAT_NBSTAGE))
+		return false;
+	T_lat_stage *s = &(g_latency.stage[nrStage]);
+	strcpy(stat->name, g_lat_name[nrStage]);
+	stat->nb = s->nb.load(std::memory_order_relaxed);
+	stat->average_us = (stat->nb > 0) ? (s->sum.load(std::memory_order_relaxed) / stat->nb) : 0;
+	stat->max_us = s->max.load(std::memory_order_relaxed);
+	for (int b = 0; b < LAT_BUCKET; b++)
+	{
+		stat->histogram[b] = s->count[b].load(std::memory_order_relaxed);
+		stat->limit[b] = lat_limit(b);
+	}
+	return true;
+}
+static long replay_outcount()
+{
+	// number of messages sent by the midiout module ( luabass.outCount ), -1 if unknown
+	long nb = -1;
+	if (lua_getglobal(g_LUAstate, moduleLuabass) == LUA_TTABLE)
 	{
-		g_collectLog = true;
-		if (nrOutBufLog != nrInBufLog)
+		if (lua_getfield(g_LUAstate, -1, soutCount) == LUA_TFUNCTION)
 		{
-			strcpy(buf, bufLog[nrOutBufLog]);
-			retCode = true;
-			nrOutBufLog++;
-			if (nrOutBufLog >= MAXNBLOGOUT)
-				nrOutBufLog = 0;
+			if (lua_pcall(g_LUAstate, 0, 1, 0) == LUA_OK)
+			{
+				if (lua_isinteger(g_LUAstate, -1))
+					nb = (long)lua_tointeger(g_LUAstate, -1);
+			}
+		}
+		lua_pop(g_LUAstate, 1);
+	}
+	lua_pop(g_LUAstate, 1);
+	return nb;
+}
+static void replay_sleep(long long dt)
+{
+	// sleep dt micro-seconds
+	if (dt <= 0)
+		return;
+#ifdef V_PC
+	Sleep((DWORD)((dt + 999) / 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)(dt / 1000000);
+	ts.tv_nsec = (long)(dt % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+#endif
+}
+static void replay_wait(long long t)
+{
+	// sleep up to the time t of the clock, in micro-seconds.
+	// The precision of the sleep of the OS is enough : the dispatcher measures the messages when it processes them
+	replay_sleep(t - (long long)clock_us());
+}
+static bool replay_full(int nr_device, DWORD length)
+{
+	// the ring of the device has no room for a message of length bytes : the dispatcher must process the waiting ones
+	T_midiin_ring *ring = &(g_midiin_ring[nr_device]);
+	if (ring->head.load(std::memory_order_relaxed) - ring->tail.load(std::memory_order_acquire) >= MIDIIN_RING_SIZE)
+		return true;
+	if (length <= sizeof(ring->events[0].data))
+		return false;
+	// the pool is full, or can be fragmented at its end : wait until it is empty ( a sysex longer than the pool is lost )
+	unsigned int used = ring->sysex_head.load(std::memory_order_relaxed) - ring->sysex_tail.load(std::memory_order_acquire);
+	return ((used > 0) && (used + 2 * length > MIDIIN_SYSEX_POOL));
+}
+static bool replay_waiting()
+{
+	// some messages replayed are not yet processed by the dispatcher
+	for (int n = 0; n < MIDIIN_MAX; n++)
+	{
+		if (g_midiin_ring[n].head.load(std::memory_order_relaxed) != g_midiin_ring[n].tail.load(std::memory_order_acquire))
+			return true;
+	}
+	return false;
+}
+void basslua_setModuleOut(const char *module)
+{
+	// module required as luabass by the next basslua_open. e.g. "luabassfake" to run without midiout.
+	// NULL or "" : luabass
+	strncpy(g_module_out, ((module == NULL) || (module[0] == '\0')) ? moduleLuabass : module, MAXBUFCHAR - 1);
+	g_module_out[MAXBUFCHAR - 1] = '\0';
+}
+bool basslua_record(const char *fname)
+{
+	// start to record the midiin messages in the journal fname. NULL or "" stops the record
+	lock_mutex_in();
+	journal_close();
+	bool retCode = true;
+	if ((fname) && (fname[0] != '\0'))
+	{
+		g_journal = fopen(fname, "wb");
+		if (g_journal)
+		{
+			setvbuf(g_journal, NULL, _IOFBF, JOURNAL_BUFFER);
+			fwrite(JOURNAL_MAGIC, 1, 4, g_journal);
+			g_journal_time = 0;
+			mlogl(LOG_INFO, "Information : record midiin in journal <%s>", fname);
 		}
 		else
 		{
-			basslua_call(moduleLuabass, soutGetLog, "i>bs", 1, &retCode, buf);
+			mlog("basslua_record : error opening journal <%s>", fname);
+			retCode = false;
 		}
 	}
 	unlock_mutex_in();
-	return (retCode);
+	return retCode;
+}
+bool basslua_replay(const char *fname, bool realtime, const char *freport, T_basslua_replay *stat)
+{
+	// feed the midiin messages of the journal fname through the dispatch of the LUA script.
+	// realtime : the messages are replayed with their original delays, otherwise as fast as possible.
+	// freport : if not NULL, one line per message is written in this text file :
+	//    index;device;time;process_us;lua_us;outputs
+	// stat : summary of the replay ( cf. T_basslua_replay )
+	memset(stat, 0, sizeof(T_basslua_replay));
+	for (int n = 0; n < BASSLUA_REPLAY_HISTO; n++)
+		stat->limit[n] = g_replay_limit[n];
+	stat->nbOutputs = -1;
+	if ((g_LUAstate == NULL) || (!g_dispatcher_running))
+		return false;
+	FILE *f = fopen(fname, "rb");
+	if (f == NULL)
+	{
+		mlog("basslua_replay : error opening journal <%s>", fname);
+		return false;
+	}
+	char magic[4];
+	if ((fread(magic, 1, 4, f) != 4) || (memcmp(magic, JOURNAL_MAGIC, 4) != 0))
+	{
+		mlog("basslua_replay : <%s> is not a journal", fname);
+		fclose(f);
+		return false;
+	}
+	FILE *report = NULL;
+	if ((freport) && (freport[0] != '\0'))
+	{
+		report = fopen(freport, "w");
+		if (report)
+			fprintf(report, "index;device;time;process_us;lua_us;outputs\n");
+	}
+	// the messages go through the rings and the dispatcher, like the messages of the drivers, which are ignored
+	// during the replay. The driver callbacks in progress end their push, then the rings are drained : the replay
+	// is their only producer. The dispatcher measures the messages ( replay_measure ), between its timer ticks
+	g_replay_running = true;
+	while (g_midiin_callbacks.load() > 0)
+		replay_sleep(REPLAY_POLL);
+	lock_mutex_in();
+	midiin_drain(true);
+	long outStart = replay_outcount();
+	g_replay_stat = stat;
+	g_replay_report = report;
+	unlock_mutex_in();
+	BYTE *buffer = NULL;
+	DWORD size = 0, length;
+	long long t = 0, tfirst = 0;
+	int midinr;
+	bool first = true;
+	long long start = (long long)clock_us();
+	while (journal_read(f, &t, &midinr, &buffer, &length, &size))
+	{
+		if (first)
+			tfirst = t;
+		first = false;
+		if (realtime)
+			replay_wait(start + (t - tfirst));
+		if ((midinr < 0) || (midinr >= MIDIIN_MAX))
+			continue;
+		while (replay_full(midinr, length))
+		{
+			dispatcher_wakeup();
+			replay_sleep(REPLAY_POLL);
+		}
+		midiin_push(midinr, (double)t / 1000000.0, buffer, length);
+		dispatcher_wakeup();
+	}
+	while (replay_waiting())
+		replay_sleep(REPLAY_POLL);
+	stat->duration_us = (long long)clock_us() - start;
+	lock_mutex_in();
+	g_replay_running = false;
+	g_replay_stat = NULL;
+	g_replay_report = NULL;
+	long outEnd = replay_outcount();
+	unlock_mutex_in();
+	if ((outStart >= 0) && (outEnd >= 0))
+		stat->nbOutputs = outEnd - outStart;
+	if (buffer)
+		free(buffer);
+	if (report)
+		fclose(report);
+	fclose(f);
+	mlogl(LOG_INFO, "Information : replay <%s> : %d messages in %lld us, process %lld us, LUA %lld us", fname, stat->nbEvents, stat->duration_us, stat->process_us, stat->lua_us);
+	return true;
 }
 bool basslua_openMidiIn(int *nrDevices, int nbDevices)
 {
 	lock_mutex_in();
 	bool retCode = true;
-	midiclose_devices();
+	bool wanted[MIDIIN_MAX];
+	for (int n = 0; n < MIDIIN_MAX; n++)
+		wanted[n] = false;
+	for (int n = 0; n < nbDevices; n++)
+	{
+		if ((nrDevices[n] >= 0) && (nrDevices[n] < MIDIIN_MAX))
+			wanted[nrDevices[n]] = true;
+		else
+			retCode = false;
+	}
+	midiin_want(wanted);
 	for (int n = 0; n < nbDevices; n++)
 	{
-		if (midiopen_device(nrDevices[n]) == false)
+		if ((retCode) && (!g_midiopened[nrDevices[n]]))
 			retCode = false;
 	}
 	unlock_mutex_in();
@@ -1442,7 +3419,14 @@ bool basslua_open(const char* fname, const char* param, bool reset, long datefna
 	// mutex are not yet available
 	// open the dedicated midiin-LUA-thread to process midiin msg
 	g_LUAstate = luaL_newstate(); // newthread 
+	g_generation++; // the prepared calls must be resolved in this new LUA state
 	luaL_openlibs(g_LUAstate);
+	// share the log with luabass
+	lua_pushlightuserdata(g_LUAstate, &g_log);
+	lua_setfield(g_LUAstate, LUA_REGISTRYINDEX, LOG_REGISTRY);
+	// share the latency measure with luabass
+	lua_pushlightuserdata(g_LUAstate, &g_latency);
+	lua_setfield(g_LUAstate, LUA_REGISTRYINDEX, LATENCY_REGISTRY);
 	
 	if (luaL_loadfile(g_LUAstate, fname) != LUA_OK)
 	{
@@ -1450,22 +3434,26 @@ bool basslua_open(const char* fname, const char* param, bool reset, long datefna
 		return(false);
 	}
 	
-	// require the "luabass" module for Midi-out
+	// require the "luabass" module for Midi-out ( or its simulation, cf. basslua_setModuleOut )
 	lua_getglobal(g_LUAstate, "require");
-	lua_pushstring(g_LUAstate, moduleLuabass);
+	lua_pushstring(g_LUAstate, g_module_out);
 	if ( lua_pcall(g_LUAstate, 1, 1,0) != LUA_OK )
 	{
-		mlog("basslua_open mlog require %s <%s>", moduleLuabass, lua_tostring(g_LUAstate, -1));
+		mlog("basslua_open mlog require %s <%s>", g_module_out, lua_tostring(g_LUAstate, -1));
 		lua_pop(g_LUAstate, 1);
 		return false;
 	}
 	if (! lua_istable(g_LUAstate, -1))
 	{
-		mlog("basslua_open mlog require %s : not a table", moduleLuabass);
+		mlog("basslua_open mlog require %s : not a table", g_module_out);
 		lua_pop(g_LUAstate, 1);
 		return false;
 	}
 	lua_setglobal(g_LUAstate, moduleLuabass);
+
+	// register the native score engine, used by luascore
+	luaL_requiref(g_LUAstate, moduleScoreEngine, luaopen_scoreengine, 0);
+	lua_pop(g_LUAstate, 1);
 	
 	// require the "chord" module for chord interpretation
 	lua_getglobal(g_LUAstate, "require");
@@ -1535,13 +3523,22 @@ void basslua_close()
 {
 	if (g_LUAstate)
 	{
+		// stop the midiin and the dispatcher thread, before to close LUA
+		midiclose_devices();
+#ifdef V_LINUX
+		alsa_in_free();
+#endif
+		free_dispatcher();
+		journal_close();
 		lock_mutex_in(); // mutex should be available at this stage
 		basslua_call(moduleLuabass, soutAllNoteOff, "s", "a");
 		basslua_call(moduleGlobal, sonStop, "");
 		basslua_call(moduleLuabass, sfree, "");
 		lua_close(g_LUAstate);
 	}
-	free();
 	g_LUAstate = 0;
+	callback_reset();
+	free();
+	log_stop(&g_log);
 	// unlock_mutex_in("basslua_open"); // mutex are not more available at this stage
 }
@@ -57,8 +57,12 @@
 #define functionScoreAddEventStarts "addEventStarts"
 #define functionScoreAddEventStops "addEventStops"
 #define functionScoreAddTrack "addTrack"
+#define functionScoreAddEvents "addEvents"
+#define functionScorePatchEvents "patchEvents"
 #define functionScoreGetPosition "getPosition"
 #define functionScoreGotoNrEvent "gotoNrEvent"
+// native score engine behind luascore.lua, registered by basslua
+#define moduleScoreEngine "scoreengine"
 
 // LUA-script-module "luachord.lua" ( for text with chords ), to be driven by the GUI. This module is loade by defaut by basslua.
 #define moduleChord "luachord"
@@ -98,10 +102,77 @@ void basslua_close();
 
 int basslua_table(const char *module, const char *table, const int index, const char* field, char*svalue, int *ivalue, int action);
 bool basslua_call(const char *module, const char *function, const char *sig, ...);
+int basslua_prepare(const char *module, const char *function, const char *sig);
+bool basslua_invoke(int handle, ...);
+
+// packed buffer of score events, decoded in one call by basslua_scoreEvents :
+//    T_basslua_score_header
+//    T_basslua_score_event[nbEvents]
+//    int indexes[nbIndexes] : the starts, then the stops, of each event in sequence ( 1 = first event )
+//    char strings[sizeStrings] : the lua strings of the events, null terminated
+#define BASSLUA_SCORE_VERSION 1
+typedef struct t_basslua_score_header
+{
+	int version; // BASSLUA_SCORE_VERSION
+	int sizeEvent; // sizeof(T_basslua_score_event)
+	int nbEvents;
+	int nbIndexes;
+	int sizeStrings;
+} T_basslua_score_header;
+typedef struct t_basslua_score_event
+{
+	// fields in the order of the events of luascore.lua
+	int played, visible;
+	int trackNr, pitch, velocity, delay;
+	int dynamic, randomDelay, pedal;
+	int lua; // offset of the lua string in the strings
+	int willStopIndex, stopIndex;
+	int partNr, measureNr, measureLength;
+	int startMeasureNr, startT, startOrder;
+	int stopMeasureNr, stopT, stopOrder;
+	int nbStarts, nbStops; // number of indexes for the starts and the stops of this event
+} T_basslua_score_event;
+bool basslua_scoreEvents(const char *module, const char *function, const void *buffer, int size);
+// replace the events [first, first + nbReplaced - 1] of the score by the events packed in buffer, if the score has still nbEvents.
+// The starts and stops of buffer are the numbers of the events after the patch. The numbers of the events after the
+// events replaced, referred by the events kept, are shifted. Return false if the score is not patched
+bool basslua_scorePatch(const char *module, const char *function, int nbEvents, int first, int nbReplaced, const void *buffer, int size);
+
+// record/replay of the midiin messages, through a journal
+#define BASSLUA_REPLAY_HISTO 10
+typedef struct t_basslua_replay
+{
+	int nbEvents; // messages replayed
+	long nbOutputs; // messages sent by the midiout module ( luabass.outCount ), -1 if unknown
+	long long duration_us; // duration of the replay
+	long long process_us; // time spent to process the messages
+	long long lua_us; // time spent in LUA, within process_us
+	long long max_us; // max time to process one message
+	long histogram[BASSLUA_REPLAY_HISTO]; // number of messages per range of process time
+	long limit[BASSLUA_REPLAY_HISTO]; // upper limits of the ranges in micro-seconds. 0 : no limit
+} T_basslua_replay;
+void basslua_setModuleOut(const char *module);
+bool basslua_record(const char *fname);
+bool basslua_replay(const char *fname, bool realtime, const char *freport, T_basslua_replay *stat);
+
+// latency measure of the midiin messages, per stage : driver callback -> dispatch -> LUA handler -> midiout
+#define BASSLUA_LATENCY_BUCKET 24
+typedef struct t_basslua_latency
+{
+	char name[32]; // name of the stage
+	long long nb; // number of measures
+	long long average_us; // average latency
+	long long max_us; // max latency
+	long long histogram[BASSLUA_LATENCY_BUCKET]; // number of measures per range of latency
+	long long limit[BASSLUA_LATENCY_BUCKET]; // upper limits of the ranges in micro-seconds. 0 : no limit
+} T_basslua_latency;
+void basslua_setLatency(bool enable, bool reset);
+bool basslua_getLatency(int nrStage, T_basslua_latency *stat);
 
 bool basslua_openMidiIn(int *nrDevices, int nbDevices);
 bool basslua_getMidiinEvent(char *buf);
 bool basslua_getLog(char *buf);
+bool basslua_getMidiinStat(int nrDevice, int *depth, int *maxDepth, int *overflow, int *received);
 
 void basslua_setSelector(int i, int luaNrAction, char op, int nrDevice, int nrChannel, const char *type_msg, const int *pitch, int nbPitch, bool stopOnMatch , const char* param);
 void basslua_selectorSearch(int nrDevice, int nrChannel, int type_msg, int p, int v);
@@ -0,0 +1,998 @@
+// Native score engine, registered by basslua as the LUA module "scoreengine" ( moduleScoreEngine )
+//
+// luascore.lua keeps its LUA entry points ( play, firstPart, nextEvent, gotoNrEvent, save, load, ... ) and
+// delegates them to this engine when it is registered. The LUA implementation of luascore.lua stays the
+// reference, used when luascore runs without basslua.
+// The events are held in contiguous arrays : the fields, the starts and stops of each event in one array of
+// indexes, and the LUA strings of the ornaments in one buffer. The moves are precomputed when the score is
+// finished : next and previous playable event, next control event, first event of each measure and part.
+// The midiout is done through the functions of luabass ( or of its simulation ), given by luascore to init.
+// A range of events can be replaced ( patchEvents ) : when the GUI compiles the same score again, it sends only the
+// events which differ from its previous push ( Lua push diff ). The GUI still compiles the whole score.
+// update : 16/10/2026
+//////////////////////////////////////////////
+
+#define SCORE_NBTRACK 32 // tracks saved in the .pck file
+#define SCORE_ERROR (MAXBUFCHAR + 64) // error of score_read : a message and the name of the file
+
+typedef struct t_score_event
+{
+	// fields in the order of the events of luascore.lua
+	int played, visible;
+	int trackNr, pitch, velocity, delay;
+	int dynamic, randomDelay, pedal;
+	int lua; // offset of the lua string in g_score.strings
+	int willStopIndex, stopIndex;
+	int partNr, measureNr, measureLength;
+	int startMeasureNr, startT, startOrder;
+	int stopMeasureNr, stopT, stopOrder;
+	int starts, nbStarts; // starts of this event, in g_score.indexes
+	int stops, nbStops; // stops of this event, in g_score.indexes
+} T_score_event;
+#define SCORE_NBFIELD 21 // fields of an event given by luascore.lua, from played to stopOrder
+static int T_score_event::* const g_score_field[SCORE_NBFIELD] =
+{
+	&T_score_event::played, &T_score_event::visible,
+	&T_score_event::trackNr, &T_score_event::pitch, &T_score_event::velocity, &T_score_event::delay,
+	&T_score_event::dynamic, &T_score_event::randomDelay, &T_score_event::pedal,
+	&T_score_event::lua,
+	&T_score_event::willStopIndex, &T_score_event::stopIndex,
+	&T_score_event::partNr, &T_score_event::measureNr, &T_score_event::measureLength,
+	&T_score_event::startMeasureNr, &T_score_event::startT, &T_score_event::startOrder,
+	&T_score_event::stopMeasureNr, &T_score_event::stopT, &T_score_event::stopOrder
+};
+static int T_basslua_score_event::* const g_score_bfield[SCORE_NBFIELD] =
+{
+	// same fields, packed by the GUI
+	&T_basslua_score_event::played, &T_basslua_score_event::visible,
+	&T_basslua_score_event::trackNr, &T_basslua_score_event::pitch, &T_basslua_score_event::velocity, &T_basslua_score_event::delay,
+	&T_basslua_score_event::dynamic, &T_basslua_score_event::randomDelay, &T_basslua_score_event::pedal,
+	&T_basslua_score_event::lua,
+	&T_basslua_score_event::willStopIndex, &T_basslua_score_event::stopIndex,
+	&T_basslua_score_event::partNr, &T_basslua_score_event::measureNr, &T_basslua_score_event::measureLength,
+	&T_basslua_score_event::startMeasureNr, &T_basslua_score_event::startT, &T_basslua_score_event::startOrder,
+	&T_basslua_score_event::stopMeasureNr, &T_basslua_score_event::stopT, &T_basslua_score_event::stopOrder
+};
+typedef struct t_score_track
+{
+	std::string name;
+	int randomDelay;
+	int dynamic;
+	int pedal;
+} T_score_track;
+typedef struct t_score_run
+{
+	int value; // measure or part number
+	int first; // first event of the run
+} T_score_run;
+typedef struct t_score
+{
+	std::vector<T_score_event> events; // events[nrEvent - 1]
+	std::vector<int> indexes; // starts and stops of the events
+	std::vector<char> strings; // lua strings of the events, null terminated. Offset 0 is the empty string
+	std::vector<T_score_track> tracks; // tracks[trackNr - 1]
+	// moves, precomputed by score_prepare, for the nb_events first events
+	bool dirty; // events added since the last score_prepare
+	std::vector<int> next_start; // next_start[nrEvent] : first playable event from nrEvent, up to nb_events - 1
+	std::vector<int> prev_start; // prev_start[nrEvent] : last playable event up to nrEvent, down to 1
+	std::vector<int> next_control; // next_control[nrEvent] : first event with a control from nrEvent
+	std::vector<T_score_run> measures; // runs of events with the same measureNr
+	std::vector<T_score_run> parts; // runs of events with the same partNr
+	// position
+	int nb_events;
+	bool playing; // an event is playing ( between the note-on and the note-off of playing_bid )
+	lua_Integer playing_bid;
+	int playing_nrEvent;
+	int noteOn; // next event for the note-on
+	int noteOff; // next event for the note-off
+	int partNr;
+	int measureNr;
+	int memEvent; // last position of the previous move
+	std::unordered_map<lua_Integer, int> noteOffStops; // event to stop on the note-off of a button-id
+	// functions of luabass, and applyLua of luascore, in the LUA registry
+	int refNoteOn, refNoteOff, refControl, refApplyLua;
+} T_score;
+
+static T_score g_score;
+
+static T_score_event *score_event(int nrEvent)
+{
+	// event nrEvent ( from 1 ), NULL if it does not exist
+	if ((nrEvent < 1) || (nrEvent > (int)g_score.events.size()))
+		return NULL;
+	return &(g_score.events[nrEvent - 1]);
+}
+static T_score_track *score_track(int trackNr)
+{
+	// track trackNr ( from 1 ), NULL if it does not exist
+	if ((trackNr < 1) || (trackNr > (int)g_score.tracks.size()))
+		return NULL;
+	return &(g_score.tracks[trackNr - 1]);
+}
+static bool score_control(const T_score_event *t)
+{
+	// the event changes a track, or has a lua string
+	return ((t->dynamic >= 0) || (t->randomDelay > 0) || (t->pedal >= 0) || (g_score.strings[t->lua] != '\0'));
+}
+static void score_runs(std::vector<T_score_run> *runs, int T_score_event::*field)
+{
+	// runs of consecutive events with the same value of field
+	runs->clear();
+	int value = -1;
+	for (int nrEvent = 1; nrEvent <= g_score.nb_events; nrEvent++)
+	{
+		int v = g_score.events[nrEvent - 1].*field;
+		if ((nrEvent == 1) || (v != value))
+		{
+			T_score_run r;
+			r.value = v;
+			r.first = nrEvent;
+			runs->push_back(r);
+			value = v;
+		}
+	}
+}
+static void score_prepare()
+{
+	// precompute the moves within the nb_events first events
+	int nb = g_score.nb_events;
+	g_score.next_start.assign(nb + 2, 0);
+	g_score.prev_start.assign(nb + 2, 0);
+	g_score.next_control.assign(nb + 2, nb + 1);
+	for (int nrEvent = nb; nrEvent >= 1; nrEvent--)
+	{
+		const T_score_event *t = &(g_score.events[nrEvent - 1]);
+		if ((nrEvent >= nb - 1) || (t->nbStarts > 0))
+			g_score.next_start[nrEvent] = nrEvent;
+		else
+			g_score.next_start[nrEvent] = g_score.next_start[nrEvent + 1];
+		g_score.next_control[nrEvent] = score_control(t) ? nrEvent : g_score.next_control[nrEvent + 1];
+	}
+	for (int nrEvent = 1; nrEvent <= nb; nrEvent++)
+	{
+		if ((nrEvent <= 1) || (g_score.events[nrEvent - 1].nbStarts > 0))
+			g_score.prev_start[nrEvent] = nrEvent;
+		else
+			g_score.prev_start[nrEvent] = g_score.prev_start[nrEvent - 1];
+	}
+	score_runs(&(g_score.measures), &T_score_event::measureNr);
+	score_runs(&(g_score.parts), &T_score_event::partNr);
+	g_score.dirty = false;
+}
+static void score_position()
+{
+	// reset the position. The event playing is kept
+	g_score.noteOn = 0;
+	g_score.noteOff = 1;
+	g_score.partNr = 1;
+	g_score.measureNr = 1;
+}
+static void score_init()
+{
+	// empty score
+	g_score.events.clear();
+	g_score.indexes.clear();
+	g_score.strings.assign(1, '\0');
+	g_score.tracks.clear();
+	g_score.noteOffStops.clear();
+	g_score.nb_events = 0;
+	g_score.playing = false;
+	score_prepare();
+	score_position();
+}
+static int score_string(const char *s)
+{
+	// add a lua string, return its offset
+	if ((s == NULL) || (*s == '\0'))
+		return 0;
+	int offset = (int)g_score.strings.size();
+	g_score.strings.insert(g_score.strings.end(), s, s + strlen(s) + 1);
+	return offset;
+}
+static void score_add_track(const char *name, int randomDelay, int dynamic, int pedal)
+{
+	T_score_track t;
+	t.name = name;
+	t.randomDelay = randomDelay;
+	t.dynamic = dynamic;
+	t.pedal = pedal;
+	g_score.tracks.push_back(t);
+}
+
+// midiout, through the functions given to init
+static void score_call(lua_State *L, int ref, int nbArg)
+{
+	// call a LUA function of the registry, with the nbArg arguments on the stack
+	// the errors are raised to the caller, as the LUA implementation does
+	if (ref == LUA_NOREF)
+	{
+		lua_pop(L, nbArg);
+		return;
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+	lua_insert(L, -(nbArg + 1));
+	lua_call(L, nbArg, 0);
+}
+static void score_control_out(lua_State *L, int control, int value, int delay, int trackNr)
+{
+	lua_pushinteger(L, control);
+	lua_pushinteger(L, value);
+	lua_pushinteger(L, delay);
+	lua_pushinteger(L, trackNr);
+	score_call(L, g_score.refControl, 4);
+}
+static void score_pedal(lua_State *L, T_score_track *track, int trackNr, int d)
+{
+	score_control_out(L, 64, 0, 0, trackNr); // pedal off
+	track->pedal = d;
+	if (d > 0)
+		score_control_out(L, 64, d, 200, trackNr); // pedal on
+}
+static void score_play_control(lua_State *L, const T_score_event *t)
+{
+	// apply the controls of an event on its track ( or on all tracks if trackNr <= 0 )
+	int p = t->trackNr;
+	int nbTrack = (int)g_score.tracks.size();
+	if (t->dynamic >= 0)
+	{
+		for (int i = 1; i <= nbTrack; i++)
+		{
+			if ((p <= 0) || (p == i))
+				g_score.tracks[i - 1].dynamic = t->dynamic;
+		}
+	}
+	if (t->randomDelay > 0)
+	{
+		for (int i = 1; i <= nbTrack; i++)
+		{
+			if ((p <= 0) || (p == i))
+				g_score.tracks[i - 1].randomDelay = t->randomDelay;
+		}
+	}
+	if (t->pedal >= 0)
+	{
+		for (int i = 1; i <= nbTrack; i++)
+		{
+			if ((p <= 0) || (p == i))
+				score_pedal(L, &(g_score.tracks[i - 1]), i, t->pedal);
+		}
+	}
+	if (g_score.strings[t->lua] != '\0')
+	{
+		lua_pushstring(L, &(g_score.strings[t->lua]));
+		lua_pushinteger(L, p);
+		score_call(L, g_score.refApplyLua, 2);
+	}
+}
+static void score_play_pending(lua_State *L, int a, int b)
+{
+	// apply the controls of the events a..b, jumping over the events without control
+	if (a < 1)
+		return;
+	if (b > g_score.nb_events)
+		b = g_score.nb_events;
+	for (int nrEvent = g_score.next_control[(a <= g_score.nb_events) ? a : g_score.nb_events + 1]; nrEvent <= b; nrEvent = g_score.next_control[nrEvent + 1])
+		score_play_control(L, &(g_score.events[nrEvent - 1]));
+}
+static void score_pending_off(lua_State *L)
+{
+	score_play_pending(L, g_score.noteOff, g_score.noteOn - 1);
+	g_score.noteOff = g_score.noteOn;
+}
+static void score_pending_reset(lua_State *L)
+{
+	g_score.noteOff = 1;
+	score_pending_off(L);
+}
+static void score_mem()
+{
+	g_score.memEvent = g_score.noteOn;
+}
+static void score_next_group()
+{
+	// adjust the position on the next playable event
+	int nb = g_score.nb_events;
+	g_score.noteOn++;
+	if (g_score.noteOn < 1)
+		g_score.noteOn = 1;
+	if (g_score.noteOn > nb)
+		g_score.noteOn = nb;
+	if (g_score.noteOn < 1)
+		return;
+	g_score.noteOn = g_score.next_start[g_score.noteOn];
+	const T_score_event *t = &(g_score.events[g_score.noteOn - 1]);
+	g_score.measureNr = t->measureNr;
+	g_score.partNr = t->partNr;
+}
+static void score_stop(lua_State *L, int to_stop_index)
+{
+	// stop the events of the group to_stop_index
+	const T_score_event *s = score_event(to_stop_index);
+	if (s == NULL)
+		return;
+	for (int n = 0; n < s->nbStops; n++)
+	{
+		int nrEvent = g_score.indexes[s->stops + n];
+		const T_score_event *t = score_event(nrEvent);
+		if (t == NULL)
+			continue;
+		lua_pushinteger(L, t->pitch);
+		lua_pushinteger(L, 0);
+		lua_pushinteger(L, nrEvent);
+		lua_pushinteger(L, 0);
+		lua_pushinteger(L, t->trackNr);
+		score_call(L, g_score.refNoteOff, 5);
+	}
+}
+static void score_play_event(lua_State *L, double velo_in, const T_score_event *t, int nrEvent, int nbEvent)
+{
+	// play an event, with the velocity rescaled from the velocity-in
+	int velo = t->velocity;
+	int p = t->pitch;
+	T_score_track *track = score_track(t->trackNr);
+	if ((nbEvent == 0) || (p <= 0) || (p >= 127) || (velo < 1) || (track == NULL))
+		return;
+	double min_velo_out, max_velo_out;
+	if (velo < 64)
+	{
+		min_velo_out = 1;
+		max_velo_out = 2 * velo;
+	}
+	else
+	{
+		min_velo_out = velo - 63;
+		max_velo_out = 128;
+	}
+	// rescale the velocity-in
+	double min_velo_in = 64.0 - track->dynamic / 2.0;
+	double max_velo_in = 64.0 + track->dynamic / 2.0;
+	double v_in = min_velo_in + ((max_velo_in - min_velo_in) * velo_in) / 128.0;
+	// rescale the velocity out
+	int velo_out = (int)floor(min_velo_out + ((max_velo_out - min_velo_out) * v_in) / 128.0);
+	// compensation of nbEvent note within one single key-in
+	int compensation = 15; // [0..30]
+	velo_out = (int)floor(((200.0 - (compensation * (nbEvent - 1))) * velo_out) / 200.0);
+	// cap the velocity-out
+	if (velo_out < 1)
+		velo_out = 1;
+	if (velo_out > 127)
+		velo_out = 127;
+	int delay = t->delay;
+	if (track->randomDelay > 0)
+		delay += rand() % (track->randomDelay + 1);
+	lua_pushinteger(L, p);
+	lua_pushinteger(L, velo_out);
+	lua_pushinteger(L, nrEvent);
+	lua_pushinteger(L, delay);
+	lua_pushinteger(L, t->trackNr);
+	score_call(L, g_score.refNoteOn, 5);
+}
+static void score_note_on(lua_State *L, lua_Integer bid, double velo_in)
+{
+	// the button-id ( bid ) plays the current group, and goes to the next one
+	const T_score_event *t = score_event(g_score.noteOn);
+	if (t == NULL)
+		return;
+	score_stop(L, t->stopIndex);
+	for (int n = 0; n < t->nbStarts; n++)
+	{
+		int nrEvent = g_score.indexes[t->starts + n];
+		const T_score_event *ts = score_event(nrEvent);
+		if (ts)
+			score_play_event(L, velo_in, ts, nrEvent, t->nbStarts);
+	}
+	// reminder for notes to stop on note-off
+	int to_stop_index = t->willStopIndex;
+	g_score.noteOffStops[bid] = to_stop_index;
+	// apply pending tunings
+	score_play_pending(L, g_score.noteOff, to_stop_index - 1);
+	g_score.noteOff = to_stop_index;
+	// goto next event to play for the next note-on
+	score_next_group();
+}
+static void score_note_off(lua_State *L, lua_Integer bid)
+{
+	// stop the group of event started with the same button-id ( bid )
+	std::unordered_map<lua_Integer, int>::const_iterator it = g_score.noteOffStops.find(bid);
+	if ((it != g_score.noteOffStops.end()) && (it->second > 0))
+		score_stop(L, it->second);
+	score_pending_off(L);
+}
+static void score_first_part(lua_State *L)
+{
+	// move to the beginning of the tune
+	g_score.nb_events = (int)g_score.events.size();
+	if (g_score.dirty || ((int)g_score.next_start.size() != g_score.nb_events + 2))
+		score_prepare();
+	score_position();
+	score_next_group();
+	score_pending_reset(L);
+	score_mem();
+}
+static void score_goto(lua_State *L, int nrEvent)
+{
+	score_first_part(L);
+	g_score.noteOn = nrEvent - 1;
+	score_next_group();
+	score_pending_reset(L);
+	score_mem();
+}
+static int score_run_next(const std::vector<T_score_run> &runs, int value)
+{
+	// first event of the first run with value, else first event of the last run
+	int j = 1;
+	for (size_t k = 0; k < runs.size(); k++)
+	{
+		j = runs[k].first;
+		if (runs[k].value == value)
+			break;
+	}
+	return j;
+}
+static void score_run_previous(lua_State *L, const std::vector<T_score_run> &runs, int value)
+{
+	// move to the first run with a value >= value, or to the run before if the position does not change
+	int j = 1, pj = 1;
+	int noteOn = g_score.noteOn;
+	for (size_t k = 0; k < runs.size(); k++)
+	{
+		pj = j;
+		j = runs[k].first;
+		if (runs[k].value >= value)
+			break;
+	}
+	score_goto(L, j);
+	if (g_score.noteOn == noteOn)
+		score_goto(L, pj);
+	score_mem();
+}
+
+// LUA functions of the module
+static int score_init_functions(lua_State *L)
+{
+	// parameter #1 : luabass module ( or its simulation ), for outNoteOn, outNoteOff, outControl
+	// parameter #2 : applyLua(string, trackNr) function of luascore, for the lua strings of the events
+	const char *names[3] = { "outNoteOn", "outNoteOff", "outControl" };
+	int *refs[3] = { &(g_score.refNoteOn), &(g_score.refNoteOff), &(g_score.refControl) };
+	for (int n = 0; n < 3; n++)
+	{
+		luaL_unref(L, LUA_REGISTRYINDEX, *(refs[n]));
+		*(refs[n]) = LUA_NOREF;
+		// a missing function is ignored, as the LUA simulations of luabass do
+		if (!lua_istable(L, 1))
+			continue;
+		if (lua_getfield(L, 1, names[n]) == LUA_TFUNCTION)
+			*(refs[n]) = luaL_ref(L, LUA_REGISTRYINDEX);
+		else
+			lua_pop(L, 1);
+	}
+	luaL_unref(L, LUA_REGISTRYINDEX, g_score.refApplyLua);
+	g_score.refApplyLua = LUA_NOREF;
+	if (lua_isfunction(L, 2))
+	{
+		lua_pushvalue(L, 2);
+		g_score.refApplyLua = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	return 0;
+}
+static int score_initScore(lua_State *L)
+{
+	score_init();
+	return 0;
+}
+static int score_addEvent(lua_State *L)
+{
+	// parameters in the order of the fields of the events, from played to stopOrder
+	T_score_event e;
+	for (int n = 0; n < SCORE_NBFIELD; n++)
+	{
+		if (g_score_field[n] == &T_score_event::lua)
+			e.*g_score_field[n] = score_string(lua_tostring(L, n + 1));
+		else
+			e.*g_score_field[n] = (int)lua_tointeger(L, n + 1);
+	}
+	e.starts = (int)g_score.indexes.size();
+	e.nbStarts = 0;
+	e.stops = e.starts;
+	e.nbStops = 0;
+	g_score.events.push_back(e);
+	g_score.dirty = true;
+	// followed by sequence of addEventStarts(..) and addEventStops(..)
+	return 0;
+}
+static int score_addEventIndex(lua_State *L, bool start)
+{
+	// add a start or a stop to the last event. The starts are before the stops in indexes
+	if (g_score.events.empty())
+		return 0;
+	T_score_event *e = &(g_score.events.back());
+	int nr = (int)lua_tointeger(L, 1);
+	if (start)
+	{
+		g_score.indexes.insert(g_score.indexes.begin() + e->starts + e->nbStarts, nr);
+		e->nbStarts++;
+		e->stops++;
+	}
+	else
+	{
+		g_score.indexes.insert(g_score.indexes.begin() + e->stops + e->nbStops, nr);
+		e->nbStops++;
+	}
+	g_score.dirty = true;
+	return 0;
+}
+static int score_addEventStarts(lua_State *L)
+{
+	return score_addEventIndex(L, true);
+}
+static int score_addEventStops(lua_State *L)
+{
+	return score_addEventIndex(L, false);
+}
+static int score_addList(lua_State *L, int index)
+{
+	// append the integers of the table at index in indexes, return the number of integers
+	int nb = (int)lua_rawlen(L, index);
+	for (int n = 1; n <= nb; n++)
+	{
+		lua_rawgeti(L, index, n);
+		g_score.indexes.push_back((int)lua_tointeger(L, -1));
+		lua_pop(L, 1);
+	}
+	return nb;
+}
+static void score_tableEvents(lua_State *L, int index, std::vector<T_score_event> *events)
+{
+	// append to events the table of events at index, each one with the structure of the events of luascore.lua
+	int nb = (int)lua_rawlen(L, index);
+	events->reserve(events->size() + nb);
+	for (int nrEvent = 1; nrEvent <= nb; nrEvent++)
+	{
+		if (lua_rawgeti(L, index, nrEvent) != LUA_TTABLE)
+		{
+			lua_pop(L, 1);
+			continue;
+		}
+		int indexEvent = lua_gettop(L);
+		T_score_event e;
+		lua_rawgeti(L, indexEvent, 1);
+		e.starts = (int)g_score.indexes.size();
+		e.nbStarts = score_addList(L, lua_gettop(L));
+		lua_pop(L, 1);
+		lua_rawgeti(L, indexEvent, 2);
+		e.stops = (int)g_score.indexes.size();
+		e.nbStops = score_addList(L, lua_gettop(L));
+		lua_pop(L, 1);
+		for (int n = 0; n < SCORE_NBFIELD; n++)
+		{
+			lua_rawgeti(L, indexEvent, n + 3);
+			if (g_score_field[n] == &T_score_event::lua)
+				e.*g_score_field[n] = score_string(lua_tostring(L, -1));
+			else
+				e.*g_score_field[n] = (int)lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+		events->push_back(e);
+		lua_pop(L, 1);
+	}
+}
+static void score_bufferEvents(const char *buffer, std::vector<T_score_event> *events)
+{
+	// append to events the events packed in buffer by the GUI ( cf. T_basslua_score_header ), without LUA tables
+	// the buffer is checked by score_check of basslua
+	const T_basslua_score_header *header = (const T_basslua_score_header *)buffer;
+	const T_basslua_score_event *bevents = (const T_basslua_score_event *)(buffer + sizeof(T_basslua_score_header));
+	const int *indexes = (const int *)(bevents + header->nbEvents);
+	const char *strings = (const char *)(indexes + header->nbIndexes);
+	events->reserve(events->size() + header->nbEvents);
+	g_score.indexes.reserve(g_score.indexes.size() + header->nbIndexes);
+	int nrIndex = 0;
+	for (int nrEvent = 0; nrEvent < header->nbEvents; nrEvent++)
+	{
+		const T_basslua_score_event *p = &(bevents[nrEvent]);
+		T_score_event e;
+		for (int n = 0; n < SCORE_NBFIELD; n++)
+			e.*g_score_field[n] = p->*g_score_bfield[n];
+		e.lua = score_string(strings + p->lua);
+		e.starts = (int)g_score.indexes.size();
+		e.nbStarts = p->nbStarts;
+		e.stops = e.starts + p->nbStarts;
+		e.nbStops = p->nbStops;
+		g_score.indexes.insert(g_score.indexes.end(), indexes + nrIndex, indexes + nrIndex + p->nbStarts + p->nbStops);
+		nrIndex += p->nbStarts + p->nbStops;
+		events->push_back(e);
+	}
+}
+static int score_addEvents(lua_State *L)
+{
+	// add a list of events, each one with the structure of the events of luascore.lua
+	luaL_checktype(L, 1, LUA_TTABLE);
+	score_tableEvents(L, 1, &(g_score.events));
+	g_score.dirty = true;
+	return 0;
+}
+static bool score_addBuffer(const char *buffer, int size)
+{
+	// add the events packed in buffer by the GUI ( cf. T_basslua_score_header ), without LUA tables
+	score_bufferEvents(buffer, &(g_score.events));
+	g_score.dirty = true;
+	return true;
+}
+static bool score_patch(lua_State *L, int nbEvents, int first, int nbReplaced, const std::vector<T_score_event> &patch)
+{
+	// replace the events [first, first + nbReplaced - 1] by the events of patch, if the score has still nbEvents events
+	// The starts, stops and strings of patch are already in g_score. The numbers of the events after the events
+	// replaced, referred by the events kept, are shifted. The starts, stops and strings of the events replaced
+	// stay unused in g_score, up to the next initScore.
+	// The moves are prepared again and the position goes to the beginning, in the same call : nb_events and the
+	// moves precomputed must never refer to the events before the patch
+	if ((nbEvents != (int)g_score.events.size()) || (first < 1) || (nbReplaced < 0) || (first + nbReplaced - 1 > nbEvents))
+		return false;
+	int delta = (int)patch.size() - nbReplaced;
+	int limit = first + nbReplaced;
+	for (int nrEvent = 1; nrEvent <= nbEvents; nrEvent++)
+	{
+		if ((nrEvent >= first) && (nrEvent < limit))
+			continue;
+		T_score_event *e = &(g_score.events[nrEvent - 1]);
+		if (e->willStopIndex >= limit)
+			e->willStopIndex += delta;
+		if (e->stopIndex >= limit)
+			e->stopIndex += delta;
+		for (int n = 0; n < e->nbStarts; n++)
+		{
+			if (g_score.indexes[e->starts + n] >= limit)
+				g_score.indexes[e->starts + n] += delta;
+		}
+		for (int n = 0; n < e->nbStops; n++)
+		{
+			if (g_score.indexes[e->stops + n] >= limit)
+				g_score.indexes[e->stops + n] += delta;
+		}
+	}
+	g_score.events.erase(g_score.events.begin() + (first - 1), g_score.events.begin() + (limit - 1));
+	g_score.events.insert(g_score.events.begin() + (first - 1), patch.begin(), patch.end());
+	g_score.noteOffStops.clear();
+	g_score.dirty = true;
+	score_first_part(L);
+	return true;
+}
+static bool score_patchBuffer(lua_State *L, int nbEvents, int first, int nbReplaced, const char *buffer, int size)
+{
+	// replace the events [first, first + nbReplaced - 1] by the events packed in buffer by the GUI
+	std::vector<T_score_event> patch;
+	score_bufferEvents(buffer, &patch);
+	return score_patch(L, nbEvents, first, nbReplaced, patch);
+}
+static int score_patchEvents(lua_State *L)
+{
+	// parameters : nbEvents, first, nbReplaced, list of events with the structure of the events of luascore.lua
+	// return true if the events [first, first + nbReplaced - 1] of a score of nbEvents are replaced
+	luaL_checktype(L, 4, LUA_TTABLE);
+	std::vector<T_score_event> patch;
+	score_tableEvents(L, 4, &patch);
+	lua_pushboolean(L, score_patch(L, (int)lua_tointeger(L, 1), (int)lua_tointeger(L, 2), (int)lua_tointeger(L, 3), patch));
+	return 1;
+}
+static int score_addTrack(lua_State *L)
+{
+	const char *name = lua_tostring(L, 1);
+	score_add_track((name) ? name : "", 0, 128, 0);
+	return 0;
+}
+static int score_finishScore(lua_State *L)
+{
+	g_score.playing = false;
+	score_first_part(L);
+	return 0;
+}
+static int score_play(lua_State *L)
+{
+	// parameters : time, bid, channel, pitch, velocity
+	if (g_score.nb_events == 0)
+		return 0;
+	lua_Integer bid = lua_tointeger(L, 2);
+	double velo = lua_tonumber(L, 5);
+	if (velo == 0)
+	{
+		// note-off
+		if ((g_score.playing) && (g_score.playing_bid == bid))
+			g_score.playing = false;
+		score_note_off(L, bid);
+	}
+	else
+	{
+		// note-on
+		g_score.playing = true;
+		g_score.playing_bid = bid;
+		g_score.playing_nrEvent = g_score.noteOn;
+		score_note_on(L, bid, velo);
+	}
+	return 0;
+}
+static int score_previousPos(lua_State *L)
+{
+	// move to the previous pos_move
+	int m = g_score.memEvent;
+	score_first_part(L);
+	g_score.noteOn = m - 1;
+	score_next_group();
+	score_pending_reset(L);
+	return 0;
+}
+static int score_firstPart(lua_State *L)
+{
+	score_first_part(L);
+	return 0;
+}
+static int score_nextEvent(lua_State *L)
+{
+	score_next_group();
+	score_pending_off(L);
+	score_mem();
+	return 0;
+}
+static int score_nextMeasure(lua_State *L)
+{
+	score_goto(L, score_run_next(g_score.measures, g_score.measureNr + 1));
+	score_mem();
+	return 0;
+}
+static int score_nextPart(lua_State *L)
+{
+	score_goto(L, score_run_next(g_score.parts, g_score.partNr + 1));
+	score_mem();
+	return 0;
+}
+static int score_lastPart(lua_State *L)
+{
+	// move to the part before the last one ( the last one is the empty end of the score )
+	size_t nb = g_score.parts.size();
+	score_goto(L, (nb >= 2) ? g_score.parts[nb - 2].first : 1);
+	score_mem();
+	return 0;
+}
+static int score_previousPart(lua_State *L)
+{
+	score_run_previous(L, g_score.parts, g_score.partNr - 1);
+	return 0;
+}
+static int score_previousMeasure(lua_State *L)
+{
+	score_run_previous(L, g_score.measures, g_score.measureNr);
+	return 0;
+}
+static int score_previousEvent(lua_State *L)
+{
+	// move to the previous event
+	g_score.noteOn--;
+	if ((g_score.noteOn > 1) && (g_score.noteOn <= g_score.nb_events))
+		g_score.noteOn = g_score.prev_start[g_score.noteOn];
+	g_score.noteOn--;
+	score_next_group();
+	score_mem();
+	return 0;
+}
+static int score_gotoNrEvent(lua_State *L)
+{
+	score_goto(L, (int)lua_tointeger(L, 1));
+	return 0;
+}
+static int score_getPosition(lua_State *L)
+{
+	// return the next event to play, or the event playing
+	if (g_score.playing)
+	{
+		lua_pushinteger(L, g_score.playing_nrEvent);
+		lua_pushinteger(L, 1);
+	}
+	else
+	{
+		lua_pushinteger(L, g_score.noteOn);
+		lua_pushinteger(L, 0);
+	}
+	return 2;
+}
+
+// .pck file : the format of string.pack in luascore.lua, "zhhh" per track and "zzhhhhhhhhhzhhhhhhhhhhh" per event
+static void score_write_string(FILE *f, const char *s)
+{
+	fwrite(s, 1, strlen(s) + 1, f);
+}
+static void score_write_short(FILE *f, int v)
+{
+	short h = (short)v;
+	fwrite(&h, sizeof(short), 1, f);
+}
+static void score_write_list(FILE *f, int first, int nb)
+{
+	for (int n = 0; n < nb; n++)
+		fprintf(f, (n == 0) ? "%d" : "/%d", g_score.indexes[first + n]);
+	fputc('\0', f);
+}
+static int score_save(lua_State *L)
+{
+	char fname[MAXBUFCHAR];
+	snprintf(fname, MAXBUFCHAR, "%s.pck", luaL_checkstring(L, 1));
+	FILE *f = fopen(fname, "w"); // same mode as io.open of luascore.lua
+	if (f == NULL)
+		return luaL_error(L, "scoreengine : error opening %s", fname);
+	for (int i = 1; i <= SCORE_NBTRACK; i++)
+	{
+		T_score_track *t = score_track(i);
+		score_write_string(f, (t) ? t->name.c_str() : "");
+		score_write_short(f, (t) ? t->randomDelay : 0);
+		score_write_short(f, (t) ? t->dynamic : 0);
+		score_write_short(f, (t) ? t->pedal : 0);
+	}
+	for (size_t nrEvent = 0; nrEvent < g_score.events.size(); nrEvent++)
+	{
+		const T_score_event *e = &(g_score.events[nrEvent]);
+		score_write_list(f, e->starts, e->nbStarts);
+		score_write_list(f, e->stops, e->nbStops);
+		for (int n = 0; n < SCORE_NBFIELD; n++)
+		{
+			if (g_score_field[n] == &T_score_event::lua)
+				score_write_string(f, &(g_score.strings[e->lua]));
+			else
+				score_write_short(f, e->*g_score_field[n]);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+static const char *score_read_string(const std::vector<char> &buf, size_t *pos)
+{
+	// read a null terminated string, NULL if the buffer is truncated
+	if (*pos >= buf.size())
+		return NULL;
+	const char *s = &(buf[*pos]);
+	const void *end = memchr(s, '\0', buf.size() - *pos);
+	if (end == NULL)
+		return NULL;
+	*pos += (const char *)end - s + 1;
+	return s;
+}
+static bool score_read_short(const std::vector<char> &buf, size_t *pos, int *v)
+{
+	short h;
+	if (*pos + sizeof(short) > buf.size())
+		return false;
+	memcpy(&h, &(buf[*pos]), sizeof(short));
+	*pos += sizeof(short);
+	*v = h;
+	return true;
+}
+static int score_read_list(const char *s)
+{
+	// append the numbers of a list "n/n/n" in indexes, return the number of numbers
+	int nb = 0;
+	while (*s)
+	{
+		if ((*s >= '0') && (*s <= '9'))
+		{
+			g_score.indexes.push_back((int)strtol(s, (char **)&s, 10));
+			nb++;
+		}
+		else
+			s++;
+	}
+	return nb;
+}
+static bool score_read(const char *fname, char *error)
+{
+	// read the score of a .pck file. error : SCORE_ERROR chars, message if false is returned
+	// the C++ objects are released here, before the LUA error of the caller
+	FILE *f = fopen(fname, "r"); // same mode as io.open of luascore.lua
+	if (f == NULL)
+	{
+		snprintf(error, SCORE_ERROR, "error opening %s", fname);
+		return false;
+	}
+	std::vector<char> buf;
+	char block[4096];
+	size_t n;
+	while ((n = fread(block, 1, sizeof(block), f)) > 0)
+		buf.insert(buf.end(), block, block + n);
+	fclose(f);
+	buf.push_back('\0'); // guard of the last string
+	size_t len = buf.size() - 1;
+	size_t pos = 0;
+	// read 32 tracks
+	for (int i = 1; i <= SCORE_NBTRACK; i++)
+	{
+		const char *name = score_read_string(buf, &pos);
+		int randomDelay, dynamic, pedal;
+		if ((name == NULL) || (!score_read_short(buf, &pos, &randomDelay)) || (!score_read_short(buf, &pos, &dynamic)) || (!score_read_short(buf, &pos, &pedal)))
+		{
+			snprintf(error, SCORE_ERROR, "truncated tracks in %s", fname);
+			return false;
+		}
+		if (*name)
+			score_add_track(name, randomDelay, dynamic, pedal);
+	}
+	// read the events
+	while (pos + 1 < len)
+	{
+		T_score_event e;
+		bool ok;
+		const char *starts = score_read_string(buf, &pos);
+		const char *stops = (starts) ? score_read_string(buf, &pos) : NULL;
+		ok = (stops != NULL);
+		if (ok)
+		{
+			e.starts = (int)g_score.indexes.size();
+			e.nbStarts = score_read_list(starts);
+			e.stops = (int)g_score.indexes.size();
+			e.nbStops = score_read_list(stops);
+		}
+		for (int n = 0; (ok) && (n < SCORE_NBFIELD); n++)
+		{
+			if (g_score_field[n] == &T_score_event::lua)
+			{
+				const char *s = score_read_string(buf, &pos);
+				ok = (s != NULL);
+				if (ok)
+					e.lua = score_string(s);
+			}
+			else
+				ok = score_read_short(buf, &pos, &(e.*g_score_field[n]));
+		}
+		if (!ok)
+		{
+			snprintf(error, SCORE_ERROR, "truncated event#%d in %s", (int)g_score.events.size() + 1, fname);
+			return false;
+		}
+		g_score.events.push_back(e);
+	}
+	return true;
+}
+static int score_load(lua_State *L)
+{
+	char fname[MAXBUFCHAR];
+	snprintf(fname, MAXBUFCHAR, "%s.pck", luaL_checkstring(L, 1));
+	char error[SCORE_ERROR];
+	score_init();
+	bool ok = score_read(fname, error);
+	g_score.dirty = true;
+	if (!ok)
+		return luaL_error(L, "scoreengine : %s", error);
+	score_first_part(L);
+	return 0;
+}
+
+static const struct luaL_Reg scoreengine[] =
+{
+	// functions of luascore.lua, with the same parameters
+	{ "init", score_init_functions }, // set the luabass module, and the applyLua function
+	{ functionScoreInitScore, score_initScore },
+	{ "addEvent", score_addEvent },
+	{ functionScoreAddEventStarts, score_addEventStarts },
+	{ functionScoreAddEventStops, score_addEventStops },
+	{ functionScoreAddEvents, score_addEvents },
+	{ functionScorePatchEvents, score_patchEvents },
+	{ functionScoreAddTrack, score_addTrack },
+	{ functionScoreFinishScore, score_finishScore },
+	{ "play", score_play },
+	{ "previousPos", score_previousPos },
+	{ "firstPart", score_firstPart },
+	{ "nextEvent", score_nextEvent },
+	{ "nextMeasure", score_nextMeasure },
+	{ "nextPart", score_nextPart },
+	{ "lastPart", score_lastPart },
+	{ "previousPart", score_previousPart },
+	{ "previousMeasure", score_previousMeasure },
+	{ "previousEvent", score_previousEvent },
+	{ functionScoreGotoNrEvent, score_gotoNrEvent },
+	{ functionScoreGetPosition, score_getPosition },
+	{ "save", score_save },
+	{ "load", score_load },
+	{ NULL, NULL }
+};
+static int luaopen_scoreengine(lua_State *L)
+{
+	g_score.refNoteOn = g_score.refNoteOff = g_score.refControl = g_score.refApplyLua = LUA_NOREF;
+	score_init();
+	luaL_newlib(L, scoreengine);
+	return 1;
+}
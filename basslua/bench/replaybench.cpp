@@ -0,0 +1,192 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        replaybench.cpp
+// Purpose:     headless check of the replay of a journal of midi-in /  expresseur V3
+// usage :      replaybench [journal] [number of messages] [script.lua]
+//              run from the directory of the scripts ( default lua/expresscmd.lua ), without luabass :
+//              the midi-out is simulated by luabassfake.lua
+// A journal is generated with journal_write ( basslua.cpp is included, to reach its static functions ) :
+// note-on/note-off on two devices, one sysex longer than a short message every 50 messages, 2 ms between the
+// messages. It is replayed as fast as possible, then its first second in real-time. The messages go through
+// the rings of the midi-in and the dispatcher thread, like the messages of the drivers.
+// The journal is kept, for expresscmd -replay.
+// During the fast replay, a simulated driver callback of the device #1 sends key-pressures, with the record of a
+// second journal and the measure of the latency on : the replay must ignore them, and the second journal and the
+// histograms must have only the messages of the driver, not the ones replayed.
+// Return 1 if a message is lost, or not processed, or if the real-time replay is shorter than the journal, or if
+// a message of the driver is replayed, or a message replayed is recorded or measured.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include "basslua.cpp"
+
+#define BENCH_DT 0.002 // seconds between two messages of the journal
+#define BENCH_SYSEX 50 // one sysex every BENCH_SYSEX messages
+#define BENCH_REALTIME 500 // messages replayed in real-time ( 1 s )
+#define BENCH_DRIVER_STATUS 0xA0 // key-pressure : messages of the simulated driver
+#define BENCH_DRIVER_DT 50 // micro-seconds between two messages of the simulated driver
+#define BENCH_RECORD "replaybench_rec.blj" // journal recorded during the fast replay
+
+static std::atomic<bool> g_bench_driver(false); // the simulated driver is running
+static std::atomic<long> g_bench_driver_nb(0); // messages sent by the simulated driver
+
+static bool bench_journal(const char *fname, int nbMessage)
+{
+	// generate the journal, with the writer of basslua_record
+	g_journal = fopen(fname, "wb");
+	if (g_journal == NULL)
+		return false;
+	fwrite(JOURNAL_MAGIC, 1, 4, g_journal);
+	g_journal_time = 0;
+	BYTE sysex[64];
+	sysex[0] = 0xF0;
+	for (int n = 1; n < 63; n++)
+		sysex[n] = (BYTE)(n & 0x7F);
+	sysex[63] = 0xF7;
+	for (int n = 0; n < nbMessage; n++)
+	{
+		double time = 1.0 + n * BENCH_DT;
+		if ((n % BENCH_SYSEX) == BENCH_SYSEX - 1)
+		{
+			journal_write((n / 2) % 2, time, sysex, sizeof(sysex));
+			continue;
+		}
+		// a note-on, then its note-off
+		int k = n / 2;
+		BYTE msg[3];
+		msg[0] = (BYTE)(((n % 2) ? 0x80 : 0x90) + (k % 16));
+		msg[1] = (BYTE)(36 + k % 48);
+		msg[2] = (BYTE)((n % 2) ? 0 : 64);
+		journal_write(k % 2, time, msg, 3);
+	}
+	journal_close();
+	return true;
+}
+static void *bench_driver(void *info)
+{
+	// simulated driver callback of the device #1, concurrent to the replay
+	BYTE msg[3] = { BENCH_DRIVER_STATUS, 60, 1 };
+	while (g_bench_driver.load())
+	{
+		midinewmsg(0, 0.0, msg, 3, (void *)0);
+		g_bench_driver_nb++;
+		replay_sleep(BENCH_DRIVER_DT);
+	}
+	return NULL;
+}
+static bool bench_record(long *nbRecorded)
+{
+	// the journal recorded has only the messages of the simulated driver
+	FILE *f = fopen(BENCH_RECORD, "rb");
+	if (f == NULL)
+		return false;
+	char magic[4];
+	bool ok = ((fread(magic, 1, 4, f) == 4) && (memcmp(magic, JOURNAL_MAGIC, 4) == 0));
+	BYTE *buffer = NULL;
+	DWORD size = 0, length;
+	long long t;
+	int midinr;
+	*nbRecorded = 0;
+	while ((ok) && (journal_read(f, &t, &midinr, &buffer, &length, &size)))
+	{
+		if ((midinr != 0) || (length != 3) || (buffer[0] != BENCH_DRIVER_STATUS))
+			ok = false;
+		(*nbRecorded)++;
+	}
+	if (buffer)
+		free(buffer);
+	fclose(f);
+	remove(BENCH_RECORD);
+	return ok;
+}
+static bool bench_replay(const char *fname, bool realtime, int nbMessage)
+{
+	int received[2];
+	for (int n = 0; n < 2; n++)
+		received[n] = (int)(g_midiin_ring[n].received.load());
+	// fast replay : with the simulated driver, the record of a journal, and the measure of the latency
+	pthread_t driver;
+	long driverStart = 0, nbRecorded = 0;
+	if (!realtime)
+	{
+		basslua_setLatency(true, true);
+		if (!basslua_record(BENCH_RECORD))
+			return false;
+		g_bench_driver = true;
+		if (pthread_create(&driver, NULL, bench_driver, NULL) != 0)
+			return false;
+		while (g_bench_driver_nb.load() < 10)
+			replay_sleep(REPLAY_POLL);
+		driverStart = g_bench_driver_nb.load();
+	}
+	T_basslua_replay stat;
+	bool replayed = basslua_replay(fname, realtime, NULL, &stat);
+	long driverReplay = g_bench_driver_nb.load() - driverStart;
+	bool driverOk = true;
+	if (!realtime)
+	{
+		g_bench_driver = false;
+		pthread_join(driver, NULL);
+		while (replay_waiting())
+			replay_sleep(REPLAY_POLL);
+		basslua_record(NULL);
+		basslua_setLatency(false, false);
+		T_basslua_latency lat;
+		basslua_getLatency(LAT_DISPATCH, &lat);
+		driverOk = bench_record(&nbRecorded) && (nbRecorded > 0) && (lat.nb == nbRecorded) && (driverReplay > 0);
+		printf("driver : %ld messages sent , %ld during the replay , %ld recorded , %lld measured : %s\n", g_bench_driver_nb.load(), driverReplay,
+			nbRecorded, lat.nb, driverOk ? "OK" : "error");
+	}
+	if (!replayed)
+	{
+		printf("error basslua_replay <%s>\n", fname);
+		return false;
+	}
+	int dispatched = 0, lost = 0;
+	for (int n = 0; n < 2; n++)
+	{
+		dispatched += (int)(g_midiin_ring[n].received.load()) - received[n];
+		lost += (int)(g_midiin_ring[n].overflow.load());
+	}
+	printf("%s : %d messages in %.3f s , process average %.1f us max %lld us , LUA %.1f%% , outputs %ld\n",
+		realtime ? "real-time" : "fast", stat.nbEvents, (double)stat.duration_us / 1000000.0,
+		(stat.nbEvents > 0) ? (double)stat.process_us / stat.nbEvents : 0.0, stat.max_us,
+		(stat.process_us > 0) ? (double)stat.lua_us * 100.0 / (double)stat.process_us : 0.0, stat.nbOutputs);
+	printf("   through the rings : %d , lost : %d\n", dispatched, lost);
+	// the rings have also the messages of the driver, before and after the fast replay
+	bool ok = ((stat.nbEvents == nbMessage) && (dispatched == nbMessage + nbRecorded) && (lost == 0) && (driverOk));
+	if ((realtime) && ((double)stat.duration_us / 1000000.0 < (nbMessage - 1) * BENCH_DT))
+		ok = false;
+	return ok;
+}
+int main(int argc, char *argv[])
+{
+	const char *journal = (argc > 1) ? argv[1] : "replaybench.blj";
+	int nbMessage = (argc > 2) ? atoi(argv[2]) : 100000;
+	const char *script = (argc > 3) ? argv[3] : "lua/expresscmd.lua";
+	if (nbMessage < 1)
+		nbMessage = 1;
+	if (!bench_journal(journal, nbMessage))
+	{
+		printf("error writing journal <%s>\n", journal);
+		return 1;
+	}
+	basslua_setModuleOut("luabassfake");
+	if (!basslua_open(script, "", true, 0, NULL, "replaybench.log"))
+	{
+		printf("error basslua_open <%s>\n", script);
+		return 1;
+	}
+	bool ok = bench_replay(journal, false, nbMessage);
+	if (nbMessage > BENCH_REALTIME)
+	{
+		bench_journal(journal, BENCH_REALTIME);
+		nbMessage = BENCH_REALTIME;
+	}
+	ok = bench_replay(journal, true, nbMessage) && ok;
+	basslua_close();
+	return (ok ? 0 : 1);
+}
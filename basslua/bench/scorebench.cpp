@@ -0,0 +1,119 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        scorebench.cpp
+// Purpose:     comparison of the native score engine with luascore.lua /  expresseur V3
+// usage :      scorebench [script.lua] [number of seeds] [number of events]
+//              run from the root of the sources ( default script basslua/bench/scoretrace.lua ), with LUA_PATH
+//              to the directory of luascore.lua
+// For each seed, the script builds a random score, plays it with random key-strokes, moves and gotos, saves
+// it and loads it again. It runs twice : in a LUA state without the module scoreengine ( the LUA
+// implementation of luascore.lua ), and in a LUA state with the native engine of bassluascore.h
+// ( basslua.cpp is included, to reach it ). The traces of the midi-out and of the positions, and the .pck
+// files saved, must be the same. The score is added event by event, then in one call ( addEvents ).
+// Return 1 at the first difference.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+
+#include "basslua.cpp"
+
+static bool bench_trace(const char *script, bool engine, int seed, int nbEvents, bool bulk, const char *save, std::string *trace)
+{
+	// run the script in a new LUA state, with or without the native engine
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	if (engine)
+	{
+		luaL_requiref(L, moduleScoreEngine, luaopen_scoreengine, 0);
+		lua_pop(L, 1);
+	}
+	lua_newtable(L);
+	lua_pushinteger(L, seed);
+	lua_setfield(L, -2, "seed");
+	lua_pushinteger(L, nbEvents);
+	lua_setfield(L, -2, "nbEvents");
+	lua_pushboolean(L, bulk);
+	lua_setfield(L, -2, "bulk");
+	lua_pushstring(L, save);
+	lua_setfield(L, -2, "save");
+	lua_setglobal(L, "bench");
+	bool ok = ((luaL_loadfile(L, script) == LUA_OK) && (lua_pcall(L, 0, 1, 0) == LUA_OK));
+	if (ok)
+		trace->assign(lua_tostring(L, -1));
+	else
+		printf("error %s : %s\n", engine ? "engine" : "lua", lua_tostring(L, -1));
+	lua_close(L);
+	return ok;
+}
+static bool bench_file(const char *fname, std::string *content)
+{
+	FILE *f = fopen(fname, "rb");
+	if (f == NULL)
+		return false;
+	content->clear();
+	char buf[4096];
+	size_t nb;
+	while ((nb = fread(buf, 1, sizeof(buf), f)) > 0)
+		content->append(buf, nb);
+	fclose(f);
+	return true;
+}
+static size_t bench_line(const std::string &a, const std::string &b)
+{
+	// line of the first difference
+	size_t line = 1;
+	for (size_t n = 0; (n < a.size()) && (n < b.size()) && (a[n] == b[n]); n++)
+	{
+		if (a[n] == '\n')
+			line++;
+	}
+	return line;
+}
+int main(int argc, char *argv[])
+{
+	const char *script = (argc > 1) ? argv[1] : "basslua/bench/scoretrace.lua";
+	int nbSeed = (argc > 2) ? atoi(argv[2]) : 8;
+	int nbEvents = (argc > 3) ? atoi(argv[3]) : 200;
+	const char *save[2] = { "scorebench_lua", "scorebench_engine" }; // luascore adds .pck
+	int nbLine = 0;
+	for (int seed = 1; seed <= nbSeed; seed++)
+	{
+		for (int bulk = 0; bulk < 2; bulk++)
+		{
+			std::string trace[2], pck[2];
+			for (int engine = 0; engine < 2; engine++)
+			{
+				std::string fname = std::string(save[engine]) + ".pck";
+				if (!bench_trace(script, engine != 0, seed, nbEvents, bulk != 0, save[engine], &(trace[engine])))
+					return 1;
+				if (!bench_file(fname.c_str(), &(pck[engine])))
+				{
+					printf("error reading %s\n", fname.c_str());
+					return 1;
+				}
+				remove(fname.c_str());
+			}
+			if (trace[0] != trace[1])
+			{
+				printf("seed %d %s : traces differ at line %d\n", seed, bulk ? "addEvents" : "addEvent", (int)bench_line(trace[0], trace[1]));
+				return 1;
+			}
+			if (pck[0] != pck[1])
+			{
+				printf("seed %d %s : .pck files differ\n", seed, bulk ? "addEvents" : "addEvent");
+				return 1;
+			}
+			for (size_t n = 0; n < trace[0].size(); n++)
+			{
+				if (trace[0][n] == '\n')
+					nbLine++;
+			}
+		}
+	}
+	printf("%d seeds , %d events : same traces ( %d lines ) and same .pck files\n", nbSeed, nbEvents, nbLine);
+	return 0;
+}
@@ -0,0 +1,98 @@
+-- trace of luascore.lua on a random score, run by scorebench
+-- parameters in the global table bench : seed, nbEvents, bulk ( addEvents instead of addEvent ), save ( .pck file, without its extension )
+-- return the trace : the midi-out of luascore ( luabass is simulated ), its moves, its patches and its positions
+-- update : 16/10/2026
+
+local trace = {}
+local function rec(...)
+  local t = { ... }
+  for i = 1, #t do t[i] = tostring(t[i]) end
+  trace[#trace + 1] = table.concat(t, " ")
+end
+luabass = {
+  outNoteOn = function(...) rec("on", ...) return 0 end,
+  outNoteOff = function(...) rec("off", ...) return 0 end,
+  outControl = function(...) rec("ctrl", ...) end,
+  outSetTrackInstrument = function(...) rec("instr", ...) end,
+  logmsg = function(...) rec("log", ...) end,
+}
+math.randomseed(bench.seed)
+local R = math.random
+local luascore = require("luascore")
+
+local ntracks, nbEvents = 0, bench.nbEvents
+local function event(n, part, measure)
+  -- random event, with the structure of the events of luascore.lua, in a score of n events
+  local lua = ""
+  local x = R(1, 20)
+  if x == 1 then lua = "test hello" elseif x == 2 then lua = "instrument piano" end
+  local ev = { {}, {},
+    1, 1, R(1, ntracks), R(0, 127), R(0, 127), R(0, 50),
+    (R(1, 8) == 1) and R(0, 128) or -1, -1, (R(1, 10) == 1) and R(0, 127) or -1,
+    lua,
+    R(0, n), R(0, n),
+    part, measure, 48, measure, R(0, 3), 0, measure, R(0, 3), 0 }
+  if R(1, 3) ~= 1 then for k = 1, R(1, 4) do table.insert(ev[1], R(1, n)) end end
+  if R(1, 2) == 1 then for k = 1, R(1, 4) do table.insert(ev[2], R(1, n)) end end
+  return ev
+end
+
+local function build(n)
+  luascore.initScore()
+  ntracks = R(1, 4)
+  for i = 1, ntracks do luascore.addTrack("track" .. i) end
+  local part, measure = 1, 1
+  local evs = {}
+  for i = 1, n do
+    if R(1, 10) == 1 then measure = measure + 1 end
+    if R(1, 30) == 1 then part = part + 1 end
+    evs[i] = event(n, part, measure)
+  end
+  if bench.bulk then
+    luascore.addEvents(evs)
+  else
+    for i, ev in ipairs(evs) do
+      luascore.addEvent(table.unpack(ev, 3, 23))
+      for _, s in ipairs(ev[1]) do luascore.addEventStarts(s) end
+      for _, s in ipairs(ev[2]) do luascore.addEventStops(s) end
+    end
+  end
+  luascore.finishScore()
+end
+
+build(bench.nbEvents)
+local moves = { "nextEvent", "previousEvent", "nextMeasure", "previousMeasure", "nextPart", "previousPart", "lastPart", "firstPart", "previousPos" }
+local bids = {}
+for step = 1, 3000 do
+  local x = R(1, 20)
+  if step % 1000 == 0 then
+    -- patch of the score, as the GUI does after a new compilation. Once in a while, with a wrong number of events
+    local first = R(1, nbEvents)
+    local nbReplaced = R(0, math.min(20, nbEvents - first + 1))
+    local evs = {}
+    local nbPatch = nbReplaced + R(0, 10) -- the events kept may refer to the events replaced
+    for i = 1, nbPatch do evs[i] = event(nbEvents + nbPatch - nbReplaced, R(1, 3), R(1, 10)) end
+    local nb = (R(1, 4) == 1) and nbEvents + 1 or nbEvents
+    local ok = luascore.patchEvents(nb, first, nbReplaced, evs)
+    if ok then nbEvents = nbEvents + #evs - nbReplaced end
+    rec("patch", first, nbReplaced, #evs, ok)
+  elseif x <= 12 then
+    -- key-strokes of 6 buttons
+    local bid = R(1, 6)
+    if bids[bid] then luascore.play(0.0, bid, 1, 60, 0) bids[bid] = nil
+    else luascore.play(0.0, bid, 1, 60, R(1, 127)) bids[bid] = true end
+  elseif x <= 18 then
+    local move = moves[R(1, #moves)]
+    rec(move)
+    luascore[move](0.0, 1, 1, 60, 64)
+  else
+    local k = R(1, nbEvents + 50)
+    rec("goto", k)
+    luascore.gotoNrEvent(k)
+  end
+  rec("pos", luascore.getPosition())
+end
+luascore.save(bench.save)
+luascore.load(bench.save)
+rec("loaded", luascore.getPosition())
+return table.concat(trace, "\n")
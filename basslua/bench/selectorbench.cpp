@@ -0,0 +1,84 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        selectorbench.cpp
+// Purpose:     benchmark of the dispatch of the midi-in events through the selectors /  expresseur V3
+// usage :      selectorbench [script.lua]
+//              run from the directory of the scripts ( default lua/expresscmd.lua ), without luabass :
+//              the midi-out is simulated by luabassfake.lua
+// The events are dispatched through 10, 100 and 1000 selectors. Each selector is a range of 12 keys on one
+// channel of all the devices. The ranges are spread over the keyboard, so that the events hit some selectors :
+// the number of matches per event is reported with the time. The action of the selectors does not exist, so
+// LUA is not called.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+
+#include "basslua.h"
+
+#define BENCH_NBEVENT 200000 // midi-in events dispatched for each number of selectors
+#define BENCH_RANGE 12 // keys of a selector
+#define BENCH_ACTION 1000000 // action of the selectors, which does not exist
+
+typedef struct
+{
+	int channel;
+	int pitch;
+} T_bench_event;
+
+int main(int argc, char *argv[])
+{
+	const char *fname = (argc > 1) ? argv[1] : "lua/expresscmd.lua";
+	basslua_setModuleOut("luabassfake");
+	if (!basslua_open(fname, "", true, 0, NULL, "selectorbench.log"))
+	{
+		printf("error basslua_open <%s>\n", fname);
+		return 1;
+	}
+
+	// same events for all the numbers of selectors
+	srand(1);
+	std::vector<T_bench_event> events(BENCH_NBEVENT);
+	for (int nrEvent = 0; nrEvent < BENCH_NBEVENT; nrEvent++)
+	{
+		events[nrEvent].channel = rand() % 16;
+		events[nrEvent].pitch = rand() % 128;
+	}
+
+	int nbSelectors[3] = { 10, 100, 1000 };
+	for (int n = 0; n < 3; n++)
+	{
+		basslua_setSelector(0, -1, 'x', 0, 0, 0, NULL, 0, false, NULL);
+		std::vector<int> low(nbSelectors[n]);
+		for (int nrSelector = 0; nrSelector < nbSelectors[n]; nrSelector++)
+		{
+			int pitch[2];
+			low[nrSelector] = pitch[0] = (nrSelector * 37) % (128 - BENCH_RANGE);
+			pitch[1] = pitch[0] + BENCH_RANGE - 1;
+			basslua_setSelector(nrSelector, BENCH_ACTION, 'b', -1, nrSelector % 16, snoteonoff, pitch, 2, false, "");
+		}
+		long nbMatch = 0;
+		for (int nrEvent = 0; nrEvent < BENCH_NBEVENT; nrEvent++)
+		{
+			for (int nrSelector = 0; nrSelector < nbSelectors[n]; nrSelector++)
+			{
+				if (((nrSelector % 16) == events[nrEvent].channel) && (events[nrEvent].pitch >= low[nrSelector]) && (events[nrEvent].pitch < low[nrSelector] + BENCH_RANGE))
+					nbMatch++;
+			}
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int nrEvent = 0; nrEvent < BENCH_NBEVENT; nrEvent++)
+			basslua_selectorSearch(0, events[nrEvent].channel, NOTEON, events[nrEvent].pitch, 64);
+		std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+		printf("%4d selectors : %.1f ns per event , %.2f matches per event\n", nbSelectors[n], d.count() / BENCH_NBEVENT, (double)nbMatch / BENCH_NBEVENT);
+	}
+	basslua_setSelector(0, -1, 'x', 0, 0, 0, NULL, 0, false, NULL);
+	basslua_close();
+	return 0;
+}
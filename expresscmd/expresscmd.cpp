@@ -30,7 +30,7 @@
 // Unsupported platform
 #endif
 #elif __linux
-// linux
+#define V_LINUX 1
 #elif __unix // all unices not caught above
 // Unix
 #elif __posix
@@ -46,6 +46,11 @@
 #define strcpy_s strcpy
 #define gets_s gets
 #endif
+#ifdef V_LINUX
+// gets does not exist anymore : read the line, without its end-of-line
+#define strcpy_s strcpy
+#define gets_s(s) ((fgets(s, sizeof(s), stdin) != NULL) && (((s)[strcspn(s, "\r\n")] = '\0') == '\0'))
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -56,20 +61,78 @@
 #include "basslua.h"
 #include "luabass.h"
 
-#define sUsage "type help for list of functions\n"
+#define sUsage "type help for list of functions, midiinstat for the midi-in queues,\n" \
+	"record <journal> to record the midi-in ( record alone to stop ), replay <journal> [fast] [<report>] to replay a journal\n"
+#define sOptions "usage : expresscmd [script.lua [param]] [-fake] [-replay journal [-fast] [-report report.csv]]\n" \
+	"   -fake : luabassfake.lua simulates the midi-out\n" \
+	"   -replay : replay the journal of midi-in, print the statistics, and exit\n"
+
+static void replay(const char *journal, bool realtime, const char *report)
+{
+	// replay a journal of midi-in through the LUA script, and print the statistics
+	T_basslua_replay stat;
+	if (!basslua_replay(journal, realtime, report, &stat))
+	{
+		printf("replay <%s> : error\n", journal);
+		return;
+	}
+	printf("replay <%s> %s : %d events in %.3f s\n", journal, realtime ? "real-time" : "fast", stat.nbEvents, (double)stat.duration_us / 1000000.0);
+	if (stat.nbEvents > 0)
+		printf("process : average %.1f us, max %lld us, LUA %.1f%%\n", (double)stat.process_us / stat.nbEvents, stat.max_us,
+			(stat.process_us > 0) ? (double)stat.lua_us * 100.0 / (double)stat.process_us : 0.0);
+	if (stat.nbOutputs >= 0)
+		printf("outputs : %ld\n", stat.nbOutputs);
+	for (int n = 0; n < BASSLUA_REPLAY_HISTO; n++)
+	{
+		if (stat.limit[n] > 0)
+			printf("   <= %5ld us : %ld\n", stat.limit[n], stat.histogram[n]);
+		else
+			printf("    > %5ld us : %ld\n", stat.limit[n - 1], stat.histogram[n]);
+	}
+}
 
 int main(int argc, char* argv[])
 {
 	
 	// define the default lua-script and its empty parameter
+#ifdef V_PC
 	char fname[1024] = "lua\\expresscmd.lua";
+#else
+	char fname[1024] = "lua/expresscmd.lua";
+#endif
 	char param[1024] = "";
+	const char *journal = NULL;
+	const char *report = NULL;
+	bool realtime = true;
 
 	// use arguments of the command-line to change the lua-scipt and its parameters
-	if (argc > 1)
-		strcpy_s(fname, argv[1]);
-	if (argc > 2)
-		strcpy_s(param, argv[2]);
+	int nbArg = 0;
+	for (int n = 1; n < argc; n++)
+	{
+		if (strcmp(argv[n], "-fake") == 0)
+			basslua_setModuleOut("luabassfake");
+		else if ((strcmp(argv[n], "-replay") == 0) && (n + 1 < argc))
+			journal = argv[++n];
+		else if ((strcmp(argv[n], "-report") == 0) && (n + 1 < argc))
+			report = argv[++n];
+		else if (strcmp(argv[n], "-fast") == 0)
+			realtime = false;
+		else if (argv[n][0] == '-')
+		{
+			printf(sOptions);
+			return 1;
+		}
+		else if (nbArg == 0)
+		{
+			strcpy_s(fname, argv[n]);
+			nbArg++;
+		}
+		else if (nbArg == 1)
+		{
+			strcpy_s(param, argv[n]);
+			nbArg++;
+		}
+	}
 
 	// starts the basslua module with the lua-scipt
 	// this command loads :
@@ -82,6 +145,14 @@ int main(int argc, char* argv[])
 	//        The lua-scriptstarts the lua-function onStart(parameters) :
 	bool retCode = basslua_open(fname, param, true, 0, NULL ,"expresscmd.log");
 	printf("run bass_lua_file=<%s> param=<%s> :  %s\n", fname, param, retCode?"OK":"Error");
+
+	if (journal)
+	{
+		// headless benchmark
+		replay(journal, realtime, report);
+		basslua_close();
+		return (retCode ? 0 : 1);
+	}
 	
 	// print the usage of this command-line tool
 	printf(sUsage);
@@ -98,6 +169,39 @@ int main(int argc, char* argv[])
 			printf(sUsage);
 			strcpy(ch, "help");
 		}
+		if (strcmp(ch, "midiinstat") == 0)
+		{
+			// statistics of the midi-in queues, which are processed by the basslua dispatcher
+			int depth, maxDepth, overflow, received;
+			for (int nrDevice = 0; basslua_getMidiinStat(nrDevice, &depth, &maxDepth, &overflow, &received); nrDevice++)
+			{
+				if (received > 0)
+					printf("midiin#%d : received=%d waiting=%d max waiting=%d lost=%d\n", nrDevice + 1, received, depth, maxDepth, overflow);
+			}
+			continue;
+		}
+		if ((strcmp(ch, "record") == 0) || (strncmp(ch, "record ", 7) == 0))
+		{
+			// record the midi-in in a journal
+			if (basslua_record(ch + 6 + ((ch[6] == ' ') ? 1 : 0)))
+				printf(">Done\n");
+			else
+				printf(">Error\n");
+			continue;
+		}
+		if (strncmp(ch, "replay ", 7) == 0)
+		{
+			// replay a journal : replay <journal> [fast] [<report>]
+			char *words[3] = { NULL, NULL, NULL };
+			int nbWord = 0;
+			for (char *w = strtok(ch + 7, " "); (w != NULL) && (nbWord < 3); w = strtok(NULL, " "))
+				words[nbWord++] = w;
+			bool fast = ((nbWord > 1) && (strcmp(words[1], "fast") == 0));
+			const char *freport = (fast) ? words[2] : words[1];
+			if (words[0])
+				replay(words[0], !fast, freport);
+			continue;
+		}
 		char *pt[20];
 		int nb;
 		pt[0] = strtok(ch, " ");
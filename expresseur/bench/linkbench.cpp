@@ -0,0 +1,283 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        linkbench.cpp
+// Purpose:     check of the linker of the musicxmlevents /  expresseur V3
+// usage :      linkbench [number of random scores]
+// The linker of musicxmlcompile ( linkMusicxmlevents : binary search of the next starts ) is compared with
+// the previous linker, kept here as the reference ( forward scans from each stop ). musicxmlcompile.cpp is
+// included, to reach its static functions.
+// The random scores have chords, graces, tenuto, hidden and unplayed events, and stops without a start at the
+// same time ( orphan stops ). The events, their links and their flags must be the same.
+// Then both linkers are run on scores of 1k, 10k and 100k events. Their times are printed for information : they
+// are of the same order, the linker is not a speed-up.
+// Return 1 at the first difference.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include "musicxmlcompile.cpp"
+
+#include <chrono>
+
+static void linkReference(c_musicxmlevents &lMusicxmlevents, bool second_time, std::vector<c_musicxmlevent> *orpheline_musicxmlevents)
+{
+	// linker of compileMusicxmlevents before linkMusicxmlevents : the stops-tenuto and the orpheline-stops scan the
+	// events forward, up to the next synchronous start, or up to the next visible start
+	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
+	int nr_musicxmlevent;
+	int nb_measure = 0;
+	if (second_time)
+		lMusicxmlevents.clearLinks();
+	int nbEvent = lMusicxmlevents.GetCount();
+	for (nr_musicxmlevent = 0; nr_musicxmlevent < nbEvent; nr_musicxmlevent++)
+	{
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nr_musicxmlevent];
+		nb_measure = current_musicxmlevent->stop_measureNr;
+		current_musicxmlevent->nr = nr_musicxmlevent;
+		if (second_time)
+		{
+			current_musicxmlevent->stop_orpheline = true;
+			current_musicxmlevent->stop_index = -1;
+			current_musicxmlevent->will_stop_index = -1;
+		}
+	}
+	if (second_time == false)
+	{
+		c_musicxmlevent last_musicxmlevent;
+		last_musicxmlevent.nr = nr_musicxmlevent + 1;
+		last_musicxmlevent.visible = false;
+		last_musicxmlevent.played = false;
+		last_musicxmlevent.start_measureNr = nb_measure + 1;
+		last_musicxmlevent.stop_measureNr = last_musicxmlevent.start_measureNr;
+		last_musicxmlevent.start_twelve_t = 0;
+		last_musicxmlevent.stop_twelve_t = 0;
+		lMusicxmlevents.Append(last_musicxmlevent);
+		nbEvent++;
+	}
+	int p_MeasureNr = -1;
+	int p_t = -1;
+	int p_order = -1;
+	bool p_tenuto = false;
+	c_musicxmlevent *p_musicxmlevent = NULL;
+	lMusicxmlevents.Sort(musicXmlEventsCompareStop);
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
+	{
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		if (current_musicxmlevent->played)
+		{
+			if ((current_musicxmlevent->stop_measureNr != p_MeasureNr) || (current_musicxmlevent->stop_twelve_t != p_t) || (current_musicxmlevent->stop_order != p_order) || (current_musicxmlevent->tenuto != p_tenuto))
+				p_musicxmlevent = current_musicxmlevent;
+			if (p_musicxmlevent)
+			{
+				lMusicxmlevents.addStop(p_musicxmlevent, current_musicxmlevent->nr);
+				if (p_musicxmlevent != current_musicxmlevent)
+					current_musicxmlevent->stop_orpheline = false;
+			}
+			p_MeasureNr = current_musicxmlevent->stop_measureNr;
+			p_t = current_musicxmlevent->stop_twelve_t;
+			p_order = current_musicxmlevent->stop_order;
+			p_tenuto = current_musicxmlevent->tenuto;
+		}
+	}
+	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
+	p_MeasureNr = -1;
+	p_t = -1;
+	p_order = -1;
+	p_musicxmlevent = NULL;
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
+	{
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		if (current_musicxmlevent->played)
+		{
+			if ((current_musicxmlevent->start_measureNr != p_MeasureNr) || (current_musicxmlevent->start_twelve_t != p_t) || (current_musicxmlevent->start_order != p_order))
+				p_musicxmlevent = current_musicxmlevent;
+			if (p_musicxmlevent)
+				lMusicxmlevents.addStart(p_musicxmlevent, current_musicxmlevent->nr);
+			p_MeasureNr = current_musicxmlevent->start_measureNr;
+			p_t = current_musicxmlevent->start_twelve_t;
+			p_order = current_musicxmlevent->start_order;
+		}
+	}
+	p_musicxmlevent = NULL;
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
+	{
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		if (current_musicxmlevent->played)
+		{
+			if (current_musicxmlevent->nb_starts > 0)
+				p_musicxmlevent = current_musicxmlevent;
+			if ((current_musicxmlevent->nb_stops > 0) && (current_musicxmlevent->tenuto == false) && (p_musicxmlevent != NULL) && (p_musicxmlevent->will_stop_index == -1))
+			{
+				p_musicxmlevent->will_stop_index = current_musicxmlevent->nr;
+				current_musicxmlevent->stop_orpheline = false;
+			}
+		}
+	}
+	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
+	{
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		if ((current_musicxmlevent->played) && (current_musicxmlevent->nb_stops > 0) && ((current_musicxmlevent->tenuto == true) || (current_musicxmlevent->stop_orpheline == true)))
+		{
+			for (int nrEvent_to = nrEvent + 1; nrEvent_to < nbEvent; nrEvent_to++)
+			{
+				c_musicxmlevent *musicxmlevent_to = lMusicxmlevents[nrEvent_to];
+				if ((musicxmlevent_to->nb_starts > 0) && (musicxmlevent_to->start_measureNr == current_musicxmlevent->stop_measureNr) && (musicxmlevent_to->start_twelve_t == current_musicxmlevent->stop_twelve_t))
+				{
+					musicxmlevent_to->stop_index = current_musicxmlevent->nr;
+					current_musicxmlevent->stop_orpheline = false;
+					break;
+				}
+				if (musicxmlevent_to->start_measureNr > current_musicxmlevent->stop_measureNr)
+					break;
+			}
+		}
+	}
+	if (orpheline_musicxmlevents == NULL)
+		return;
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
+	{
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		if ((current_musicxmlevent->played) && (current_musicxmlevent->stop_orpheline))
+		{
+			c_musicxmlevent orpheline_event = current_musicxmlevent->duplicate();
+			orpheline_event.start_measureNr = current_musicxmlevent->stop_measureNr;
+			orpheline_event.start_twelve_t = current_musicxmlevent->stop_twelve_t;
+			orpheline_event.start_order = current_musicxmlevent->stop_order;
+			orpheline_event.stop_measureNr = current_musicxmlevent->stop_measureNr;
+			orpheline_event.stop_twelve_t = current_musicxmlevent->stop_twelve_t + 12;
+			orpheline_event.stop_order = current_musicxmlevent->stop_order;
+			orpheline_event.velocity = 0;
+			orpheline_event.pitch = 0;
+			lMusicxmlevents.addStart(&orpheline_event, -1);
+			orpheline_event.played = true;
+			orpheline_event.visible = true;
+			for (int nrEvent_after = nrEvent + 1; nrEvent_after < nbEvent; nrEvent_after++)
+			{
+				c_musicxmlevent *musicxmlevent_after = lMusicxmlevents[nrEvent_after];
+				if ((musicxmlevent_after->visible == false) || (musicxmlevent_after->nb_starts == 0))
+					continue;
+				if (musicxmlevent_after->start_measureNr < orpheline_event.start_measureNr)
+					continue;
+				if ((musicxmlevent_after->start_measureNr == orpheline_event.start_measureNr) && (musicxmlevent_after->start_twelve_t <= orpheline_event.start_twelve_t))
+					continue;
+				orpheline_event.stop_measureNr = musicxmlevent_after->start_measureNr;
+				orpheline_event.stop_twelve_t = musicxmlevent_after->stop_twelve_t;
+				orpheline_musicxmlevents->push_back(orpheline_event);
+				break;
+			}
+		}
+	}
+}
+typedef void (*linker)(c_musicxmlevents &l, bool second_time, std::vector<c_musicxmlevent> *orpheline_musicxmlevents);
+static double bench_link(linker link, c_musicxmlevents &l)
+{
+	// same sequence as compileMusicxmlevents : link, append the orpheline, link again. Return the time in ms
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<c_musicxmlevent> orpheline_musicxmlevents;
+	link(l, false, &orpheline_musicxmlevents);
+	if (orpheline_musicxmlevents.size() > 0)
+	{
+		for (unsigned int i = 0; i < orpheline_musicxmlevents.size(); i++)
+			l.Append(orpheline_musicxmlevents[i]);
+		link(l, true, NULL);
+	}
+	std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+static void bench_score(c_musicxmlevents &l, int nbEvent)
+{
+	// random score : voices of notes and chords, with graces, tenuto, long notes over the next measures,
+	// hidden and unplayed events, and stops in the middle of the notes of the other voices ( orphan stops )
+	l.Clear();
+	int nbVoice = 1 + rand() % 4;
+	std::vector<int> measure(nbVoice, 1), t(nbVoice, 0);
+	for (int nr = 0; nr < nbEvent;)
+	{
+		int v = rand() % nbVoice;
+		int duration = 12 * (1 + rand() % 8) * ((rand() % 10 == 0) ? 7 : 1);
+		if (rand() % 6 == 0)
+			duration -= 6 * (1 + rand() % 2); // orphan stop, between the starts of the other voices
+		int stop_measureNr = measure[v] + (t[v] + duration) / 192;
+		int stop_t = (t[v] + duration) % 192;
+		int nbNote = (rand() % 4 == 0) ? 1 + rand() % 4 : 1;
+		int order = (rand() % 8 == 0) ? 1 + rand() % 2 : 0;
+		bool tenuto = (rand() % 8 == 0);
+		for (int n = 0; (n < nbNote) && (nr < nbEvent); n++, nr++)
+		{
+			c_musicxmlevent m(1 + v / 2, 1, v, measure[v], measure[v], 0, stop_measureNr, 0, 48 + rand() % 36, 16, 4, 4, 0, order, 0);
+			m.start_twelve_t = t[v];
+			m.stop_twelve_t = stop_t;
+			m.stop_order = order;
+			m.tenuto = tenuto;
+			m.visible = (rand() % 10 != 0);
+			m.played = (rand() % 20 != 0);
+			l.Append(m);
+		}
+		measure[v] = stop_measureNr;
+		t[v] = stop_t;
+	}
+}
+static bool bench_same(c_musicxmlevents &a, c_musicxmlevents &b)
+{
+	if (a.GetCount() != b.GetCount())
+		return false;
+	for (int nr = 0; nr < a.GetCount(); nr++)
+	{
+		c_musicxmlevent *ea = a[nr];
+		c_musicxmlevent *eb = b[nr];
+		if ((ea->nr != eb->nr) || (ea->partNr != eb->partNr) || (ea->voice != eb->voice) || (ea->pitch != eb->pitch)
+			|| (ea->start_measureNr != eb->start_measureNr) || (ea->start_twelve_t != eb->start_twelve_t) || (ea->start_order != eb->start_order)
+			|| (ea->stop_measureNr != eb->stop_measureNr) || (ea->stop_twelve_t != eb->stop_twelve_t) || (ea->stop_order != eb->stop_order)
+			|| (ea->played != eb->played) || (ea->visible != eb->visible) || (ea->tenuto != eb->tenuto) || (ea->velocity != eb->velocity)
+			|| (ea->will_stop_index != eb->will_stop_index) || (ea->stop_index != eb->stop_index) || (ea->stop_orpheline != eb->stop_orpheline)
+			|| (ea->nb_starts != eb->nb_starts) || (ea->nb_stops != eb->nb_stops))
+			return false;
+		for (int i = 0; i < ea->nb_starts; i++)
+		{
+			if (a.getStart(ea, i) != b.getStart(eb, i))
+				return false;
+		}
+		for (int i = 0; i < ea->nb_stops; i++)
+		{
+			if (a.getStop(ea, i) != b.getStop(eb, i))
+				return false;
+		}
+	}
+	return true;
+}
+int main(int argc, char *argv[])
+{
+	int nbScore = (argc > 1) ? atoi(argv[1]) : 300;
+	srand(1);
+	c_musicxmlevents score, a, b;
+	int nbOrphan = 0;
+	for (int n = 0; n < nbScore; n++)
+	{
+		bench_score(score, 20 + rand() % 400);
+		a.Set(score.getEvents(), score.GetCount(), score.getPool(), score.getPoolCount());
+		b.Set(score.getEvents(), score.GetCount(), score.getPool(), score.getPoolCount());
+		bench_link(linkMusicxmlevents, a);
+		bench_link(linkReference, b);
+		if (!bench_same(a, b))
+		{
+			printf("score#%d : the links differ\n", n + 1);
+			return 1;
+		}
+		nbOrphan += a.GetCount() - score.GetCount() - 1;
+	}
+	printf("%d random scores : same events and links ( %d orphan stops )\n", nbScore, nbOrphan);
+	int nbEvents[3] = { 1000, 10000, 100000 };
+	for (int n = 0; n < 3; n++)
+	{
+		bench_score(score, nbEvents[n]);
+		a.Set(score.getEvents(), score.GetCount(), score.getPool(), score.getPoolCount());
+		b.Set(score.getEvents(), score.GetCount(), score.getPool(), score.getPoolCount());
+		double t_new = bench_link(linkMusicxmlevents, a);
+		double t_ref = bench_link(linkReference, b);
+		printf("%6d events : %.1f ms , previous linker %.1f ms%s\n", nbEvents[n], t_new, t_ref, bench_same(a, b) ? "" : " : the links differ");
+	}
+	return 0;
+}
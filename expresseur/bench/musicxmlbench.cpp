@@ -0,0 +1,317 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        musicxmlbench.cpp
+// Purpose:     benchmark of the musicxml loaders /  expresseur V3
+// usage :      musicxmlbench generate <dir> [scale] : corpus of large scores ( .xml and .mxl )
+//              musicxmlbench dom <files>            : load with wxXmlDocument, then the C++ score structure
+//              musicxmlbench stream <files>         : load with the streaming c_musicxml_reader
+//              musicxmlbench check <files>          : both loads must write the same score
+// A .mxl is read from its score entry, as musicxmlscore does ( not in a directory, not the mimetype ).
+// Run one process per loader : the peak memory reported is the one of the process.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include "wx/wxprec.h"
+
+#ifndef WX_PRECOMP
+#include "wx/wx.h"
+#endif
+
+#include "wx/init.h"
+#include "wx/filename.h"
+#include "wx/ffile.h"
+#include "wx/xml/xml.h"
+#include "wx/wfstream.h"
+#include "wx/zipstrm.h"
+#include "wx/stopwatch.h"
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "global.h"
+
+#include "musicxml.h"
+#include "musicxmlreader.h"
+
+static unsigned long g_random = 12345;
+
+static int benchRandom(int n)
+{
+	// deterministic random, to generate the same corpus on all the platforms
+	g_random = g_random * 1103515245 + 12345;
+	return (int)((g_random >> 16) % n);
+}
+static long peakMemory()
+{
+	// peak resident memory of the process, in KB
+#ifdef RUN_WIN
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return (long)(pmc.PeakWorkingSetSize / 1024);
+	return 0;
+#endif
+#ifdef RUN_MAC
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+	return (long)(r.ru_maxrss / 1024);
+#endif
+#ifdef RUN_LINUX
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+	return (long)(r.ru_maxrss);
+#endif
+}
+static void generateNote(wxString *s, int voice, int duration, bool chord)
+{
+	static const char *steps = "CDEFGAB";
+	static const char *syllables[] = { "la", "do", "r\xc3\xa9", "mi &amp; fa", "sol", "si" };
+	s->Append("<note default-x=\"");
+	*s << (10 + benchRandom(300));
+	s->Append("\">\n");
+	if (chord)
+		s->Append("<chord/>\n");
+	if (benchRandom(10) == 0)
+		s->Append("<rest/>\n");
+	else
+	{
+		s->Append("<pitch>\n<step>");
+		*s << steps[benchRandom(7)];
+		s->Append("</step>\n");
+		if (benchRandom(5) == 0)
+			s->Append("<alter>1</alter>\n");
+		s->Append("<octave>");
+		*s << (2 + benchRandom(5));
+		s->Append("</octave>\n</pitch>\n");
+	}
+	s->Append("<duration>");
+	*s << duration;
+	s->Append("</duration>\n<voice>");
+	*s << voice;
+	s->Append("</voice>\n<type>quarter</type>\n<stem>up</stem>\n");
+	if (benchRandom(6) == 0)
+		s->Append("<notations>\n<tied type=\"start\"/>\n<articulations>\n<staccato placement=\"above\"/>\n</articulations>\n</notations>\n");
+	if (benchRandom(4) == 0)
+	{
+		s->Append("<lyric number=\"1\">\n<syllabic>single</syllabic>\n<text>");
+		s->Append(wxString::FromUTF8(syllables[benchRandom(6)]));
+		s->Append("</text>\n</lyric>\n");
+	}
+	s->Append("</note>\n");
+}
+static bool generateScore(wxString filename, int nbParts, int nbMeasures)
+{
+	// write a score of nbParts * nbMeasures, in an .xml and an .mxl file
+	wxFFile f(filename, "w");
+	if (!f.IsOpened())
+		return false;
+	wxString s;
+	s << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n";
+	s << "<!DOCTYPE score-partwise PUBLIC \"-//Recordare//DTD MusicXML 3.0 Partwise//EN\" \"http://www.musicxml.org/dtds/partwise.dtd\">\n";
+	s << "<score-partwise version=\"3.0\">\n<work>\n<work-title>Benchmark " << nbParts << "x" << nbMeasures << "</work-title>\n</work>\n";
+	s << "<part-list>\n";
+	for (int p = 1; p <= nbParts; p++)
+		s << "<score-part id=\"P" << p << "\">\n<part-name>Part " << p << "</part-name>\n</score-part>\n";
+	s << "</part-list>\n";
+	f.Write(s, wxConvUTF8);
+	for (int p = 1; p <= nbParts; p++)
+	{
+		s.Empty();
+		s << "<part id=\"P" << p << "\">\n";
+		for (int m = 1; m <= nbMeasures; m++)
+		{
+			s << "<measure number=\"" << m << "\" width=\"" << (150 + benchRandom(150)) << "\">\n";
+			if (m == 1)
+				s << "<attributes>\n<divisions>4</divisions>\n<key>\n<fifths>0</fifths>\n</key>\n<time>\n<beats>4</beats>\n<beat-type>4</beat-type>\n</time>\n<clef>\n<sign>G</sign>\n<line>2</line>\n</clef>\n</attributes>\n";
+			if (benchRandom(8) == 0)
+				s << "<direction placement=\"below\">\n<direction-type>\n<dynamics>\n<mf/>\n</dynamics>\n</direction-type>\n<sound dynamics=\"80\"/>\n</direction>\n";
+			if (benchRandom(4) == 0)
+				s << "<harmony>\n<root>\n<root-step>C</root-step>\n</root>\n<kind>major</kind>\n</harmony>\n";
+			for (int voice = 1; voice <= 2; voice++)
+			{
+				if (voice == 2)
+					s << "<backup>\n<duration>16</duration>\n</backup>\n";
+				for (int beat = 0; beat < 4; beat++)
+				{
+					generateNote(&s, voice, 4, false);
+					int nbChord = benchRandom(3);
+					for (int c = 0; c < nbChord; c++)
+						generateNote(&s, voice, 4, true);
+				}
+			}
+			s << "</measure>\n";
+		}
+		s << "</part>\n";
+		f.Write(s, wxConvUTF8);
+	}
+	f.Write(wxString("</score-partwise>\n"));
+	f.Close();
+
+	// same score, compressed
+	wxFileName fxml(filename);
+	wxFileName fmxl(filename);
+	fmxl.SetExt(SUFFIXE_MUSICMXL);
+	wxFFileOutputStream out(fmxl.GetFullPath());
+	wxZipOutputStream zip(out);
+	wxFFileInputStream in(filename);
+	if ((!out.IsOk()) || (!in.IsOk()))
+		return false;
+	zip.PutNextEntry(fxml.GetFullName());
+	zip.Write(in);
+	return zip.Close();
+}
+static bool nextScoreEntry(wxZipInputStream *zip)
+{
+	// position the zip on the score entry of the mxl, as musicxmlscore : not in a directory, not the mimetype
+	wxZipEntry *zipEntry = zip->GetNextEntry();
+	while (zipEntry != NULL)
+	{
+		wxFileName ffzip(zipEntry->GetName());
+		delete zipEntry;
+		if ((ffzip.GetDirCount() == 0) && (ffzip.GetFullName() != "mimetype"))
+			return true;
+		zipEntry = zip->GetNextEntry();
+	}
+	return false;
+}
+static c_score_partwise *loadDom(wxInputStream *in)
+{
+	// load with the wxXmlDocument DOM, then the C++ score structure
+	wxXmlDocument *xmlDoc = new wxXmlDocument();
+	if (!xmlDoc->Load(*in))
+	{
+		delete xmlDoc;
+		return NULL;
+	}
+	c_score_partwise *score = NULL;
+	if (xmlDoc->GetRoot()->GetName() == "score-partwise")
+		score = new c_score_partwise(xmlDoc->GetRoot());
+	delete xmlDoc;
+	return score;
+}
+static c_score_partwise *loadStream(wxInputStream *in, wxString filename, long long *nbBytes)
+{
+	// load with the streaming reader
+	c_musicxml_reader reader(in);
+	c_score_partwise *score = reader.load();
+	*nbBytes = reader.nbBytes;
+	if (score == NULL)
+		wxPrintf("%s : %s\n", filename, reader.error);
+	return score;
+}
+static c_score_partwise *load(wxString filename, bool dom, long long *nbBytes)
+{
+	// load the file, or the score entry of the mxl
+	wxFileName f(filename);
+	wxFFileInputStream in(filename);
+	if (!in.IsOk())
+		return NULL;
+	if (f.GetExt() != SUFFIXE_MUSICMXL)
+		return dom ? loadDom(&in) : loadStream(&in, filename, nbBytes);
+	wxZipInputStream zip(in);
+	if ((!zip.IsOk()) || (!nextScoreEntry(&zip)))
+		return NULL;
+	return dom ? loadDom(&zip) : loadStream(&zip, filename, nbBytes);
+}
+static int countMeasures(c_score_partwise *score)
+{
+	int nb = 0;
+	for (l_part::iterator iter = score->parts.begin(); iter != score->parts.end(); ++iter)
+		nb += (*iter)->measures.GetCount();
+	return nb;
+}
+static bool sameFile(wxString f1, wxString f2)
+{
+	wxFFile a(f1, "rb");
+	wxFFile b(f2, "rb");
+	wxString sa, sb;
+	if ((!a.IsOpened()) || (!b.IsOpened()) || (!a.ReadAll(&sa)) || (!b.ReadAll(&sb)))
+		return false;
+	return (sa == sb);
+}
+
+int main(int argc, char **argv)
+{
+	wxInitializer initializer;
+	if ((!initializer) || (argc < 3))
+	{
+		printf("usage : musicxmlbench generate <dir> [scale] | dom <files> | stream <files> | check <files>\n");
+		return 1;
+	}
+	wxString mode(argv[1]);
+	if (mode == "generate")
+	{
+		// corpus of large scores : parts x measures
+		int sizes[][2] = { { 4, 200 }, { 8, 500 }, { 16, 1000 }, { 32, 1000 } };
+		long scale = 1;
+		if (argc > 3)
+			wxString(argv[3]).ToLong(&scale);
+		wxFileName::Mkdir(argv[2], wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+		for (int i = 0; i < 4; i++)
+		{
+			wxFileName f(argv[2], wxString::Format("bench_%dx%d.%s", sizes[i][0], sizes[i][1] * (int)scale, SUFFIXE_MUSICXML));
+			if (!generateScore(f.GetFullPath(), sizes[i][0], sizes[i][1] * (int)scale))
+			{
+				wxPrintf("error writing %s\n", f.GetFullPath());
+				return 1;
+			}
+			wxPrintf("%s : %lld KB\n", f.GetFullPath(), (long long)(f.GetSize().GetValue() / 1024));
+		}
+		return 0;
+	}
+	int ret = 0;
+	for (int i = 2; i < argc; i++)
+	{
+		wxString filename(argv[i]);
+		if (mode == "check")
+		{
+			long long nbBytes = 0;
+			c_score_partwise *dom = load(filename, true, &nbBytes);
+			c_score_partwise *stream = load(filename, false, &nbBytes);
+			bool ok = ((dom != NULL) && (stream != NULL));
+			if (ok)
+			{
+				wxString fdom = wxFileName::CreateTempFileName("musicxmlbench");
+				wxString fstream = wxFileName::CreateTempFileName("musicxmlbench");
+				dom->write(fdom, false);
+				stream->write(fstream, false);
+				ok = sameFile(fdom, fstream);
+				wxRemoveFile(fdom);
+				wxRemoveFile(fstream);
+			}
+			wxPrintf("%s : %s\n", filename, ok ? "same score" : "DIFFERENT");
+			if (!ok)
+				ret = 1;
+			if (dom)
+				delete dom;
+			if (stream)
+				delete stream;
+			continue;
+		}
+		wxStopWatch sw;
+		long long nbBytes = 0;
+		c_score_partwise *score = load(filename, (mode == "dom"), &nbBytes);
+		long ms = sw.Time();
+		if (score == NULL)
+		{
+			wxPrintf("%s : load error\n", filename);
+			ret = 1;
+			continue;
+		}
+		wxPrintf("%s %s : %ld ms, %d measures, peak memory %ld KB", mode, filename, ms, countMeasures(score), peakMemory());
+		if (nbBytes > 0)
+			wxPrintf(", %lld KB streamed", nbBytes / 1024);
+		wxPrintf("\n");
+		delete score;
+	}
+	return ret;
+}
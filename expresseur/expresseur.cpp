@@ -54,6 +54,10 @@
 #include "wx/stdpaths.h"
 #include "wx/dir.h"
 #include "wx/dynlib.h"
+#include "wx/hashmap.h"
+
+#include <vector>
+
 #include "MNL.h"
 
 #include "global.h"
@@ -66,6 +70,7 @@
 #include "midishortcut.h"
 #include "expression.h"
 #include "logerror.h"
+#include "statistics.h"
 #include "emptyscore.h"
 #include "bitmapscore.h"
 #include "musicxml.h"
@@ -145,6 +150,7 @@ enum
 	ID_MAIN_SETTING_SAVEAS,
 	ID_MAIN_RESET,
 	ID_MAIN_LOG,
+	ID_MAIN_STATISTICS,
 	ID_MAIN_UPDATE,
 
 	ID_MAIN_TIMER,
@@ -211,6 +217,7 @@ EVT_MENU(ID_MAIN_EXPRESSION, Expresseur::OnExpression)
 EVT_MENU(ID_MAIN_LUAFILE, Expresseur::OnLuafile)
 EVT_MENU(ID_MAIN_RESET, Expresseur::OnReset)
 EVT_MENU(ID_MAIN_LOG, Expresseur::OnLog)
+EVT_MENU(ID_MAIN_STATISTICS, Expresseur::OnStatistics)
 EVT_MENU(ID_MAIN_SETTING_OPEN, Expresseur::OnSettingOpen)
 EVT_MENU(ID_MAIN_SETTING_SAVE, Expresseur::OnSettingSave)
 EVT_MENU(ID_MAIN_SETTING_SAVEAS, Expresseur::OnSettingSaveas)
@@ -300,6 +307,7 @@ Expresseur::Expresseur(wxFrame* parent,wxWindowID id,const wxString& title,const
 	mMixer = NULL;
 	mExpression = NULL;
 	mLog = NULL;
+	mStatistics = NULL;
 	mMidishortcut = NULL;
 	for (int i = 0; i < MAX_KEYS; i++)
 		ckeys[i] = 0;
@@ -425,6 +433,7 @@ Expresseur::Expresseur(wxFrame* parent,wxWindowID id,const wxString& title,const
 #endif
 	settingMenu->Append(ID_MAIN_LUAFILE, _("LUA Files..."));
 	settingMenu->Append(ID_MAIN_LOG, _("Log"));
+	settingMenu->Append(ID_MAIN_STATISTICS, _("Statistics"), _("Latency of the Midi processing, from the Midi-in to the Midi-out"));
 	//settingMenu->Append(ID_MAIN_TEST, "Test\tCTRL+T");
 	settingMenu->AppendSeparator();
 	settingMenu->AppendCheckItem(ID_MAIN_LOCAL_OFF, _("Send MIDI local-off"), _("Send local-off on MIDI-out opening, i.e. to unlink keyboard and soud-generator on electronic piano"));
@@ -548,8 +557,10 @@ Expresseur::~Expresseur()
 	}
 
 	delete mLog;
+	delete mStatistics;
 	delete mTextscore;
 	delete mViewerscore;
+	musicxmlscore::clearCompile();
 	delete mMixer;
 	delete mMidishortcut;
 	delete mExpression;
@@ -721,8 +732,9 @@ bool Expresseur::timerTask(bool compile, bool longWait)
 	{
 		if ((quick) || (longWait))
 		{
+			static int callScoreGetPosition = basslua_prepare(moduleScore, functionScoreGetPosition, ">ii");
 			int nrEvent, playing;
-			basslua_call(moduleScore, functionScoreGetPosition, ">ii", &nrEvent, &playing);
+			basslua_invoke(callScoreGetPosition, &nrEvent, &playing);
 			mViewerscore->setPosition(nrEvent, (playing>0) , quick);
 		}
 		break;
@@ -736,6 +748,8 @@ bool Expresseur::timerTask(bool compile, bool longWait)
 		// scan pendings useful events from LUA
 		if (mLog && (mLog->IsVisible()))
 			mLog->scanLog(); // updates any log from LUA to the window of this GUI
+		if (mStatistics && (mStatistics->IsVisible()))
+			mStatistics->scanStatistics(); // updates the latency measured by LUA
 		if (mMixer && (mMixer->IsVisible()))
 			mMixer->scanVolume(); // updates the volume of the mixer of thuis GUI, with the values in LUA
 		if (mExpression && (mExpression->IsVisible()))
@@ -1606,6 +1620,17 @@ void Expresseur::OnLog(wxCommandEvent& WXUNUSED(event))
 	mLog = new logerror(this, wxID_ANY, _("log !!! timeline bottom->up : last-event is the first-line !!!"));
 	mLog->Show();
 }
+void Expresseur::OnStatistics(wxCommandEvent& WXUNUSED(event))
+{
+	// display the latency measures
+	if (mStatistics != NULL)
+	{
+		delete mStatistics;
+	}
+	mStatistics = NULL;
+	mStatistics = new statistics(this, wxID_ANY, _("Statistics"));
+	mStatistics->Show();
+}
 void Expresseur::OnSettingOpen(wxCommandEvent& WXUNUSED(event))
 {
 	wxFileDialog
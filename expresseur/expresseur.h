@@ -62,6 +62,7 @@ public:
 	void OnLuafile(wxCommandEvent& WXUNUSED(event));
 	void OnReset(wxCommandEvent& WXUNUSED(event));
 	void OnLog(wxCommandEvent& WXUNUSED(event));
+	void OnStatistics(wxCommandEvent& WXUNUSED(event));
 	void OnSettingOpen(wxCommandEvent& WXUNUSED(event));
 	void OnSettingSave(wxCommandEvent& WXUNUSED(event));
 	void OnSettingSaveas(wxCommandEvent& WXUNUSED(event));
@@ -93,6 +94,7 @@ public:
 	midishortcut *mMidishortcut;
 	expression *mExpression;
 	logerror *mLog;
+	statistics *mStatistics;
 
 private:
 	bool layoutWaiting;
@@ -109,6 +109,7 @@
 #define ID_MUSICXML 7000
 #define ID_LOGERROR 8000
 #define ID_AUDIO 9000
+#define ID_STATISTICS 10000
 
 #define SUFFIXE_MUSICXML "xml"
 #define SUFFIXE_MUSICMXL "mxl"
@@ -147,6 +148,8 @@ enum{ EMPTYVIEWER, BITMAPVIEWER, MUSICXMLVIEWER };
     #define RUN_WIN 1
 #elif defined(__APPLE__)
     #define RUN_MAC 1
+#elif defined(__linux__)
+    #define RUN_LINUX 1
 #else
     #error Unsupported platform
 #endif
@@ -156,8 +156,11 @@ void mixer::scanVolume()
 {
 	// scan the volume which are currently in place, and update the GUI if necessary
 	// this scan is called periodically by a global recurrent timer on main thread
+	// the calls are prepared once, as this scan is frequent
+	static int callGetVolume = basslua_prepare(moduleLuabass, soutGetVolume, ">i");
+	static int callGetTrackVolume = basslua_prepare(moduleLuabass, soutGetTrackVolume, "i>i");
 	int v;
-	basslua_call(moduleLuabass, soutGetVolume , ">i", &v);
+	basslua_invoke(callGetVolume, &v);
 	if (v != mainVolume)
 	{
 		mainVolume = v;
@@ -165,7 +168,7 @@ void mixer::scanVolume()
 	}
 	for (int nrTrack = 0; nrTrack < nbTrack; nrTrack++)
 	{
-		basslua_call(moduleLuabass, soutGetTrackVolume, "i>i", nrTrack , &v);
+		basslua_invoke(callGetTrackVolume, nrTrack , &v);
 		if (v != trackVolume[nrTrack])
 		{
 			trackVolume[nrTrack] = v;
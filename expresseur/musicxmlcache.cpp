@@ -0,0 +1,318 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        musicxmlcache.cpp
+// Purpose:     cache of the compiled musicxml scores /  expresseur V3
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include "wx/wxprec.h"
+
+#ifdef __BORLANDC__
+#pragma hdrstop
+#endif
+
+#ifndef WX_PRECOMP
+#include "wx/wx.h"
+#endif
+
+#include "wx/filename.h"
+#include "wx/ffile.h"
+#include "wx/dir.h"
+#include "wx/filefn.h"
+#include "wx/dynarray.h"
+#include "wx/arrstr.h"
+#include "wx/stream.h"
+#include "wx/hashmap.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "global.h"
+
+#ifdef RUN_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "basslua.h"
+
+#include "musicxml.h"
+#include "musicxmlcompile.h"
+#include "musicxmlreader.h"
+#include "musicxmlcache.h"
+
+static long long align8(long long n)
+{
+	return ((n + 7) / 8) * 8;
+}
+
+c_musicxml_cache::c_musicxml_cache(unsigned long long ikey)
+{
+	key = ikey;
+	wxFileName f;
+	f.SetPath(getDir());
+	f.SetName(wxString::Format("%016llx", key));
+	f.SetExt(MUSICXMLCACHE_SUFFIXE);
+	filename = f.GetFullPath();
+}
+c_musicxml_cache::~c_musicxml_cache()
+{
+	unmap();
+}
+wxString c_musicxml_cache::getDir()
+{
+	wxFileName f;
+	f.AssignDir(wxFileName::GetTempDir());
+	f.AppendDir(MUSICXMLCACHE_DIR);
+	return f.GetPath();
+}
+bool c_musicxml_cache::map()
+{
+	// map the file of the entry, read-only
+#ifdef RUN_WIN
+	hfile = CreateFileW(filename.wc_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hfile == INVALID_HANDLE_VALUE)
+	{
+		hfile = NULL;
+		return false;
+	}
+	LARGE_INTEGER l;
+	if ((!GetFileSizeEx(hfile, &l)) || (l.QuadPart < (LONGLONG)sizeof(T_musicxmlcache_header)) || (l.QuadPart > MUSICXMLCACHE_MAX_ENTRY))
+		return false;
+	size = (size_t)(l.QuadPart);
+	hmap = CreateFileMappingW(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hmap == NULL)
+		return false;
+	data = (const char *)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+	return (data != NULL);
+#else
+	int fd = open(filename.fn_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(T_musicxmlcache_header)) || (st.st_size > MUSICXMLCACHE_MAX_ENTRY))
+	{
+		close(fd);
+		return false;
+	}
+	size = (size_t)(st.st_size);
+	void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	data = (const char *)p;
+	return true;
+#endif
+}
+void c_musicxml_cache::unmap()
+{
+	header = NULL;
+#ifdef RUN_WIN
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (hmap != NULL)
+		CloseHandle(hmap);
+	if (hfile != NULL)
+		CloseHandle(hfile);
+	hmap = NULL;
+	hfile = NULL;
+#else
+	if (data != NULL)
+		munmap((void *)data, size);
+#endif
+	data = NULL;
+	size = 0;
+}
+bool c_musicxml_cache::check()
+{
+	// validate the entry mapped : versions, key, sections inside the file, checksum
+	const T_musicxmlcache_header *h = (const T_musicxmlcache_header *)data;
+	if ((memcmp(h->magic, MUSICXMLCACHE_MAGIC, 8) != 0)
+		|| (h->version != MUSICXMLCACHE_VERSION)
+		|| (h->sizeHeader != (int)sizeof(T_musicxmlcache_header))
+		|| (h->sizeEvent != (int)sizeof(c_musicxmlevent))
+		|| (h->luaVersion != BASSLUA_SCORE_VERSION)
+		|| (h->key != key)
+		|| (h->size != (long long)size))
+		return false;
+	if ((h->nbEvents < 0) || (h->nbPool < 0) || (h->nbStrings < 0) || (h->sizeStrings < 0) || (h->nbMarkList < 0) || (h->nbMeasureList < 0) || (h->sizeLua < (int)sizeof(T_basslua_score_header)) || (h->sizeXml < 0))
+		return false;
+	long long sections[7][2] = {
+		{ h->offsetEvents, (long long)(h->nbEvents) * (long long)sizeof(c_musicxmlevent) },
+		{ h->offsetPool, (long long)(h->nbPool) * (long long)sizeof(int) },
+		{ h->offsetStrings, h->sizeStrings },
+		{ h->offsetMarkList, (long long)(h->nbMarkList) * (long long)sizeof(int) },
+		{ h->offsetMeasureList, (long long)(h->nbMeasureList) * (long long)sizeof(int) },
+		{ h->offsetLua, h->sizeLua },
+		{ h->offsetXml, h->sizeXml } };
+	for (int i = 0; i < 7; i++)
+	{
+		if ((sections[i][0] < (long long)sizeof(T_musicxmlcache_header)) || ((sections[i][0] % 8) != 0) || (sections[i][0] + sections[i][1] > h->size))
+			return false;
+	}
+	int nbStrings = 0;
+	for (int i = 0; i < h->sizeStrings; i++)
+	{
+		if (data[h->offsetStrings + i] == '\0')
+			nbStrings++;
+	}
+	if ((nbStrings != h->nbStrings) || ((h->sizeStrings > 0) && (data[h->offsetStrings + h->sizeStrings - 1] != '\0')))
+		return false;
+	// links of the events inside the pool
+	const c_musicxmlevent *e = (const c_musicxmlevent *)(data + h->offsetEvents);
+	for (int nrEvent = 0; nrEvent < h->nbEvents; nrEvent++, e++)
+	{
+		if ((e->nb_starts < 0) || (e->nb_stops < 0)
+			|| ((e->nb_starts > 0) && ((e->starts < 0) || (e->starts + e->nb_starts > h->nbPool)))
+			|| ((e->nb_stops > 0) && ((e->stops < 0) || (e->stops + e->nb_stops > h->nbPool)))
+			|| (e->text < 0) || (e->text > h->nbStrings) || (e->lua < 0) || (e->lua > h->nbStrings))
+			return false;
+	}
+	unsigned long long checksum = c_musicxml_reader::hashBytes(XMLREADER_HASH_SEED, data + sizeof(T_musicxmlcache_header), size - sizeof(T_musicxmlcache_header));
+	return (checksum == h->checksum);
+}
+bool c_musicxml_cache::load()
+{
+	// map the entry of the key. Return false if there is no valid entry
+	unmap();
+	if (!wxFileExists(filename))
+		return false;
+	if ((!map()) || (!check()))
+	{
+		unmap();
+		wxRemoveFile(filename);
+		return false;
+	}
+	header = (const T_musicxmlcache_header *)data;
+	// most recently used
+	wxFileName(filename).Touch();
+	return true;
+}
+bool c_musicxml_cache::writeXml(wxString xmlfile)
+{
+	// write the xml to display, from the entry loaded
+	if (header == NULL)
+		return false;
+	wxFFile f(xmlfile, "wb");
+	if (!f.IsOpened())
+		return false;
+	return (f.Write(data + header->offsetXml, header->sizeXml) == (size_t)(header->sizeXml));
+}
+bool c_musicxml_cache::save(const c_musicxmlevents &events, const wxArrayInt &markList, const wxArrayInt &measureList, const char *lua, int sizeLua, wxString xmlfile)
+{
+	// write the entry of the key, from the compiled score
+	unmap();
+	if (!wxFileName::Mkdir(getDir(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL))
+		return false;
+
+	wxFFile fxml(xmlfile, "rb");
+	if (!fxml.IsOpened())
+		return false;
+	long long sizeXml = fxml.Length();
+	if ((sizeXml < 0) || (sizeXml > MUSICXMLCACHE_MAX_ENTRY))
+		return false;
+	std::string strings;
+	for (int i = 1; i < events.getStringsCount(); i++)
+	{
+		strings += (const char *)(events.getString(i).utf8_str());
+		strings += '\0';
+	}
+
+	T_musicxmlcache_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MUSICXMLCACHE_MAGIC, 8);
+	h.version = MUSICXMLCACHE_VERSION;
+	h.sizeHeader = sizeof(T_musicxmlcache_header);
+	h.sizeEvent = sizeof(c_musicxmlevent);
+	h.luaVersion = BASSLUA_SCORE_VERSION;
+	h.key = key;
+	h.nbEvents = events.GetCount();
+	h.nbPool = events.getPoolCount();
+	h.nbStrings = events.getStringsCount() - 1;
+	h.sizeStrings = strings.size();
+	h.nbMarkList = markList.GetCount();
+	h.nbMeasureList = measureList.GetCount();
+	h.sizeLua = sizeLua;
+	h.sizeXml = (int)sizeXml;
+	h.offsetEvents = align8(sizeof(T_musicxmlcache_header));
+	h.offsetPool = align8(h.offsetEvents + (long long)(h.nbEvents) * sizeof(c_musicxmlevent));
+	h.offsetStrings = align8(h.offsetPool + (long long)(h.nbPool) * sizeof(int));
+	h.offsetMarkList = align8(h.offsetStrings + h.sizeStrings);
+	h.offsetMeasureList = align8(h.offsetMarkList + (long long)(h.nbMarkList) * sizeof(int));
+	h.offsetLua = align8(h.offsetMeasureList + (long long)(h.nbMeasureList) * sizeof(int));
+	h.offsetXml = align8(h.offsetLua + h.sizeLua);
+	h.size = h.offsetXml + h.sizeXml;
+	if (h.size > MUSICXMLCACHE_MAX_ENTRY)
+		return false;
+
+	// the entry is built in memory, then written in one file renamed at the end
+	std::vector<char> buffer(h.size, 0);
+	char *p = buffer.data();
+	if (h.nbEvents > 0)
+		memcpy(p + h.offsetEvents, events.getEvents(), h.nbEvents * sizeof(c_musicxmlevent));
+	if (h.nbPool > 0)
+		memcpy(p + h.offsetPool, events.getPool(), h.nbPool * sizeof(int));
+	if (h.sizeStrings > 0)
+		memcpy(p + h.offsetStrings, strings.data(), h.sizeStrings);
+	int *l = (int *)(p + h.offsetMarkList);
+	for (int i = 0; i < h.nbMarkList; i++)
+		l[i] = markList[i];
+	l = (int *)(p + h.offsetMeasureList);
+	for (int i = 0; i < h.nbMeasureList; i++)
+		l[i] = measureList[i];
+	memcpy(p + h.offsetLua, lua, sizeLua);
+	if ((h.sizeXml > 0) && (fxml.Read(p + h.offsetXml, h.sizeXml) != (size_t)(h.sizeXml)))
+		return false;
+	fxml.Close();
+	h.checksum = c_musicxml_reader::hashBytes(XMLREADER_HASH_SEED, p + sizeof(T_musicxmlcache_header), h.size - sizeof(T_musicxmlcache_header));
+	memcpy(p, &h, sizeof(h));
+
+	wxString tmpname = filename + ".tmp";
+	wxFFile f(tmpname, "wb");
+	if (!f.IsOpened())
+		return false;
+	bool ok = (f.Write(p, h.size) == (size_t)(h.size));
+	ok = f.Close() && ok;
+	if ((!ok) || (!wxRenameFile(tmpname, filename, true)))
+	{
+		wxRemoveFile(tmpname);
+		return false;
+	}
+	prune();
+	return true;
+}
+static bool olderFile(const std::pair<time_t, wxString> &a, const std::pair<time_t, wxString> &b)
+{
+	return (a.first < b.first);
+}
+void c_musicxml_cache::prune()
+{
+	// remove the least recently used entries, over MUSICXMLCACHE_MAX_TOTAL
+	wxArrayString files;
+	wxDir::GetAllFiles(getDir(), &files, wxString("*.") + MUSICXMLCACHE_SUFFIXE, wxDIR_FILES);
+	std::vector< std::pair<time_t, wxString> > entries;
+	long long total = 0;
+	for (unsigned int i = 0; i < files.GetCount(); i++)
+	{
+		wxFileName f(files[i]);
+		total += f.GetSize().GetValue();
+		entries.push_back(std::make_pair(f.GetModificationTime().GetTicks(), files[i]));
+	}
+	if (total <= MUSICXMLCACHE_MAX_TOTAL)
+		return;
+	std::sort(entries.begin(), entries.end(), olderFile);
+	for (unsigned int i = 0; (i < entries.size()) && (total > MUSICXMLCACHE_MAX_TOTAL); i++)
+	{
+		total -= wxFileName(entries[i].second).GetSize().GetValue();
+		wxRemoveFile(entries[i].second);
+	}
+}
@@ -0,0 +1,78 @@
+// update : 16/10/2026
+
+#ifndef DEF_MUSICXMLCACHE
+
+#define DEF_MUSICXMLCACHE
+
+#define MUSICXMLCACHE_VERSION 1 // to increment each time the compilation of the scores changes
+#define MUSICXMLCACHE_MAGIC "EXPCACHE"
+#define MUSICXMLCACHE_DIR "expresseur_cache" // in the temp directory
+#define MUSICXMLCACHE_SUFFIXE "cache"
+#define MUSICXMLCACHE_MAX_ENTRY (64 * 1024 * 1024) // a bigger compiled score is not cached
+#define MUSICXMLCACHE_MAX_TOTAL (256 * 1024 * 1024) // the least recently used entries are removed over this size
+
+// header of an entry of the cache. The sections follow, at the offsets, aligned on 8 bytes :
+// events ( c_musicxmlevent ), pool of starts/stops ( int ), strings ( '\0' separated ),
+// markList ( int ), measureList ( int ), events packed for LUA ( T_basslua_score_header ), xml to display
+typedef struct
+{
+	char magic[8];
+	int version; // MUSICXMLCACHE_VERSION
+	int sizeHeader; // sizeof(T_musicxmlcache_header)
+	int sizeEvent; // sizeof(c_musicxmlevent)
+	int luaVersion; // BASSLUA_SCORE_VERSION
+	unsigned long long key; // hash of the source xml, of the marks, and of the versions
+	unsigned long long checksum; // hash of the bytes after the header
+	long long size; // size of the file
+	long long offsetEvents;
+	long long offsetPool;
+	long long offsetStrings;
+	long long offsetMarkList;
+	long long offsetMeasureList;
+	long long offsetLua;
+	long long offsetXml;
+	int nbEvents;
+	int nbPool;
+	int nbStrings; // without the empty string of id 0
+	int sizeStrings;
+	int nbMarkList;
+	int nbMeasureList;
+	int sizeLua;
+	int sizeXml;
+} T_musicxmlcache_header;
+
+// cache of the compiled scores, in the temp directory : one memory-mapped file per key
+class c_musicxml_cache
+{
+public:
+	c_musicxml_cache(unsigned long long ikey);
+	~c_musicxml_cache();
+	bool load(); // map and validate the entry of the key
+	bool save(const c_musicxmlevents &events, const wxArrayInt &markList, const wxArrayInt &measureList, const char *lua, int sizeLua, wxString xmlfile);
+	// sections of the entry loaded
+	const T_musicxmlcache_header *header = NULL;
+	const c_musicxmlevent *getEvents() { return (const c_musicxmlevent *)(data + header->offsetEvents); }
+	const int *getPool() { return (const int *)(data + header->offsetPool); }
+	const char *getStrings() { return data + header->offsetStrings; }
+	const int *getMarkList() { return (const int *)(data + header->offsetMarkList); }
+	const int *getMeasureList() { return (const int *)(data + header->offsetMeasureList); }
+	const char *getLua() { return data + header->offsetLua; }
+	bool writeXml(wxString xmlfile);
+	static wxString getDir();
+
+private:
+	unsigned long long key;
+	wxString filename;
+	const char *data = NULL;
+	size_t size = 0;
+#ifdef RUN_WIN
+	void *hfile = NULL;
+	void *hmap = NULL;
+#endif
+	bool map();
+	void unmap();
+	bool check();
+	static void prune();
+};
+
+#endif
@@ -30,6 +30,17 @@
 #include "wx/dynarray.h"
 #include "wx/arrstr.h"
 #include "wx/textfile.h"
+#include "wx/stream.h"
+#include "wx/hashmap.h"
+#include "wx/thread.h"
+#include "wx/stopwatch.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <algorithm>
+
 #include "global.h"
 
 #include "luabass.h"
@@ -37,6 +48,8 @@
 
 #include "musicxml.h"
 #include "musicxmlcompile.h"
+#include "musicxmlreader.h"
+#include "musicxmlcache.h"
 
 
 //#include <wx/arrimpl.cpp>
@@ -46,7 +59,6 @@
 #include <wx/listimpl.cpp>
 WX_DEFINE_LIST(l_measureMark);
 WX_DEFINE_LIST(l_ornament);
-WX_DEFINE_LIST(l_musicxmlevent);
 WX_DEFINE_LIST(l_arpeggiate_toapply);
 enum ornamentType
 {
@@ -119,11 +131,9 @@ char const *ornamentName[] =
 #define PART_VISIBLE "visible"
 #define PART_NOT_VISIBLE "not visible"
 
-int musicXmlEventsCompareStart(const void *arg1, const void *arg2)
+int musicXmlEventsCompareStart(const c_musicxmlevent *r1, const c_musicxmlevent *r2)
 {
-	// funtion used to sort the list of musicxmlevent, using start time : l_musicxmlevent
-	c_musicxmlevent *r1 = *(c_musicxmlevent**)arg1;
-	c_musicxmlevent *r2 = *(c_musicxmlevent**)arg2;
+	// funtion used to sort the musicxmlevents, using start time
 	if (r1->start_measureNr < r2->start_measureNr)
 		return -1;
 	if (r1->start_measureNr >r2->start_measureNr)
@@ -169,11 +179,9 @@ int musicXmlEventsCompareStart(const void *arg1, const void *arg2)
 
 	return 0;
 }
-int musicXmlEventsCompareStop(const void *arg1, const void *arg2)
+int musicXmlEventsCompareStop(const c_musicxmlevent *r1, const c_musicxmlevent *r2)
 {
-	// funtion used to sort the list of c_musicxmlevent, using stop time : l_musicxmlevent
-	c_musicxmlevent *r1 = *(c_musicxmlevent**)arg1;
-	c_musicxmlevent *r2 = *(c_musicxmlevent**)arg2;
+	// funtion used to sort the musicxmlevents, using stop time
 
 	if (r1->stop_measureNr < r2->stop_measureNr)
 		return -1;
@@ -256,19 +264,88 @@ int arpeggiateCompare(const void *pa, const void *pb)
 		return -1;
 	if (ppa->nr > ppb->nr)
 		return 1;
-	if (ppa->musicxmlevent->pitch < ppb->musicxmlevent->pitch)
+	if (ppa->pitch < ppb->pitch)
 		return ((ppa->down && !(ppa->before)) || (!(ppa->down) && ppa->before) ? 1 : -1);
-	if (ppa->musicxmlevent->pitch > ppb->musicxmlevent->pitch)
+	if (ppa->pitch > ppb->pitch)
 		return ((ppa->down && !(ppa->before)) || (!(ppa->down) && ppa->before) ? -1 : 1);
 	return 0;
 }
+c_musicxmlevents::c_musicxmlevents()
+{
+	strings.Add(wxEmptyString);
+}
+void c_musicxmlevents::Clear()
+{
+	events.clear();
+	pool.clear();
+	strings.Clear();
+	stringIds.clear();
+	strings.Add(wxEmptyString);
+}
+void c_musicxmlevents::Set(const c_musicxmlevent *e, int nbEvents, const int *p, int nbPool)
+{
+	Clear();
+	events.assign(e, e + nbEvents);
+	pool.assign(p, p + nbPool);
+}
+void c_musicxmlevents::Sort(musicxmleventCompare compare)
+{
+	// stable sort of an index, then one move of the records in this order
+	int nb = events.size();
+	std::vector<int> order(nb);
+	for (int i = 0; i < nb; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [this, compare](int a, int b) { return (compare(&(events[a]), &(events[b])) < 0); });
+	std::vector<c_musicxmlevent> sorted;
+	sorted.reserve(nb);
+	for (int i = 0; i < nb; i++)
+		sorted.push_back(events[order[i]]);
+	events.swap(sorted);
+}
+void c_musicxmlevents::add(int *offset, int *nb, int nr)
+{
+	// add nr in a range of the pool. The range is moved at the end of the pool if it cannot grow in place
+	if ((*nb > 0) && (*offset + *nb != (int)(pool.size())))
+	{
+		int from = *offset;
+		*offset = pool.size();
+		for (int i = 0; i < *nb; i++)
+			pool.push_back(pool[from + i]);
+	}
+	if (*nb == 0)
+		*offset = pool.size();
+	pool.push_back(nr);
+	(*nb)++;
+}
+void c_musicxmlevents::clearLinks()
+{
+	// remove all the starts and stops
+	for (unsigned int i = 0; i < events.size(); i++)
+	{
+		events[i].nb_starts = 0;
+		events[i].nb_stops = 0;
+	}
+	pool.clear();
+}
+int c_musicxmlevents::intern(const wxString &s)
+{
+	// return the id of the string s
+	if (s.IsEmpty())
+		return 0;
+	h_musicxmlstring::iterator it = stringIds.find(s);
+	if (it != stringIds.end())
+		return it->second;
+	int id = strings.GetCount();
+	strings.Add(s);
+	stringIds[s] = id;
+	return id;
+}
 void musicxmlcompile::dump_musicxmlevents()
 {
 	/*
-	l_musicxmlevent::iterator iter_musicxmlevent;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	for (int nrEvent = 0; nrEvent < lMusicxmlevents.GetCount(); nrEvent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
 		int nr = current_musicxmlevent->nr;
 		int start = current_musicxmlevent->start_twelve_t / 12;
 		int stop = current_musicxmlevent->stop_twelve_t / 12;
@@ -284,22 +361,21 @@ musicxmlcompile::musicxmlcompile()
 	// slMusicxmlevents = new SortedArrayOfMusicxmlevents(ComparemusicXmlEvents);
 	score = NULL;
 	compiled_score = NULL;
-	lMusicxmlevents.DeleteContents(true);
 	lMeasureMarks.DeleteContents(true);
 	lOrnaments.DeleteContents(true);
 }
 musicxmlcompile::~musicxmlcompile()
 {
-	lMusicxmlevents.DeleteContents(true);
 	lMeasureMarks.DeleteContents(true);
 	lArpeggiate_toapply.DeleteContents(true);
 	lOrnaments.DeleteContents(true);
-	lOrnamentsMusicxmlevents.DeleteContents(true);
 
 	if (score != NULL)
 		delete score;
 	if (compiled_score != NULL)
 		delete compiled_score;
+	if (base_part_expresseur != NULL)
+		delete base_part_expresseur;
 }
 wxFileName musicxmlcompile::loadTxtFile(wxFileName itxtFile)
 {
@@ -313,54 +389,54 @@ void musicxmlcompile::setNameFile(wxFileName itxtFile, wxFileName ixmlFile)
 	txtFile = itxtFile;
 	musicxmlFile = ixmlFile;
 }
-bool musicxmlcompile::loadXmlFile(wxString xmlfilein, wxString xmlfileout, bool useMarkFile)
+bool musicxmlcompile::loadXmlFile(wxInputStream *xmlin, wxString xmlfileout, bool useMarkFile)
 {
-	// load the musicxml musicxmlFile, compile it, and generate the MUSICXML_FILE for the musicxml-viewer
+	// load the musicxml stream ( file, or entry of the mxl zip ), compile it, and generate the MUSICXML_FILE for the musicxml-viewer
 
-	// load the inupt muscixml file in the C++ score structure
-	xmlLoad(xmlfilein);
+	// load the inupt muscixml stream in the C++ score structure
+	xmlLoad(xmlin);
 
 	if (!isOk())
 		return false;
 
 	// score->write("copytest.xml", false); // for debug
 
-	// compile the C++ score structure into :
+	return compileXmlFile(xmlfileout, useMarkFile);
+}
+bool musicxmlcompile::compileXmlFile(wxString xmlfileout, bool useMarkFile)
+{
+	// compile the C++ score structure loaded into :
 	// - a musicxml file to diplay 
 	// - a set of events to play
 	// - a file of parameters ( lOrnaments, repetitions, .. )
+	// called again without a new load, when the marks of the same score are edited
+
+	if (!isOk())
+		return false;
+
 	compile(useMarkFile, xmlfileout);
 
 	return isOk();
 }
-void musicxmlcompile::xmlLoad(wxString xmlfilein)
+void musicxmlcompile::xmlLoad(wxInputStream *xmlin)
 {
-	// load the inupt muscixml file in the C++ score structure
+	// load the inupt muscixml stream in the C++ score structure
+	// the score is built while the stream is read, without an intermediate wxXmlDocument
 
 	if (score != NULL)
 		delete score;
 	score = NULL;
+	clearBase();
 
-	wxXmlDocument *xmlDoc = new wxXmlDocument();
-	if (!xmlDoc->Load(xmlfilein))
+	c_musicxml_reader reader(xmlin);
+	score = reader.load();
+	xmlHash = reader.hash;
+	if (score == NULL)
 	{
-		delete xmlDoc;
+		wxMessageBox(reader.error, "MusicXML load", wxICON_ERROR);
 		return;
 	}
 
-	wxXmlNode *root = xmlDoc->GetRoot();
-	wxString name = root->GetName();
-	if (name != "score-partwise")
-	{
-		wxMessageBox("Only musicXML score-partwise is accepted", "MusicXML load", wxICON_ERROR);
-		delete xmlDoc;
-		return ;
-	}
-
-	// load xml in the C++ score-structure
-	score = new c_score_partwise(root);
-	delete xmlDoc;
-
 	if (!isOk())
 	{
 		delete score;
@@ -378,27 +454,28 @@ void musicxmlcompile::compile(bool useMarkFile, wxString xmlfileout)
 	if (!isOk())
 		return;
 
-	lMusicxmlevents.DeleteContents(true);
 	lMeasureMarks.DeleteContents(true);
 	lArpeggiate_toapply.DeleteContents(true);
 	lOrnaments.DeleteContents(true);
-	lOrnamentsMusicxmlevents.DeleteContents(true);
 
 	lMusicxmlevents.Clear();
 	lMeasureMarks.Clear();
 	lArpeggiate_toapply.Clear();
 	lOrnaments.Clear();
-	lOrnamentsMusicxmlevents.Clear();
+	lOrnamentsMusicxmlevents.clear();
+	markList.Clear();
+	measureList.Clear();
 
+	// remove the Expresseur Part added by a previous compilation of this score
+	removeExpresseurPart(score);
 	score->compile();
 	// analyse the default repeat-sequence from "score" to "measureMark" and "markList"
 	analyseMeasure();
 	// create a new score, from the original one, without the measures
-	if (compiled_score != NULL)
-		delete compiled_score;
+	c_score_partwise *previous_compiled_score = compiled_score;
 	compiled_score = new c_score_partwise(*score, false);
 	// remove an existing Expresseur Part
-	removeExpresseurPart();
+	removeExpresseurPart(compiled_score);
 	// overload the parameters read from the score, with the optional data available in the input text file
 	if (useMarkFile)
 		readMarks();
@@ -406,11 +483,38 @@ void musicxmlcompile::compile(bool useMarkFile, wxString xmlfileout)
 		writeMarks();
 	// create the list of measures, according to repetitions
 	createListMeasures();
-	// build the sequence of measures in the compiled parts
-	addExpresseurPart();
-	buildMeasures();
-	// compile the score and build the notes to play in lMusicxmlevents
-	compileScore();
+	c_musicxml_cache cache(cacheKey(useMarkFile));
+	unsigned long long key = structureKey();
+	if ((previous_compiled_score != NULL) && (base_part_expresseur != NULL) && (key == baseKey))
+	{
+		// same marks, repetitions and parts as the previous compilation of this score : its measures and its
+		// notes to play before the ornaments are reused. This is not an incremental compilation : the changes are
+		// not tracked per measure, and the steps after this point run on the whole score ( addOrnaments, the
+		// linker, compileExpresseurPart, the xml to display ). Only the push to LUA is a diff with the previous
+		// push ( patchLuaMusicxmlevents ). A change of the marks, repetitions or parts rebuilds all the measures
+		addExpresseurPart();
+		delete compiled_score;
+		compiled_score = previous_compiled_score;
+		restoreBase();
+	}
+	else
+	{
+		if (previous_compiled_score != NULL)
+			delete previous_compiled_score;
+		clearBase();
+		// reuse the compilation of the same score, with the same marks
+		if (cache.load() && loadCache(&cache, xmlfileout))
+			return;
+		// build the sequence of measures in the compiled parts
+		addExpresseurPart();
+		buildMeasures();
+		// compile the score and build the notes to play in lMusicxmlevents
+		compileScore();
+		// keep the notes to play before the ornaments, for the next compilation of this score
+		baseKey = key;
+		lBaseMusicxmlevents = lMusicxmlevents;
+		base_part_expresseur = new c_part(*(compiled_score->parts.GetLast()->GetData()));
+	}
 	//  add lOrnaments in the notes to play in lMusicxmlevents
 	addOrnaments();
 	// lMusicxmlevents contains the notes to play. Compile lMusicxmlevents
@@ -420,10 +524,112 @@ void musicxmlcompile::compile(bool useMarkFile, wxString xmlfileout)
 	// write the xml to display
 	compiled_score->write(xmlfileout, true);
 	// push the events to play to the LUA-script
-	pushLuaMusicxmlevents();
+	int sizeLua;
+	char *lua = packLuaMusicxmlevents(&sizeLua);
+	if (lua != NULL)
+	{
+		pushLuaMusicxmlevents(lua, sizeLua);
+		// keep the compilation for the next load of the same score
+		if (!cache.save(lMusicxmlevents, markList, measureList, lua, sizeLua, xmlfileout))
+			wxLogDebug("compile : score not cached");
+		free(lua);
+	}
 
 	nbEvents = lMusicxmlevents.GetCount();
 }
+unsigned long long musicxmlcompile::structureKey()
+{
+	// hash of what the measures and the notes to play depend on, apart from the score : the marks, the repetitions,
+	// and the parts. The ornaments are not in the key
+	unsigned long long key = XMLREADER_HASH_SEED;
+	int nb = markList.GetCount();
+	key = c_musicxml_reader::hashBytes(key, &nb, sizeof(nb));
+	for (int i = 0; i < nb; i++)
+		key = c_musicxml_reader::hashBytes(key, &(markList[i]), sizeof(int));
+	nb = measureList.GetCount();
+	key = c_musicxml_reader::hashBytes(key, &nb, sizeof(nb));
+	for (int i = 0; i < nb; i++)
+		key = c_musicxml_reader::hashBytes(key, &(measureList[i]), sizeof(int));
+	l_measureMark::iterator iter_measure_mark;
+	for (iter_measure_mark = lMeasureMarks.begin(); iter_measure_mark != lMeasureMarks.end(); ++iter_measure_mark)
+	{
+		c_measureMark *measureMark = *iter_measure_mark;
+		key = c_musicxml_reader::hashBytes(key, &(measureMark->number), sizeof(int));
+		wxScopedCharBuffer name = measureMark->name.utf8_str();
+		key = c_musicxml_reader::hashBytes(key, name.data(), name.length() + 1);
+	}
+	l_score_part::iterator iter_score_part;
+	for (iter_score_part = compiled_score->part_list->score_parts.begin(); iter_score_part != compiled_score->part_list->score_parts.end(); ++iter_score_part)
+	{
+		c_score_part *current = *iter_score_part;
+		int flags[2] = { current->play ? 1 : 0, current->view ? 1 : 0 };
+		key = c_musicxml_reader::hashBytes(key, flags, sizeof(flags));
+		wxScopedCharBuffer alias = (current->part_alias + "/" + current->part_alias_abbreviation).utf8_str();
+		key = c_musicxml_reader::hashBytes(key, alias.data(), alias.length() + 1);
+	}
+	return key;
+}
+void musicxmlcompile::clearBase()
+{
+	lBaseMusicxmlevents.Clear();
+	if (base_part_expresseur != NULL)
+		delete base_part_expresseur;
+	base_part_expresseur = NULL;
+}
+void musicxmlcompile::restoreBase()
+{
+	// restore in compiled_score the Expresseur part, and the notes to play, before the ornaments
+	c_part *part_expresseur = (c_part*)(compiled_score->parts.GetLast()->GetData());
+	compiled_score->parts.DeleteObject(part_expresseur);
+	delete part_expresseur;
+	compiled_score->parts.Append(new c_part(*base_part_expresseur));
+	compiled_score->pedal_bar = 0;
+	lMusicxmlevents = lBaseMusicxmlevents;
+}
+unsigned long long musicxmlcompile::cacheKey(bool useMarkFile)
+{
+	// key of the compilation : hash of the source xml, of the marks file used, and of the versions
+	unsigned long long key = xmlHash;
+	int versions[3] = { MUSICXMLCACHE_VERSION, BASSLUA_SCORE_VERSION, useMarkFile ? 1 : 0 };
+	key = c_musicxml_reader::hashBytes(key, versions, sizeof(versions));
+	if (useMarkFile)
+	{
+		wxFFile f(txtFile.GetFullPath(), "rb");
+		char buf[4096];
+		size_t n;
+		while (f.IsOpened() && ((n = f.Read(buf, sizeof(buf))) > 0))
+			key = c_musicxml_reader::hashBytes(key, buf, n);
+	}
+	return key;
+}
+bool musicxmlcompile::loadCache(c_musicxml_cache *cache, wxString xmlfileout)
+{
+	// restore the compilation from the cache, instead of compiling the score
+	const T_musicxmlcache_header *h = cache->header;
+	if ((int)(markList.GetCount()) != h->nbMarkList)
+		return false;
+	for (int i = 0; i < h->nbMarkList; i++)
+	{
+		if (markList[i] != cache->getMarkList()[i])
+			return false;
+	}
+	if (!cache->writeXml(xmlfileout))
+		return false;
+	measureList.Clear();
+	for (int i = 0; i < h->nbMeasureList; i++)
+		measureList.Add(cache->getMeasureList()[i]);
+	addExpresseurPart();
+	lMusicxmlevents.Set(cache->getEvents(), h->nbEvents, cache->getPool(), h->nbPool);
+	const char *s = cache->getStrings();
+	for (int i = 1; i <= h->nbStrings; i++)
+	{
+		lMusicxmlevents.intern(wxString::FromUTF8(s));
+		s += strlen(s) + 1;
+	}
+	pushLuaMusicxmlevents(cache->getLua(), h->sizeLua);
+	nbEvents = lMusicxmlevents.GetCount();
+	return true;
+}
 bool musicxmlcompile::isOk(bool check_compiled_score)
 {
 	// return true if the C++ score is OK
@@ -447,57 +653,255 @@ bool musicxmlcompile::isOk(bool check_compiled_score)
 	}
 	return true;
 }
-void musicxmlcompile::pushLuaMusicxmlevents()
+char *musicxmlcompile::packLuaMusicxmlevents(int *size)
 {
-	// push to LUA the musicXemEvents compiled
-	basslua_call(moduleScore, functionScoreInitScore, "");
-	
+	// pack the musicXemEvents compiled in one buffer, decoded by basslua in one call. To free by the caller
 	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
 	getMarkNr(-1);
 	getMeasureNr(-1);
-	int nr_musicxmlevent;
-	l_musicxmlevent::iterator iter_musicxmlevent;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(), nr_musicxmlevent = 0; iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++, nr_musicxmlevent++)
-	{
-		c_musicxmlevent *m = *iter_musicxmlevent;
-		char buflua[256];
-		strcpy(buflua, m->lua.c_str());
-
-		int markNr = getMarkNr(m->original_measureNr);
-		int measureNr = getMeasureNr(m->original_measureNr);
-		int measureLength = m->twelve_division_measure / 12 ;
-		// push the event itself
-#define pushLUAparameters "iiiiiiiiisiiiiiiiiiii"
-		basslua_call(moduleScore, functionScoreAddEvent, pushLUAparameters,
-			m->played , m->visible, 
-			(m->partNr) + 1, m->pitch, m->velocity, m->delay ,
-			m->dynamic, m->random_delay, m->pedal,
-			buflua ,
-			(m->will_stop_index) + 1, (m->stop_index) + 1,
-			markNr, measureNr, measureLength,
-			m->start_measureNr,m->start_twelve_t / 12, m->start_order, 
-			m->stop_measureNr, m->stop_twelve_t / 12, m->stop_order			
-			);
-		// push the starts of the event
-		int nb = m->starts.GetCount();
-		for (int n = 0; n < nb; n++)
-			basslua_call(moduleScore, functionScoreAddEventStarts, "i",( m->starts[n]) + 1);
-		// push the stops of the event
-		nb = m->stops.GetCount();
-		for (int n = 0; n < nb; n++)
-			basslua_call(moduleScore, functionScoreAddEventStops, "i", (m->stops[n]) + 1);
-	}
-	// push the tracks to LUA
+	int nbEvents = lMusicxmlevents.GetCount();
+	int nbIndexes = 0;
+	int sizeStrings = 1; // empty string at offset 0
+	for (int nrEvent = 0; nrEvent < nbEvents; nrEvent++)
+	{
+		c_musicxmlevent *m = lMusicxmlevents[nrEvent];
+		nbIndexes += m->nb_starts + m->nb_stops;
+		if (m->lua != 0)
+			sizeStrings += strlen(lMusicxmlevents.getString(m->lua).c_str()) + 1;
+	}
+	*size = sizeof(T_basslua_score_header) + nbEvents * sizeof(T_basslua_score_event) + nbIndexes * sizeof(int) + sizeStrings;
+	char *buffer = (char *)malloc(*size);
+	if (buffer == NULL)
+	{
+		wxLogError("packLuaMusicxmlevents : no more memory for %d events", nbEvents);
+		return NULL;
+	}
+	T_basslua_score_header *header = (T_basslua_score_header *)buffer;
+	header->version = BASSLUA_SCORE_VERSION;
+	header->sizeEvent = sizeof(T_basslua_score_event);
+	header->nbEvents = nbEvents;
+	header->nbIndexes = nbIndexes;
+	header->sizeStrings = sizeStrings;
+	T_basslua_score_event *e = (T_basslua_score_event *)(buffer + sizeof(T_basslua_score_header));
+	int *index = (int *)(e + nbEvents);
+	char *strings = (char *)(index + nbIndexes);
+	int offsetString = 1;
+	strings[0] = '\0';
+	for (int nrEvent = 0; nrEvent < nbEvents; nrEvent++, e++)
+	{
+		c_musicxmlevent *m = lMusicxmlevents[nrEvent];
+		e->played = m->played;
+		e->visible = m->visible;
+		e->trackNr = (m->partNr) + 1;
+		e->pitch = m->pitch;
+		e->velocity = m->velocity;
+		e->delay = m->delay;
+		e->dynamic = m->dynamic;
+		e->randomDelay = m->random_delay;
+		e->pedal = m->pedal;
+		e->lua = 0;
+		if (m->lua != 0)
+		{
+			e->lua = offsetString;
+			strcpy(strings + offsetString, lMusicxmlevents.getString(m->lua).c_str());
+			offsetString += strlen(strings + offsetString) + 1;
+		}
+		e->willStopIndex = (m->will_stop_index) + 1;
+		e->stopIndex = (m->stop_index) + 1;
+		e->partNr = getMarkNr(m->original_measureNr);
+		e->measureNr = getMeasureNr(m->original_measureNr);
+		e->measureLength = m->twelve_division_measure / 12;
+		e->startMeasureNr = m->start_measureNr;
+		e->startT = m->start_twelve_t / 12;
+		e->startOrder = m->start_order;
+		e->stopMeasureNr = m->stop_measureNr;
+		e->stopT = m->stop_twelve_t / 12;
+		e->stopOrder = m->stop_order;
+		// the starts and the stops of the event
+		e->nbStarts = m->nb_starts;
+		for (int n = 0; n < e->nbStarts; n++)
+			*index++ = lMusicxmlevents.getStart(m, n) + 1;
+		e->nbStops = m->nb_stops;
+		for (int n = 0; n < e->nbStops; n++)
+			*index++ = lMusicxmlevents.getStop(m, n) + 1;
+	}
+	return buffer;
+}
+void musicxmlcompile::pushLuaMusicxmlevents(const char *buffer, int size)
+{
+	// push to LUA the musicXemEvents packed in buffer
+	// Lua push diff : if LUA has still the previous push, with the same tracks, only the range of events which
+	// differ from it is replaced
+	wxArrayString tracks;
 	int nb_tracks = getTracksCount();
 	for (int n = 0; n < nb_tracks; n++)
+		tracks.Add(getTrackName(n));
+	if ((tracks != luaTracks) || (!patchLuaMusicxmlevents(buffer, size)))
 	{
-		wxString s = getTrackName(n);
-		char buf[256];
-		strcpy(buf, s.c_str());
-		basslua_call(moduleScore, functionScoreAddTrack, "s", buf);
+		basslua_call(moduleScore, functionScoreInitScore, "");
+		wxStopWatch watch;
+		if (basslua_scoreEvents(moduleScore, functionScoreAddEvents, buffer, size))
+		{
+			// load time per event, in the log of the compilation
+			int nbEvents = ((const T_basslua_score_header *)buffer)->nbEvents;
+			long long us = watch.TimeInMicro().GetValue();
+			wxLogDebug("compile : %d events loaded in LUA in %lld us , %.2f us/event", nbEvents, us, (nbEvents > 0) ? (double)us / (double)nbEvents : 0.0);
+		}
+		// push the tracks to LUA
+		for (int n = 0; n < nb_tracks; n++)
+		{
+			char buf[256];
+			strcpy(buf, tracks[n].c_str());
+			basslua_call(moduleScore, functionScoreAddTrack, "s", buf);
+		}
 	}
 	// finish the push
 	basslua_call(moduleScore, functionScoreFinishScore, "");
+	luaPushed.assign(buffer, buffer + size);
+	luaTracks = tracks;
+}
+// events packed for LUA ( cf. T_basslua_score_header ), with the offset of the starts of each event in the indexes
+typedef struct
+{
+	int nbEvents;
+	const T_basslua_score_event *events;
+	const int *indexes;
+	const char *strings;
+	std::vector<int> offsets;
+} T_lua_score;
+static void luaScore(const char *buffer, T_lua_score *s)
+{
+	const T_basslua_score_header *header = (const T_basslua_score_header *)buffer;
+	s->nbEvents = header->nbEvents;
+	s->events = (const T_basslua_score_event *)(buffer + sizeof(T_basslua_score_header));
+	s->indexes = (const int *)(s->events + header->nbEvents);
+	s->strings = (const char *)(s->indexes + header->nbIndexes);
+	s->offsets.resize(header->nbEvents + 1);
+	s->offsets[0] = 0;
+	for (int nrEvent = 0; nrEvent < header->nbEvents; nrEvent++)
+		s->offsets[nrEvent + 1] = s->offsets[nrEvent] + s->events[nrEvent].nbStarts + s->events[nrEvent].nbStops;
+}
+// fields of the packed events compared by luaEventSame : all but the lua string and the numbers of events
+#define LUA_NBVALUE 18
+static int T_basslua_score_event::* const luaEventValues[LUA_NBVALUE] =
+{
+	&T_basslua_score_event::played, &T_basslua_score_event::visible,
+	&T_basslua_score_event::trackNr, &T_basslua_score_event::pitch, &T_basslua_score_event::velocity, &T_basslua_score_event::delay,
+	&T_basslua_score_event::dynamic, &T_basslua_score_event::randomDelay, &T_basslua_score_event::pedal,
+	&T_basslua_score_event::partNr, &T_basslua_score_event::measureNr, &T_basslua_score_event::measureLength,
+	&T_basslua_score_event::startMeasureNr, &T_basslua_score_event::startT, &T_basslua_score_event::startOrder,
+	&T_basslua_score_event::stopMeasureNr, &T_basslua_score_event::stopT, &T_basslua_score_event::stopOrder
+};
+static bool luaEventSame(const T_lua_score &a, int nra, const T_lua_score &b, int nrb)
+{
+	// same fields, apart from the numbers of events ( cf. luaEventSameLinks )
+	const T_basslua_score_event *ea = &(a.events[nra]);
+	const T_basslua_score_event *eb = &(b.events[nrb]);
+	if ((ea->nbStarts != eb->nbStarts) || (ea->nbStops != eb->nbStops) || (strcmp(a.strings + ea->lua, b.strings + eb->lua) != 0))
+		return false;
+	for (int n = 0; n < LUA_NBVALUE; n++)
+	{
+		if (ea->*luaEventValues[n] != eb->*luaEventValues[n])
+			return false;
+	}
+	return true;
+}
+static int luaEventShift(int nr, int limit, int delta)
+{
+	return ((nr >= limit) ? (nr + delta) : nr);
+}
+static bool luaEventSameLinks(const T_lua_score &a, int nra, const T_lua_score &b, int nrb, int limit, int delta)
+{
+	// the numbers of events of a, shifted by delta from limit, are the numbers of events of b
+	const T_basslua_score_event *ea = &(a.events[nra]);
+	const T_basslua_score_event *eb = &(b.events[nrb]);
+	if ((luaEventShift(ea->willStopIndex, limit, delta) != eb->willStopIndex) || (luaEventShift(ea->stopIndex, limit, delta) != eb->stopIndex))
+		return false;
+	int nb = ea->nbStarts + ea->nbStops;
+	for (int n = 0; n < nb; n++)
+	{
+		if (luaEventShift(a.indexes[a.offsets[nra] + n], limit, delta) != b.indexes[b.offsets[nrb] + n])
+			return false;
+	}
+	return true;
+}
+static void luaPackRange(const T_lua_score &s, int from, int nb, std::vector<char> *buffer)
+{
+	// pack the events [from, from + nb - 1] of s, with their starts, stops and strings
+	int nbIndexes = s.offsets[from + nb] - s.offsets[from];
+	int sizeStrings = 1;
+	for (int nrEvent = from; nrEvent < from + nb; nrEvent++)
+	{
+		if (s.events[nrEvent].lua != 0)
+			sizeStrings += strlen(s.strings + s.events[nrEvent].lua) + 1;
+	}
+	buffer->assign(sizeof(T_basslua_score_header) + nb * sizeof(T_basslua_score_event) + nbIndexes * sizeof(int) + sizeStrings, '\0');
+	T_basslua_score_header *header = (T_basslua_score_header *)(buffer->data());
+	header->version = BASSLUA_SCORE_VERSION;
+	header->sizeEvent = sizeof(T_basslua_score_event);
+	header->nbEvents = nb;
+	header->nbIndexes = nbIndexes;
+	header->sizeStrings = sizeStrings;
+	T_basslua_score_event *e = (T_basslua_score_event *)(buffer->data() + sizeof(T_basslua_score_header));
+	int *index = (int *)(e + nb);
+	char *strings = (char *)(index + nbIndexes);
+	memcpy(e, s.events + from, nb * sizeof(T_basslua_score_event));
+	memcpy(index, s.indexes + s.offsets[from], nbIndexes * sizeof(int));
+	int offsetString = 1;
+	for (int nrEvent = 0; nrEvent < nb; nrEvent++, e++)
+	{
+		if (e->lua == 0)
+			continue;
+		strcpy(strings + offsetString, s.strings + e->lua);
+		e->lua = offsetString;
+		offsetString += strlen(strings + offsetString) + 1;
+	}
+}
+bool musicxmlcompile::patchLuaMusicxmlevents(const char *buffer, int size)
+{
+	// replace in LUA the events which differ from the previous push, return false if LUA has not the previous push
+	if (luaPushed.empty())
+		return false;
+	T_lua_score o, n;
+	luaScore(luaPushed.data(), &o);
+	luaScore(buffer, &n);
+	if (o.nbEvents == 0)
+		return false;
+	// events at the beginning, and at the end, which are the same
+	int nbMin = (o.nbEvents < n.nbEvents) ? o.nbEvents : n.nbEvents;
+	int prefix = 0;
+	while ((prefix < nbMin) && (luaEventSame(o, prefix, n, prefix)))
+		prefix++;
+	int suffix = 0;
+	while ((suffix < nbMin - prefix) && (luaEventSame(o, o.nbEvents - 1 - suffix, n, n.nbEvents - 1 - suffix)))
+		suffix++;
+	// the numbers of events they refer to must be the same, once shifted after the events replaced
+	int delta = n.nbEvents - o.nbEvents;
+	bool reduced = true;
+	while (reduced)
+	{
+		reduced = false;
+		int limit = o.nbEvents - suffix + 1;
+		for (int nr = 0; (!reduced) && (nr < prefix); nr++)
+		{
+			if (!luaEventSameLinks(o, nr, n, nr, limit, delta))
+			{
+				prefix = nr;
+				reduced = true;
+			}
+		}
+		for (int nr = 0; (!reduced) && (nr < suffix); nr++)
+		{
+			if (!luaEventSameLinks(o, o.nbEvents - 1 - nr, n, n.nbEvents - 1 - nr, limit, delta))
+			{
+				suffix = nr;
+				reduced = true;
+			}
+		}
+	}
+	std::vector<char> patch;
+	luaPackRange(n, prefix, n.nbEvents - suffix - prefix, &patch);
+	return basslua_scorePatch(moduleScore, functionScorePatchEvents, o.nbEvents, prefix + 1, o.nbEvents - suffix - prefix, patch.data(), (int)(patch.size()));
 }
 void musicxmlcompile::clearLuaScore()
 {
@@ -575,195 +979,287 @@ int musicxmlcompile::getMeasureNr(int measureNr)
 	pMeasureNr = measureNr;
 	return cMeasureNr;
 }
+// jobs of the parts, taken one by one by the threads
+typedef struct
+{
+	musicxmlcompile *compile;
+	void (musicxmlcompile::*run)(c_part_job *job);
+	std::vector<c_part_job> *jobs;
+	std::atomic<int> next;
+} T_part_jobs;
+static void runPartJobs(T_part_jobs *partJobs)
+{
+	int nbJobs = partJobs->jobs->size();
+	int nrJob;
+	while ((nrJob = partJobs->next++) < nbJobs)
+		(partJobs->compile->*(partJobs->run))(&((*(partJobs->jobs))[nrJob]));
+}
+class c_part_thread : public wxThread
+{
+public:
+	c_part_thread(T_part_jobs *ipartJobs) : wxThread(wxTHREAD_JOINABLE) { partJobs = ipartJobs; }
+	virtual ExitCode Entry() { runPartJobs(partJobs); return (ExitCode)0; }
+private:
+	T_part_jobs *partJobs;
+};
+void musicxmlcompile::runParts(std::vector<c_part_job> &jobs, void (musicxmlcompile::*run)(c_part_job *job))
+{
+	// run the jobs of the parts on the cores available. The job of a part must not use the data of the other parts
+	T_part_jobs partJobs;
+	partJobs.compile = this;
+	partJobs.run = run;
+	partJobs.jobs = &jobs;
+	partJobs.next = 0;
+	int nbThreads = wxThread::GetCPUCount();
+	if (nbThreads > (int)(jobs.size()))
+		nbThreads = jobs.size();
+	std::vector<c_part_thread *> threads;
+	for (int nrThread = 1; nrThread < nbThreads; nrThread++)
+	{
+		c_part_thread *thread = new c_part_thread(&partJobs);
+		if (thread->Run() != wxTHREAD_NO_ERROR)
+		{
+			// the jobs not taken are run by the current thread
+			delete thread;
+			break;
+		}
+		threads.push_back(thread);
+	}
+	runPartJobs(&partJobs);
+	for (unsigned int nrThread = 0; nrThread < threads.size(); nrThread++)
+	{
+		threads[nrThread]->Wait();
+		delete threads[nrThread];
+	}
+}
 void musicxmlcompile::analyseMeasureMarks()
 {
 	// extract from the current score : rehearsal, special barlines, repeat, coda, segno ..., filling :
 	//   - measureMark : marks read from barlines and rehearsal 
 	//   - markList : list of marks to play , acording to repeat signs
 
-	// extract from the current score lOrnaments list
-	c_measureMark *measureMark;
-	bool mark; 
-	int partNr = 0;
+	// extract from the current score lOrnaments list, each part in parallel
+	std::vector<c_part_job> jobs(score->parts.GetCount());
 	l_part::iterator iter_part;
-	for (iter_part = score->parts.begin(); iter_part != score->parts.end(); ++iter_part , ++partNr )
+	int partNr = 0;
+	for (iter_part = score->parts.begin(); iter_part != score->parts.end(); ++iter_part, ++partNr)
 	{
-		mark = (partNr == 0);
-		c_part *part = *iter_part;
-		int nbMeasure = part->measures.GetCount();
-		l_measure::iterator iter_measure;
-		for (iter_measure = part->measures.begin(); iter_measure != part->measures.end(); ++iter_measure)
+		jobs[partNr].part = *iter_part;
+		jobs[partNr].partNr = partNr;
+	}
+	if (jobs.size() > 0)
+		jobs[0].grace = grace;
+	runParts(jobs, &musicxmlcompile::analysePartMarks);
+	// grace notes at the end of a part belong to the first note of the next one : the parts are analysed again in sequence
+	bool serial = false;
+	for (unsigned int nrJob = 0; nrJob + 1 < jobs.size(); nrJob++)
+		serial = serial || (jobs[nrJob].grace.IsEmpty() == false);
+	if (serial)
+	{
+		for (unsigned int nrJob = 0; nrJob < jobs.size(); nrJob++)
 		{
-			c_measure *measure = *iter_measure;
-			int timeMeasure = 0;
-			if (measure->attributes != NULL)
+			c_part_job *job = &(jobs[nrJob]);
+			for (unsigned int i = 0; i < job->ornaments.size(); i++)
+				delete job->ornaments[i];
+			job->ornaments.clear();
+			for (unsigned int i = 0; i < job->measureMarks.size(); i++)
+				delete job->measureMarks[i];
+			job->measureMarks.clear();
+			job->grace = (nrJob == 0) ? grace : jobs[nrJob - 1].grace;
+			analysePartMarks(job);
+		}
+	}
+	// merge in the order of the parts
+	for (unsigned int nrJob = 0; nrJob < jobs.size(); nrJob++)
+	{
+		c_part_job *job = &(jobs[nrJob]);
+		for (unsigned int i = 0; i < job->ornaments.size(); i++)
+			lOrnaments.Append(job->ornaments[i]);
+		for (unsigned int i = 0; i < job->measureMarks.size(); i++)
+			lMeasureMarks.Append(job->measureMarks[i]);
+		grace = job->grace;
+	}
+}
+void musicxmlcompile::analysePartMarks(c_part_job *job)
+{
+	// extract the marks and the ornaments of one part, in job. Runs in parallel with the other parts
+	c_measureMark *measureMark;
+	int partNr = job->partNr;
+	bool mark = (partNr == 0);
+	c_part *part = job->part;
+	int nbMeasure = part->measures.GetCount();
+	l_measure::iterator iter_measure;
+	for (iter_measure = part->measures.begin(); iter_measure != part->measures.end(); ++iter_measure)
+	{
+		c_measure *measure = *iter_measure;
+		int timeMeasure = 0;
+		if (measure->attributes != NULL)
+		{
+			if ((measure->attributes->divisions != NULL_INT) && (partNr == 0))
 			{
-				if ((measure->attributes->divisions != NULL_INT) && (partNr == 0))
-				{
-					c_ornament *ornament = new c_ornament(o_divisions, measure->number, 0, -1, -1, -1, false, wxString::Format("%d", measure->attributes->divisions));
-					lOrnaments.Append(ornament);
-				}
+				c_ornament *ornament = new c_ornament(o_divisions, measure->number, 0, -1, -1, -1, false, wxString::Format("%d", measure->attributes->divisions));
+				job->ornaments.push_back(ornament);
 			}
-			l_measure_sequence::iterator iter_sequence;
-			for (iter_sequence = measure->measure_sequences.begin(); iter_sequence != measure->measure_sequences.end(); ++iter_sequence)
+		}
+		l_measure_sequence::iterator iter_sequence;
+		for (iter_sequence = measure->measure_sequences.begin(); iter_sequence != measure->measure_sequences.end(); ++iter_sequence)
+		{
+			measureMark = new c_measureMark(measure->number);
+			c_measure_sequence *sequence = *iter_sequence;
+			switch (sequence->type)
 			{
-				measureMark = new c_measureMark(measure->number);
-				c_measure_sequence *sequence = *iter_sequence;
-				switch (sequence->type)
+			case t_barline:
+				if ( partNr == 0 )
 				{
-				case t_barline:
-					if ( partNr == 0 )
+					c_barline *barline = (c_barline *)(sequence->pt);
+					// bar_style in { regular, dotted, dashed, heavy, light-light, light-heavy, heavy-light, heavy-heavy, tick, short, none }
+					wxChar c = barline->bar_style[0];
+					switch (c)
 					{
-						c_barline *barline = (c_barline *)(sequence->pt);
-						// bar_style in { regular, dotted, dashed, heavy, light-light, light-heavy, heavy-light, heavy-heavy, tick, short, none }
-						wxChar c = barline->bar_style[0];
-						switch (c)
-						{
-						case 'h':
-						case 'H':
-						case 'l':
-						case 'L':
-							mark = true;
-							break;
-						default:break;
-						}
-						if (barline->location == "right")
-						{
-							measureMark->changeMeasure(measure->number + 1);
-							if (measure->number == nbMeasure)
-							{
-								measureMark->name = END_OF_THE_SCORE;
-							}
-						}
-						if ((barline->repeat) && (barline->repeat->direction == "forward"))
-						{
-							mark = true;
-							measureMark->repeatForward = true;
-						}
-						if ((barline->repeat) && (barline->repeat->direction == "backward"))
-						{
-							mark = true;
-							measureMark->repeatBackward = true;
-						}
-						if ((barline->ending) && (barline->ending->type == "start") && (barline->ending->number[0] == '1'))
-						{
-							mark = true;
-							measureMark->jumpnext = true;
-						}
+					case 'h':
+					case 'H':
+					case 'l':
+					case 'L':
+						mark = true;
+						break;
+					default:break;
 					}
-					break;
-				case t_direction:
-				{
-					c_direction *direction = (c_direction *)(sequence->pt);
-					l_direction_type::iterator iter_direction_type;
-					l_direction_type direction_type = direction->direction_types;
-					for (iter_direction_type = direction_type.begin(); iter_direction_type != direction_type.end(); ++iter_direction_type)
+					if (barline->location == "right")
 					{
-						c_direction_type *direction_type = *iter_direction_type;
-						switch (direction_type->type)
-						{
-						case t_rehearsal:
-							mark = true;
-							measureMark->name = ((c_rehearsal*)(direction_type->pt))->value;
-							measureMark->rehearsal = true;
-							break;
-						case t_wedge:
+						measureMark->changeMeasure(measure->number + 1);
+						if (measure->number == nbMeasure)
 						{
-							c_wedge *current_wedge = (c_wedge*)(direction_type->pt);
-							wxString type = current_wedge->type.MakeLower();
-							if (type == "crescendo")
-							{
-								lOrnaments.Append(new c_ornament(o_crescendo, measure->original_number, timeMeasure, partNr, -1, -1, false, ""));
-							}
-							else if (type == "diminuendo")
-							{
-								lOrnaments.Append(new c_ornament(o_diminuendo, measure->original_number, timeMeasure, partNr, -1, -1 , false, ""));
-							}
-						}
-							break;
-						case t_pedal:
-						{
-							c_pedal *pedal = (c_pedal*)(direction_type->pt);
-							wxString s = pedal->type.Lower();
-							if (s == "start")
-								lOrnaments.Append(new c_ornament(o_pedal, measure->original_number, timeMeasure, partNr, -1, -1, false, ""));
-						}
-						default: break;
+							measureMark->name = END_OF_THE_SCORE;
 						}
 					}
-					l_sound::iterator iter_sound;
-					l_sound sound = direction->sounds;
-					for (iter_sound = sound.begin(); iter_sound != sound.end(); ++iter_sound)
+					if ((barline->repeat) && (barline->repeat->direction == "forward"))
 					{
-						c_sound *sound = *iter_sound;
 						mark = true;
-						if (sound->name == "dacapo")
-						{
-							measureMark->changeMeasure(measure->number + 1);
-							measureMark->dacapo = true;
-						}
-						else if (sound->name == "coda")
-						{
-							measureMark->name = "coda";
-							measureMark->coda = true;
-						}
-						else if (sound->name == "segno")
-						{
-							measureMark->segno = true;
-							measureMark->name = "segno";
-						}
-						else if (sound->name == "fine")
-						{
-							measureMark->changeMeasure(measure->number + 1);
-							measureMark->fine = true;
-						}
-						else if (sound->name == "tocoda")
+						measureMark->repeatForward = true;
+					}
+					if ((barline->repeat) && (barline->repeat->direction == "backward"))
+					{
+						mark = true;
+						measureMark->repeatBackward = true;
+					}
+					if ((barline->ending) && (barline->ending->type == "start") && (barline->ending->number[0] == '1'))
+					{
+						mark = true;
+						measureMark->jumpnext = true;
+					}
+				}
+				break;
+			case t_direction:
+			{
+				c_direction *direction = (c_direction *)(sequence->pt);
+				l_direction_type::iterator iter_direction_type;
+				l_direction_type direction_type = direction->direction_types;
+				for (iter_direction_type = direction_type.begin(); iter_direction_type != direction_type.end(); ++iter_direction_type)
+				{
+					c_direction_type *direction_type = *iter_direction_type;
+					switch (direction_type->type)
+					{
+					case t_rehearsal:
+						mark = true;
+						measureMark->name = ((c_rehearsal*)(direction_type->pt))->value;
+						measureMark->rehearsal = true;
+						break;
+					case t_wedge:
+					{
+						c_wedge *current_wedge = (c_wedge*)(direction_type->pt);
+						wxString type = current_wedge->type.MakeLower();
+						if (type == "crescendo")
 						{
-							measureMark->changeMeasure(measure->number + 1);
-							measureMark->tocoda = true;
+							job->ornaments.push_back(new c_ornament(o_crescendo, measure->original_number, timeMeasure, partNr, -1, -1, false, ""));
 						}
-						else if (sound->name == "dalsegno")
+						else if (type == "diminuendo")
 						{
-							measureMark->changeMeasure(measure->number + 1);
-							measureMark->dalsegno = true;
+							job->ornaments.push_back(new c_ornament(o_diminuendo, measure->original_number, timeMeasure, partNr, -1, -1 , false, ""));
 						}
 					}
+						break;
+					case t_pedal:
+					{
+						c_pedal *pedal = (c_pedal*)(direction_type->pt);
+						wxString s = pedal->type.Lower();
+						if (s == "start")
+							job->ornaments.push_back(new c_ornament(o_pedal, measure->original_number, timeMeasure, partNr, -1, -1, false, ""));
+					}
+					default: break;
+					}
 				}
-					break;
-				case t_note:
-				{
-					c_note *note = (c_note *)(sequence->pt);
-					if (note->chord)
-						timeMeasure -= (note->duration == NULL_INT) ? 0 : note->duration;
-					analyseNoteOrnaments(note, measure->number, timeMeasure);
-					timeMeasure += (note->duration == NULL_INT) ? 0 : note->duration;
-				}
-					break;
-				case t_backup:
-				{
-					c_backup *backup = (c_backup *)(sequence->pt);
-					timeMeasure -= backup->duration;
-				}
-					break;
-				case t_forward:
+				l_sound::iterator iter_sound;
+				l_sound sound = direction->sounds;
+				for (iter_sound = sound.begin(); iter_sound != sound.end(); ++iter_sound)
 				{
-					c_forward *forward = (c_forward *)(sequence->pt);
-					timeMeasure += forward->duration;
-				}
-					break;
-				default:
-					break;
+					c_sound *sound = *iter_sound;
+					mark = true;
+					if (sound->name == "dacapo")
+					{
+						measureMark->changeMeasure(measure->number + 1);
+						measureMark->dacapo = true;
+					}
+					else if (sound->name == "coda")
+					{
+						measureMark->name = "coda";
+						measureMark->coda = true;
+					}
+					else if (sound->name == "segno")
+					{
+						measureMark->segno = true;
+						measureMark->name = "segno";
+					}
+					else if (sound->name == "fine")
+					{
+						measureMark->changeMeasure(measure->number + 1);
+						measureMark->fine = true;
+					}
+					else if (sound->name == "tocoda")
+					{
+						measureMark->changeMeasure(measure->number + 1);
+						measureMark->tocoda = true;
+					}
+					else if (sound->name == "dalsegno")
+					{
+						measureMark->changeMeasure(measure->number + 1);
+						measureMark->dalsegno = true;
+					}
 				}
-				if (mark)
-					lMeasureMarks.Append(measureMark);
-				else
-					delete measureMark;
-				mark = false;
 			}
+				break;
+			case t_note:
+			{
+				c_note *note = (c_note *)(sequence->pt);
+				if (note->chord)
+					timeMeasure -= (note->duration == NULL_INT) ? 0 : note->duration;
+				analyseNoteOrnaments(note, measure->number, timeMeasure, job);
+				timeMeasure += (note->duration == NULL_INT) ? 0 : note->duration;
+			}
+				break;
+			case t_backup:
+			{
+				c_backup *backup = (c_backup *)(sequence->pt);
+				timeMeasure -= backup->duration;
+			}
+				break;
+			case t_forward:
+			{
+				c_forward *forward = (c_forward *)(sequence->pt);
+				timeMeasure += forward->duration;
+			}
+				break;
+			default:
+				break;
+			}
+			if (mark)
+				job->measureMarks.push_back(measureMark);
+			else
+				delete measureMark;
+			mark = false;
 		}
 	}
 }
-void musicxmlcompile::analyseNoteOrnaments(c_note *note, int measureNumber, int t)
+void musicxmlcompile::analyseNoteOrnaments(c_note *note, int measureNumber, int t, c_part_job *job)
 {
 	// extract the list of arnaments from the note read in the muscixml source file
 	if (note->grace)
@@ -771,7 +1267,7 @@ void musicxmlcompile::analyseNoteOrnaments(c_note *note, int measureNumber, int
 		wxString s;
 		wxString sep;
 		wxString alter;
-		if (grace.IsEmpty() == false)
+		if (job->grace.IsEmpty() == false)
 		{
 			if (note->chord)
 				sep = "+";
@@ -787,14 +1283,14 @@ void musicxmlcompile::analyseNoteOrnaments(c_note *note, int measureNumber, int
 		default: alter = ""; break;
 		}
 		s.Printf("%s%s%s%d", sep, note->pitch->step, alter, note->pitch->octave);
-		grace.Append(s);
+		job->grace.Append(s);
 	}
 	else
 	{
-		if (grace.IsEmpty() == false)
+		if (job->grace.IsEmpty() == false)
 		{
-			lOrnaments.Append(new c_ornament(o_grace, measureNumber, t, note->partNr, note->staff, -1, false, grace));
-			grace.Empty();
+			job->ornaments.push_back(new c_ornament(o_grace, measureNumber, t, note->partNr, note->staff, -1, false, job->grace));
+			job->grace.Empty();
 		}
 	}
 
@@ -803,49 +1299,49 @@ void musicxmlcompile::analyseNoteOrnaments(c_note *note, int measureNumber, int
 		if (note->notations->arpeggiate)
 		{
 			if (note->notations->arpeggiate->direction == "down")
-				lOrnaments.Append(new c_ornament(o_arpeggiate, measureNumber, t, note->partNr, note->staff, -1, false, "down"));
+				job->ornaments.push_back(new c_ornament(o_arpeggiate, measureNumber, t, note->partNr, note->staff, -1, false, "down"));
 			else
-				lOrnaments.Append(new c_ornament(o_arpeggiate, measureNumber, t, note->partNr, note->staff, -1, false, "up"));
+				job->ornaments.push_back(new c_ornament(o_arpeggiate, measureNumber, t, note->partNr, note->staff, -1, false, "up"));
 		}
 		if ((note->notations->lOrnaments) && (note->notations->lOrnaments->lOrnaments.GetCount() > 0))
 		{
 			wxString stype = note->notations->lOrnaments->lOrnaments[0].Lower();
 			if (stype == "inverted-mordent")
 			{
-				lOrnaments.Append(new c_ornament(o_mordent, measureNumber, t,  note->partNr, note->staff, -1, false, "inverted"));
+				job->ornaments.push_back(new c_ornament(o_mordent, measureNumber, t,  note->partNr, note->staff, -1, false, "inverted"));
 			}
 			else if (stype == "mordent")
 			{
-				lOrnaments.Append(new c_ornament(o_mordent, measureNumber, t, note->partNr, note->staff, -1, false, ""));
+				job->ornaments.push_back(new c_ornament(o_mordent, measureNumber, t, note->partNr, note->staff, -1, false, ""));
 			}
 			else if (stype == "inverted-turn")
 			{
-				lOrnaments.Append(new c_ornament(o_turn, measureNumber, t, note->partNr, note->staff, -1, false, "inverted"));
+				job->ornaments.push_back(new c_ornament(o_turn, measureNumber, t, note->partNr, note->staff, -1, false, "inverted"));
 			}
 			else if (stype == "turn")
 			{
-				lOrnaments.Append(new c_ornament(o_turn, measureNumber, t,  note->partNr, note->staff, -1, false, ""));
+				job->ornaments.push_back(new c_ornament(o_turn, measureNumber, t,  note->partNr, note->staff, -1, false, ""));
 			}
 			/*
 			else if (stype == "delayed-inverted-turn")
 			{
-				lOrnaments.Append(new c_ornament(o_delayed_turn, measureNumber, t, partNr, -1, false, "inverted"));
+				job->ornaments.push_back(new c_ornament(o_delayed_turn, measureNumber, t, partNr, -1, false, "inverted"));
 			}
 			else if (stype == "delayed-turn")
 			{
-				lOrnaments.Append(new c_ornament(o_delayed_turn, measureNumber, t, partNr, -1, false, ""));
+				job->ornaments.push_back(new c_ornament(o_delayed_turn, measureNumber, t, partNr, -1, false, ""));
 			}
 			*/
 			else if (stype == "trill-mark")
 			{
 				if (((note->mtype == "whole") || (note->mtype == "half")) && (note->dots == 0))
-					lOrnaments.Append(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "8"));
+					job->ornaments.push_back(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "8"));
 				else if (((note->mtype == "whole") || (note->mtype == "half")) && (note->dots > 0))
-					lOrnaments.Append(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "12"));
+					job->ornaments.push_back(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "12"));
 				else if (note->dots > 0)
-					lOrnaments.Append(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "6"));
+					job->ornaments.push_back(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "6"));
 				else
-					lOrnaments.Append(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "4"));
+					job->ornaments.push_back(new c_ornament(o_trill, measureNumber, t, note->partNr, note->staff, -1, false, "4"));
 			}
 		}
 		if ((note->notations->articulations) && (note->notations->articulations->articulations.GetCount() > 0))
@@ -857,15 +1353,15 @@ void musicxmlcompile::analyseNoteOrnaments(c_note *note, int measureNumber, int
 				wxString stype = (*iter_articulations).Lower();
 				if (stype.Contains("accent"))
 				{
-					lOrnaments.Append(new c_ornament(o_accent, measureNumber, t, note->partNr, note->staff, -1, false, ""));
+					job->ornaments.push_back(new c_ornament(o_accent, measureNumber, t, note->partNr, note->staff, -1, false, ""));
 				}
 				else if (stype == "tenuto")
 				{
-					lOrnaments.Append(new c_ornament(o_tenuto, measureNumber, t, note->partNr, note->staff, -1, false, ""));
+					job->ornaments.push_back(new c_ornament(o_tenuto, measureNumber, t, note->partNr, note->staff, -1, false, ""));
 				}
 				else if (stype == "staccato")
 				{
-					lOrnaments.Append(new c_ornament(o_staccato, measureNumber, t, note->partNr, note->staff, -1, false, ""));
+					job->ornaments.push_back(new c_ornament(o_staccato, measureNumber, t, note->partNr, note->staff, -1, false, ""));
 				}
 			}
 		}
@@ -1522,9 +2018,9 @@ void musicxmlcompile::readMarks(bool full)
 		f.Write();
 	f.Close();
 }
-int musicxmlcompile::compileNote(c_part *part, c_note *note, int measureNr, int originalMeasureNr, int t, int division_measure, int division_beat, int division_quarter, int repeat, int key_fifths)
+int musicxmlcompile::compileNote(c_part *part, c_note *note, int measureNr, int originalMeasureNr, int t, int division_measure, int division_beat, int division_quarter, int repeat, int key_fifths, std::vector<c_musicxmlevent> *musicxmlevents)
 {
-	// compile a note in the lMusicxmlevents
+	// compile a note in musicxmlevents
 	if ((note->grace)  || (note->rest) || (note->cue) || ((note->tie) && ((note->tie->stop) || (note->tie->compiled))))
 	{
 		if (! note->chord)
@@ -1544,12 +2040,12 @@ int musicxmlcompile::compileNote(c_part *part, c_note *note, int measureNr, int
 	stop_t = t;
 	compileTie(part, note, &stop_measureNr, &stop_t, division_measure);
 
-	c_musicxmlevent *mmusicxmlevent = new c_musicxmlevent(part->idNr,note->staff, note->voice, measureNr, originalMeasureNr, t, stop_measureNr, stop_t, pitch, division_measure, division_beat, division_quarter, repeat, 0, key_fifths);
-	mmusicxmlevent->chord_order = note->chord_order;
+	c_musicxmlevent mmusicxmlevent(part->idNr,note->staff, note->voice, measureNr, originalMeasureNr, t, stop_measureNr, stop_t, pitch, division_measure, division_beat, division_quarter, repeat, 0, key_fifths);
+	mmusicxmlevent.chord_order = note->chord_order;
 	if (note->notehead.IsSameAs("x",false))
-		mmusicxmlevent->velocity = 0;
+		mmusicxmlevent.velocity = 0;
 
-	lMusicxmlevents.Append(mmusicxmlevent);
+	musicxmlevents->push_back(mmusicxmlevent);
 
 	t += (note->duration == NULL_INT) ? 0 : note->duration;
 
@@ -1633,41 +2129,36 @@ void musicxmlcompile::compilePedalBar()
 		return;
 	// add a pedal on each bar
 	int p_measureNr = -1;
-	l_musicxmlevent pedalPending;
-	l_musicxmlevent::iterator iter_musicxmlevent;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); ++iter_musicxmlevent)
+	std::vector<c_musicxmlevent> pedalPending;
+	for (int nrEvent = 0; nrEvent < lMusicxmlevents.GetCount(); nrEvent++)
 	{
-		c_musicxmlevent *musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *musicxmlevent = lMusicxmlevents[nrEvent];
 		if (musicxmlevent->start_measureNr != p_measureNr)
 		{
-			c_musicxmlevent *m = new c_musicxmlevent(*musicxmlevent);
-			m->played = false;
-			m->visible = false;
-			m->start_order = -128;
-			m->pedal = compiled_score->pedal_bar;
-			pedalPending.Append(m);
+			c_musicxmlevent m = musicxmlevent->duplicate();
+			m.played = false;
+			m.visible = false;
+			m.start_order = -128;
+			m.pedal = compiled_score->pedal_bar;
+			pedalPending.push_back(m);
 			p_measureNr = musicxmlevent->start_measureNr;
 		}
 	}
-	for (iter_musicxmlevent = pedalPending.begin(); iter_musicxmlevent != pedalPending.end(); ++iter_musicxmlevent)
-	{
-		c_musicxmlevent *musicxmlevent = *iter_musicxmlevent;
-		lMusicxmlevents.Append(musicxmlevent);
-	}
-	pedalPending.DeleteContents(false);
+	for (unsigned int i = 0; i < pedalPending.size(); i++)
+		lMusicxmlevents.Append(pedalPending[i]);
 }
 void musicxmlcompile::compileCrescendo()
 {
-	l_musicxmlevent::iterator iter_musicxmlevent;
 	int startMusicxmlevent[MAX_SCORE_PART];
 	int pVelocity[MAX_SCORE_PART];
 	for (int i = 0; i < MAX_SCORE_PART; i++)
 		pVelocity[i] = 64;
 
 	// fix all velocities, not yet defined by an ornament-velocity
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); ++iter_musicxmlevent)
+	int nbEvent = lMusicxmlevents.GetCount();
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
 	{
-		c_musicxmlevent *musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *musicxmlevent = lMusicxmlevents[nrEvent];
 		if (musicxmlevent->nuance != NULL_INT)
 			pVelocity[musicxmlevent->partNr] = musicxmlevent->nuance;
 		musicxmlevent->velocity = pVelocity[musicxmlevent->partNr];
@@ -1684,11 +2175,10 @@ void musicxmlcompile::compileCrescendo()
 		crescendo_pending[i] = false;
 		pVelocity[i] = 64;
 	}
-	int nrEvent = 0;
 	// fix crescendos
-	for (iter_musicxmlevent = lMusicxmlevents.begin(), nrEvent = 0; iter_musicxmlevent != lMusicxmlevents.end(); ++iter_musicxmlevent, nrEvent++)
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
 	{
-		c_musicxmlevent *musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *musicxmlevent = lMusicxmlevents[nrEvent];
 		if ((crescendo_pending[musicxmlevent->partNr] == false) && (musicxmlevent->nuance != NULL_INT))
 			pVelocity[musicxmlevent->partNr] = musicxmlevent->nuance;
 		if (musicxmlevent->crescendo)
@@ -1728,10 +2218,9 @@ void musicxmlcompile::compileTransposition()
 	int pTransposition[MAX_SCORE_PART];
 	for (int i = 0; i < MAX_SCORE_PART; i++)
 		pTransposition[i] = 0;
-	l_musicxmlevent::iterator iter_musicxmlevent;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); ++iter_musicxmlevent)
+	for (int nrEvent = 0; nrEvent < lMusicxmlevents.GetCount(); nrEvent++)
 	{
-		c_musicxmlevent *musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *musicxmlevent = lMusicxmlevents[nrEvent];
 		if (musicxmlevent->transpose != NULL_INT)
 			pTransposition[musicxmlevent->partNr] = musicxmlevent->transpose;
 		musicxmlevent->pitch += pTransposition[musicxmlevent->partNr];
@@ -1742,9 +2231,14 @@ void musicxmlcompile::compileArppegio()
 	// proccess pending arpegiatte
 	if (lArpeggiate_toapply.GetCount() == 0)
 		return;
+	l_arpeggiate_toapply::iterator iter_arpeggiate_toapply;
+	for (iter_arpeggiate_toapply = lArpeggiate_toapply.begin(); iter_arpeggiate_toapply != lArpeggiate_toapply.end(); ++iter_arpeggiate_toapply)
+	{
+		c_arpeggiate_toapply *arpeggiate_toapply = *iter_arpeggiate_toapply;
+		arpeggiate_toapply->pitch = lMusicxmlevents[arpeggiate_toapply->nrEvent]->pitch;
+	}
 	lArpeggiate_toapply.Sort(arpeggiateCompare);
 	int dt = 0;
-	l_arpeggiate_toapply::iterator iter_arpeggiate_toapply;
 	int pnr = lArpeggiate_toapply[0]->nr;
 	for (iter_arpeggiate_toapply = lArpeggiate_toapply.begin(), iter_arpeggiate_toapply++; iter_arpeggiate_toapply != lArpeggiate_toapply.end(); ++iter_arpeggiate_toapply)
 	{
@@ -1752,8 +2246,8 @@ void musicxmlcompile::compileArppegio()
 		if (arpeggiate_toapply->nr == pnr)
 		{
 			dt += (arpeggiate_toapply->before) ? -1 : 1;
-			arpeggiate_toapply->musicxmlevent->start_order = dt;
-			arpeggiate_toapply->musicxmlevent->visible = false;
+			lMusicxmlevents[arpeggiate_toapply->nrEvent]->start_order = dt;
+			lMusicxmlevents[arpeggiate_toapply->nrEvent]->visible = false;
 		}
 		else
 		{
@@ -1868,13 +2362,13 @@ wxArrayInt musicxmlcompile::stringToPitch(wxString s, int *nbChord)
 void musicxmlcompile::addGraces(wxArrayInt gracePitches, bool before, c_musicxmlevent *musicxmlevent)
 {
 	int nbChord = gracePitches.GetCount() ;
-	c_musicxmlevent *mtemplate = new c_musicxmlevent(*musicxmlevent);
+	c_musicxmlevent mtemplate = musicxmlevent->duplicate();
 	musicxmlevent->visible = true;
 	musicxmlevent->played = true;
-	mtemplate->visible = false;
-	mtemplate->played = true;
-	mtemplate->stop_measureNr = mtemplate->start_measureNr;
-	mtemplate->stop_twelve_t = mtemplate->start_twelve_t;
+	mtemplate.visible = false;
+	mtemplate.played = true;
+	mtemplate.stop_measureNr = mtemplate.start_measureNr;
+	mtemplate.stop_twelve_t = mtemplate.start_twelve_t;
 	int start_order = musicxmlevent->start_order;
 	if (before)
 		musicxmlevent->start_order = start_order + 0;
@@ -1884,19 +2378,18 @@ void musicxmlcompile::addGraces(wxArrayInt gracePitches, bool before, c_musicxml
 	{
 		if (before)
 		{
-			mtemplate->start_order = start_order - 2 * (nbChord - nrChord);
-			mtemplate->stop_order = start_order - 2 * (nbChord - nrChord) + 1;
+			mtemplate.start_order = start_order - 2 * (nbChord - nrChord);
+			mtemplate.stop_order = start_order - 2 * (nbChord - nrChord) + 1;
 		}
 		else
 		{
-			mtemplate->start_order = start_order + 2 * nrChord;
-			mtemplate->stop_order = start_order + 2 * nrChord + 1;
+			mtemplate.start_order = start_order + 2 * nrChord;
+			mtemplate.stop_order = start_order + 2 * nrChord + 1;
 		}
-		c_musicxmlevent *m = new c_musicxmlevent(*mtemplate);
-		m->pitch = gracePitches[nrChord];
-		lOrnamentsMusicxmlevents.Append(m);
+		c_musicxmlevent m = mtemplate.duplicate();
+		m.pitch = gracePitches[nrChord];
+		lOrnamentsMusicxmlevents.push_back(m);
 	}
-	delete mtemplate;
 }
 void musicxmlcompile::addGraces(wxString gracePitches, bool before, c_musicxmlevent *musicxmlevent)
 {
@@ -1904,13 +2397,13 @@ void musicxmlcompile::addGraces(wxString gracePitches, bool before, c_musicxmlev
 	int nbChord;
 	pitchChord = stringToPitch(gracePitches, &nbChord);
 	int nrChord = 0;
-	c_musicxmlevent *mtemplate = new c_musicxmlevent(*musicxmlevent);
+	c_musicxmlevent mtemplate = musicxmlevent->duplicate();
 	musicxmlevent->visible = true;
 	musicxmlevent->played = true;
-	mtemplate->visible = false;
-	mtemplate->played = true;
-	mtemplate->stop_measureNr = mtemplate->start_measureNr;
-	mtemplate->stop_twelve_t = mtemplate->start_twelve_t;
+	mtemplate.visible = false;
+	mtemplate.played = true;
+	mtemplate.stop_measureNr = mtemplate.start_measureNr;
+	mtemplate.stop_twelve_t = mtemplate.start_twelve_t;
 	int start_order = musicxmlevent->start_order;
 	if (before)
 		musicxmlevent->start_order = start_order + 0;
@@ -1920,27 +2413,26 @@ void musicxmlcompile::addGraces(wxString gracePitches, bool before, c_musicxmlev
 	{
 		if (before)
 		{
-			mtemplate->start_order = start_order - 2 * (nbChord - nrChord);
-			mtemplate->stop_order = start_order - 2 * (nbChord - nrChord) + 1;
+			mtemplate.start_order = start_order - 2 * (nbChord - nrChord);
+			mtemplate.stop_order = start_order - 2 * (nbChord - nrChord) + 1;
 		}
 		else
 		{
-			mtemplate->start_order = start_order + 2 * nrChord;
-			mtemplate->stop_order = start_order + 2 * nrChord + 1;
+			mtemplate.start_order = start_order + 2 * nrChord;
+			mtemplate.stop_order = start_order + 2 * nrChord + 1;
 		}
 		int nbPitch = pitchChord.GetCount();
 		for (int nrPitch = 0; nrPitch < nbPitch; nrPitch++)
 		{
-			c_musicxmlevent *m = new c_musicxmlevent(*mtemplate);
-			m->pitch = pitchChord[nrPitch];
-			lOrnamentsMusicxmlevents.Append(m);
+			c_musicxmlevent m = mtemplate.duplicate();
+			m.pitch = pitchChord[nrPitch];
+			lOrnamentsMusicxmlevents.push_back(m);
 		}
 		nrChord++;
 		pitchChord = stringToPitch("", NULL);
 	}
-	delete mtemplate;
 }
-void musicxmlcompile::addOrnament(c_ornament *ornament, c_musicxmlevent *musicxmlevent, int nr_ornament)
+void musicxmlcompile::addOrnament(c_ornament *ornament, c_musicxmlevent *musicxmlevent, int nr_ornament, int nrEvent)
 {
 	// add the ornament in the musicxmlevent
 	bool btrill = false;
@@ -1965,7 +2457,7 @@ void musicxmlcompile::addOrnament(c_ornament *ornament, c_musicxmlevent *musicxm
 		break;
 	}
 	case o_lua:
-		musicxmlevent->lua = ornament->value;
+		musicxmlevent->lua = lMusicxmlevents.intern(ornament->value);
 		break;
 	case o_pianissimo:
 		musicxmlevent->nuance = 10;
@@ -1996,27 +2488,27 @@ void musicxmlcompile::addOrnament(c_ornament *ornament, c_musicxmlevent *musicxm
 		break;
 	case o_staccato:
 	{
-		c_musicxmlevent *m = new c_musicxmlevent(*musicxmlevent);
+		c_musicxmlevent m = musicxmlevent->duplicate();
 		musicxmlevent->visible = true;
 		musicxmlevent->played = false;
-		m->visible = false;
-		m->played = true;
+		m.visible = false;
+		m.played = true;
 		if (ornament->value == "2/3")
 		{
-			m->twelve_duration = (musicxmlevent->twelve_duration * 2) / 3;
-			m->stop_twelve_t = musicxmlevent->start_twelve_t + musicxmlevent->twelve_duration;
+			m.twelve_duration = (musicxmlevent->twelve_duration * 2) / 3;
+			m.stop_twelve_t = musicxmlevent->start_twelve_t + musicxmlevent->twelve_duration;
 		}
 		else if (ornament->value == "1/3")
 		{
-			m->twelve_duration = musicxmlevent->twelve_duration / 3;
-			m->stop_twelve_t = musicxmlevent->start_twelve_t + musicxmlevent->twelve_duration;
+			m.twelve_duration = musicxmlevent->twelve_duration / 3;
+			m.stop_twelve_t = musicxmlevent->start_twelve_t + musicxmlevent->twelve_duration;
 		}
 		else
 		{
-			m->twelve_duration = musicxmlevent->twelve_duration / 2;
-			m->stop_twelve_t = musicxmlevent->start_twelve_t + musicxmlevent->twelve_duration;
+			m.twelve_duration = musicxmlevent->twelve_duration / 2;
+			m.stop_twelve_t = musicxmlevent->start_twelve_t + musicxmlevent->twelve_duration;
 		}
-		lOrnamentsMusicxmlevents.Append(m);
+		lOrnamentsMusicxmlevents.push_back(m);
 		break;
 	}
 	case o_accent:
@@ -2093,58 +2585,59 @@ void musicxmlcompile::addOrnament(c_ornament *ornament, c_musicxmlevent *musicxm
 		break;
 	}
 	case o_arpeggiate:
-		lArpeggiate_toapply.Append(new c_arpeggiate_toapply(100 * musicxmlevent->repeat + nr_ornament, (ornament->value == "down"), ornament->before, musicxmlevent));
+		if (nrEvent >= 0)
+			lArpeggiate_toapply.Append(new c_arpeggiate_toapply(100 * musicxmlevent->repeat + nr_ornament, (ornament->value == "down"), ornament->before, nrEvent));
 		break;
 	case o_dynamic:
 	{
-		c_musicxmlevent *m = new c_musicxmlevent(*musicxmlevent);
-		m->played = false;
-		m->visible = false;
-		m->start_order = -128;
+		c_musicxmlevent m = musicxmlevent->duplicate();
+		m.played = false;
+		m.visible = false;
+		m.start_order = -128;
 		long l;
 		int v = 100;
 		if (ornament->value.ToLong(&l))
 			v = l;
-		m->dynamic = v;
-		lOrnamentsMusicxmlevents.Append(m);
+		m.dynamic = v;
+		lOrnamentsMusicxmlevents.push_back(m);
 		break;
 	}
 	case o_random_delay:
 	{
-		c_musicxmlevent *m = new c_musicxmlevent(*musicxmlevent);
-		m->played = false;
-		m->visible = false;
-		m->start_order = -128;
+		c_musicxmlevent m = musicxmlevent->duplicate();
+		m.played = false;
+		m.visible = false;
+		m.start_order = -128;
 		long l;
 		int v = 0;
 		if (ornament->value.ToLong(&l))
 			v = l;
-		m->random_delay = v;
-		lOrnamentsMusicxmlevents.Append(m);
+		m.random_delay = v;
+		lOrnamentsMusicxmlevents.push_back(m);
 		break;
 	}
 	case o_text :
 	{
-		c_musicxmlevent *m = new c_musicxmlevent(*musicxmlevent);
-		m->played = false;
-		m->visible = false;
-		m->start_order = -128;
-		m->text = ornament->value;
-		lOrnamentsMusicxmlevents.Append(m);
+		c_musicxmlevent m = musicxmlevent->duplicate();
+		m.played = false;
+		m.visible = false;
+		m.start_order = -128;
+		m.text = lMusicxmlevents.intern(ornament->value);
+		lOrnamentsMusicxmlevents.push_back(m);
 		break;
 	}
 	case o_pedal:
 	{
-		c_musicxmlevent *m = new c_musicxmlevent(*musicxmlevent);
-		m->played = false;
-		m->visible = false;
-		m->start_order = -128;
+		c_musicxmlevent m = musicxmlevent->duplicate();
+		m.played = false;
+		m.visible = false;
+		m.start_order = -128;
 		long l;
 		int v = 65;
 		if (ornament->value.ToLong(&l))
 			v = l;
-		m->pedal = v;
-		lOrnamentsMusicxmlevents.Append(m);
+		m.pedal = v;
+		lOrnamentsMusicxmlevents.push_back(m);
 		break;
 	}
 	case o_after:
@@ -2171,12 +2664,11 @@ void musicxmlcompile::createOrnament(c_ornament *ornament)
 	if (ornament->type == o_divisions)
 		return;
 	// look for nex start, to finish a new virtual note for the ornament
-	l_musicxmlevent::iterator iter_musicxmlevent;
 	c_musicxmlevent *after_musicxmlevent = NULL;
 	bool found = false;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	for (int nrEvent = 0; nrEvent < lMusicxmlevents.GetCount(); nrEvent++)
 	{
-		after_musicxmlevent = *iter_musicxmlevent;
+		after_musicxmlevent = lMusicxmlevents[nrEvent];
 		if ((after_musicxmlevent->start_measureNr > ornament->measureNumber) || ((after_musicxmlevent->start_measureNr == ornament->measureNumber) && (after_musicxmlevent->start_twelve_t > ornament->twelve_t)))
 		{
 			found = true;
@@ -2188,14 +2680,14 @@ void musicxmlcompile::createOrnament(c_ornament *ornament)
 	if (ornament->twelve_t >= after_musicxmlevent->twelve_division_measure)
 		return;
 	// add the ornament in the musicxmlevent
-	c_musicxmlevent *m = new c_musicxmlevent(ornament->partNr, 0, 0,
+	c_musicxmlevent m(ornament->partNr, 0, 0,
 		ornament->measureNumber, ornament->measureNumber, ornament->t, 
 		after_musicxmlevent->start_measureNr, after_musicxmlevent->start_twelve_t, 0,
 		after_musicxmlevent->twelve_division_measure, after_musicxmlevent->twelve_division_beat, after_musicxmlevent->twelve_division_quarter,
 		0, 0, 0);
-	m->played = true;
-	m->visible = true;
-	addOrnament(ornament, m,0);
+	m.played = true;
+	m.visible = true;
+	addOrnament(ornament, &m,0);
 	lMusicxmlevents.Append(m);
 }
 void musicxmlcompile::addOrnaments()
@@ -2203,8 +2695,7 @@ void musicxmlcompile::addOrnaments()
 	//  add lOrnaments in the lMusicxmlevents
 	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
 	lOrnaments.Sort(ornamentCompare);
-	lOrnamentsMusicxmlevents.DeleteContents(true);
-	lOrnamentsMusicxmlevents.Clear();
+	lOrnamentsMusicxmlevents.clear();
 
 	l_ornament::iterator iter_ornament;
 	for (iter_ornament = lOrnaments.begin(); iter_ornament != lOrnaments.end(); ++iter_ornament)
@@ -2219,42 +2710,51 @@ void musicxmlcompile::addOrnaments()
 		}
 	}
 
-	l_musicxmlevent::iterator iter_musicxmlevent;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	// the ornaments, indexed by the measure where they apply : measure of the compiled score for the absolute ones,
+	// measure of the original score for the others. A note looks only at the ornaments of its measures
+	std::vector<c_ornament *> ornaments;
+	std::map<int, std::vector<int> > absoluteOrnaments;
+	std::map<int, std::vector<int> > originalOrnaments;
+	for (iter_ornament = lOrnaments.begin(); iter_ornament != lOrnaments.end(); ++iter_ornament)
 	{
-		c_musicxmlevent *musicxmlevent = *iter_musicxmlevent;
-		l_ornament::iterator iter_ornament;
-		int nr_ornament;
-		for (iter_ornament = lOrnaments.begin(), nr_ornament = 0; iter_ornament != lOrnaments.end(); ++iter_ornament, nr_ornament++)
+		c_ornament *ornament = *iter_ornament;
+		int nr_ornament = ornaments.size();
+		ornaments.push_back(ornament);
+		if (ornament->absolute_measureNr)
+			absoluteOrnaments[ornament->measureNumber].push_back(nr_ornament);
+		else if (ornament->mark_prefix == -1)
+			originalOrnaments[ornament->measureNumber].push_back(nr_ornament);
+		else if ((ornament->mark_prefix >= 0) && (ornament->mark_prefix < (int)(lMeasureMarks.GetCount())))
+			originalOrnaments[ornament->measureNumber + lMeasureMarks[ornament->mark_prefix]->number - 1].push_back(nr_ornament);
+	}
+
+	std::vector<int> measureOrnaments;
+	int nbEvent = lMusicxmlevents.GetCount();
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
+	{
+		c_musicxmlevent *musicxmlevent = lMusicxmlevents[nrEvent];
+		// ornaments of the measures of this note, in the order of lOrnaments
+		measureOrnaments.clear();
+		std::map<int, std::vector<int> >::const_iterator absolute = absoluteOrnaments.find(musicxmlevent->start_measureNr);
+		if (absolute != absoluteOrnaments.end())
+			measureOrnaments.insert(measureOrnaments.end(), absolute->second.begin(), absolute->second.end());
+		std::map<int, std::vector<int> >::const_iterator original = originalOrnaments.find(musicxmlevent->original_measureNr);
+		if (original != originalOrnaments.end())
+			measureOrnaments.insert(measureOrnaments.end(), original->second.begin(), original->second.end());
+		std::sort(measureOrnaments.begin(), measureOrnaments.end());
+		for (unsigned int i = 0; i < measureOrnaments.size(); i++)
 		{
-			c_ornament *ornament = *iter_ornament;
-			bool measureOk = false;
-			if (ornament->absolute_measureNr)
-			{
-				measureOk = (musicxmlevent->start_measureNr == ornament->measureNumber);
-			}
-			else
-			{
-				if (ornament->mark_prefix ==  -1 )
-				{
-					measureOk = (musicxmlevent->original_measureNr == ornament->measureNumber);
-				}
-				else
-				{
-					if ((ornament->mark_prefix >= 0) && (ornament->mark_prefix < (int)(lMeasureMarks.GetCount())))
-						measureOk = (musicxmlevent->original_measureNr == ornament->measureNumber + lMeasureMarks[ornament->mark_prefix]->number - 1);
-				}
-			}
+			int nr_ornament = measureOrnaments[i];
+			c_ornament *ornament = ornaments[nr_ornament];
 			if
-			(		measureOk
-				   && (musicxmlevent->start_twelve_t == ornament->twelve_t)
+			(		(musicxmlevent->start_twelve_t == ornament->twelve_t)
 				   && ((ornament->chord_order < 0) || (musicxmlevent->chord_order == ornament->chord_order))
 				   && ((ornament->partNr < 0) || (musicxmlevent->partNr == ornament->partNr))
 				   && ((ornament->staffNr < 0) || (musicxmlevent->staffNr == NULL_INT) || (musicxmlevent->staffNr == ornament->staffNr))
 				   && ((ornament->repeat < 0) || (musicxmlevent->repeat == ornament->repeat))
 				)
 			{
-				addOrnament(ornament, musicxmlevent,nr_ornament);
+				addOrnament(ornament, musicxmlevent,nr_ornament, nrEvent);
 				ornament->processed = true;
 			}
 		}
@@ -2273,38 +2773,52 @@ void musicxmlcompile::addOrnaments()
 		}
 	}
 
-	for (iter_musicxmlevent = lOrnamentsMusicxmlevents.begin(); iter_musicxmlevent != lOrnamentsMusicxmlevents.end(); iter_musicxmlevent ++)
-	{
-		c_musicxmlevent *ornament_musicxmlevent = *iter_musicxmlevent;
-		lMusicxmlevents.Append(ornament_musicxmlevent);
-	}
-	lOrnamentsMusicxmlevents.DeleteContents(false);
-	lOrnamentsMusicxmlevents.Clear();
+	for (unsigned int i = 0; i < lOrnamentsMusicxmlevents.size(); i++)
+		lMusicxmlevents.Append(lOrnamentsMusicxmlevents[i]);
+	lOrnamentsMusicxmlevents.clear();
 	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
 
 }
-void musicxmlcompile::compileMusicxmlevents(bool second_time)
+static int startPosition(c_musicxmlevents &l, int nbEvent, int measureNr, int twelve_t, bool after)
 {
-	// lMusicxmlevents contains the notes to play. Compile lMusicxmlevents
+	// in the start order, first musicxmlevent which starts at measureNr/twelve_t, or strictly after if after==true
+	int lo = 0;
+	int hi = nbEvent;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		c_musicxmlevent *m = l[mid];
+		if ((m->start_measureNr < measureNr) || ((m->start_measureNr == measureNr) && ((m->start_twelve_t < twelve_t) || (after && (m->start_twelve_t == twelve_t)))))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+static void linkMusicxmlevents(c_musicxmlevents &lMusicxmlevents, bool second_time, std::vector<c_musicxmlevent> *orpheline_musicxmlevents)
+{
+	// links the starts and stops of lMusicxmlevents, sweeping the events sorted by stop, then by start
+	// the residual stop-orpheline are returned in orpheline_musicxmlevents, if not NULL
+	// expresseur/bench/linkbench checks it against the previous linker, with forward scans
 
 	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
 	/////////////////////////////////////////////////
 	
 
 	// set musicxmlevent->nr in the order
-	l_musicxmlevent::iterator iter_musicxmlevent;
 	int nr_musicxmlevent;
 	int nb_measure = 0;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(), nr_musicxmlevent = 0; iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++, nr_musicxmlevent++)
+	if (second_time)
+		lMusicxmlevents.clearLinks();
+	int nbEvent = lMusicxmlevents.GetCount();
+	for (nr_musicxmlevent = 0; nr_musicxmlevent < nbEvent; nr_musicxmlevent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nr_musicxmlevent];
 		nb_measure = current_musicxmlevent->stop_measureNr;
 		current_musicxmlevent->nr = nr_musicxmlevent;
 		if (second_time)
 		{
 			current_musicxmlevent->stop_orpheline = true;
-			current_musicxmlevent->stops.Clear();
-			current_musicxmlevent->starts.Clear();
 			current_musicxmlevent->stop_index = -1;
 			current_musicxmlevent->will_stop_index = -1;
 		}
@@ -2312,15 +2826,16 @@ void musicxmlcompile::compileMusicxmlevents(bool second_time)
 	if ( second_time == false )
 	{ 
 		// add a fake element at the end 
-		c_musicxmlevent *last_musicxmlevent = new c_musicxmlevent();
-		last_musicxmlevent->nr = nr_musicxmlevent + 1;
-		last_musicxmlevent->visible = false;
-		last_musicxmlevent->played = false;
-		last_musicxmlevent->start_measureNr = nb_measure + 1;
-		last_musicxmlevent->stop_measureNr = last_musicxmlevent->start_measureNr;
-		last_musicxmlevent->start_twelve_t = 0;
-		last_musicxmlevent->stop_twelve_t = 0;
+		c_musicxmlevent last_musicxmlevent;
+		last_musicxmlevent.nr = nr_musicxmlevent + 1;
+		last_musicxmlevent.visible = false;
+		last_musicxmlevent.played = false;
+		last_musicxmlevent.start_measureNr = nb_measure + 1;
+		last_musicxmlevent.stop_measureNr = last_musicxmlevent.start_measureNr;
+		last_musicxmlevent.start_twelve_t = 0;
+		last_musicxmlevent.stop_twelve_t = 0;
 		lMusicxmlevents.Append(last_musicxmlevent);
+		nbEvent++;
 	}
 
 	// links the starts and stops in the list of Musicxmlevents to play
@@ -2334,16 +2849,16 @@ void musicxmlcompile::compileMusicxmlevents(bool second_time)
 	/////////////////////////////////////////////////
 
 	// link synchronous-stops
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
 		if (current_musicxmlevent->played)
 		{
 			if ((current_musicxmlevent->stop_measureNr != p_MeasureNr) || (current_musicxmlevent->stop_twelve_t != p_t) || (current_musicxmlevent->stop_order != p_order) || (current_musicxmlevent->tenuto != p_tenuto))
 				p_musicxmlevent = current_musicxmlevent;
 			if (p_musicxmlevent)
 			{
-				p_musicxmlevent->stops.Add(current_musicxmlevent->nr);
+				lMusicxmlevents.addStop(p_musicxmlevent, current_musicxmlevent->nr);
 				if (p_musicxmlevent != current_musicxmlevent)
 					current_musicxmlevent->stop_orpheline = false;
 			}
@@ -2365,15 +2880,15 @@ void musicxmlcompile::compileMusicxmlevents(bool second_time)
 	p_order = -1;
 	p_tenuto = false;
 	p_musicxmlevent = NULL;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
 		if (current_musicxmlevent->played)
 		{
 			if ((current_musicxmlevent->start_measureNr != p_MeasureNr) || (current_musicxmlevent->start_twelve_t != p_t) || (current_musicxmlevent->start_order != p_order))
 				p_musicxmlevent = current_musicxmlevent;
 			if (p_musicxmlevent)
-				p_musicxmlevent->starts.Add(current_musicxmlevent->nr);
+				lMusicxmlevents.addStart(p_musicxmlevent, current_musicxmlevent->nr);
 
 			p_MeasureNr = current_musicxmlevent->start_measureNr;
 			p_t = current_musicxmlevent->start_twelve_t;
@@ -2382,163 +2897,138 @@ void musicxmlcompile::compileMusicxmlevents(bool second_time)
 	}
 
 	// links starts with stops-non-tenuto
-	p_MeasureNr = -1;
-	p_t = -1;
-	p_order = -1;
-	p_tenuto = false;
 	p_musicxmlevent = NULL;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
 		if (current_musicxmlevent->played)
 		{
-			if (current_musicxmlevent->starts.IsEmpty() == false)
+			if (current_musicxmlevent->nb_starts > 0)
 				p_musicxmlevent = current_musicxmlevent;
-			if ((current_musicxmlevent->stops.IsEmpty() == false) && (current_musicxmlevent->tenuto == false) && (p_musicxmlevent->will_stop_index == -1))
+			if ((current_musicxmlevent->nb_stops > 0) && (current_musicxmlevent->tenuto == false) && (p_musicxmlevent != NULL) && (p_musicxmlevent->will_stop_index == -1))
 			{
-				if (p_musicxmlevent)
-				{
-					p_musicxmlevent->will_stop_index = current_musicxmlevent->nr;
-					current_musicxmlevent->stop_orpheline = false;
-				}
+				p_musicxmlevent->will_stop_index = current_musicxmlevent->nr;
+				current_musicxmlevent->stop_orpheline = false;
 			}
 		}
 	}
-	// links stops-tenuto and orpheline-stops-non-tenuto with synchronous starts 
-	lMusicxmlevents.Sort(musicXmlEventsCompareStart);
-	p_MeasureNr = -1;
-	p_t = -1;
-	p_order = -1;
-	p_tenuto = false;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+
+	// next musicxmlevent with starts ( and visible ), from each position in the start order
+	std::vector<int> next_start(nbEvent + 1, -1);
+	std::vector<int> next_visible_start(nbEvent + 1, -1);
+	for (int nrEvent = nbEvent - 1; nrEvent >= 0; nrEvent--)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
-		if ((current_musicxmlevent->played) && (current_musicxmlevent->stops.IsEmpty() == false) && ((current_musicxmlevent->tenuto == true) || (current_musicxmlevent->stop_orpheline == true)))
-		{
-			l_musicxmlevent::iterator iter_musicxmlevent_to;
-			for (iter_musicxmlevent_to = iter_musicxmlevent, iter_musicxmlevent_to++; iter_musicxmlevent_to != lMusicxmlevents.end(); iter_musicxmlevent_to++)
-			{
-				c_musicxmlevent *musicxmlevent_to = *iter_musicxmlevent_to;
-				if ((musicxmlevent_to->starts.IsEmpty() == false) && (musicxmlevent_to->start_measureNr == current_musicxmlevent->stop_measureNr) && (musicxmlevent_to->start_twelve_t == current_musicxmlevent->stop_twelve_t))
-				{
-					musicxmlevent_to->stop_index = current_musicxmlevent->nr;
-					current_musicxmlevent->stop_orpheline = false;
-					break;
-				}
-				if (musicxmlevent_to->start_measureNr > current_musicxmlevent->stop_measureNr)
-					break;
-			}
-		}
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		next_start[nrEvent] = (current_musicxmlevent->nb_starts > 0) ? nrEvent : next_start[nrEvent + 1];
+		next_visible_start[nrEvent] = ((current_musicxmlevent->nb_starts > 0) && (current_musicxmlevent->visible)) ? nrEvent : next_visible_start[nrEvent + 1];
 	}
 
-	// residual stop-orpheline==true will be triggered like a start
-	bool orpheline_found = false;
-	l_musicxmlevent orpheline_musicxmlevents;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	// links stops-tenuto and orpheline-stops-non-tenuto with the next synchronous starts 
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
-		if ((current_musicxmlevent->played) && (current_musicxmlevent->stop_orpheline))
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		if ((current_musicxmlevent->played) && (current_musicxmlevent->nb_stops > 0) && ((current_musicxmlevent->tenuto == true) || (current_musicxmlevent->stop_orpheline == true)))
 		{
-			c_musicxmlevent *orpheline_event = new c_musicxmlevent(*current_musicxmlevent);
-			orpheline_event->start_measureNr = current_musicxmlevent->stop_measureNr;
-			orpheline_event->start_twelve_t = current_musicxmlevent->stop_twelve_t;
-			orpheline_event->start_order = current_musicxmlevent->stop_order;
-			orpheline_event->stop_measureNr = current_musicxmlevent->stop_measureNr;
-			orpheline_event->stop_twelve_t = current_musicxmlevent->stop_twelve_t + 12;
-			orpheline_event->stop_order = current_musicxmlevent->stop_order;
-			orpheline_event->velocity = 0;
-			orpheline_event->pitch = 0;
-			orpheline_event->starts.Add(-1);
-			orpheline_event->played = true;
-			orpheline_event->visible = true;
-			l_musicxmlevent::iterator iter_musicxmlevent_after;
-			bool found = false;
-			for (iter_musicxmlevent_after = iter_musicxmlevent, iter_musicxmlevent_after++; iter_musicxmlevent_after != lMusicxmlevents.end(); iter_musicxmlevent_after++)
+			int nrEvent_to = next_start[std::max(nrEvent + 1, startPosition(lMusicxmlevents, nbEvent, current_musicxmlevent->stop_measureNr, current_musicxmlevent->stop_twelve_t, false))];
+			if (nrEvent_to == -1)
+				continue;
+			c_musicxmlevent *musicxmlevent_to = lMusicxmlevents[nrEvent_to];
+			if ((musicxmlevent_to->start_measureNr == current_musicxmlevent->stop_measureNr) && (musicxmlevent_to->start_twelve_t == current_musicxmlevent->stop_twelve_t))
 			{
-				c_musicxmlevent *musicxmlevent_after = *iter_musicxmlevent_after;
-				if ((musicxmlevent_after->visible == false) || (musicxmlevent_after->starts.IsEmpty()))
-					continue;
-				if (musicxmlevent_after->start_measureNr < orpheline_event->start_measureNr)
-					continue;
-				if ((musicxmlevent_after->start_measureNr == orpheline_event->start_measureNr) && (musicxmlevent_after->start_twelve_t <= orpheline_event->start_twelve_t))
-					continue;
-				orpheline_event->stop_measureNr = musicxmlevent_after->start_measureNr;
-				orpheline_event->stop_twelve_t = musicxmlevent_after->stop_twelve_t;
-				found = true;
-				break;
+				musicxmlevent_to->stop_index = current_musicxmlevent->nr;
+				current_musicxmlevent->stop_orpheline = false;
 			}
-			if (found)
-			{
-				orpheline_musicxmlevents.Append(orpheline_event);
-				orpheline_found = true;
-			}
-			else
-				delete orpheline_event;
 		}
 	}
-	if (second_time) // finish the secund round
+
+	if (orpheline_musicxmlevents == NULL)
 		return;
-	if (orpheline_found)
+	// residual stop-orpheline==true will be triggered like a start, up to the next visible start
+	for (int nrEvent = 0; nrEvent < nbEvent; nrEvent++)
 	{
-		// orpheline are added. Need to recompile in a second round
-		for (iter_musicxmlevent = orpheline_musicxmlevents.begin(); iter_musicxmlevent != orpheline_musicxmlevents.end(); iter_musicxmlevent++)
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
+		if ((current_musicxmlevent->played) && (current_musicxmlevent->stop_orpheline))
 		{
-			c_musicxmlevent *current_orpheline_musicxmlevent = *iter_musicxmlevent;
-			lMusicxmlevents.Append(current_orpheline_musicxmlevent);
+			int nrEvent_after = next_visible_start[std::max(nrEvent + 1, startPosition(lMusicxmlevents, nbEvent, current_musicxmlevent->stop_measureNr, current_musicxmlevent->stop_twelve_t, true))];
+			if (nrEvent_after == -1)
+				continue;
+			c_musicxmlevent *musicxmlevent_after = lMusicxmlevents[nrEvent_after];
+			c_musicxmlevent orpheline_event = current_musicxmlevent->duplicate();
+			orpheline_event.start_measureNr = current_musicxmlevent->stop_measureNr;
+			orpheline_event.start_twelve_t = current_musicxmlevent->stop_twelve_t;
+			orpheline_event.start_order = current_musicxmlevent->stop_order;
+			orpheline_event.stop_measureNr = musicxmlevent_after->start_measureNr;
+			orpheline_event.stop_twelve_t = musicxmlevent_after->stop_twelve_t;
+			orpheline_event.stop_order = current_musicxmlevent->stop_order;
+			orpheline_event.velocity = 0;
+			orpheline_event.pitch = 0;
+			orpheline_event.played = true;
+			orpheline_event.visible = true;
+			orpheline_musicxmlevents->push_back(orpheline_event);
 		}
-		orpheline_musicxmlevents.DeleteContents(false);
-		orpheline_musicxmlevents.Clear();
-		compileMusicxmlevents(true);
 	}
+}
+void musicxmlcompile::compileMusicxmlevents()
+{
+	// lMusicxmlevents contains the notes to play. Compile lMusicxmlevents
+
+	std::vector<c_musicxmlevent> orpheline_musicxmlevents;
+	linkMusicxmlevents(lMusicxmlevents, false, &orpheline_musicxmlevents);
+	if (orpheline_musicxmlevents.size() > 0)
+	{
+		// orpheline are added. They take part in the synchronous starts and stops : link again
+		for (unsigned int i = 0; i < orpheline_musicxmlevents.size(); i++)
+			lMusicxmlevents.Append(orpheline_musicxmlevents[i]);
+		orpheline_musicxmlevents.clear();
+		linkMusicxmlevents(lMusicxmlevents, true, NULL);
+	}
+	int nbEvent = lMusicxmlevents.GetCount();
 
 	// count ornaments per note
 	int prev_start_twelve_t = -1;
 	int prev_start_measureNr = -1;
 	int nb_order_start_blind = 0;
-	l_musicxmlevent lmusicxmlevents_visible;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(), nr_musicxmlevent = 0; iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++, nr_musicxmlevent++)
+	std::vector<int> lmusicxmlevents_visible;
+	for (int nr_musicxmlevent = 0; nr_musicxmlevent < nbEvent; nr_musicxmlevent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nr_musicxmlevent];
 		if ((current_musicxmlevent->start_twelve_t != prev_start_twelve_t) || (current_musicxmlevent->start_measureNr != prev_start_measureNr))
 		{
-			if (lmusicxmlevents_visible.GetCount() > 0)
+			if (lmusicxmlevents_visible.size() > 0)
 			{
-				l_musicxmlevent::iterator iter_musicxmlevent_visible;
-				for (iter_musicxmlevent_visible = lmusicxmlevents_visible.begin(); iter_musicxmlevent_visible != lmusicxmlevents_visible.end(); iter_musicxmlevent_visible++)
-				{
-					c_musicxmlevent *current_musicxmlevent_visible = *iter_musicxmlevent_visible;
-					current_musicxmlevent_visible->nb_ornaments = nb_order_start_blind;
-				}
+				for (unsigned int i = 0; i < lmusicxmlevents_visible.size(); i++)
+					lMusicxmlevents[lmusicxmlevents_visible[i]]->nb_ornaments = nb_order_start_blind;
 				nb_order_start_blind = 0;
-				lmusicxmlevents_visible.DeleteContents(false);
-				lmusicxmlevents_visible.Clear();
+				lmusicxmlevents_visible.clear();
 			}
 			prev_start_twelve_t = current_musicxmlevent->start_twelve_t;
 			prev_start_measureNr = current_musicxmlevent->start_measureNr;
 		}
 		if (current_musicxmlevent->visible)
-			lmusicxmlevents_visible.Append(current_musicxmlevent);
+			lmusicxmlevents_visible.push_back(nr_musicxmlevent);
 		else
 		{
-			if (current_musicxmlevent->starts.GetCount() > 0)
+			if (current_musicxmlevent->nb_starts > 0)
 				nb_order_start_blind++;
 		}
 	}
 }
-void musicxmlcompile::removeExpresseurPart()
+void musicxmlcompile::removeExpresseurPart(c_score_partwise *s)
 {
 	// remove an existing Expresseur Part
 
 	l_score_part::iterator iter_score_part;
 	l_part::iterator iter_part;
-	for (iter_score_part = compiled_score->part_list->score_parts.begin(), iter_part = compiled_score->parts.begin(); iter_score_part != compiled_score->part_list->score_parts.end(); ++iter_score_part, ++iter_part)
+	for (iter_score_part = s->part_list->score_parts.begin(), iter_part = s->parts.begin(); iter_score_part != s->part_list->score_parts.end(); ++iter_score_part, ++iter_part)
 	{
 		c_score_part *current_score_part = *iter_score_part;
 		c_part *current_part = *iter_part;
 		if (current_score_part->id == ExpresseurId)
 		{
-			compiled_score->part_list->score_parts.DeleteObject(current_score_part);
-			compiled_score->parts.DeleteObject(current_part);
+			s->part_list->score_parts.DeleteObject(current_score_part);
+			s->parts.DeleteObject(current_part);
+			delete current_score_part;
+			delete current_part;
 			break;
 		}
 	}
@@ -2816,62 +3306,80 @@ void musicxmlcompile::buildMeasures()
 void musicxmlcompile::compileScore()
 {
 	// compile the score and build the notes to play in lMusicxmlevents
+	// each part is compiled in parallel, and its notes are appended in the order of the parts
 
 	l_part::iterator iter_compiled_part;
 	l_score_part::iterator iter_score_part;
 
 	grace.Empty();
-	int key_fifths = 0;
-	for (iter_compiled_part = compiled_score->parts.begin(), iter_score_part = compiled_score->part_list->score_parts.begin(); iter_compiled_part != compiled_score->parts.end(); ++iter_compiled_part, ++iter_score_part)
+	std::vector<c_part_job> jobs(compiled_score->parts.GetCount());
+	int partNr = 0;
+	for (iter_compiled_part = compiled_score->parts.begin(), iter_score_part = compiled_score->part_list->score_parts.begin(); iter_compiled_part != compiled_score->parts.end(); ++iter_compiled_part, ++iter_score_part, ++partNr)
 	{
 		c_part *current_compiled_part = *iter_compiled_part;
 		current_compiled_part->idNr = getTrackNr(current_compiled_part->id);
-		c_score_part *current_score_part = *iter_score_part;
-		l_measure::iterator iter_measure;
-		for (iter_measure = current_compiled_part->measures.begin(); iter_measure != current_compiled_part->measures.end(); iter_measure++)
+		jobs[partNr].part = current_compiled_part;
+		jobs[partNr].score_part = *iter_score_part;
+		jobs[partNr].partNr = partNr;
+	}
+	runParts(jobs, &musicxmlcompile::compilePart);
+	for (unsigned int nrJob = 0; nrJob < jobs.size(); nrJob++)
+	{
+		std::vector<c_musicxmlevent> *musicxmlevents = &(jobs[nrJob].musicxmlevents);
+		for (unsigned int i = 0; i < musicxmlevents->size(); i++)
+			lMusicxmlevents.Append((*musicxmlevents)[i]);
+	}
+}
+void musicxmlcompile::compilePart(c_part_job *job)
+{
+	// build the notes to play of one part, in job. Runs in parallel with the other parts
+	int key_fifths = 0;
+	c_part *current_compiled_part = job->part;
+	c_score_part *current_score_part = job->score_part;
+	l_measure::iterator iter_measure;
+	for (iter_measure = current_compiled_part->measures.begin(); iter_measure != current_compiled_part->measures.end(); iter_measure++)
+	{
+		int current_t = 0;
+		c_measure *current_measure = *iter_measure;
+		l_measure_sequence::iterator iter_measure_sequence;
+		for (iter_measure_sequence = current_measure->measure_sequences.begin(); iter_measure_sequence != current_measure->measure_sequences.end(); iter_measure_sequence++)
 		{
-			int current_t = 0;
-			c_measure *current_measure = *iter_measure;
-			l_measure_sequence::iterator iter_measure_sequence;
-			for (iter_measure_sequence = current_measure->measure_sequences.begin(); iter_measure_sequence != current_measure->measure_sequences.end(); iter_measure_sequence++)
+			c_measure_sequence *current_measure_sequence = *iter_measure_sequence;
+			switch (current_measure_sequence->type)
 			{
-				c_measure_sequence *current_measure_sequence = *iter_measure_sequence;
-				switch (current_measure_sequence->type)
-				{
-				case t_note:
-				{
-					c_note *current_note = (c_note *)(current_measure_sequence->pt);
-					// process the note 
-					if (current_score_part->play)
-						current_t = compileNote(current_compiled_part, current_note, current_measure->number, current_measure->original_number, current_t, current_measure->division_measure, current_measure->division_beat, current_measure->division_quarter, current_measure->repeat, key_fifths);
-				}
-					break;
-					/*
-					case t_harmony:
-					{
-					c_harmony *current_harmony = (c_harmony *)(current_measure_sequence->pt);
-					}
-					break;
-					*/
-				case t_backup:
-				{
-					c_backup *current_backup = (c_backup *)(current_measure_sequence->pt);
-					current_t -= current_backup->duration;
-				}
-					break;
-				case t_forward:
+			case t_note:
+			{
+				c_note *current_note = (c_note *)(current_measure_sequence->pt);
+				// process the note 
+				if (current_score_part->play)
+					current_t = compileNote(current_compiled_part, current_note, current_measure->number, current_measure->original_number, current_t, current_measure->division_measure, current_measure->division_beat, current_measure->division_quarter, current_measure->repeat, key_fifths, &(job->musicxmlevents));
+			}
+				break;
+				/*
+				case t_harmony:
 				{
-					c_forward *current_forward = (c_forward *)(current_measure_sequence->pt);
-					current_t += current_forward->duration;
-				}
-					break;
-				case t_barline:
-					break;
-				case t_direction:
-					break;
-				default:
-					break;
+				c_harmony *current_harmony = (c_harmony *)(current_measure_sequence->pt);
 				}
+				break;
+				*/
+			case t_backup:
+			{
+				c_backup *current_backup = (c_backup *)(current_measure_sequence->pt);
+				current_t -= current_backup->duration;
+			}
+				break;
+			case t_forward:
+			{
+				c_forward *current_forward = (c_forward *)(current_measure_sequence->pt);
+				current_t += current_forward->duration;
+			}
+				break;
+			case t_barline:
+				break;
+			case t_direction:
+				break;
+			default:
+				break;
 			}
 		}
 	}
@@ -2890,13 +3398,13 @@ void musicxmlcompile::compileExpresseurPart()
 	wxString text;
 
 	int currentT = 0;
-	l_musicxmlevent::iterator iter_musicxmlevent_from;
-	for (iter_musicxmlevent_from = lMusicxmlevents.begin(); iter_musicxmlevent_from != lMusicxmlevents.end(); iter_musicxmlevent_from++)
+	int nbEvent = lMusicxmlevents.GetCount();
+	for (int nrEvent_from = 0; nrEvent_from < nbEvent; nrEvent_from++)
 	{
-		c_musicxmlevent *musicxmlevent_from = *iter_musicxmlevent_from;
-		if (musicxmlevent_from->text.IsEmpty() == false)
-			text = musicxmlevent_from->text;
-		if ((musicxmlevent_from->visible == false) || (musicxmlevent_from->starts.IsEmpty()))
+		c_musicxmlevent *musicxmlevent_from = lMusicxmlevents[nrEvent_from];
+		if (musicxmlevent_from->text != 0)
+			text = lMusicxmlevents.getString(musicxmlevent_from->text);
+		if ((musicxmlevent_from->visible == false) || (musicxmlevent_from->nb_starts == 0))
 			continue;
 		int from_start_measureNr = musicxmlevent_from->start_measureNr;
 		int from_stop_measureNr = musicxmlevent_from->stop_measureNr;
@@ -2911,11 +3419,10 @@ void musicxmlcompile::compileExpresseurPart()
 		int to_stop_measureNr = from_stop_measureNr + 1;
 		int to_startT = 0;
 		int to_stopT = 0;
-		l_musicxmlevent::iterator iter_musicxmlevent_to;
-		for (iter_musicxmlevent_to = iter_musicxmlevent_from, iter_musicxmlevent_to++; iter_musicxmlevent_to != lMusicxmlevents.end(); iter_musicxmlevent_to++)
+		for (int nrEvent_to = nrEvent_from + 1; nrEvent_to < nbEvent; nrEvent_to++)
 		{
-			c_musicxmlevent *musicxmlevent_to = *iter_musicxmlevent_to;
-			if (((musicxmlevent_to->visible == false) || (musicxmlevent_to->starts.IsEmpty()))
+			c_musicxmlevent *musicxmlevent_to = lMusicxmlevents[nrEvent_to];
+			if (((musicxmlevent_to->visible == false) || (musicxmlevent_to->nb_starts == 0))
 				|| ((musicxmlevent_to->start_measureNr == from_start_measureNr) && ((musicxmlevent_to->start_twelve_t / 12) == from_startT)))
 				continue;;
 			to_start_measureNr = musicxmlevent_to->start_measureNr;
@@ -3515,10 +4022,9 @@ int musicxmlcompile::stringToEventNr(wxString s)
 	}
 	if (measureNr == -1)
 		return -1;
-	l_musicxmlevent::iterator iter_musicxmlevent;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	for (int nrEvent = 0; nrEvent < lMusicxmlevents.GetCount(); nrEvent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
 		if (absolute)
 		{
 			if (current_musicxmlevent->start_measureNr == measureNr)
@@ -3596,10 +4102,9 @@ wxArrayString  musicxmlcompile::getListOrnament()
 }
 int musicxmlcompile::measureBeatToEventNr(int measureNr, int beat)
 {
-	l_musicxmlevent::iterator iter_musicxmlevent;
-	for (iter_musicxmlevent = lMusicxmlevents.begin(); iter_musicxmlevent != lMusicxmlevents.end(); iter_musicxmlevent++)
+	for (int nrEvent = 0; nrEvent < lMusicxmlevents.GetCount(); nrEvent++)
 	{
-		c_musicxmlevent *current_musicxmlevent = *iter_musicxmlevent;
+		c_musicxmlevent *current_musicxmlevent = lMusicxmlevents[nrEvent];
 		int beatEvent = current_musicxmlevent->start_twelve_t / current_musicxmlevent->twelve_division_beat + 1;
 		if ((current_musicxmlevent->start_measureNr >= measureNr) && (beatEvent >= beat))
 			return current_musicxmlevent->nr;
@@ -1,4 +1,4 @@
-// update : 01/12/2016 21:00
+// update : 16/10/2026
 
 #ifndef DEF_MUSICXMLCOMPILE
 
@@ -93,34 +93,12 @@ public:
 };
 WX_DECLARE_LIST(c_ornament, l_ornament);
 
-// class to have a sorted list of musicXml events
-/////////////////////////////////////////////////
+// musicXml event : fixed-size record, stored in c_musicxmlevents
+//////////////////////////////////////////////////////////////////
 class c_musicxmlevent
 {
 public:
 	c_musicxmlevent() {}
-	c_musicxmlevent(const c_musicxmlevent &musicxmlevent)
-	{
-		partNr = musicxmlevent.partNr;
-		staffNr = musicxmlevent.staffNr;
-		voice = musicxmlevent.voice;
-		original_measureNr = musicxmlevent.original_measureNr;
-		start_measureNr = musicxmlevent.start_measureNr;
-		start_twelve_t = musicxmlevent.start_twelve_t;
-		start_order = musicxmlevent.start_order;
-		stop_measureNr = musicxmlevent.stop_measureNr;
-		stop_twelve_t = musicxmlevent.stop_twelve_t;
-		stop_order = musicxmlevent.stop_order;
-		pitch = musicxmlevent.pitch;
-		twelve_duration = musicxmlevent.twelve_duration;
-		repeat = musicxmlevent.repeat;
-		twelve_division_measure = musicxmlevent.twelve_division_measure;
-		twelve_division_beat = musicxmlevent.twelve_division_beat;
-		twelve_division_quarter = musicxmlevent.twelve_division_quarter;
-		fifths = musicxmlevent.fifths;
-		visible = musicxmlevent.visible;
-		played = musicxmlevent.played;
-	}
 	c_musicxmlevent(int ipartNr, int istaffNr, int ivoice, int istart_measureNr, int ioriginal_measureNr, int istart_t, int istop_measureNr, int istop_t, int ipitch, int idivision_measure, int idivision_beat, int idivision_quarter, int irepeat, int iorder, int ififths)
 	{
 		partNr = ipartNr;
@@ -140,6 +118,31 @@ public:
 		start_order = iorder;
 		fifths = ififths;
 	}
+	c_musicxmlevent duplicate() const
+	{
+		// new event at the same place in the score, without the links and the ornaments
+		c_musicxmlevent m;
+		m.partNr = partNr;
+		m.staffNr = staffNr;
+		m.voice = voice;
+		m.original_measureNr = original_measureNr;
+		m.start_measureNr = start_measureNr;
+		m.start_twelve_t = start_twelve_t;
+		m.start_order = start_order;
+		m.stop_measureNr = stop_measureNr;
+		m.stop_twelve_t = stop_twelve_t;
+		m.stop_order = stop_order;
+		m.pitch = pitch;
+		m.twelve_duration = twelve_duration;
+		m.repeat = repeat;
+		m.twelve_division_measure = twelve_division_measure;
+		m.twelve_division_beat = twelve_division_beat;
+		m.twelve_division_quarter = twelve_division_quarter;
+		m.fifths = fifths;
+		m.visible = visible;
+		m.played = played;
+		return m;
+	}
 	int nr = 0; // index sorted
 	int partNr = 0;
 	int staffNr = 0;
@@ -162,8 +165,10 @@ public:
 	int stop_twelve_t = 0; // start of the note in 2*2*3*divisions of the quarter
 	int stop_order = 0; 
 
-	wxArrayInt starts; // index of musicxmlevent to start synchronously at the trigger-on
-	wxArrayInt stops; // index of musicxmlevent to stop synchronously 
+	int starts = 0; // offset in the pool of c_musicxmlevents : nr of musicxmlevent to start synchronously at the trigger-on
+	int nb_starts = 0;
+	int stops = 0; // offset in the pool of c_musicxmlevents : nr of musicxmlevent to stop synchronously
+	int nb_stops = 0;
 	int will_stop_index = -1 ; // in a starts musicxmlevent, link with the index of musicxmlevent to stop at the trigger-off
 	int stop_index = -1; // in a starts musicxmlevent, link with the index of musicxmlevent to stop synchronously with the trigger-on 
 	bool stop_orpheline = true; // true when the stop is not linked to a musicxmlevent
@@ -181,32 +186,85 @@ public:
 	int random_delay = -1;
 	int pedal = -1 ;
 	int o_arpeggiate = 0 ;
-	wxString text;
-	wxString lua;
+	int text = 0; // interned in c_musicxmlevents, 0 for an empty string
+	int lua = 0; // interned in c_musicxmlevents, 0 for an empty string
 	int fifths = 0;
 	int nb_ornaments = 0;
 };
-WX_DECLARE_LIST(c_musicxmlevent, l_musicxmlevent);
+typedef int (*musicxmleventCompare)(const c_musicxmlevent *r1, const c_musicxmlevent *r2);
+WX_DECLARE_STRING_HASH_MAP(int, h_musicxmlstring);
+
+// store of the musicXml events
+// The records are contiguous, in the order of the last sort : the access by position is direct.
+// The starts and stops of the events are ranges in a shared pool of nr, the texts are interned.
+/////////////////////////////////////////////////////////////////////////////////////////////////
+class c_musicxmlevents
+{
+public:
+	c_musicxmlevents();
+	int GetCount() const { return (int)(events.size()); }
+	c_musicxmlevent *operator[](int i) { return &(events[i]); } // valid up to the next Append, Sort or Clear
+	void Append(const c_musicxmlevent &m) { events.push_back(m); }
+	void Clear();
+	void Sort(musicxmleventCompare compare); // stable sort
+	void addStart(c_musicxmlevent *m, int nr) { add(&(m->starts), &(m->nb_starts), nr); }
+	void addStop(c_musicxmlevent *m, int nr) { add(&(m->stops), &(m->nb_stops), nr); }
+	int getStart(const c_musicxmlevent *m, int i) const { return pool[m->starts + i]; }
+	int getStop(const c_musicxmlevent *m, int i) const { return pool[m->stops + i]; }
+	void clearLinks();
+	int intern(const wxString &s);
+	const wxString &getString(int id) const { return strings[id]; }
+	// raw access, for the cache of the compiled scores
+	const c_musicxmlevent *getEvents() const { return events.data(); }
+	int getPoolCount() const { return (int)(pool.size()); }
+	const int *getPool() const { return pool.data(); }
+	int getStringsCount() const { return strings.GetCount(); }
+	void Set(const c_musicxmlevent *e, int nbEvents, const int *p, int nbPool); // replace the events and their links, the strings are cleared
+private:
+	void add(int *offset, int *nb, int nr);
+	std::vector<c_musicxmlevent> events;
+	std::vector<int> pool;
+	wxArrayString strings;
+	h_musicxmlstring stringIds;
+};
 
 // class to have a list of arpeggiate
 ////////////////////////////////////
 class c_arpeggiate_toapply
 {
 public:
-	c_arpeggiate_toapply(int inr, bool idown, bool ibefore, c_musicxmlevent *imusicxmlevent)
+	c_arpeggiate_toapply(int inr, bool idown, bool ibefore, int inrEvent)
 	{
 		nr = inr;
 		down = idown;
 		before = ibefore;
-		musicxmlevent = imusicxmlevent;
+		nrEvent = inrEvent;
 	}
 	int nr;
 	bool down;
 	bool before;
-	c_musicxmlevent *musicxmlevent;
+	int nrEvent; // position of the musicxmlevent in lMusicxmlevents
+	int pitch = 0;
 };
 WX_DECLARE_LIST(c_arpeggiate_toapply, l_arpeggiate_toapply);
 
+// work on one part of the score, done in parallel with the other parts ( cf. musicxmlcompile::runParts )
+// The results are merged in the order of the parts, as a serial compilation would produce them
+////////////////////////////////////
+class c_part_job
+{
+public:
+	c_part *part = NULL;
+	c_score_part *score_part = NULL;
+	int partNr = 0;
+	std::vector<c_ornament *> ornaments; // analysePartMarks
+	std::vector<c_measureMark *> measureMarks; // analysePartMarks
+	wxString grace; // grace notes waiting for their note, at the end of the part
+	std::vector<c_musicxmlevent> musicxmlevents; // compilePart
+};
+
+
+class c_musicxml_cache;
 
 // class to compile a musicXML score
 ////////////////////////////////////
@@ -217,7 +275,8 @@ public:
 	~musicxmlcompile();
 	wxFileName loadTxtFile(wxFileName txtfile);
 	void setNameFile(wxFileName txtfile,wxFileName xmlfile);
-	bool loadXmlFile(wxString xmlfilein, wxString xmlfileout, bool useMarkFile = true);
+	bool loadXmlFile(wxInputStream *xmlin, wxString xmlfileout, bool useMarkFile = true);
+	bool compileXmlFile(wxString xmlfileout, bool useMarkFile = true);
 	bool isOk(bool compiled_score = false);
 	bool getInfoEvent(int nrEvent, int *measureNr, int *t480);
 	int measureBeatToEventNr(int measureNr, int beat);
@@ -238,7 +297,6 @@ public:
 	wxString pitchToString(wxArrayInt p);
 	wxArrayInt stringToPitch(wxString s, int *nbChord);
 	static wxArrayString getListOrnament();
-	wxString music_xml_complete_file;
 	wxString music_xml_displayed_file;
 
 private:
@@ -247,35 +305,45 @@ private:
 	void writeMarks();
 	void readMarks(bool full = true);
 	bool readMarkLine(wxString line, wxString sectionName);
-	void xmlLoad(wxString xmlfilein);
+	void xmlLoad(wxInputStream *xmlin);
 	void analyseMeasure(); // analyse the default repeat-sequence from "score" to "measureMark" and "markList"
 	void analyseMeasureMarks();
 	int getMarkNr(int measureNr);
 	int getMeasureNr(int measureNr);
 	void analyseList();
-	void analyseNoteOrnaments(c_note *note, int measureNumber, int t);
+	void analysePartMarks(c_part_job *job);
+	void analyseNoteOrnaments(c_note *note, int measureNumber, int t, c_part_job *job);
+	void runParts(std::vector<c_part_job> &jobs, void (musicxmlcompile::*run)(c_part_job *job));
 	void sortMeasureMarks();
 	int getDivision(int measure_nr, int *division_quarter, int *division_measure);
 	int getPartNr(wxString spart, int *partNb = NULL);
-	int compileNote(c_part *part,c_note *note, int measureNr, int originalMeasureNr, int t, int division_measure, int division_beat, int division_quarter, int repeat, int key_fifths);
+	int compileNote(c_part *part,c_note *note, int measureNr, int originalMeasureNr, int t, int division_measure, int division_beat, int division_quarter, int repeat, int key_fifths, std::vector<c_musicxmlevent> *musicxmlevents);
 	void compileTie(c_part *part, c_note *note, int *measureNr, int *t, int nbDivision);
-	void compileMusicxmlevents(bool second_time = false);
-	void pushLuaMusicxmlevents();
+	void compileMusicxmlevents();
+	char *packLuaMusicxmlevents(int *size);
+	void pushLuaMusicxmlevents(const char *buffer, int size);
+	bool patchLuaMusicxmlevents(const char *buffer, int size);
+	unsigned long long cacheKey(bool useMarkFile);
+	bool loadCache(c_musicxml_cache *cache, wxString xmlfileout);
+	unsigned long long structureKey();
+	void clearBase();
+	void restoreBase();
 	void addOrnaments();
 	void clearOrnaments();
 	void singleOrnaments();
 	void createOrnament(c_ornament *ornament);
 	void addGraces(wxString gracePitches, bool before, c_musicxmlevent *musicxmlevent);
 	void addGraces(wxArrayInt gracePitches, bool before, c_musicxmlevent *musicxmlevent);
-	void addOrnament(c_ornament *ornament, c_musicxmlevent *musicxmlevent,int nr_ornament);
+	void addOrnament(c_ornament *ornament, c_musicxmlevent *musicxmlevent, int nr_ornament, int nrEvent = -1);
 	void compileCrescendo();
 	void compileTransposition();
 	void compileArppegio();
 	void compilePedalBar();
-	void removeExpresseurPart();
+	void removeExpresseurPart(c_score_partwise *s);
 	void createListMeasures();
 	void buildMeasures();
 	void compileScore();
+	void compilePart(c_part_job *job);
 	void delete_bar_label(c_measure *newMeasure);
 	void addExpresseurPart();
 	void compileExpresseurPart();
@@ -290,11 +358,18 @@ private:
 	wxArrayInt measureList; // list of measures to play, refer to markList and score. e.g. 10,11,12,13,14,15,16,17,14,15,16,17,10,11,12,13
 	l_ornament lOrnaments; // list of lOrnaments to compile and add 
 	c_score_partwise *compiled_score = NULL; // score compiled, refer to score, measureList, partidToPlay, partidToPlay
-	l_musicxmlevent lMusicxmlevents;
-	l_musicxmlevent lOrnamentsMusicxmlevents;
+	c_musicxmlevents lMusicxmlevents;
+	std::vector<c_musicxmlevent> lOrnamentsMusicxmlevents; // added by the ornaments, texts interned in lMusicxmlevents
 	wxString grace;
 	l_arpeggiate_toapply lArpeggiate_toapply;
 	int nbEvents = 0;
+	unsigned long long xmlHash = 0; // hash of the source xml, key of the cache
+	// state of the last compilation, for the next one of the same score ( e.g. after an edit of the marks )
+	unsigned long long baseKey = 0; // structureKey of the base
+	c_musicxmlevents lBaseMusicxmlevents; // notes to play, before the ornaments
+	c_part *base_part_expresseur = NULL; // Expresseur part of compiled_score, before the ornaments
+	std::vector<char> luaPushed; // events packed, pushed to LUA
+	wxArrayString luaTracks; // tracks pushed to LUA
 };
 
 
@@ -0,0 +1,647 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        musicxmlreader.cpp
+// Purpose:     streaming loader of musicxml /  expresseur V3
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include "wx/wxprec.h"
+
+#ifdef __BORLANDC__
+#pragma hdrstop
+#endif
+
+#ifndef WX_PRECOMP
+#include "wx/wx.h"
+#endif
+
+#include "wx/xml/xml.h"
+#include "wx/stream.h"
+#include "wx/strconv.h"
+
+#include <string>
+#include <vector>
+
+#include "global.h"
+
+#include "musicxml.h"
+#include "musicxmlreader.h"
+
+static int utf8(char *p, long cp)
+{
+	// write the code-point cp in UTF-8. Return the number of bytes
+	if (cp < 0x80)
+	{
+		p[0] = (char)cp;
+		return 1;
+	}
+	if (cp < 0x800)
+	{
+		p[0] = (char)(0xC0 | (cp >> 6));
+		p[1] = (char)(0x80 | (cp & 0x3F));
+		return 2;
+	}
+	if (cp < 0x10000)
+	{
+		p[0] = (char)(0xE0 | (cp >> 12));
+		p[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		p[2] = (char)(0x80 | (cp & 0x3F));
+		return 3;
+	}
+	p[0] = (char)(0xF0 | (cp >> 18));
+	p[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+	p[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+	p[3] = (char)(0x80 | (cp & 0x3F));
+	return 4;
+}
+static bool xmlblank(int c)
+{
+	return ((c == ' ') || (c == '\n') || (c == '\r') || (c == '\t'));
+}
+
+unsigned long long c_musicxml_reader::hashBytes(unsigned long long h, const void *p, size_t n)
+{
+	// FNV-1a of n bytes, continuing the hash h
+	const unsigned char *c = (const unsigned char *)p;
+	for (size_t i = 0; i < n; i++)
+	{
+		h ^= c[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+c_musicxml_reader::c_musicxml_reader(wxInputStream *stream)
+{
+	in = stream;
+	buf = new char[XMLREADER_BUFFER];
+}
+c_musicxml_reader::~c_musicxml_reader()
+{
+	delete[] buf;
+	if (conv != NULL)
+		delete conv;
+}
+void c_musicxml_reader::transcode(const unsigned char *raw, size_t n)
+{
+	// append UTF-16 bytes in the buffer, transcoded in UTF-8
+	for (size_t i = 0; i < n; i++)
+	{
+		if (oddbyte < 0)
+		{
+			oddbyte = raw[i];
+			continue;
+		}
+		long u = bigendian ? ((oddbyte << 8) | raw[i]) : ((raw[i] << 8) | oddbyte);
+		oddbyte = -1;
+		if ((u >= 0xD800) && (u < 0xDC00))
+		{
+			surrogate = u;
+			continue;
+		}
+		long cp = u;
+		if ((u >= 0xDC00) && (u < 0xE000))
+			cp = (surrogate == 0) ? 0xFFFD : (0x10000 + ((surrogate - 0xD800) << 10) + (u - 0xDC00));
+		surrogate = 0;
+		len += utf8(buf + len, cp);
+	}
+}
+bool c_musicxml_reader::fill()
+{
+	// refill the buffer from the stream. Return false at the end of the stream
+	pos = 0;
+	len = 0;
+	while (len == 0)
+	{
+		if (utf16)
+		{
+			// up to 4 bytes of UTF-8 for 2 bytes of UTF-16
+			unsigned char raw[XMLREADER_BUFFER / 2];
+			in->Read(raw, XMLREADER_BUFFER / 2);
+			size_t n = in->LastRead();
+			if (n == 0)
+				return false;
+			nbBytes += n;
+			hash = hashBytes(hash, raw, n);
+			transcode(raw, n);
+		}
+		else
+		{
+			in->Read(buf, XMLREADER_BUFFER);
+			len = in->LastRead();
+			if (len == 0)
+				return false;
+			nbBytes += len;
+			hash = hashBytes(hash, buf, len);
+		}
+	}
+	return true;
+}
+void c_musicxml_reader::start()
+{
+	// detect the encoding with the first bytes : UTF-8 ( with or without BOM ), or UTF-16
+	unsigned char raw[4];
+	in->Read(raw, 4);
+	size_t n = in->LastRead();
+	nbBytes += n;
+	hash = hashBytes(hash, raw, n);
+	pos = 0;
+	len = 0;
+	if ((n >= 2) && (((raw[0] == 0xFF) && (raw[1] == 0xFE)) || ((raw[0] == 0xFE) && (raw[1] == 0xFF))))
+	{
+		utf16 = true;
+		bigendian = (raw[0] == 0xFE);
+		transcode(raw + 2, n - 2);
+		return;
+	}
+	if ((n == 4) && (((raw[0] == '<') && (raw[1] == 0)) || ((raw[0] == 0) && (raw[1] == '<'))))
+	{
+		utf16 = true;
+		bigendian = (raw[0] == 0);
+		transcode(raw, n);
+		return;
+	}
+	size_t skip = 0;
+	if ((n >= 3) && (raw[0] == 0xEF) && (raw[1] == 0xBB) && (raw[2] == 0xBF))
+		skip = 3;
+	for (size_t i = skip; i < n; i++)
+		buf[len++] = (char)(raw[i]);
+}
+inline int c_musicxml_reader::getch()
+{
+	// next byte of the stream, -1 at the end
+	if ((pos >= len) && (!fill()))
+		return -1;
+	char c = buf[pos++];
+	if (c == '\n')
+		line++;
+	return (unsigned char)c;
+}
+bool c_musicxml_reader::fail(const char *reason)
+{
+	if (error.IsEmpty())
+		error.Printf("MusicXML error line %d : %s", line, reason);
+	return false;
+}
+bool c_musicxml_reader::readUntil(const char *s, std::string *out)
+{
+	// read until the sequence s ( max 3 bytes ), which is consumed. The bytes before s are appended in out
+	size_t n = strlen(s);
+	char last[3] = { 0, 0, 0 };
+	while (true)
+	{
+		int c = getch();
+		if (c == -1)
+			return fail("unexpected end of file");
+		last[0] = last[1];
+		last[1] = last[2];
+		last[2] = (char)c;
+		if (out != NULL)
+			*out += (char)c;
+		if (memcmp(last + 3 - n, s, n) == 0)
+		{
+			if (out != NULL)
+				out->resize(out->size() - n);
+			return true;
+		}
+	}
+}
+int c_musicxml_reader::readName(int c)
+{
+	// read a name starting with c. Return the byte following the name
+	name.clear();
+	while ((c != -1) && (!xmlblank(c)) && (c != '/') && (c != '>') && (c != '=') && (c != '?'))
+	{
+		name += (char)c;
+		c = getch();
+	}
+	return c;
+}
+bool c_musicxml_reader::readAttributes(int c)
+{
+	// read the attributes of the element started, until > or />
+	attributes.clear();
+	while (true)
+	{
+		while (xmlblank(c))
+			c = getch();
+		if (c == '>')
+			return true;
+		if (c == '/')
+		{
+			if (getch() != '>')
+				return fail("> expected after /");
+			pendingEnd = true;
+			return true;
+		}
+		if (c == -1)
+			return fail("unexpected end of file");
+		std::string attr;
+		while ((c != -1) && (!xmlblank(c)) && (c != '=') && (c != '>') && (c != '/'))
+		{
+			attr += (char)c;
+			c = getch();
+		}
+		while (xmlblank(c))
+			c = getch();
+		if (c != '=')
+			return fail("= expected after an attribute");
+		c = getch();
+		while (xmlblank(c))
+			c = getch();
+		if ((c != '"') && (c != '\''))
+			return fail("quote expected for an attribute value");
+		int quote = c;
+		std::string value;
+		while ((c = getch()) != quote)
+		{
+			if ((c == -1) || (c == '<'))
+				return fail("unterminated attribute value");
+			value += (char)(xmlblank(c) ? ' ' : c);
+		}
+		attributes.push_back(attr);
+		attributes.push_back(value);
+		c = getch();
+	}
+}
+bool c_musicxml_reader::readDeclaration()
+{
+	// <?xml ... ?> : the encoding, if it is not UTF-8
+	std::string decl;
+	if (!readUntil("?>", &decl))
+		return false;
+	size_t p = decl.find("encoding");
+	if ((p == std::string::npos) || (utf16))
+		return true;
+	p = decl.find_first_of("\"'", p);
+	if (p == std::string::npos)
+		return true;
+	size_t e = decl.find(decl[p], p + 1);
+	if (e == std::string::npos)
+		return true;
+	wxString encoding(decl.substr(p + 1, e - p - 1).c_str());
+	encoding.MakeLower();
+	if ((encoding == "utf-8") || (encoding == "utf8") || (encoding == "us-ascii") || (encoding == "ascii"))
+		return true;
+	conv = new wxCSConv(encoding);
+	if (!conv->IsOk())
+		return fail("unknown encoding");
+	return true;
+}
+bool c_musicxml_reader::skipDoctype()
+{
+	// <!DOCTYPE ... [ ... ] > : ignored
+	int depth = 0;
+	int quote = 0;
+	while (true)
+	{
+		int c = getch();
+		if (c == -1)
+			return fail("unexpected end of file in DOCTYPE");
+		if (quote != 0)
+		{
+			if (c == quote)
+				quote = 0;
+		}
+		else if ((c == '"') || (c == '\''))
+			quote = c;
+		else if (c == '[')
+			depth++;
+		else if (c == ']')
+			depth--;
+		else if ((c == '>') && (depth <= 0))
+			return true;
+	}
+}
+int c_musicxml_reader::next()
+{
+	// next event of the stream : start of an element, end of an element, text
+	if (pendingEnd)
+	{
+		// end of the empty element <name/>
+		pendingEnd = false;
+		name = open.back();
+		open.pop_back();
+		return XML_END;
+	}
+	while (true)
+	{
+		int c = getch();
+		if (c == -1)
+		{
+			if (!open.empty())
+			{
+				fail("unexpected end of file");
+				return XML_ERROR;
+			}
+			return XML_EOF;
+		}
+		if (c != '<')
+		{
+			// text until the next tag. Text with only blanks is ignored, as in wxXmlDocument
+			text.clear();
+			bool blank = true;
+			bool cr = false;
+			while ((c != '<') && (c != -1))
+			{
+				if (c == '\r')
+				{
+					c = '\n';
+					cr = true;
+				}
+				else if ((c == '\n') && (cr))
+				{
+					cr = false;
+					c = getch();
+					continue;
+				}
+				else
+					cr = false;
+				if (!xmlblank(c))
+					blank = false;
+				text += (char)c;
+				c = getch();
+			}
+			if (c == '<')
+				pos--; // the tag is read by the next call
+			if (blank)
+				continue;
+			return XML_TEXT;
+		}
+		c = getch();
+		if (c == '/')
+		{
+			c = readName(getch());
+			while (xmlblank(c))
+				c = getch();
+			if (c != '>')
+			{
+				fail("> expected in an end tag");
+				return XML_ERROR;
+			}
+			if (open.empty() || (open.back() != name))
+			{
+				fail("end tag not matching the start tag");
+				return XML_ERROR;
+			}
+			open.pop_back();
+			return XML_END;
+		}
+		if (c == '?')
+		{
+			c = readName(getch());
+			if (c == '?')
+			{
+				if (getch() != '>')
+				{
+					fail("> expected after ?");
+					return XML_ERROR;
+				}
+				continue;
+			}
+			if ((name == "xml") ? (!readDeclaration()) : (!readUntil("?>", NULL)))
+				return XML_ERROR;
+			continue;
+		}
+		if (c == '!')
+		{
+			c = getch();
+			if (c == '-')
+			{
+				if ((getch() != '-') || (!readUntil("-->", NULL)))
+				{
+					fail("malformed comment");
+					return XML_ERROR;
+				}
+				continue;
+			}
+			if (c == '[')
+			{
+				const char *cdata = "CDATA[";
+				for (int i = 0; cdata[i] != '\0'; i++)
+				{
+					if (getch() != cdata[i])
+					{
+						fail("malformed CDATA");
+						return XML_ERROR;
+					}
+				}
+				text.clear();
+				if (!readUntil("]]>", &text))
+					return XML_ERROR;
+				return XML_TEXT;
+			}
+			if (!skipDoctype())
+				return XML_ERROR;
+			continue;
+		}
+		// start tag
+		c = readName(c);
+		if (name.empty())
+		{
+			fail("element name expected");
+			return XML_ERROR;
+		}
+		if (!readAttributes(c))
+			return XML_ERROR;
+		open.push_back(name);
+		nbElements++;
+		return XML_START;
+	}
+}
+wxString c_musicxml_reader::str(const char *s, size_t n)
+{
+	// decode bytes of the stream. Invalid UTF-8 is read as latin-1
+	if (conv != NULL)
+		return wxString(s, *conv, n);
+	wxString w = wxString::FromUTF8(s, n);
+	if (w.IsEmpty() && (n > 0))
+		w = wxString(s, wxConvISO8859_1, n);
+	return w;
+}
+wxString c_musicxml_reader::str(const std::string &s)
+{
+	// decode bytes of the stream, with the entities
+	size_t amp = s.find('&');
+	if (amp == std::string::npos)
+		return str(s.data(), s.size());
+	wxString w;
+	std::string segment(s, 0, amp);
+	size_t i = amp;
+	while (i < s.size())
+	{
+		size_t semicolon;
+		if ((s[i] != '&') || ((semicolon = s.find(';', i)) == std::string::npos))
+		{
+			segment += s[i++];
+			continue;
+		}
+		std::string entity(s, i + 1, semicolon - i - 1);
+		if (entity == "lt")
+			segment += '<';
+		else if (entity == "gt")
+			segment += '>';
+		else if (entity == "amp")
+			segment += '&';
+		else if (entity == "quot")
+			segment += '"';
+		else if (entity == "apos")
+			segment += '\'';
+		else if ((entity.size() > 1) && (entity[0] == '#'))
+		{
+			long cp = (entity[1] == 'x') ? strtol(entity.c_str() + 2, NULL, 16) : strtol(entity.c_str() + 1, NULL, 10);
+			char u[4];
+			int nb = utf8(u, ((cp > 0) && (cp < 0x110000)) ? cp : 0xFFFD);
+			w += str(segment.data(), segment.size());
+			w += wxString::FromUTF8(u, nb);
+			segment.clear();
+		}
+		else
+			segment += s.substr(i, semicolon - i + 1);
+		i = semicolon + 1;
+	}
+	w += str(segment.data(), segment.size());
+	return w;
+}
+wxString c_musicxml_reader::attribute(const char *attr)
+{
+	// value of an attribute of the element started. Return NULL_STRING if no attribute
+	for (size_t i = 0; i + 1 < attributes.size(); i += 2)
+	{
+		if (attributes[i] == attr)
+			return str(attributes[i + 1]);
+	}
+	return NULL_STRING;
+}
+wxXmlNode *c_musicxml_reader::element()
+{
+	// wxXmlNode of the element started
+	wxXmlNode *node = new wxXmlNode(wxXML_ELEMENT_NODE, str(name));
+	for (size_t i = 0; i + 1 < attributes.size(); i += 2)
+		node->AddAttribute(str(attributes[i]), str(attributes[i + 1]));
+	return node;
+}
+wxXmlNode *c_musicxml_reader::fragment()
+{
+	// wxXmlNode of the element started, with its content, until its end
+	wxXmlNode *root = element();
+	wxXmlNode *current = root;
+	wxXmlNode *child;
+	while (true)
+	{
+		switch (next())
+		{
+		case XML_START:
+			child = element();
+			current->AddChild(child);
+			current = child;
+			break;
+		case XML_END:
+			if (current == root)
+				return root;
+			current = current->GetParent();
+			break;
+		case XML_TEXT:
+			current->AddChild(new wxXmlNode(wxXML_TEXT_NODE, wxEmptyString, str(text)));
+			break;
+		default:
+			delete root;
+			return NULL;
+		}
+	}
+}
+bool c_musicxml_reader::skip()
+{
+	// skip the content of the element started, until its end
+	size_t depth = open.size();
+	while (open.size() >= depth)
+	{
+		int event = next();
+		if ((event == XML_EOF) || (event == XML_ERROR))
+			return false;
+	}
+	return true;
+}
+c_score_partwise *c_musicxml_reader::load()
+{
+	// read the stream, and build the C++ score structure along
+
+	if ((in == NULL) || (!in->IsOk()))
+	{
+		error = "MusicXML stream cannot be read";
+		return NULL;
+	}
+	start();
+
+	int event;
+	while ((event = next()) == XML_TEXT);
+	if (event != XML_START)
+	{
+		if (event == XML_EOF)
+			fail("no root element");
+		return NULL;
+	}
+	if (name != "score-partwise")
+	{
+		error = "Only musicXML score-partwise is accepted";
+		return NULL;
+	}
+
+	c_score_partwise *score = new c_score_partwise();
+	c_part *part = NULL;
+	wxXmlNode *node;
+	bool ok = true;
+	while (ok && (!open.empty()))
+	{
+		event = next();
+		if (event == XML_START)
+		{
+			if ((open.size() == 2) && (name == "part"))
+			{
+				part = new c_part(attribute("id"));
+				score->parts.Append(part);
+			}
+			else if ((open.size() == 3) && (part != NULL) && (name == "measure"))
+			{
+				ok = ((node = fragment()) != NULL);
+				if (ok)
+				{
+					part->measures.Append(new c_measure(node));
+					nbMeasures++;
+					delete node;
+				}
+			}
+			else if ((open.size() == 2) && ((name == "work") || (name == "part-list")))
+			{
+				bool work = (name == "work");
+				ok = ((node = fragment()) != NULL);
+				if (ok)
+				{
+					if (work)
+						score->work = new c_work(node);
+					else
+						score->part_list = new c_part_list(node);
+					delete node;
+				}
+			}
+			else
+				ok = skip();
+		}
+		else if (event == XML_END)
+		{
+			if (open.size() == 1)
+				part = NULL;
+		}
+		else if (event != XML_TEXT)
+			ok = false;
+	}
+	if (!ok)
+	{
+		delete score;
+		return NULL;
+	}
+	return score;
+}
@@ -0,0 +1,64 @@
+// update : 16/10/2026
+
+#ifndef DEF_MUSICXMLREADER
+
+#define DEF_MUSICXMLREADER
+
+#define XMLREADER_BUFFER 65536 // size of the read buffer
+#define XMLREADER_HASH_SEED 14695981039346656037ULL // FNV-1a 64 bits
+
+// streaming loader of a MusicXML score-partwise
+// The bytes are tokenized as they are read from the stream ( file, or entry of a .mxl zip ).
+// The C++ score structure is built along : only one measure ( or work, part-list ) at a time
+// is held as a wxXmlNode fragment, to reuse the constructors of musicxml.cpp, then freed.
+class c_musicxml_reader
+{
+public:
+	c_musicxml_reader(wxInputStream *stream);
+	~c_musicxml_reader();
+	c_score_partwise *load(); // return NULL on error, explained in error
+	wxString error;
+	long long nbBytes = 0; // bytes read from the stream
+	long nbElements = 0; // elements tokenized
+	long nbMeasures = 0; // measures loaded
+	unsigned long long hash = XMLREADER_HASH_SEED; // hash of the bytes read from the stream
+	static unsigned long long hashBytes(unsigned long long h, const void *p, size_t n);
+
+private:
+	enum { XML_EOF, XML_ERROR, XML_START, XML_END, XML_TEXT };
+	wxInputStream *in;
+	char *buf;
+	size_t pos = 0;
+	size_t len = 0;
+	int line = 1;
+	bool utf16 = false; // the stream is UTF-16, transcoded in UTF-8 in the buffer
+	bool bigendian = false;
+	int surrogate = 0; // pending high surrogate of the UTF-16 transcoding
+	int oddbyte = -1; // pending byte of the UTF-16 transcoding
+	wxMBConv *conv = NULL; // conversion of the strings, NULL for UTF-8
+	bool pendingEnd = false; // empty element <name/> : its end is the next event
+	std::string name; // name of the element started or ended
+	std::string text; // text, or CDATA
+	std::vector<std::string> attributes; // name, value, name, value, ...
+	std::vector<std::string> open; // names of the elements started, not ended
+
+	void start();
+	void transcode(const unsigned char *raw, size_t n);
+	bool fill();
+	int getch();
+	bool fail(const char *reason);
+	bool readUntil(const char *s, std::string *out);
+	int readName(int c);
+	bool readAttributes(int c);
+	bool readDeclaration();
+	bool skipDoctype();
+	int next();
+	wxString str(const char *s, size_t n);
+	wxString str(const std::string &s);
+	wxString attribute(const char *attr);
+	wxXmlNode *element();
+	wxXmlNode *fragment();
+	bool skip();
+};
+
+#endif
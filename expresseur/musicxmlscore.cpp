@@ -44,6 +44,9 @@
 #include "wx/zipstrm.h"
 #include "wx/dynarray.h"
 #include "wx/dynlib.h"
+#include "wx/hashmap.h"
+
+#include <vector>
 
 #include "global.h"
 #include "luabass.h"
@@ -69,6 +72,11 @@ EVT_PAINT(musicxmlscore::onPaint)
 EVT_SIZE(musicxmlscore::OnSize)
 wxEND_EVENT_TABLE()
 
+musicxmlcompile *musicxmlscore::lastXmlCompile = NULL;
+wxFileName musicxmlscore::lastXmlFile;
+wxDateTime musicxmlscore::lastXmlTime;
+wxULongLong musicxmlscore::lastXmlSize;
+
 musicxmlscore::musicxmlscore(wxWindow *parent, wxWindowID id, mxconf* lconf, const wxDynamicLibrary  &myDll)
 : viewerscore(parent, id)
 {
@@ -107,11 +115,17 @@ musicxmlscore::musicxmlscore(wxWindow *parent, wxWindowID id, mxconf* lconf, con
 }
 musicxmlscore::~musicxmlscore()
 {
-	if (xmlCompile != NULL)
-		delete xmlCompile;
+	// the compilation is kept in lastXmlCompile, for the next viewer
 	xmlCompile = NULL;
 
 }
+void musicxmlscore::clearCompile()
+{
+	if (lastXmlCompile != NULL)
+		delete lastXmlCompile;
+	lastXmlCompile = NULL;
+	lastXmlFile.Clear();
+}
 bool musicxmlscore::xmlIsOk()
 {
 	if (xmlCompile == NULL)
@@ -131,27 +145,23 @@ bool musicxmlscore::setFile(const wxFileName &lfilename, bool WXUNUSED(onstart))
 	rectPrevPos.SetWidth(0);
 	measurePage.Clear();
 
-	if (xmlCompile != NULL)
-		delete xmlCompile;
-	xmlCompile = new musicxmlcompile();
+	if (lastXmlCompile == NULL)
+		lastXmlCompile = new musicxmlcompile();
+	xmlCompile = lastXmlCompile;
 
 	wxFileName fm;
 	fm.SetPath(wxFileName::GetTempDir());
-	fm.SetFullName("expresseur_in.xml");
-	xmlCompile->music_xml_complete_file = fm.GetFullPath();
 	fm.SetFullName("expresseur_out.xml");
 	xmlCompile->music_xml_displayed_file = fm.GetFullPath();
 
 	if ((lfilename.GetExt() == SUFFIXE_MUSICXML) || (lfilename.GetExt() == SUFFIXE_MUSICMXL))
 	{
-		// extract the music_xml_complete_file from the xmlname file ( compressed with zipped or not )
-		if (!xmlExtractXml(lfilename))
-			return false;
 		wxFileName txtfile(lfilename);
 		txtfile.SetExt(SUFFIXE_TEXT);
 		xmlCompile->setNameFile(txtfile, lfilename);
-		// compile the musicxml-source-file, to create the music-xml-expresseur MUSICXML_FILE for display
-		xmlCompile->loadXmlFile(xmlCompile->music_xml_complete_file, xmlCompile->music_xml_displayed_file, false);
+		// read the xmlname file ( compressed with zipped or not ), and compile it to create the music-xml-expresseur MUSICXML_FILE for display
+		if (!xmlLoadFile(lfilename, false))
+			return false;
 	}
 	if (lfilename.GetExt() == SUFFIXE_TEXT)
 	{
@@ -159,34 +169,41 @@ bool musicxmlscore::setFile(const wxFileName &lfilename, bool WXUNUSED(onstart))
 		if ((!xmlfile.IsOk()) || ((xmlfile.GetExt() != SUFFIXE_MUSICXML) && (xmlfile.GetExt() != SUFFIXE_MUSICMXL)))
 			return false;
 		xmlCompile->setNameFile(lfilename, xmlfile);
-		// extract the music_xml_complete_file from the xmlname file ( compressed with zipped or not )
-		if (!xmlExtractXml(xmlfile))
+		// read the xmlname file ( compressed with zipped or not ), and compile it to create the music-xml-expresseur MUSICXML_FILE for display
+		if (!xmlLoadFile(xmlfile, true))
 			return false;
-		// compile the musicxml-source-file, to create the music-xml-expresseur MUSICXML_FILE for display
-		xmlCompile->loadXmlFile(xmlCompile->music_xml_complete_file, xmlCompile->music_xml_displayed_file, true);
 	}
 	return xmlIsOk();
 }
-bool musicxmlscore::xmlExtractXml(wxFileName f)
+bool musicxmlscore::xmlLoadFile(wxFileName f, bool useMarkFile)
 {
-	// extract musicXML file, not conpressed , in the file MUSICXML_COMPLETE_FILE
+	// load and compile the musicXML file, streamed from the file, or from the zip entry of a compressed mxl
 
 	wxBusyCursor wait;
+	// same musicxml file, unchanged since the last load : only the compilation is done again ( marks, ornaments )
+	wxDateTime t = f.GetModificationTime();
+	wxULongLong size = f.GetSize();
+	if ((f.SameAs(lastXmlFile)) && (t.IsValid()) && (t == lastXmlTime) && (size == lastXmlSize) && (xmlCompile->isOk()))
+		return xmlCompile->compileXmlFile(xmlCompile->music_xml_displayed_file, useMarkFile);
+	lastXmlFile = f;
+	lastXmlTime = t;
+	lastXmlSize = size;
 	if ((f.GetExt() == SUFFIXE_MUSICXML) && (f.IsFileReadable()))
 	{
-		// xml file not compressed. Copy it directky to the temporary full score MUSICXML_COMPLETE_FILE
-		if (!wxCopyFile(f.GetFullPath(), xmlCompile->music_xml_complete_file))
+		// xml file not compressed
+		wxFFileInputStream in(f.GetFullPath());
+		if (!in.IsOk())
 		{
 			wxString s;
-			s.sprintf("File %s cannot be copy in %s", f.GetFullPath(), xmlCompile->music_xml_complete_file);
+			s.sprintf("Error opening stream file %s", f.GetFullName());
 			wxMessageBox(s);
 			return false;
 		}
-		return true;
+		return xmlCompile->loadXmlFile(&in, xmlCompile->music_xml_displayed_file, useMarkFile);
 	}
 	if ((f.GetExt() != SUFFIXE_MUSICMXL) || (!(f.IsFileReadable())))
 		return false;
-	// xml file compressed ( mxl ). unzip to the temporary full score MUSICXML_COMPLETE_FILE
+	// xml file compressed ( mxl ). The score is read from the zip entry, decompressed on the fly
 	wxFFileInputStream in(f.GetFullPath());
 	if (!in.IsOk())
 	{
@@ -212,27 +229,11 @@ bool musicxmlscore::xmlExtractXml(wxFileName f)
 		wxString name = zipEntry->GetName();
 		delete zipEntry;
 		wxFileName ffzip(name);
-		if (ffzip.GetDirCount() == 0)
+		if ((ffzip.GetDirCount() == 0) && (ffzip.GetFullName() != "mimetype"))
 		{
-			wxFileOutputStream  stream_out(xmlCompile->music_xml_complete_file);
-			if (!stream_out.IsOk())
-			{
-				wxString s;
-				s.sprintf("Error reading zip entry %s of %s", name, xmlName.GetFullName());
-				wxMessageBox(s);
-				return false;
-			}
-			zip.Read(stream_out);
-			if (zip.LastRead() < 10)
-			{
-				wxString s;
-				s.sprintf("Error content in zip entry %s of %s", name, xmlName.GetFullName());
-				wxMessageBox(s);
-				return false;
-			}
-			stream_out.Close();
+			bool ret = xmlCompile->loadXmlFile(&zip, xmlCompile->music_xml_displayed_file, useMarkFile);
 			zip.CloseEntry();
-			return true;
+			return ret;
 		}
 		zipEntry = zip.GetNextEntry();
 	}
@@ -1,4 +1,4 @@
-// update : 15/11/2016 18:00
+// update : 16/10/2026
 
 #ifndef DEF_MUSICXMLSCORE
 
@@ -46,6 +46,8 @@ public:
 	virtual void zoom(int dzoom);
 	virtual void gotoPosition();
 
+	static void clearCompile();
+
 private:
 	wxWindow *mParent;
 	mxconf *mConf;
@@ -64,7 +66,12 @@ private:
 	MNLFindPositionProc *MNLFindPosition;
 
 	musicxmlcompile *xmlCompile = NULL;
-	bool xmlExtractXml(wxFileName f);
+	// compilation kept from one viewer to the next : the same musicxml file, unchanged, is not loaded again
+	static musicxmlcompile *lastXmlCompile;
+	static wxFileName lastXmlFile;
+	static wxDateTime lastXmlTime;
+	static wxULongLong lastXmlSize;
+	bool xmlLoadFile(wxFileName f, bool useMarkFile);
 	bool xmlLoad();
 	bool xmlLoadMusicXml();
 
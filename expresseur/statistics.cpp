@@ -0,0 +1,154 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        statistics.cpp
+// Purpose:     non-modal dialog to display the latency of the Midi processing /  expresseur V3
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+// For compilers that support precompilation, includes "wx/wx.h".
+#include "wx/wxprec.h"
+
+#ifdef __BORLANDC__
+#pragma hdrstop
+#endif
+
+#ifndef WX_PRECOMP
+#include "wx/wx.h"
+#endif
+
+
+#include "wx/dialog.h"
+#include "wx/sizer.h"
+#include "wx/checkbox.h"
+#include "wx/listctrl.h"
+
+
+#include "global.h"
+#include "statistics.h"
+#include "luabass.h"
+#include "basslua.h"
+
+enum
+{
+	IDM_STATISTICS_MEASURE = ID_STATISTICS,
+	IDM_STATISTICS_RESET,
+	IDM_STATISTICS_CLOSE
+};
+
+wxBEGIN_EVENT_TABLE(statistics, statistics::wxDialog)
+EVT_CHECKBOX(IDM_STATISTICS_MEASURE, statistics::OnStatisticsMeasure)
+EVT_BUTTON(IDM_STATISTICS_RESET, statistics::OnStatisticsReset)
+EVT_BUTTON(IDM_STATISTICS_CLOSE, statistics::OnStatisticsClose)
+EVT_SIZE(statistics::OnSize)
+wxEND_EVENT_TABLE()
+
+statistics::statistics(wxFrame *parent, wxWindowID id, const wxString &title)
+: wxDialog(parent, id, title, wxPoint(20, 20), wxDefaultSize, wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER)
+{
+	// some sizerFlags commonly used
+	sizerFlagMaximumPlace.Proportion(1);
+	sizerFlagMaximumPlace.Expand();
+	sizerFlagMaximumPlace.Border(wxALL, 2);
+
+	sizerFlagMinimumPlace.Proportion(0);
+	sizerFlagMinimumPlace.Border(wxALL, 2);
+
+	wxBoxSizer *topsizer = new wxBoxSizer(wxVERTICAL);
+
+	// latency per stage, from the midiin driver callback up to the midiout
+	mlatency = new wxListCtrl(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_SINGLE_SEL);
+	mlatency->AppendColumn(_("Stage"));
+	mlatency->AppendColumn(_("Nb"), wxLIST_FORMAT_RIGHT);
+	mlatency->AppendColumn(_("Average (us)"), wxLIST_FORMAT_RIGHT);
+	mlatency->AppendColumn(_("Max (us)"), wxLIST_FORMAT_RIGHT);
+	mlatency->AppendColumn(_("Histogram ( < us : nb )"), wxLIST_FORMAT_LEFT, 400);
+	mlatency->SetMinSize(wxSize(700, 180));
+	topsizer->Add(mlatency, sizerFlagMaximumPlace);
+
+	// waiting queue of the midiin devices
+	mmidiin = new wxListCtrl(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_SINGLE_SEL);
+	mmidiin->AppendColumn(_("Midi-in"));
+	mmidiin->AppendColumn(_("Received"), wxLIST_FORMAT_RIGHT);
+	mmidiin->AppendColumn(_("Waiting"), wxLIST_FORMAT_RIGHT);
+	mmidiin->AppendColumn(_("Max waiting"), wxLIST_FORMAT_RIGHT);
+	mmidiin->AppendColumn(_("Overflow"), wxLIST_FORMAT_RIGHT);
+	mmidiin->SetMinSize(wxSize(700, 120));
+	topsizer->Add(mmidiin, sizerFlagMaximumPlace);
+
+	wxBoxSizer *buttonSizer = new wxBoxSizer(wxHORIZONTAL);
+
+	mmeasure = new wxCheckBox(this, IDM_STATISTICS_MEASURE, _("Measure latency"));
+	buttonSizer->Add(mmeasure, sizerFlagMinimumPlace);
+	wxButton *bReset = new wxButton(this, IDM_STATISTICS_RESET, _("Reset"));
+	buttonSizer->Add(bReset, sizerFlagMaximumPlace);
+	wxButton *bClose = new wxButton(this, IDM_STATISTICS_CLOSE, _("Close"));
+	buttonSizer->Add(bClose, sizerFlagMaximumPlace);
+
+	topsizer->Add(buttonSizer, sizerFlagMinimumPlace);
+
+	SetSizerAndFit(topsizer);
+	Layout();
+}
+statistics::~statistics()
+{
+	basslua_setLatency(false, false);
+}
+
+void statistics::OnSize(wxSizeEvent& WXUNUSED(event))
+{
+	Layout();
+}
+void statistics::OnStatisticsClose(wxCommandEvent& WXUNUSED(event))
+{
+	Close();
+}
+void statistics::OnStatisticsReset(wxCommandEvent& WXUNUSED(event))
+{
+	basslua_setLatency(mmeasure->GetValue(), true);
+	scanStatistics();
+}
+void statistics::OnStatisticsMeasure(wxCommandEvent& WXUNUSED(event))
+{
+	basslua_setLatency(mmeasure->GetValue(), false);
+}
+void statistics::scanStatistics()
+{
+	T_basslua_latency stat;
+	for (int nrStage = 0; basslua_getLatency(nrStage, &stat); nrStage++)
+	{
+		if (nrStage >= mlatency->GetItemCount())
+			mlatency->InsertItem(nrStage, stat.name);
+		mlatency->SetItem(nrStage, 1, wxString::Format("%lld", stat.nb));
+		mlatency->SetItem(nrStage, 2, wxString::Format("%lld", stat.average_us));
+		mlatency->SetItem(nrStage, 3, wxString::Format("%lld", stat.max_us));
+		wxString histogram;
+		for (int b = 0; b < BASSLUA_LATENCY_BUCKET; b++)
+		{
+			if (stat.histogram[b] == 0)
+				continue;
+			if (stat.limit[b] > 0)
+				histogram += wxString::Format("<%lld:%lld ", stat.limit[b], stat.histogram[b]);
+			else
+				histogram += wxString::Format(">=%lld:%lld ", stat.limit[b - 1], stat.histogram[b]);
+		}
+		mlatency->SetItem(nrStage, 4, histogram);
+	}
+	int depth, maxDepth, overflow, received;
+	int nrItem = 0;
+	for (int nrDevice = 0; basslua_getMidiinStat(nrDevice, &depth, &maxDepth, &overflow, &received); nrDevice++)
+	{
+		if (received == 0)
+			continue;
+		if (nrItem >= mmidiin->GetItemCount())
+			mmidiin->InsertItem(nrItem, wxEmptyString);
+		mmidiin->SetItem(nrItem, 0, wxString::Format("#%d", nrDevice + 1));
+		mmidiin->SetItem(nrItem, 1, wxString::Format("%d", received));
+		mmidiin->SetItem(nrItem, 2, wxString::Format("%d", depth));
+		mmidiin->SetItem(nrItem, 3, wxString::Format("%d", maxDepth));
+		mmidiin->SetItem(nrItem, 4, wxString::Format("%d", overflow));
+		nrItem++;
+	}
+}
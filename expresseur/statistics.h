@@ -0,0 +1,32 @@
+#ifndef DEF_STATISTICS
+
+#define DEF_STATISTICS
+
+class statistics
+	: public wxDialog
+{
+
+public:
+	statistics(wxFrame *parent, wxWindowID id, const wxString &title);
+	~statistics();
+
+	void OnSize(wxSizeEvent& event);
+
+	void OnStatisticsClose(wxCommandEvent& event);
+	void OnStatisticsReset(wxCommandEvent& event);
+	void OnStatisticsMeasure(wxCommandEvent& event);
+
+	void scanStatistics();
+
+private:
+	wxSizerFlags sizerFlagMinimumPlace;
+	wxSizerFlags sizerFlagMaximumPlace;
+
+	wxListCtrl *mlatency;
+	wxListCtrl *mmidiin;
+	wxCheckBox *mmeasure;
+
+	wxDECLARE_EVENT_TABLE();
+};
+
+#endif
@@ -114,7 +114,8 @@ int textscore::scanPosition(bool editmode)
 {
 	int sectionStart, sectionEnd, chordStart, chordEnd , nrChord;
 	bool userModification = this->IsModified();
-	basslua_call(moduleChord, functionChordGetPosition, ">iiiii", &sectionStart, &sectionEnd, &chordStart, &chordEnd, &nrChord);
+	static int callChordGetPosition = basslua_prepare(moduleChord, functionChordGetPosition, ">iiiii");
+	basslua_invoke(callChordGetPosition, &sectionStart, &sectionEnd, &chordStart, &chordEnd, &nrChord);
 	if (nrChord >= 0)
 	{
 		if ((sectionStart != oldsectionStart) || (sectionEnd != oldsectionEnd))
@@ -0,0 +1,191 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        audiobench.cpp
+// Purpose:     check and benchmark of the audio kernels of the virtual instruments /  expresseur V3
+// usage :      audiobench [frames of a block] [iterations]
+//              without arguments, blocks of 256 frames, 20000 iterations
+// Each kernel supported by the CPU ( luabassaudio.h ) is compared with the scalar version, bit per bit, over
+// 1 to 8 channels, odd sizes and unaligned buffers. The interleave is checked against its definition :
+// the output #c of a VSTi goes to the channel #c of the stream.
+// Then the stereo kernels are timed, in nano-seconds per frame.
+// Return 1 if a result differs.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+#include "luabassaudio.h"
+
+#define BENCH_MAXCHANNEL 8
+
+static unsigned long g_random = 12345;
+
+static float benchRandom()
+{
+	// deterministic random samples in [-2, 2[ , with some denormals and zeros
+	g_random = g_random * 1103515245 + 12345;
+	int r = (int)((g_random >> 8) % 100000);
+	if (r < 100)
+		return 0.0f;
+	if (r < 200)
+		return (r & 1) ? 1e-40f : -1e-40f;
+	return (float)(r - 50000) / 25000.0f;
+}
+static void benchFill(std::vector<float> &v)
+{
+	for (unsigned int n = 0; n < v.size(); n++)
+		v[n] = benchRandom();
+}
+static bool same(const float *a, const float *b, int nb)
+{
+	return (nb == 0) || (memcmp(a, b, nb * sizeof(float)) == 0);
+}
+static bool check(const T_audio_kernels *k)
+{
+	// compare the kernels with the scalar version, bit per bit
+	const T_audio_kernels *ref = audio_kernels_get(AUDIO_SCALAR);
+	int sizes[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 255, 256, 1023, 4096 };
+	int nbSizes = sizeof(sizes) / sizeof(int);
+	int errors = 0;
+	for (int nbChannels = 1; nbChannels <= BENCH_MAXCHANNEL; nbChannels++)
+	{
+		for (int s = 0; s < nbSizes; s++)
+		{
+			for (int shift = 0; shift < 2; shift++)
+			{
+				// shift : the buffers are not aligned on 16 bytes
+				int nbFrames = sizes[s];
+				int nb = nbFrames * nbChannels;
+				std::vector<float> planar[BENCH_MAXCHANNEL];
+				float *src[BENCH_MAXCHANNEL];
+				for (int c = 0; c < nbChannels; c++)
+				{
+					planar[c].resize(nbFrames + 1);
+					benchFill(planar[c]);
+					src[c] = &(planar[c][shift]);
+				}
+				std::vector<float> out(nb + 1), outRef(nb + 1);
+				k->interleave(&(out[shift]), src, nbChannels, nbFrames);
+				ref->interleave(&(outRef[shift]), src, nbChannels, nbFrames);
+				bool ok = same(&(out[shift]), &(outRef[shift]), nb);
+				for (int frame = 0; (frame < nbFrames) && ok; frame++)
+				{
+					for (int c = 0; c < nbChannels; c++)
+						ok = ok && (memcmp(&(out[shift + frame * nbChannels + c]), &(src[c][frame]), sizeof(float)) == 0);
+				}
+				if (!ok)
+				{
+					printf("%s interleave %d channels %d frames : FAILED\n", k->name, nbChannels, nbFrames);
+					errors++;
+				}
+
+				std::vector<float> back[BENCH_MAXCHANNEL], backRef[BENCH_MAXCHANNEL];
+				float *dst[BENCH_MAXCHANNEL], *dstRef[BENCH_MAXCHANNEL];
+				for (int c = 0; c < nbChannels; c++)
+				{
+					back[c].resize(nbFrames + 1);
+					backRef[c].resize(nbFrames + 1);
+					dst[c] = &(back[c][shift]);
+					dstRef[c] = &(backRef[c][shift]);
+				}
+				k->deinterleave(dst, &(out[shift]), nbChannels, nbFrames);
+				ref->deinterleave(dstRef, &(out[shift]), nbChannels, nbFrames);
+				ok = true;
+				for (int c = 0; c < nbChannels; c++)
+					ok = ok && same(dst[c], dstRef[c], nbFrames) && same(dst[c], src[c], nbFrames);
+				if (!ok)
+				{
+					printf("%s deinterleave %d channels %d frames : FAILED\n", k->name, nbChannels, nbFrames);
+					errors++;
+				}
+
+				std::vector<float> a(nb + 1), aRef, b(nb + 1);
+				benchFill(a);
+				benchFill(b);
+				aRef = a;
+				float gain = benchRandom();
+				k->gain(&(a[shift]), gain, nb);
+				ref->gain(&(aRef[shift]), gain, nb);
+				if (!same(&(a[shift]), &(aRef[shift]), nb))
+				{
+					printf("%s gain %d samples : FAILED\n", k->name, nb);
+					errors++;
+				}
+				k->sum(&(a[shift]), &(b[shift]), nb);
+				ref->sum(&(aRef[shift]), &(b[shift]), nb);
+				if (!same(&(a[shift]), &(aRef[shift]), nb))
+				{
+					printf("%s sum %d samples : FAILED\n", k->name, nb);
+					errors++;
+				}
+			}
+		}
+	}
+	printf("%s : bit-exact %s\n", k->name, (errors == 0) ? "OK" : "FAILED");
+	return (errors == 0);
+}
+static double elapsed(std::chrono::steady_clock::time_point start, int iterations, int nbFrames)
+{
+	// nano-seconds per frame
+	std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+	return d.count() / ((double)iterations * nbFrames);
+}
+static void bench(const T_audio_kernels *k, int nbFrames, int iterations)
+{
+	// time the stereo kernels, as used by the render of a VSTi
+	std::vector<float> l(nbFrames), r(nbFrames), out(2 * nbFrames), mix(2 * nbFrames);
+	benchFill(l);
+	benchFill(r);
+	float *src[2] = { &(l[0]), &(r[0]) };
+	float *dst[2] = { &(l[0]), &(r[0]) };
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int n = 0; n < iterations; n++)
+		k->interleave(&(out[0]), src, 2, nbFrames);
+	double tInterleave = elapsed(start, iterations, nbFrames);
+	start = std::chrono::steady_clock::now();
+	for (int n = 0; n < iterations; n++)
+		k->deinterleave(dst, &(out[0]), 2, nbFrames);
+	double tDeinterleave = elapsed(start, iterations, nbFrames);
+	start = std::chrono::steady_clock::now();
+	for (int n = 0; n < iterations; n++)
+		k->gain(&(out[0]), (n & 1) ? 2.0f : 0.5f, 2 * nbFrames);
+	double tGain = elapsed(start, iterations, nbFrames);
+	start = std::chrono::steady_clock::now();
+	for (int n = 0; n < iterations; n++)
+		k->sum(&(mix[0]), &(out[0]), 2 * nbFrames);
+	double tSum = elapsed(start, iterations, nbFrames);
+	printf("%-6s stereo %5d frames : interleave %6.3f , deinterleave %6.3f , gain %6.3f , sum %6.3f ns/frame\n",
+		k->name, nbFrames, tInterleave, tDeinterleave, tGain, tSum);
+}
+int main(int argc, char *argv[])
+{
+	int nbFrames = (argc > 1) ? atoi(argv[1]) : 256;
+	int iterations = (argc > 2) ? atoi(argv[2]) : 20000;
+	if ((nbFrames <= 0) || (iterations <= 0))
+	{
+		printf("usage : audiobench [frames of a block] [iterations]\n");
+		return 1;
+	}
+	printf("kernels chosen at runtime : %s\n", audio_kernels()->name);
+	bool ok = true;
+	for (int level = 0; level < AUDIO_NBKERNELS; level++)
+	{
+		const T_audio_kernels *k = audio_kernels_get(level);
+		if (k != NULL)
+			ok = check(k) && ok;
+	}
+	for (int level = 0; level < AUDIO_NBKERNELS; level++)
+	{
+		const T_audio_kernels *k = audio_kernels_get(level);
+		if (k != NULL)
+			bench(k, nbFrames, iterations);
+	}
+	return (ok ? 0 : 1);
+}
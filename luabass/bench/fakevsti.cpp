@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        fakevsti.cpp
+// Purpose:     VSTi of the check of the offline render ( offlinebench ) /  expresseur V3
+// Built as a shared library with a .dll extension, loaded by outTrackOpenVi like a VSTi.
+// At the frame of each note-on, it writes a click : 1.0 on the left, velocity / 128 on the right.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#define __cdecl // VSTCALLBACK of aeffect.h : the default calling convention
+#endif
+#include "aeffect.h"
+#include "aeffectx.h"
+
+#define FAKEVSTI_MAX 512 // note-on of a block
+
+typedef struct t_fakevsti
+{
+	AEffect effect;
+	int nb;
+	int frames[FAKEVSTI_MAX];
+	int velocity[FAKEVSTI_MAX];
+} T_fakevsti;
+
+static VstIntPtr VSTCALLBACK fakevsti_dispatcher(AEffect *effect, VstInt32 opcode, VstInt32 index, VstIntPtr value, void *ptr, float opt)
+{
+	T_fakevsti *fx = (T_fakevsti *)(effect->object);
+	switch (opcode)
+	{
+	case effProcessEvents:
+	{
+		VstEvents *events = (VstEvents *)ptr;
+		for (int n = 0; n < events->numEvents; n++)
+		{
+			VstMidiEvent *e = (VstMidiEvent *)(events->events[n]);
+			if (((((unsigned char)(e->midiData[0])) >> 4) == 9) && (e->midiData[2] > 0) && (fx->nb < FAKEVSTI_MAX))
+			{
+				fx->frames[fx->nb] = e->deltaFrames;
+				fx->velocity[fx->nb] = e->midiData[2];
+				fx->nb++;
+			}
+		}
+		return 1;
+	}
+	case effClose:
+		free(fx);
+		return 0;
+	default:
+		return 0;
+	}
+}
+static void VSTCALLBACK fakevsti_process(AEffect *effect, float **inputs, float **outputs, VstInt32 nbFrames)
+{
+	T_fakevsti *fx = (T_fakevsti *)(effect->object);
+	for (int c = 0; c < 2; c++)
+		memset(outputs[c], 0, nbFrames * sizeof(float));
+	for (int n = 0; n < fx->nb; n++)
+	{
+		if ((fx->frames[n] >= 0) && (fx->frames[n] < nbFrames))
+		{
+			outputs[0][fx->frames[n]] += 1.0f;
+			outputs[1][fx->frames[n]] += (float)(fx->velocity[n]) / 128.0f;
+		}
+	}
+	fx->nb = 0;
+}
+extern "C" AEffect *VSTPluginMain(audioMasterCallback host)
+{
+	T_fakevsti *fx = (T_fakevsti *)calloc(1, sizeof(T_fakevsti));
+	fx->effect.magic = kEffectMagic;
+	fx->effect.dispatcher = fakevsti_dispatcher;
+	fx->effect.processReplacing = fakevsti_process;
+	fx->effect.numInputs = 0;
+	fx->effect.numOutputs = 2;
+	fx->effect.flags = effFlagsIsSynth | effFlagsCanReplacing;
+	fx->effect.object = fx;
+	return &(fx->effect);
+}
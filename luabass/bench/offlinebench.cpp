@@ -0,0 +1,246 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        offlinebench.cpp
+// Purpose:     check of the offline render of the virtual instruments /  expresseur V3
+// usage :      offlinebench [number of notes]
+//              run from the root of the sources, after the build of luabass/bench/fakevsti.dll
+// The render goes through the LUA functions of luabass ( audioOfflineStart, outTrackOpenVi, outNoteOn,
+// audioOfflineRender, audioOfflineStop ). luabass.cpp is included, to replace the BASS mixer by a fake one :
+// the mixer of each audio-device pulls its streams and sums them. Two tracks are opened on fakevsti, on the
+// audio-devices #1 and #2, which writes a click at the frame of each note-on. The notes are not aligned on the
+// blocks, and the notes of the second track are 7 ms after the notes of the first one.
+// Each click of the WAV must be at the frame of its note. The same render with blocks of 1323 frames must give
+// the same WAV as with blocks of 441 frames, in the same session. A duration over the size of a WAV is refused.
+// Return 1 at the first error.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include "luabass.cpp"
+
+#define BENCH_VI "luabass/bench/fakevsti.dll"
+#define BENCH_WAV "offlinebench.wav"
+#define BENCH_WAV_HEADER 58 // bytes before the samples, with the chunk fact
+#define BENCH_NOTE_US 123457 // micro-seconds between two notes of a track
+#define BENCH_START_MS 100 // first note
+#define BENCH_OFFSET_MS 7 // notes of the second track after the first one
+
+// fake BASS mixer : the streams of the VI are pulled by the mixer of their audio-device, and summed
+typedef struct t_bench_stream
+{
+	STREAMPROC *proc; // NULL for a mixer, or a stream free
+	void *user;
+	std::vector<DWORD> sources; // streams of a mixer
+} T_bench_stream;
+static std::vector<T_bench_stream> g_bench_streams(1); // handle 0 is not used
+
+BOOL BASSDEF(BASS_Init)(int device, DWORD freq, DWORD flags, void *win, void *dsguid) { return TRUE; }
+BOOL BASSDEF(BASS_Free)() { return TRUE; }
+int BASSDEF(BASS_ErrorGetCode)() { return 0; }
+BOOL BASSDEF(BASS_ChannelSetAttribute)(DWORD handle, DWORD attrib, float value) { return TRUE; }
+HSTREAM BASSDEF(BASS_StreamCreate)(DWORD freq, DWORD chans, DWORD flags, STREAMPROC *proc, void *user)
+{
+	T_bench_stream s;
+	s.proc = proc;
+	s.user = user;
+	g_bench_streams.push_back(s);
+	return (HSTREAM)(g_bench_streams.size() - 1);
+}
+HSTREAM BASSMIXDEF(BASS_Mixer_StreamCreate)(DWORD freq, DWORD chans, DWORD flags)
+{
+	return BASS_StreamCreate(freq, chans, flags, NULL, NULL);
+}
+BOOL BASSMIXDEF(BASS_Mixer_StreamAddChannel)(HSTREAM handle, DWORD channel, DWORD flags)
+{
+	if ((handle == 0) || (handle >= g_bench_streams.size()))
+		return FALSE;
+	g_bench_streams[handle].sources.push_back(channel);
+	return TRUE;
+}
+BOOL BASSDEF(BASS_StreamFree)(HSTREAM handle)
+{
+	if ((handle == 0) || (handle >= g_bench_streams.size()))
+		return FALSE;
+	g_bench_streams[handle].proc = NULL;
+	g_bench_streams[handle].sources.clear();
+	return TRUE;
+}
+DWORD BASSDEF(BASS_ChannelGetData)(DWORD handle, void *buffer, DWORD length)
+{
+	if ((handle == 0) || (handle >= g_bench_streams.size()))
+		return (DWORD)-1;
+	float *out = (float *)buffer;
+	int nb = length / sizeof(float);
+	memset(out, 0, length);
+	std::vector<float> source(nb);
+	for (size_t n = 0; n < g_bench_streams[handle].sources.size(); n++)
+	{
+		T_bench_stream *s = &(g_bench_streams[g_bench_streams[handle].sources[n]]);
+		if (s->proc == NULL)
+			continue;
+		DWORD got = s->proc(g_bench_streams[handle].sources[n], &(source[0]), length, s->user);
+		for (int f = 0; f < (int)(got / sizeof(float)); f++)
+			out[f] += source[f];
+	}
+	return length;
+}
+
+static void bench_function(lua_State *L, const char *name)
+{
+	lua_getglobal(L, "luabass");
+	lua_getfield(L, -1, name);
+	lua_remove(L, -2);
+}
+static bool bench_call(lua_State *L, int nbArg, int nbResult)
+{
+	if (lua_pcall(L, nbArg, nbResult, 0) == LUA_OK)
+		return true;
+	printf("error LUA : %s\n", lua_tostring(L, -1));
+	lua_pop(L, 1);
+	return false;
+}
+static bool bench_render(lua_State *L, int nbNote, int block, long long duration_ms, std::vector<float> *samples)
+{
+	// render the notes of two tracks in BENCH_WAV, and read its samples
+	bench_function(L, "audioOfflineStart");
+	if (!bench_call(L, 0, 0))
+		return false;
+	for (int track = 1; track <= 2; track++)
+	{
+		bench_function(L, "outTrackOpenVi");
+		lua_pushinteger(L, track);
+		lua_pushinteger(L, track);
+		lua_pushstring(L, "");
+		lua_pushstring(L, BENCH_VI);
+		lua_pushinteger(L, 0);
+		lua_pushinteger(L, 64);
+		lua_pushinteger(L, track); // audio-device #track
+		if ((!bench_call(L, 7, 1)) || (lua_tointeger(L, -1) != 1))
+		{
+			printf("error opening %s on track#%d\n", BENCH_VI, track);
+			return false;
+		}
+		lua_pop(L, 1);
+	}
+	for (int k = 0; k < nbNote; k++)
+	{
+		for (int track = 1; track <= 2; track++)
+		{
+			bench_function(L, "outNoteOn");
+			lua_pushinteger(L, 30 + k % 60);
+			lua_pushinteger(L, (track == 1) ? 64 : 32);
+			lua_pushinteger(L, 0);
+			lua_pushinteger(L, BENCH_START_MS + ((long long)k * BENCH_NOTE_US) / 1000 + ((track == 1) ? 0 : BENCH_OFFSET_MS));
+			lua_pushinteger(L, track);
+			if (!bench_call(L, 5, 1))
+				return false;
+			lua_pop(L, 1);
+		}
+	}
+	bench_function(L, "audioOfflineRender");
+	lua_pushstring(L, BENCH_WAV);
+	lua_pushinteger(L, duration_ms);
+	lua_pushinteger(L, block);
+	if (!bench_call(L, 3, 3))
+		return false;
+	bool rendered = !lua_isnil(L, -3);
+	long long frames = lua_tointeger(L, -3);
+	if (rendered)
+		printf("blocks of %4d frames : %lld frames rendered in %lld ms , x%.0f real-time\n", block, frames, (long long)lua_tointeger(L, -2), lua_tonumber(L, -1));
+	lua_pop(L, 3);
+	bench_function(L, "audioOfflineStop");
+	if ((!bench_call(L, 0, 0)) || (!rendered))
+		return false;
+	// the WAV : header, then the samples
+	FILE *f = fopen(BENCH_WAV, "rb");
+	if (f == NULL)
+		return false;
+	std::vector<unsigned char> b;
+	unsigned char buf[4096];
+	size_t nb;
+	while ((nb = fread(buf, 1, sizeof(buf), f)) > 0)
+		b.insert(b.end(), buf, buf + nb);
+	fclose(f);
+	remove(BENCH_WAV);
+	if (b.size() < BENCH_WAV_HEADER)
+		return false;
+	unsigned long riff = b[4] | (b[5] << 8) | (b[6] << 16) | ((unsigned long)b[7] << 24);
+	unsigned long fact = b[46] | (b[47] << 8) | (b[48] << 16) | ((unsigned long)b[49] << 24);
+	unsigned long data = b[54] | (b[55] << 8) | (b[56] << 16) | ((unsigned long)b[57] << 24);
+	if ((memcmp(&(b[0]), "RIFF", 4) != 0) || (memcmp(&(b[50]), "data", 4) != 0) || (riff != b.size() - 8)
+		|| (fact != (unsigned long)frames) || (data != b.size() - BENCH_WAV_HEADER) || (data != (unsigned long)frames * 2 * sizeof(float)))
+	{
+		printf("error : header of the WAV\n");
+		return false;
+	}
+	samples->resize(data / sizeof(float));
+	memcpy(&((*samples)[0]), &(b[BENCH_WAV_HEADER]), data);
+	return true;
+}
+int main(int argc, char *argv[])
+{
+	int nbNote = (argc > 1) ? atoi(argv[1]) : 40;
+	if (nbNote < 1)
+		nbNote = 1;
+	long long duration_ms = BENCH_START_MS + ((long long)nbNote * BENCH_NOTE_US) / 1000 + 1000;
+
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	luaL_requiref(L, "luabass", luaopen_luabass, 1);
+	lua_pop(L, 1);
+	bench_function(L, sinit);
+	lua_pushstring(L, "offlinebench");
+	if (!bench_call(L, 1, 0))
+		return 1;
+
+	std::vector<float> a, b;
+	bool ok = bench_render(L, nbNote, OFFLINE_BLOCK, duration_ms, &a) && bench_render(L, nbNote, 3 * OFFLINE_BLOCK, duration_ms, &b);
+	if (ok)
+	{
+		// a click at the frame of each note : 1.0 on the left, velocity / 128 on the right
+		int nbClick = 0, nbWrong = 0;
+		for (size_t n = 0; n < a.size(); n += 2)
+		{
+			if (a[n] != 0.0f)
+				nbClick++;
+		}
+		for (int k = 0; k < nbNote; k++)
+		{
+			for (int track = 1; track <= 2; track++)
+			{
+				long long ms = BENCH_START_MS + ((long long)k * BENCH_NOTE_US) / 1000 + ((track == 1) ? 0 : BENCH_OFFSET_MS);
+				long long frame = (ms * M_SAMPLE_RATE) / 1000;
+				float right = ((track == 1) ? 64.0f : 32.0f) / 128.0f;
+				if ((2 * frame + 1 >= (long long)a.size()) || (a[2 * frame] != 1.0f) || (a[2 * frame + 1] != right))
+				{
+					if (nbWrong < 5)
+						printf("error : note#%d of track#%d not at the frame %lld\n", k + 1, track, frame);
+					nbWrong++;
+				}
+			}
+		}
+		printf("clicks %d ( %d expected ) , at a wrong frame %d\n", nbClick, 2 * nbNote, nbWrong);
+		printf("blocks of %d and %d frames : %s WAV\n", OFFLINE_BLOCK, 3 * OFFLINE_BLOCK, (a == b) ? "same" : "different");
+		ok = (nbClick == 2 * nbNote) && (nbWrong == 0) && (a == b);
+	}
+	if (ok)
+	{
+		// over the 32 bits sizes of a WAV : refused, before to write the file
+		std::vector<float> c;
+		long long max_ms = ((long long)WAV_MAX_FRAMES * 1000) / M_SAMPLE_RATE;
+		bool refused = !bench_render(L, 1, OFFLINE_BLOCK, max_ms + 1, &c);
+		FILE *f = fopen(BENCH_WAV, "rb");
+		if (f != NULL)
+			fclose(f);
+		printf("render of %lld ms : %s\n", max_ms + 1, (refused && (f == NULL)) ? "refused" : "not refused");
+		ok = refused && (f == NULL);
+	}
+	bench_function(L, sfree);
+	bench_call(L, 0, 0);
+	lua_close(L);
+	return (ok ? 0 : 1);
+}
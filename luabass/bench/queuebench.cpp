@@ -0,0 +1,256 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        queuebench.cpp
+// Purpose:     stress of the queue of the delayed midi-out messages /  expresseur V3
+// usage :      queuebench [number of delayed events] [max delay in ms]
+//              without arguments, 100000 events with delays up to 10 s
+// The events go through the same path as outNoteOn/outNoteOff ( sendmsgdt, unqueue, queue_flush, sendmsg ) :
+// luabass.cpp is included, to reach its static functions. The output is a stub : a midi-out is flagged opened,
+// and the ALSA functions which encode and write a message are replaced, to record each message with its planned
+// time and the time it is sent. One note-off out of four is sent before its note-on, which cancels the note-on,
+// like a short key-stroke on a strummed chord.
+// The timer ticks are simulated : the bench does not wait for the real time.
+// The messages recorded are compared with the expected ones : the messages not cancelled, in the order of their
+// planned time ( first queued first sent for the same time ), with the rules of sendmidimsg for a pitch already
+// played ( note-on filtered or re-struck, note-off of a note-on filtered not sent ).
+// Return 1 if a message is not flushed, not expected, sent before its planned time or out of order, or if a slot
+// of the queue or of its pitch index is not released.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "luabass.cpp"
+
+#define BENCH_TICK_MS 20 // ms between two simulated timer ticks
+#define BENCH_TRACK 1 // track of the stub midi-out
+#define BENCH_FLOOD_MS 200 // a note-on on a pitch already played is filtered, if played before this delay
+#define BENCH_NOTE_MS 100 // max duration of a note
+#define BENCH_START_US 1000000 // start of the output clock : the times of the pitches are unsigned, and compared to the time minus BENCH_FLOOD_MS
+
+typedef struct t_bench_msg
+{
+	int status; // MIDI_NOTEON or MIDI_NOTEOFF
+	int pitch;
+	long long planned; // us
+	long long sent; // us
+	long id;
+	long seq; // order of insertion in the queue
+} T_bench_msg;
+static std::vector<T_bench_msg> g_bench_sent; // messages written by the stub
+
+// stub of the ALSA midi-out : the message is recorded, with its planned time ( g_out_us ) and the current time
+void snd_midi_event_reset_encode(snd_midi_event_t *dev) {}
+long snd_midi_event_encode(snd_midi_event_t *dev, const unsigned char *buf, long count, snd_seq_event_t *ev)
+{
+	T_bench_msg m;
+	m.status = buf[0] >> 4;
+	m.pitch = buf[1];
+	m.planned = g_out_us;
+	m.sent = g_current_us;
+	m.id = 0;
+	m.seq = 0;
+	g_bench_sent.push_back(m);
+	ev->type = (m.status == MIDI_NOTEON) ? SND_SEQ_EVENT_NOTEON : SND_SEQ_EVENT_NOTEOFF;
+	return count;
+}
+int snd_seq_event_output(snd_seq_t *handle, snd_seq_event_t *ev) { return 0; }
+int snd_seq_drain_output(snd_seq_t *handle) { return 0; }
+
+static bool bench_before(const T_bench_msg &a, const T_bench_msg &b)
+{
+	return (a.planned < b.planned) || ((a.planned == b.planned) && (a.seq < b.seq));
+}
+static long bench_expected(std::vector<T_bench_msg> &queued, std::vector<T_bench_msg> *expected)
+{
+	// messages expected from the stub, sent at the first tick after their planned time, and the count of outCount
+	std::sort(queued.begin(), queued.end(), bench_before);
+	long holder[MAXPITCH]; // id of the note-on playing the pitch
+	long long played[MAXPITCH]; // time of this note-on, in ms
+	for (int p = 0; p < MAXPITCH; p++)
+	{
+		holder[p] = -1;
+		played[p] = 0;
+	}
+	long nbCount = 0;
+	for (size_t n = 0; n < queued.size(); n++)
+	{
+		T_bench_msg m = queued[n];
+		long long tick = BENCH_TICK_MS * 1000;
+		m.sent = BENCH_START_US + ((m.planned - BENCH_START_US + tick - 1) / tick) * tick;
+		long long ms = m.sent / 1000;
+		if (m.status == MIDI_NOTEON)
+		{
+			// a note-on is counted, even filtered
+			nbCount++;
+			if (holder[m.pitch] == -1)
+				expected->push_back(m);
+			else if ((holder[m.pitch] != m.id) && (played[m.pitch] < ms - BENCH_FLOOD_MS))
+			{
+				// struck again : note-off and note-on
+				T_bench_msg off = m;
+				off.status = MIDI_NOTEOFF;
+				expected->push_back(off);
+				expected->push_back(m);
+			}
+			else
+				continue;
+			holder[m.pitch] = m.id;
+			played[m.pitch] = ms;
+		}
+		else if (holder[m.pitch] == m.id)
+		{
+			nbCount++;
+			expected->push_back(m);
+			holder[m.pitch] = -1;
+		}
+	}
+	return nbCount;
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+int main(int argc, char *argv[])
+{
+	int nbEvent = (argc > 1) ? atoi(argv[1]) : 100000;
+	int maxDelay = (argc > 2) ? atoi(argv[2]) : 10000;
+	if (maxDelay < 1)
+		maxDelay = 1;
+
+	// luabass without midi-in/out drivers, audio and timer thread
+	picth_init();
+	fifo_init();
+	chord_init();
+	channel_extended_init();
+	track_init();
+	curve_init();
+	init_mutex();
+	jitter_init();
+
+	// stub output : the track is on a midi-out flagged opened, written by the stub of ALSA
+	g_midiopened[0] = 1;
+	g_tracks[BENCH_TRACK].device = 0;
+	g_tracks[BENCH_TRACK].channel = 0;
+	channel_extended_set(0, 0, 0, true);
+	g_out_count = 0;
+
+	lock_mutex_out();
+	g_current_us = BENCH_START_US;
+	g_current_t = (long)(g_current_us / 1000);
+	srand(1);
+	long nbQueued = 0;
+	std::vector<T_bench_msg> queued;
+	T_bench_msg q;
+	q.sent = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	T_midioutmsg u;
+	memset(&u, 0, sizeof(u));
+	u.track = BENCH_TRACK;
+	u.nbbyte = 3;
+	for (int n = 0; n < nbEvent; n += 2)
+	{
+		u.id = g_unique_id++;
+		u.midimsg.bData[0] = (MIDI_NOTEON << 4);
+		u.midimsg.bData[1] = 24 + (n % 96);
+		u.midimsg.bData[2] = 64;
+		u.dt = 1 + rand() % maxDelay;
+		sendmsgdt(u);
+		nbQueued++;
+		q.status = MIDI_NOTEON;
+		q.pitch = u.midimsg.bData[1];
+		q.planned = BENCH_START_US + (long long)(u.dt) * 1000;
+		q.id = u.id;
+		q.seq = nbQueued;
+		u.midimsg.bData[0] = (MIDI_NOTEOFF << 4);
+		u.midimsg.bData[2] = 0;
+		if ((n % 8) == 0)
+		{
+			// note-off before the note-on : cancel it. Neither is expected
+			u.dt = u.dt / 2;
+			if (unqueue(OUT_QUEUE_NOTEOFF, u) == 0)
+			{
+				sendmsgdt(u);
+				nbQueued++;
+			}
+			else
+				nbQueued--;
+		}
+		else
+		{
+			queued.push_back(q);
+			u.dt += 1 + rand() % BENCH_NOTE_MS;
+			sendmsgdt(u);
+			nbQueued++;
+			q.status = MIDI_NOTEOFF;
+			q.planned = BENCH_START_US + (long long)(u.dt) * 1000;
+			q.seq = nbQueued;
+			queued.push_back(q);
+		}
+	}
+	double queue_ms = elapsed_ms(start);
+	int maxWaiting = g_max_queue_msg;
+
+	int nbTick = 0;
+	start = std::chrono::steady_clock::now();
+	while (g_queue_nb > 0)
+	{
+		g_current_us += BENCH_TICK_MS * 1000;
+		g_current_t = (long)(g_current_us / 1000);
+		queue_flush(g_current_us, false);
+		nbTick++;
+	}
+	double flush_ms = elapsed_ms(start);
+	int nbFree = 0;
+	for (int n = g_queue_free; (n != OUT_QUEUE_NIL) && (nbFree <= g_queue_size); n = g_queue_msg[n].next_free)
+		nbFree++;
+	int nbIndexed = 0;
+	for (int p = 0; p < MAXPITCH; p++)
+	{
+		if (g_queue_pitch[BENCH_TRACK][p] != OUT_QUEUE_NIL)
+			nbIndexed++;
+	}
+	unlock_mutex_out();
+
+	// the messages sent : in the order of their planned time, not before it, and the ones expected
+	int nbEarly = 0, nbDisorder = 0, nbUnexpected = 0;
+	for (size_t n = 0; n < g_bench_sent.size(); n++)
+	{
+		if (g_bench_sent[n].sent < g_bench_sent[n].planned)
+			nbEarly++;
+		if ((n > 0) && (g_bench_sent[n].planned < g_bench_sent[n - 1].planned))
+			nbDisorder++;
+	}
+	std::vector<T_bench_msg> expected;
+	long nbCount = bench_expected(queued, &expected);
+	for (size_t n = 0; n < g_bench_sent.size(); n++)
+	{
+		if ((n >= expected.size()) || (g_bench_sent[n].status != expected[n].status) || (g_bench_sent[n].pitch != expected[n].pitch)
+			|| (g_bench_sent[n].planned != expected[n].planned) || (g_bench_sent[n].sent != expected[n].sent))
+		{
+			if (nbUnexpected == 0)
+				printf("error : message#%d %s pitch %d planned %lld us sent %lld us not expected\n", (int)n + 1, (g_bench_sent[n].status == MIDI_NOTEON) ? "note-on" : "note-off", g_bench_sent[n].pitch, g_bench_sent[n].planned, g_bench_sent[n].sent);
+			nbUnexpected++;
+		}
+	}
+	if (g_bench_sent.size() < expected.size())
+		nbUnexpected += (int)(expected.size() - g_bench_sent.size());
+
+	printf("%d events , max delay %d ms\n", nbEvent, maxDelay);
+	printf("queue : %.1f ms ( %.0f ns per event ) , max waiting %d\n", queue_ms, queue_ms * 1000000.0 / (nbEvent > 0 ? nbEvent : 1), maxWaiting);
+	printf("flush : %.1f ms in %d ticks of %d ms\n", flush_ms, nbTick, BENCH_TICK_MS);
+	// the note-offs of a note-on filtered by sendmidimsg are not sent, and not counted
+	printf("sent : %ld messages counted ( %ld expected ) , %ld queued and not cancelled\n", g_out_count, nbCount, nbQueued);
+	printf("stub : %d messages written ( %d expected ) , %d not expected , %d before their time , %d out of order\n", (int)g_bench_sent.size(), (int)expected.size(), nbUnexpected, nbEarly, nbDisorder);
+	printf("released : %d slots of %d , %d pitches still indexed\n", nbFree, g_queue_size, nbIndexed);
+	return ((g_queue_nb == 0) && (nbFree == g_queue_size) && (nbIndexed == 0) && (g_out_count == nbCount)
+		&& (nbUnexpected == 0) && (nbEarly == 0) && (nbDisorder == 0)) ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        timingbench.cpp
+// Purpose:     offline check of the timing of the events rendered by the virtual instruments /  expresseur V3
+// usage :      timingbench [frames of a block] [jitter of the audio callback, in us]
+//              without arguments, the blocks of 256, 1024 and 4096 frames are checked, without jitter
+// A click pattern is rendered through the same timing as vsti_streamProc and sf2_streamProc ( luabasstiming.h ),
+// by an audio callback simulated on a virtual clock. The onsets of the clicks are measured in the output, and
+// compared with their planned time : the error is reported in samples, with the events applied at the start of
+// the block ( previous behaviour ), and at their frame in the block.
+// Return 1 if an onset is wrong by more than the jitter of the callback plus one sample.
+// Author:      Franck REVOLLE
+// Modified by:
+// Created:     16/10/2026
+// Copyright:   (c) Franck REVOLLE Expresseur
+// Licence:    Expresseur licence
+/////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "luabass.h"
+#include "luabasstiming.h"
+
+#define BENCH_CLICKS 400 // clicks of the pattern
+#define BENCH_PERIOD_US 123457 // period of the clicks, not aligned on the samples
+
+static unsigned long g_random = 12345;
+
+static int benchRandom(int n)
+{
+	// deterministic random, to get the same jitter on all the platforms
+	g_random = g_random * 1103515245 + 12345;
+	return (int)((g_random >> 16) % n);
+}
+typedef struct
+{
+	long long max; // max error in samples
+	double average; // average error in samples
+} T_bench_error;
+
+static T_bench_error render(int nbFrames, int jitter_us, bool accurate)
+{
+	// render the click pattern, and measure the error of the onsets
+	std::vector<long long> clicks; // planned time of the clicks
+	for (int n = 0; n < BENCH_CLICKS; n++)
+		clicks.push_back(100000 + (long long)n * BENCH_PERIOD_US);
+	long long totalFrames = ((clicks.back() + 1000000) * M_SAMPLE_RATE) / 1000000;
+	std::vector<float> out(totalFrames + nbFrames, 0.0f);
+
+	T_vi_clock clock;
+	timing_init(&clock, M_SAMPLE_RATE);
+	g_random = 12345;
+	unsigned int nextClick = 0;
+	for (long long frame = 0; frame < totalFrames; frame += nbFrames)
+	{
+		// the callback of the block is called when its last frame is due, delayed by the jitter
+		long long now = ((frame + nbFrames) * 1000000) / M_SAMPLE_RATE + (jitter_us ? benchRandom(jitter_us) : 0);
+		timing_block(&clock, now, nbFrames);
+		// the clicks sent before the callback are pending for this block
+		while ((nextClick < clicks.size()) && (clicks[nextClick] <= now))
+		{
+			int offset = accurate ? timing_offset(&clock, clicks[nextClick]) : 0;
+			out[frame + offset] = 1.0f;
+			nextClick++;
+		}
+	}
+	// onsets in the output, compared with the planned frames, with a constant latency
+	std::vector<long long> delays;
+	for (long long frame = 0; frame < totalFrames; frame++)
+	{
+		if (out[frame] != 0.0f)
+			delays.push_back(frame - (clicks[delays.size()] * M_SAMPLE_RATE) / 1000000);
+	}
+	std::vector<long long> sorted(delays);
+	std::sort(sorted.begin(), sorted.end());
+	long long latency = sorted[sorted.size() / 2];
+	T_bench_error e;
+	e.max = 0;
+	e.average = 0.0;
+	for (unsigned int n = 0; n < delays.size(); n++)
+	{
+		long long d = llabs(delays[n] - latency);
+		e.max = (d > e.max) ? d : e.max;
+		e.average += (double)d;
+	}
+	e.average /= delays.size();
+	return e;
+}
+static bool bench(int nbFrames, int jitter_us)
+{
+	T_bench_error block = render(nbFrames, jitter_us, false);
+	T_bench_error accurate = render(nbFrames, jitter_us, true);
+	long long tolerance = ((long long)jitter_us * M_SAMPLE_RATE) / 1000000 + 1;
+	bool ok = (accurate.max <= tolerance);
+	printf("block %5d frames, jitter %6d us : start of block max %5lld avg %8.1f , in block max %5lld avg %8.1f samples %s\n",
+		nbFrames, jitter_us, block.max, block.average, accurate.max, accurate.average, ok ? "OK" : "FAILED");
+	return ok;
+}
+int main(int argc, char *argv[])
+{
+	bool ok = true;
+	if (argc > 1)
+		ok = bench(atoi(argv[1]), (argc > 2) ? atoi(argv[2]) : 0);
+	else
+	{
+		int sizes[] = { 256, 1024, 4096 };
+		for (int n = 0; n < 3; n++)
+			ok = bench(sizes[n], 0) && ok;
+	}
+	return (ok ? 0 : 1);
+}
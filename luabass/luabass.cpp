@@ -32,7 +32,8 @@
 // Unsupported platform
 #endif
 #elif __linux
-// linux
+#define V_LINUX 1
+#define V_CPP 1 // the Lua library of the distributions is compiled in C
 #elif __unix // all unices not caught above
 // Unix
 #elif __posix
@@ -50,12 +51,18 @@
 #include <errno.h>
 #include <time.h>
 #include <stdarg.h>
+#include <atomic>
+#include <climits>
 #ifdef V_PC
 #include <ctgmath>
 #endif
 #ifdef V_MAC
 #include <math.h>
 #endif
+#ifdef V_LINUX
+#include <math.h>
+#define __cdecl // VSTCALLBACK of aeffect.h : the default calling convention
+#endif
 
 #ifdef V_CPP
 #include <lua.hpp>
@@ -86,9 +93,24 @@
 #include <CoreMIDI/MIDISetup.h>
 #include <CoreMIDI/MIDIThruConnection.h>
 #include <pthread.h>
+#include <mach/mach_time.h>
+#include <unistd.h>
+#endif
+#ifdef V_LINUX
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dlfcn.h>
 #endif
 
 #include "luabass.h"
+#include "luabasslog.h"
+#include "luabasslatency.h"
+#include "luabasstiming.h"
+#include "luabassaudio.h"
+#ifdef V_LINUX
+#include "luabassalsa.h"
+#endif
 #include "global.h"
 
 #ifdef V_PC
@@ -102,6 +124,10 @@
 #define strtok_s strtok_r
 #define strnlen_s strnlen
 #endif
+#ifdef V_LINUX
+#define strtok_s strtok_r
+#define strnlen_s strnlen
+#endif
 
 int g_transposition = 0;
 int g_audio_buffer_length = 0; // length if audio buffer ( large by default, latency, but no crack .. )
@@ -122,7 +148,36 @@ typedef union t_midimsg
 	BYTE bData[4]; /*!< The data, byte per byte. */
 } T_midimsg;
 
-#define MAX_VSTI_PENDING_MIDIMSG 256
+#define MAX_VSTI_PENDING_MIDIMSG 256 // max midi msg rendered by a VI in one block : the next ones wait for the next block
+
+/**
+* \struct T_vi_event
+* \brief short Midi Message waiting to be rendered by a VI, with the time it was sent
+*/
+typedef struct t_vi_event
+{
+	T_midimsg midimsg;
+	long long t; // time of the output clock, in micro-seconds
+} T_vi_event;
+
+/**
+* \struct T_vi_ring
+* \brief Single-producer single-consumer ring of the midi msg waiting to be rendered by one VI
+*
+* The output pushes the msg without waiting ( head ). It is a single producer : the sends are serialized by g_mutex_out.
+* The audio callback of the VI renders them, without any lock ( tail ).
+*/
+#define VI_RING_SIZE 1024 // must be a power of two
+typedef struct t_vi_ring
+{
+	T_vi_event events[VI_RING_SIZE];
+	std::atomic<unsigned int> head; /*!< next slot to write, by the output */
+	std::atomic<unsigned int> tail; /*!< next slot to read, by the audio callback */
+	std::atomic<unsigned int> max_depth; /*!< max number of waiting msg */
+	std::atomic<unsigned int> overflow; /*!< number of msg lost because the ring was full */
+	std::atomic<unsigned int> xrun; /*!< number of blocks rendered slower than real time */
+	std::atomic<long long> max_render_us; /*!< max duration of the render of a block, in micro-seconds */
+} T_vi_ring;
 
 /**
 * \struct T_vi_opened
@@ -136,20 +191,30 @@ typedef struct t_vi_opened
 	HSTREAM mstream; // BASS stream connected to the mixer of the audio-device
 
 	HSOUNDFONT sf2_midifont; // handler Soundfont SF2
+	HSTREAM sf2_stream; // BASSMIDI stream of the SF2, rendered by sf2_streamProc in mstream
+	int sf2_rpn_msb, sf2_rpn_lsb; // RPN selected by the controls 100/101
 
 	AEffect *vsti_plugins; // handler of the VSTi
 #ifdef V_PC
 	HMODULE vsti_modulePtr; // library dll loaded for the VSTi
-#else
+#elif defined(V_MAC)
     CFBundleRef vsti_modulePtr;// library dll loaded for the VSTi
+#else
+	void *vsti_modulePtr; // shared library loaded for the VSTi
 #endif
 	int vsti_nb_outputs; // number of audio outputs of the vsti
 	bool vsti_midi_prog; // vst-prog will be sent 
 	int vsti_last_prog; // last vst-prog sent to the VSTi on next update
-	bool vsti_todo_prog;// pending vst-prog to send to the VSTi on next update
-	T_midimsg vsti_pending_midimsg[MAX_VSTI_PENDING_MIDIMSG]; // pending midi msg to send to the VSTi on next update
-	int vsti_nb_pending_midimsg; // nb pending midi msg to send to the VS on next update
+	std::atomic<int> vsti_todo_prog;// pending vst-prog to send to the VSTi on next update ( -1 : none )
+	VstEvents *vsti_events; // block of midi msg sent to the VSTi, used only by its audio callback
+	T_vi_ring vi_ring; // midi msg to render in the next block
+	T_vi_clock vi_clock; // place of the pending midi msg in the block rendered, used only by the audio callback
 	float **vsti_outputs; // buffer for vsti output
+	std::atomic<long long> vi_render_us; // duration of the render of the last block, in micro-seconds
+	float *vi_pre_buffer; // block rendered in advance by the pool of workers ( cf. vi_parallel )
+	DWORD vi_pre_size; // bytes allocated in vi_pre_buffer
+	DWORD vi_pre_length; // bytes rendered in vi_pre_buffer
+	long long vi_pre_seq; // block of the audio-device rendered in vi_pre_buffer, 0 : none
 } T_vi_opened;
 
 /**
@@ -230,14 +295,69 @@ typedef struct t_chord
 typedef struct t_queue_msg
 {
 	T_midioutmsg midioutmsg; /*!< The midi message delayed */
-	long t; /*!< the time to send the message */
-	bool free; /*!< slot free */
+	long long t; /*!< the time to send the message, in micro-seconds on the output clock */
+	unsigned long seq; /*!< insertion order, to send messages with the same time in FIFO order */
+	bool free; /*!< slot free, or cancelled and waiting to be removed from the heap */
+	int next_free; /*!< next slot in the list of free slots */
+	int prev_pitch; /*!< previous pending note-on on the same track/pitch */
+	int next_pitch; /*!< next pending note-on on the same track/pitch */
 } T_queue_msg;
-#define OUT_QUEUE_MAX_MSG 1024
+#define OUT_QUEUE_INIT_MSG 1024 // initial number of slots. The queue grows when they are all busy
+#define OUT_QUEUE_NIL -1
+/**
+* \struct T_sysex_out
+* \brief Sysex waiting to be sent, or in progress.
+*
+* The sysex are sent by the scheduler thread, in the order of the calls, one at a time per device.
+* The caller never waits for the driver.
+*/
+typedef struct t_sysex_out
+{
+	int id; /*!< identifier given to LUA */
+	int nr_device; /*!< midiout device */
+	BYTE *data; /*!< bytes of the sysex */
+	int length; /*!< number of bytes */
+	int sent; /*!< number of bytes given to the driver */
+	int status; /*!< SYSEX_xxx */
+	int ref; /*!< LUA function to call when the sysex is sent, LUA_NOREF if none */
+	lua_State *owner; /*!< main thread of the LUA state of ref */
+#ifdef V_PC
+	MIDIHDR hdr; /*!< part given to the driver */
+#endif
+#ifdef V_MAC
+	MIDISysexSendRequest request; /*!< request given to CoreMIDI */
+	std::atomic<bool> completed; /*!< set by the completion of CoreMIDI */
+#endif
+} T_sysex_out;
+/**
+* \struct T_sysex_done
+* \brief Sysex sent or aborted, waiting for the call of its LUA function by outSysexDone.
+*
+* The slot of the sysex is released when it ends : the LUA function is called later, by its own LUA state.
+*/
+typedef struct t_sysex_done
+{
+	int id; /*!< identifier given to LUA */
+	bool ok; /*!< the sysex is sent */
+	int ref; /*!< LUA function to call, LUA_NOREF when it is called */
+	lua_State *owner; /*!< main thread of the LUA state of ref */
+} T_sysex_done;
+#define SYSEX_QUEUE 64 // max number of sysex waiting ( power of two )
+#define SYSEX_DONE_QUEUE 256 // max number of LUA functions waiting to be called ( power of two )
+#define SYSEX_POLL 1000 // micro-seconds between two checks of the sysex in progress
+#define SYSEX_PART 65535 // max bytes of one long message, for winmm
+#define SYSEX_PACKET 256 // max bytes of one sequencer event, for ALSA
+#define SYSEX_BURST 16 // max sequencer events written per pass of the scheduler, for ALSA
+#define SYSEX_FREE 0
+#define SYSEX_WAITING 1
+#define SYSEX_SENDING 2
+#define SYSEX_DONE 3
+#define SYSEX_ERROR 4
 
 #define MAXBUFERROR 64
 
-#define timer_dt 20 // ms between two timer interrupts on output
+
+#define OUT_JITTER_MAX 10 // number of ranges in the histogram of the delay of the queued messages
 
 #define OUT_QUEUE_FLUSH 0
 #define OUT_QUEUE_NOTEOFF 1
@@ -292,15 +412,69 @@ static MIDIEndpointRef g_midiopened[MIDIOUT_MAX]; // list of midiout. 0 if midio
 static MIDIPortRef g_midiOutPortRef = 0;
 static MIDIClientRef g_midiClientRef = 0;
 #endif
+#ifdef V_LINUX
+static int g_midiopened[MIDIOUT_MAX]; // list of midiout. 0 if midiout is free.
+static snd_seq_addr_t g_midiaddr[MIDIOUT_MAX]; // sequencer address of the opened midiout
+// ALSA sequencer client for the midiout, with its virtual port and its real-time queue
+static snd_seq_t *g_alsa_seq = NULL;
+static int g_alsa_port = -1;
+static int g_alsa_queue = -1;
+static snd_midi_event_t *g_alsa_encoder = NULL;
+static bool g_alsa_pending = false; // events waiting in the output buffer of the sequencer
+#endif
 
 static bool g_audio_open[MAX_AUDIO_DEVICE];
 static T_vi_opened g_vi_opened[VI_MAX];
 static int g_vi_opened_nb = 0;
 static HSTREAM g_mixer_stream[MAX_AUDIO_DEVICE];
 
+/**
+* \struct T_vi_job
+* \brief render of a block of a VI, in advance, by the pool of workers
+*/
+typedef struct t_vi_job
+{
+	T_vi_opened *vi;
+	DWORD length; // bytes to render in vi_pre_buffer
+	long long now; // time of the block
+	long long seq; // block of the audio-device
+} T_vi_job;
+
+/**
+* \struct T_vi_pool
+* \brief pool of workers which render the VI of an audio-device in parallel ( cf. vi_parallel )
+*
+* One batch at a time. The jobs are not assigned : each thread takes the next job ( next ), and counts it when
+* it is rendered ( done ). The audio thread waits done == number of jobs before the mix.
+*/
+#define VI_POOL_MAX 8 // max workers
+#define VI_PARALLEL_SHARE 50 // default share of the block duration, in percent, above which the VI are rendered in parallel
+typedef struct t_vi_pool
+{
+	int nbThreads; // workers started
+	std::atomic<bool> running;
+	std::atomic<bool> busy; // a batch is rendered, or the pool is configured
+	std::atomic<unsigned int> generation; // incremented for each batch, to wake-up the workers
+	std::atomic<unsigned int> next; // number of jobs of the batch << 16 | next job to take
+	std::atomic<int> done; // jobs rendered
+	T_vi_job jobs[VI_MAX];
+	std::atomic<long long> nbParallel; // blocks rendered in parallel
+	std::atomic<long long> nbSerial; // blocks rendered serially, because the pool was busy with another audio-device
+#ifdef V_PC
+	HANDLE threads[VI_POOL_MAX];
+	HANDLE events[VI_POOL_MAX];
+#else
+	pthread_t threads[VI_POOL_MAX];
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+#endif
+} T_vi_pool;
+static T_vi_pool g_vi_pool;
+static std::atomic<int> g_vi_parallel_share(VI_PARALLEL_SHARE); // 0 : never in parallel
+static long long g_vi_block_seq[MAX_AUDIO_DEVICE]; // last block of the audio-device rendered in parallel, used only by its mixer
+
 #define VSTI_BUFSIZE 4096
 
-VstEvents *g_vsti_events;
 int g_vsti_bufsize = 1024;
 
 
@@ -318,12 +492,10 @@ static int g_chordCompensation = 0; // compensation of velocity for each note in
 static int g_randomDelay = 0; // random delay in seconds for each note of a chord
 static int g_randomVelocity = 0; // random velocity for each note of a chord
 
-static bool g_collectLog = false;
-static int nrOutBufLog = 0;
-static int nrInBufLog = 0;
-#define MAXBUFLOGOUT 512
-#define MAXNBLOGOUT 64
-static char bufLog[MAXNBLOGOUT][MAXBUFLOGOUT];
+static T_log g_log_own; // log used when luabass is not loaded by basslua
+static T_log *g_log = &g_log_own; // log shared with basslua
+static T_latency g_latency_own; // latency measure used when luabass is not loaded by basslua
+static T_latency *g_latency = &g_latency_own; // latency measure shared with basslua
 
 static long g_unique_id = 128;
 
@@ -334,21 +506,72 @@ static T_curve g_curves[MAXCURVE];
 static T_chord g_chords[CHORDMAX];
 
 static long g_current_t = 0 ; // relative time in ms for output
+static long long g_current_us = 0; // relative time in micro-seconds for output
+static long long g_out_us = -1; // planned time of the delayed message being sent, -1 for g_current_us
+// offline render : the time of the output is a virtual clock, advanced by audioOfflineRender
+static std::atomic<bool> g_offline(false);
+static std::atomic<long long> g_offline_us(0);
+#define OFFLINE_BLOCK 441 // default frames of a block of the offline render : 10 ms, the blocks start on an exact micro-second
+#define WAV_MAX_FRAMES ((0xFFFFFFFFULL - 50) / (2 * sizeof(float))) // the sizes of a WAV file are 32 bits : 3h22 in stereo 32 bits float at 44.1 kHz
 
 #ifdef V_PC
-// timer to flush the midiout queud messages
+// scheduler thread to flush the midiout queud messages
 static HANDLE g_timer = NULL;
+// event to wake-up the scheduler thread, when the next deadline changes
+static HANDLE g_timer_event = NULL;
 // mutex to protect the output ( from LUA and timer, to outputs )
 static HANDLE g_mutex_out = NULL;
+// monotonic clock
+static LARGE_INTEGER g_clock_freq;
+static LARGE_INTEGER g_clock_start;
 #endif
 #ifdef V_MAC
 // mutex to protect the access od the midiout queud messages
 static pthread_mutex_t g_mutex_out ;
+// scheduler thread to flush the midiout queud messages
+static pthread_t g_timer;
+// condition to wake-up the scheduler thread, when the next deadline changes
+static pthread_cond_t g_timer_cond;
+// monotonic clock
+static mach_timebase_info_data_t g_clock_freq;
+static uint64_t g_clock_start;
 #endif
-
-static T_queue_msg g_queue_msg[OUT_QUEUE_MAX_MSG];
-static int g_end_queue_msg = 0; // end of potential waitin slot
+#ifdef V_LINUX
+// mutex to protect the access od the midiout queud messages
+static pthread_mutex_t g_mutex_out ;
+// scheduler thread to flush the midiout queud messages
+static pthread_t g_timer;
+// condition to wake-up the scheduler thread, when the next deadline changes
+static pthread_cond_t g_timer_cond;
+// monotonic clock
+static struct timespec g_clock_start;
+#endif
+static bool g_timer_running = false;
+
+// histogram of the delay between the planned and the actual time of the queued messages
+static const long g_jitter_limit[OUT_JITTER_MAX] = { 50, 100, 250, 500, 1000, 2000, 5000, 10000, 20000, 0 }; // upper limits in micro-seconds. 0 : no limit
+static long g_jitter[OUT_JITTER_MAX];
+static long g_jitter_nb = 0;
+static long long g_jitter_sum = 0;
+static long long g_jitter_max = 0;
+
+static T_queue_msg *g_queue_msg = NULL; // slots of the delayed messages
+static int *g_queue_heap = NULL; // binary min-heap of the busy slots, ordered by time
+static int g_queue_size = 0; // number of slots allocated
+static int g_queue_nb = 0; // number of slots in the heap
+static int g_queue_free = OUT_QUEUE_NIL; // first free slot
+static unsigned long g_queue_seq = 0; // insertion counter
+static int g_queue_pitch[MAXTRACK][MAXPITCH]; // first pending note-on slot, for each track/pitch
 static int g_max_queue_msg = 0; // max of waiting slot
+static long g_out_count = 0; // number of messages sent ( cf. outCount )
+
+static T_sysex_out g_sysex[SYSEX_QUEUE]; // FIFO of the sysex to send
+static unsigned int g_sysex_head = 0; // next slot to write
+static unsigned int g_sysex_tail = 0; // oldest slot not free
+static int g_sysex_id = 0; // last identifier given
+static T_sysex_done g_sysex_done[SYSEX_DONE_QUEUE]; // FIFO of the LUA functions of the sysex ended
+static unsigned int g_sysex_done_head = 0; // next slot to write
+static unsigned int g_sysex_done_tail = 0; // oldest slot not called
 
 static 	lua_State *g_LUAoutState = 0 ; // LUA state for the process of midiout messages
 static bool g_process_NoteOn, g_process_NoteOff;
@@ -371,48 +594,192 @@ static int pitchbend_value(T_midimsg u)
 {
 	return((int)(u.bData[2]) * (int)(0x80) + (int)(u.bData[1]) - (int)(0x2000));
 }
-static void log_init(const char *fname)
+static void log_init(lua_State *L, const char *fname)
 {
 	if ((fname != NULL) && (strlen(fname) > 0))
 	{
 		strcpy(g_path_out_error_txt, fname);
 		strcat(g_path_out_error_txt, "_out.txt");
 	}
-	FILE * pFile = fopen(g_path_out_error_txt, "w");;
-	if (pFile == NULL) return;
-	fprintf(pFile, "log luabass out\n");
-	fclose(pFile);
+	// use the log of basslua if available, else its own log
+	lua_getfield(L, LUA_REGISTRYINDEX, LOG_REGISTRY);
+	T_log *shared = (T_log *)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	g_log = (shared) ? shared : &g_log_own;
+	if (!g_log->running.load())
+		g_log->level.store(LOG_TRACE);
+	log_path(g_log, LOG_SOURCE_OUT, g_path_out_error_txt);
+	log_start(g_log);
+}
+static void latency_init(lua_State *L)
+{
+	// use the latency measure of basslua if available, else its own measure
+	lua_getfield(L, LUA_REGISTRYINDEX, LATENCY_REGISTRY);
+	T_latency *shared = (T_latency *)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	g_latency = (shared) ? shared : &g_latency_own;
+}
+static void log_free()
+{
+	if (g_log == &g_log_own)
+		log_stop(&g_log_own);
 }
 int mlog(const char * format, ...)
 {
-	char msg[MAXBUFLOGOUT];
 	va_list args;
 	va_start(args, format);
-	vsprintf(msg, format, args);
+	log_write(g_log, LOG_SOURCE_OUT, LOG_ERROR, format, args);
+	va_end(args);
+	return(-1);
+}
+static int mlogl(int level, const char * format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	log_write(g_log, LOG_SOURCE_OUT, level, format, args);
 	va_end(args);
-	FILE * pFile = fopen(g_path_out_error_txt, "a");;
-	if (pFile != NULL)
+	return(-1);
+}
+static void mlogk(int level, unsigned long long key, const char * format, ...)
+{
+	// log with the rate limiter of the call site key
+	va_list args;
+	va_start(args, format);
+	log_write_key(g_log, LOG_SOURCE_OUT, level, key, format, args);
+	va_end(args);
+}
+static void clock_init()
+{
+	// start the monotonic clock of the output
+#ifdef V_PC
+	QueryPerformanceFrequency(&g_clock_freq);
+	QueryPerformanceCounter(&g_clock_start);
+#endif
+#ifdef V_MAC
+	mach_timebase_info(&g_clock_freq);
+	g_clock_start = mach_absolute_time();
+#endif
+#ifdef V_LINUX
+	clock_gettime(CLOCK_MONOTONIC, &g_clock_start);
+#endif
+	g_current_us = 0;
+	g_current_t = 0;
+}
+static long long clock_real_us()
+{
+	// return the monotonic high-resolution time, in micro-seconds
+#ifdef V_PC
+	LARGE_INTEGER c;
+	QueryPerformanceCounter(&c);
+	long long dc = c.QuadPart - g_clock_start.QuadPart;
+	return ((dc / g_clock_freq.QuadPart) * 1000000 + ((dc % g_clock_freq.QuadPart) * 1000000) / g_clock_freq.QuadPart);
+#endif
+#ifdef V_MAC
+	uint64_t dc = mach_absolute_time() - g_clock_start;
+	return ((long long)((dc * g_clock_freq.numer) / g_clock_freq.denom / 1000));
+#endif
+#ifdef V_LINUX
+	struct timespec c;
+	clock_gettime(CLOCK_MONOTONIC, &c);
+	return ((long long)(c.tv_sec - g_clock_start.tv_sec) * 1000000 + (c.tv_nsec - g_clock_start.tv_nsec) / 1000);
+#endif
+}
+static long long clock_us()
+{
+	// return the time of the output, in micro-seconds : the monotonic clock, or the virtual clock of the offline render
+	if (g_offline.load(std::memory_order_acquire))
+		return g_offline_us.load(std::memory_order_acquire);
+	return clock_real_us();
+}
+static void clock_update()
+{
+	// refresh the current time of the output
+	g_current_us = clock_us();
+	g_current_t = (long)(g_current_us / 1000);
+}
+#ifdef V_LINUX
+static bool alsa_out_open()
+{
+	// open the sequencer client of the midiout, with its readable port "out"
+	if (g_alsa_seq)
+		return true;
+	g_alsa_seq = alsa_open("luabass", "out", ALSA_CAP_IN, &g_alsa_port, &g_alsa_queue);
+	if (g_alsa_seq == NULL)
+	{
+		mlog("ALSA : error opening the sequencer for midiout");
+		return false;
+	}
+	snd_midi_event_new(16, &g_alsa_encoder);
+	snd_midi_event_no_status(g_alsa_encoder, 1);
+	return true;
+}
+static void alsa_out_free()
+{
+	if (g_alsa_seq == NULL)
+		return;
+	snd_midi_event_free(g_alsa_encoder);
+	g_alsa_encoder = NULL;
+	alsa_close(g_alsa_seq, g_alsa_queue);
+	g_alsa_seq = NULL;
+	g_alsa_pending = false;
+}
+static bool alsa_output(int nr_device, snd_seq_event_t *ev)
+{
+	// write an event for a midiout device in the output buffer of the sequencer.
+	// The event is scheduled without delay on the real-time queue, to be timestamped.
+	// The buffer is drained by batch ( alsa_drain )
+	snd_seq_ev_set_source(ev, g_alsa_port);
+	snd_seq_ev_set_dest(ev, g_midiaddr[nr_device].client, g_midiaddr[nr_device].port);
+	snd_seq_real_time_t now = { 0, 0 };
+	snd_seq_ev_schedule_real(ev, g_alsa_queue, 1, &now);
+	if (snd_seq_event_output(g_alsa_seq, ev) < 0)
+		return false;
+	g_alsa_pending = true;
+	return true;
+}
+static bool alsa_send(int nr_device, BYTE *data, int nbbyte)
+{
+	// write a midi message for a midiout device
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	if (data[0] == 0xF0)
+		snd_seq_ev_set_sysex(&ev, nbbyte, data);
+	else
 	{
-		fprintf(pFile, "%s\n",msg);
-		fclose(pFile);
+		snd_midi_event_reset_encode(g_alsa_encoder);
+		if ((snd_midi_event_encode(g_alsa_encoder, data, nbbyte, &ev) <= 0) || (ev.type == SND_SEQ_EVENT_NONE))
+			return false;
 	}
-	if (g_collectLog)
+	return alsa_output(nr_device, &ev);
+}
+static bool alsa_send_sysex(int nr_device, BYTE *data, int nbbyte)
+{
+	// write a part of a sysex for a midiout device. Only the first part starts with F0
+	snd_seq_event_t ev;
+	snd_seq_ev_clear(&ev);
+	snd_seq_ev_set_sysex(&ev, nbbyte, data);
+	return alsa_output(nr_device, &ev);
+}
+static void alsa_drain()
+{
+	// send the batch of messages waiting in the output buffer of the sequencer
+	if (g_alsa_pending)
 	{
-		strcpy(bufLog[nrInBufLog], msg);
-		nrInBufLog++;
-		if (nrInBufLog >= MAXNBLOGOUT)
-			nrInBufLog = 0;
+		snd_seq_drain_output(g_alsa_seq);
+		g_alsa_pending = false;
 	}
-	return(-1);
 }
+#endif
 void lock_mutex_out()
 {
 #ifdef V_PC
 	WaitForSingleObject(g_mutex_out, INFINITE);
 #endif
-#ifdef V_MAC
+#if defined(V_MAC) || defined(V_LINUX)
 	pthread_mutex_lock(&g_mutex_out);
 #endif
+	// every action on the outputs is stamped with the current time
+	clock_update();
 }
 void unlock_mutex_out()
 {
@@ -422,6 +789,10 @@ void unlock_mutex_out()
 #ifdef V_MAC
 	pthread_mutex_unlock(&g_mutex_out);
 #endif
+#ifdef V_LINUX
+	alsa_drain(); // the messages of this action are sent in one batch
+	pthread_mutex_unlock(&g_mutex_out);
+#endif
 }
 
 static int apply_volume(int nrTrack, int v)
@@ -519,7 +890,7 @@ static bool audio_name(int nr_device, char *name)
 		return true;
 	}
 #endif
-#ifdef V_MAC
+#if defined(V_MAC) || defined(V_LINUX)
 	BASS_DEVICEINFO info;
 	nr_device = 1; // 0 = nosound ...
 	if (BASS_GetDeviceInfo(nr_device, &info) == TRUE)
@@ -576,6 +947,15 @@ static int BASS_MIDI_OutInit(int nr_device)
 		mlog("MidiGetDestination : error");
 		return(-1);
 	}
+#endif
+#ifdef V_LINUX
+	char name_device[ALSA_MAXNAME];
+	if ((!alsa_out_open()) || (alsa_port(g_alsa_seq, ALSA_CAP_OUT, nr_device, &(g_midiaddr[nr_device]), name_device) < 0))
+	{
+		mlog("BASS_MIDI_OutInit device = %d : not found", nr_device);
+		return(-1);
+	}
+	g_midiopened[nr_device] = 1;
 #endif
 	if (nr_device >= g_midimax_nr_device)
 		g_midimax_nr_device = nr_device + 1;
@@ -610,6 +990,11 @@ static int BASS_MIDI_OutInit(int nr_device)
     curPacket = MIDIPacketListAdd(pktlist, sizeof(buffer), curPacket, 0, 3, & (midimsg3.bData[0] ));
     MIDISend(g_midiOutPortRef, g_midiopened[nr_device], pktlist);
 #endif
+#ifdef V_LINUX
+	alsa_send(nr_device, midimsg1.bData, 3);
+	alsa_send(nr_device, midimsg2.bData, 3);
+	alsa_send(nr_device, midimsg3.bData, 3);
+#endif
 
     
 	return(nr_device);
@@ -626,9 +1011,18 @@ static void BASS_MIDI_OutFree(int nr_device)
 		MIDIClientDispose(g_midiClientRef);
 	g_midiopened[nr_device] = 0;
 #endif
+#ifdef V_LINUX
+	g_midiopened[nr_device] = 0;
+#endif
 }
 static bool midi_in_name(int nr_device, char *name_device)
 {
+#ifdef V_LINUX
+	name_device[0] = '\0';
+	if (!alsa_out_open())
+		return false;
+	return (alsa_port(g_alsa_seq, ALSA_CAP_IN, nr_device, NULL, name_device) >= 0);
+#endif
 	BASS_MIDI_DEVICEINFO info;
 	name_device[0] = '\0';
 	BOOL retCode = BASS_MIDI_InGetDeviceInfo(nr_device, &info);
@@ -670,6 +1064,11 @@ static bool midi_out_name(int nr_device, char *name_device)
 	CFRelease(result);
 	return (true);
 #endif
+#ifdef V_LINUX
+	if (!alsa_out_open())
+		return false;
+	return (alsa_port(g_alsa_seq, ALSA_CAP_OUT, nr_device, NULL, name_device) >= 0);
+#endif
 }
 int countMidiOut()
 {
@@ -679,6 +1078,11 @@ int countMidiOut()
 #ifdef V_MAC
 	return (int)(MIDIGetNumberOfDevices());
 #endif
+#ifdef V_LINUX
+	if (!alsa_out_open())
+		return 0;
+	return alsa_port(g_alsa_seq, ALSA_CAP_OUT, -1, NULL, NULL);
+#endif
 }
 int countMidiIn()
 {
@@ -688,13 +1092,15 @@ int countMidiIn()
 #ifdef V_MAC
     return (int)(MIDIGetNumberOfDevices());
 #endif
+#ifdef V_LINUX
+	if (!alsa_out_open())
+		return 0;
+	return alsa_port(g_alsa_seq, ALSA_CAP_IN, -1, NULL, NULL);
+#endif
 }
-/*
 static void inspect_channel()
 {
-	mlog("=============================================== outInspect extended channel");
-	char buf[1024];
-	int nb = 0;
+	mlogl(LOG_INFO, "=============================================== outInspect extended channel");
 	for (int d = 0; d < MIDIOUT_MAX; d++)
 	{
 		if (g_midiopened[d])
@@ -702,45 +1108,35 @@ static void inspect_channel()
 			for (int c = 0; c < MAXCHANNEL; c++)
 			{
 				if ((g_channels[d][c].extended != c) && (g_channels[d][c].extended != -1))
-				{
-					sprintf(buf, "device#%d : channel#%d is extension of channel %d", d + 1, c + 1, g_channels[d][c].extended + 1);
-					mlog(buf);
-					nb++;
-				}
+					mlogl(LOG_INFO, "device#%d : channel#%d is extension of channel %d", d + 1, c + 1, g_channels[d][c].extended + 1);
 			}
 		}
 	}
-	mlog("=============================================== end extended channel");
+	mlogl(LOG_INFO, "=============================================== end extended channel");
 }
 static void inspect_queue()
 {
-	char buf[1024];
-	int nbFree;
-	mlog("=============================================== outInspect queue ");
-	nbFree = 0;
-	for (int n = 0; n < OUT_QUEUE_MAX_MSG; n++)
+	mlogl(LOG_INFO, "=============================================== outInspect queue ");
+	int nbFree = g_queue_size;
+	for (int h = 0; h < g_queue_nb; h++)
 	{
-		if (g_queue_msg[n].free)
-			nbFree++;
-		else
+		int n = g_queue_heap[h];
+		if (! g_queue_msg[n].free)
 		{
-			sprintf(buf, "waiting %d : t=%ld msg=%02X %02X %02X", n,
+			nbFree--;
+			mlogl(LOG_INFO, "waiting %d : t=%lld msg=%02X %02X %02X", n,
 				g_queue_msg[n].t,
 				g_queue_msg[n].midioutmsg.midimsg.bData[0],
 				g_queue_msg[n].midioutmsg.midimsg.bData[1],
 				g_queue_msg[n].midioutmsg.midimsg.bData[2]);
-			mlog(buf);
 		}
 	}
-	mlog("");
-	mlog("nb queue free : %d / max used : %d", nbFree, g_max_queue_msg);
-
-	mlog("=============================================== end queue");
+	mlogl(LOG_INFO, "nb queue free : %d / size : %d / max used : %d", nbFree, g_queue_size, g_max_queue_msg);
+	mlogl(LOG_INFO, "=============================================== end queue");
 }
 static void inspect_note()
 {
-	mlog("=============================================== outInspect note");
-	char buf[1024];
+	mlogl(LOG_INFO, "=============================================== outInspect note");
 	int nb = 0;
 	for (int d = 0; d < OUT_MAX_DEVICE; d++)
 	{
@@ -748,44 +1144,74 @@ static void inspect_note()
 		{
 			for (int p = 0; p < MAXPITCH; p++)
 			{
-				if (g_midistatuspitch[d][c][p] != -1)
+				if (g_midistatuspitch[d][c][p] != (unsigned long)(-1))
 				{
-					sprintf(buf, "note-ON : device #%d , channel #%d , pitch #%d = %lu", d + 1, c + 1, p, g_midistatuspitch[d][c][p]);
-					mlog(buf);
+					mlogl(LOG_INFO, "note-ON : device #%d , channel #%d , pitch #%d = %lu", d + 1, c + 1, p, g_midistatuspitch[d][c][p]);
 					nb++;
 				}
 			}
 		}
 	}
-	mlog("total of note-ON : %d", nb);
-	mlog("===============================================  end note");
+	mlogl(LOG_INFO, "total of note-ON : %d", nb);
+	mlogl(LOG_INFO, "===============================================  end note");
 }
 static void inspect_device()
 {
-	mlog("=============================================== outInspect device");
+	mlogl(LOG_INFO, "=============================================== outInspect device");
 	char buf[MAXBUFCHAR];
 	for (int m = 0; m < MIDIOUT_MAX; m++)
 	{
-		midi_out_name(m, buf);
-		if (g_midiopened[m])
-			mlog("Midiout open : %s (#%d)", buf, m + 1);
+		if ((g_midiopened[m]) && (midi_out_name(m, buf)))
+			mlogl(LOG_INFO, "Midiout open : %s (#%d)", buf, m + 1);
 	}
 	for (int d = 0; d < MAX_AUDIO_DEVICE; d++)
 	{
 		if (g_mixer_stream[d])
-		{
-			sprintf(buf, "vi : mixer_stream[device #%d] %d", d + 1, g_mixer_stream[d]);
-			mlog(buf);
-		}
-}
+			mlogl(LOG_INFO, "vi : mixer_stream[device #%d] %lu", d + 1, (unsigned long)(g_mixer_stream[d]));
+	}
 	for (int s = 0; s < VI_MAX; s++)
 	{
 		if (g_vi_opened[s].mstream)
-			mlog("vi : midi[stream #%d] , %d", s, g_vi_opened[s].mstream + 1);
+			mlogl(LOG_INFO, "vi : midi[stream #%d] , %lu", s, (unsigned long)(g_vi_opened[s].mstream));
 		if (g_vi_opened[s].sf2_midifont)
-			mlog("vi : midifont[stream #%d] %d", s, g_vi_opened[s].sf2_midifont);
+			mlogl(LOG_INFO, "vi : midifont[stream #%d] %lu", s, (unsigned long)(g_vi_opened[s].sf2_midifont));
+		if (g_vi_opened[s].vi_clock.nb > 0)
+			mlogl(LOG_INFO, "vi : timing[stream #%d] %lld events , %lld late", s, g_vi_opened[s].vi_clock.nb, g_vi_opened[s].vi_clock.late);
+		if (g_vi_opened[s].mstream)
+			mlogl(LOG_INFO, "vi : render[stream #%d] last block %lld us", s, g_vi_opened[s].vi_render_us.load(std::memory_order_relaxed));
+		T_vi_ring *ring = &(g_vi_opened[s].vi_ring);
+		if (ring->max_depth.load(std::memory_order_relaxed) > 0)
+			mlogl(LOG_INFO, "vi : ring[stream #%d] depth %u , max %u , overflow %u , xrun %u , max render %lld us", s,
+				ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_acquire),
+				ring->max_depth.load(std::memory_order_relaxed), ring->overflow.load(std::memory_order_relaxed),
+				ring->xrun.load(std::memory_order_relaxed), ring->max_render_us.load(std::memory_order_relaxed));
+	}
+	mlogl(LOG_INFO, "vi : pool %d workers , share %d%% , %lld blocks in parallel , %lld blocks serial ( pool busy )", g_vi_pool.nbThreads,
+		g_vi_parallel_share.load(std::memory_order_relaxed), g_vi_pool.nbParallel.load(std::memory_order_relaxed), g_vi_pool.nbSerial.load(std::memory_order_relaxed));
+	mlogl(LOG_INFO, "=============================================== end device");
+}
+static void inspect_latency()
+{
+	mlogl(LOG_INFO, "=============================================== outInspect latency %s", g_latency->enabled.load() ? "" : "( disabled )");
+	for (int stage = 0; stage < LAT_NBSTAGE; stage++)
+	{
+		T_lat_stage *s = &(g_latency->stage[stage]);
+		long long nb = s->nb.load(std::memory_order_relaxed);
+		if (nb == 0)
+			continue;
+		mlogl(LOG_INFO, "%s : nb=%lld average=%lldus max=%lldus", g_lat_name[stage], nb, s->sum.load(std::memory_order_relaxed) / nb, s->max.load(std::memory_order_relaxed));
+		for (int b = 0; b < LAT_BUCKET; b++)
+		{
+			long long count = s->count[b].load(std::memory_order_relaxed);
+			if (count == 0)
+				continue;
+			if (lat_limit(b) > 0)
+				mlogl(LOG_INFO, "    < %lldus : %lld", lat_limit(b), count);
+			else
+				mlogl(LOG_INFO, "    >= %lldus : %lld", lat_limit(b - 1), count);
+		}
 	}
-	mlog("=============================================== end device");
+	mlogl(LOG_INFO, "=============================================== end latency");
 }
 static void inspect()
 {
@@ -793,8 +1219,8 @@ static void inspect()
 	inspect_channel();
 	inspect_note();
 	inspect_queue();
+	inspect_latency();
 }
-*/
 #ifdef V_PC
 DWORD CALLBACK asioProc(BOOL input, DWORD channel, void *buffer, DWORD length, void *user)
 {
@@ -852,6 +1278,71 @@ extern "C"
 		return 0;
 	}
 }
+static void vi_pending(T_vi_opened *vi, T_midimsg midimsg)
+{
+	// push a midi msg to render in the next block of the VI, stamped with the time it is sent. Called under g_mutex_out
+	// It never waits : if the ring is full, the msg is counted as an overflow, and lost
+	T_vi_ring *ring = &(vi->vi_ring);
+	unsigned int head = ring->head.load(std::memory_order_relaxed);
+	unsigned int depth = head - ring->tail.load(std::memory_order_acquire);
+	if (depth >= VI_RING_SIZE)
+	{
+		ring->overflow.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	T_vi_event *e = &(ring->events[head & (VI_RING_SIZE - 1)]);
+	e->midimsg.dwData = midimsg.dwData;
+	e->t = (g_out_us < 0) ? g_current_us : g_out_us;
+	ring->head.store(head + 1, std::memory_order_release);
+	if (depth + 1 > ring->max_depth.load(std::memory_order_relaxed))
+		ring->max_depth.store(depth + 1, std::memory_order_relaxed);
+}
+static int vi_pop(T_vi_opened *vi, T_vi_event *events, int nbMax)
+{
+	// pop up to nbMax midi msg to render in this block. Called only by the audio callback of the VI : it never waits
+	T_vi_ring *ring = &(vi->vi_ring);
+	unsigned int head = ring->head.load(std::memory_order_acquire);
+	unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+	int nb = 0;
+	while ((tail != head) && (nb < nbMax))
+	{
+		events[nb] = ring->events[tail & (VI_RING_SIZE - 1)];
+		nb++;
+		tail++;
+	}
+	ring->tail.store(tail, std::memory_order_release);
+	return nb;
+}
+static void vi_render_time(T_vi_opened *vi, long long start_us, int nbFrames)
+{
+	// measure the duration of the render of a block. An xrun is counted when it is longer than the block itself
+	long long dt = clock_real_us() - start_us;
+	vi->vi_render_us.store(dt, std::memory_order_relaxed);
+	T_vi_ring *ring = &(vi->vi_ring);
+	if (dt > ring->max_render_us.load(std::memory_order_relaxed))
+		ring->max_render_us.store(dt, std::memory_order_relaxed);
+	if (dt > ((long long)nbFrames * 1000000) / M_SAMPLE_RATE)
+		ring->xrun.fetch_add(1, std::memory_order_relaxed);
+}
+static void vi_pre_free(T_vi_opened *vi)
+{
+	if (vi->vi_pre_buffer != NULL)
+		free(vi->vi_pre_buffer);
+	vi->vi_pre_buffer = NULL;
+	vi->vi_pre_size = 0;
+	vi->vi_pre_length = 0;
+	vi->vi_pre_seq = 0;
+}
+static void vi_ring_init(T_vi_opened *vi)
+{
+	T_vi_ring *ring = &(vi->vi_ring);
+	ring->head.store(0);
+	ring->tail.store(0);
+	ring->max_depth.store(0);
+	ring->overflow.store(0);
+	ring->xrun.store(0);
+	ring->max_render_us.store(0);
+}
 static void vsti_send_shortmsg(char vsti_nr, T_midimsg midimsg)
 {
 	T_vi_opened *vi = &(g_vi_opened[vsti_nr]);
@@ -859,27 +1350,25 @@ static void vsti_send_shortmsg(char vsti_nr, T_midimsg midimsg)
 		vi->vsti_midi_prog == false ;
 	if (((midimsg.bData[0] >> 4) == MIDI_PROGRAM) && (vi->vsti_midi_prog == false) && (midimsg.bData[1] != vi->vsti_last_prog))
 	{
-		// send the VST program
+		// send the VST program, in the next block
 		vi->vsti_last_prog = midimsg.bData[1];
-		vi->vsti_todo_prog = true;
+		vi->vsti_todo_prog.store(vi->vsti_last_prog, std::memory_order_release);
 		vi->vsti_midi_prog == true ;
 		return;
 	}
-	if (vi->vsti_nb_pending_midimsg >= MAX_VSTI_PENDING_MIDIMSG)
-		return;
-	vi->vsti_pending_midimsg[vi->vsti_nb_pending_midimsg].dwData = midimsg.dwData;
-	(g_vi_opened[vsti_nr].vsti_nb_pending_midimsg)++;
+	vi_pending(vi, midimsg);
 }
-static void vsti_init()
+static VstEvents *vsti_events_alloc()
 {
 	// malloc for an data-structure in VST-DSK, to send block of midi-msg :-/
-	g_vsti_events = (VstEvents *)malloc(sizeof(VstEvents)+MAX_VSTI_PENDING_MIDIMSG*(sizeof(VstEvent *)));;
-	g_vsti_events->numEvents = 0;
-	g_vsti_events->reserved = 0;
+	// One per VSTi : the audio callbacks of the VSTi do not share any buffer
+	VstEvents *vsti_events = (VstEvents *)malloc(sizeof(VstEvents)+MAX_VSTI_PENDING_MIDIMSG*(sizeof(VstEvent *)));;
+	vsti_events->numEvents = 0;
+	vsti_events->reserved = 0;
 	for (int nrEvent = 0; nrEvent < MAX_VSTI_PENDING_MIDIMSG; nrEvent++)
 	{
 		VstEvent *mvstevent = (VstEvent *)malloc(sizeof(VstMidiEvent));;
-		g_vsti_events->events[nrEvent] = mvstevent;
+		vsti_events->events[nrEvent] = mvstevent;
 		VstMidiEvent *midiEvent = (VstMidiEvent *)mvstevent;
 		midiEvent->type = kVstMidiType;
 		midiEvent->byteSize = sizeof(VstMidiEvent);
@@ -896,15 +1385,18 @@ static void vsti_init()
 		midiEvent->reserved1 = 0;			///< zero (Reserved for future use)
 		midiEvent->reserved2 = 0;			///< zero (Reserved for future use)
 	}
+	return vsti_events;
 }
-static void vsti_free()
+static void vsti_events_free(VstEvents *vsti_events)
 {
+	if (vsti_events == NULL)
+		return;
 	for (int nrEvent = 0; nrEvent < MAX_VSTI_PENDING_MIDIMSG; nrEvent++)
 	{
-		VstEvent *mvstevent = g_vsti_events->events[nrEvent];
+		VstEvent *mvstevent = vsti_events->events[nrEvent];
 		free(mvstevent);
 	}
-	free(g_vsti_events);
+	free(vsti_events);
 }
 #ifdef V_PC
 static bool closeVSTi(T_vi_opened *vi)
@@ -1080,6 +1572,60 @@ static bool openVSTi(const char *fname , T_vi_opened *vi)
     return true;
 }
 #endif
+#ifdef V_LINUX
+static bool closeVSTi(T_vi_opened *vi)
+{
+	if (vi->vsti_modulePtr == NULL)
+		return false;
+	if (vi->vsti_plugins != NULL)
+		vi->vsti_plugins->dispatcher(vi->vsti_plugins, effClose, 0, 0, NULL, 0.0f);
+	vi->vsti_plugins = NULL;
+	dlclose(vi->vsti_modulePtr);
+	vi->vsti_modulePtr = NULL;
+	return true;
+}
+static bool openVSTi(const char *fname, T_vi_opened *vi)
+{
+	vi->vsti_plugins = NULL;
+	vi->vsti_modulePtr = dlopen(fname, RTLD_NOW | RTLD_LOCAL);
+	if (vi->vsti_modulePtr == NULL)
+	{
+		mlog("Failed trying to load VST from <%s>, error %s", fname, dlerror());
+		return false;
+	}
+	vstPluginFuncPtr mainEntryPoint = (vstPluginFuncPtr)dlsym(vi->vsti_modulePtr, "VSTPluginMain");
+	if (mainEntryPoint == NULL)
+		mainEntryPoint = (vstPluginFuncPtr)dlsym(vi->vsti_modulePtr, "main");
+	if (mainEntryPoint == NULL)
+	{
+		mlog("Couldn't get a pointer to plugin's main() for VSTi %s", fname);
+		closeVSTi(vi);
+		return false;
+	}
+	vi->vsti_plugins = mainEntryPoint((audioMasterCallback)hostCallback);
+	if (vi->vsti_plugins == NULL)
+	{
+		mlog("Plugin's main() returns null for VSTi %s", fname);
+		closeVSTi(vi);
+		return false;
+	}
+	if (vi->vsti_plugins->magic != kEffectMagic)
+	{
+		mlog("Plugin magic number is bad <%s>", fname);
+		closeVSTi(vi);
+		return false;
+	}
+	int numOutputs = vi->vsti_plugins->numOutputs;
+	if (numOutputs < 1)
+	{
+		mlog("Error : VST does not have stereo output <%s>", fname);
+		closeVSTi(vi);
+		return false;
+	}
+	vi->vsti_nb_outputs = numOutputs;
+	return true;
+}
+#endif
 static bool vsti_start(const char *fname, char vsti_nr)
 {
 	T_vi_opened *vi = &(g_vi_opened[vsti_nr]);
@@ -1094,6 +1640,7 @@ static bool vsti_start(const char *fname, char vsti_nr)
 	for (int channel = 0; channel < vi->vsti_nb_outputs; ++channel)
 	for (long frame = 0; frame < VSTI_BUFSIZE; ++frame)
 		vi->vsti_outputs[channel][frame] = 0.0f;
+	vi->vsti_events = vsti_events_alloc();
 
 
 	MidiProgramName mProgram;
@@ -1130,63 +1677,52 @@ static void vsti_stop(char vsti_nr)
 		free(vi->vsti_outputs);
 		vi->vsti_outputs = NULL;
 	}
+	vsti_events_free(vi->vsti_events);
+	vi->vsti_events = NULL;
+	vi_pre_free(vi);
 }
-DWORD CALLBACK vsti_streamProc(HSTREAM handle, void *buffer, DWORD length, void * pvsti_nr)
+static void vsti_render(T_vi_opened *vi, void *buffer, DWORD length, long long now)
 {
-    VstIntPtr intptr = (VstIntPtr)pvsti_nr ;
-    int vsti_nr = (int)intptr;
-	T_vi_opened *vi = &(g_vi_opened[vsti_nr]);
+	// render a block of the VSTi, rendered at time now
+	float *fbuf = (float *)buffer;
+	int nbfloat = length / (sizeof(float) * vi->vsti_nb_outputs);
 
-	lock_mutex_out();
+	// audio thread : no lock. The midi msg are popped from the ring of the VSTi
 	// send pending vst-program
-	if (vi->vsti_todo_prog)
-	{
-		g_vi_opened[vsti_nr].vsti_plugins->dispatcher(g_vi_opened[vsti_nr].vsti_plugins, effSetProgram, 0, vi->vsti_last_prog, NULL, 0.0f);
-		vi->vsti_todo_prog = false;
-	}
-	// send pending midi messages
-	if (vi->vsti_nb_pending_midimsg > 0)
-	{
-		g_vsti_events->numEvents = vi->vsti_nb_pending_midimsg;
-		for (int nrEvent = 0; nrEvent < vi->vsti_nb_pending_midimsg; nrEvent++)
+	int prog = vi->vsti_todo_prog.exchange(-1, std::memory_order_acquire);
+	if (prog >= 0)
+		vi->vsti_plugins->dispatcher(vi->vsti_plugins, effSetProgram, 0, prog, NULL, 0.0f);
+	// send pending midi messages, at their frame in the block
+	timing_block(&(vi->vi_clock), now, nbfloat);
+	T_vi_event events[MAX_VSTI_PENDING_MIDIMSG];
+	int nbEvents = vi_pop(vi, events, MAX_VSTI_PENDING_MIDIMSG);
+	if (nbEvents > 0)
+	{
+		VstEvents *vsti_events = vi->vsti_events;
+		vsti_events->numEvents = nbEvents;
+		for (int nrEvent = 0; nrEvent < nbEvents; nrEvent++)
 		{
-			VstEvent *mvstevent = g_vsti_events->events[nrEvent] ;
+			VstEvent *mvstevent = vsti_events->events[nrEvent] ;
 			VstMidiEvent *midiEvent = (VstMidiEvent *)mvstevent;
-			midiEvent->midiData[0] = vi->vsti_pending_midimsg[nrEvent].bData[0];
-			midiEvent->midiData[1] = vi->vsti_pending_midimsg[nrEvent].bData[1];
-			midiEvent->midiData[2] = vi->vsti_pending_midimsg[nrEvent].bData[2];
+			T_vi_event *e = &(events[nrEvent]);
+			midiEvent->midiData[0] = e->midimsg.bData[0];
+			midiEvent->midiData[1] = e->midimsg.bData[1];
+			midiEvent->midiData[2] = e->midimsg.bData[2];
+			midiEvent->deltaFrames = timing_offset(&(vi->vi_clock), e->t);
 		}
-		vi->vsti_plugins->dispatcher(vi->vsti_plugins, effProcessEvents, 0, 0, g_vsti_events, 0.0f);
-		vi->vsti_nb_pending_midimsg = 0;
+		vi->vsti_plugins->dispatcher(vi->vsti_plugins, effProcessEvents, 0, 0, vsti_events, 0.0f);
 	}
-	unlock_mutex_out();
-
 
-	float *fbuf = (float *)buffer;
-	int nbfloat = length / (sizeof(float) * vi->vsti_nb_outputs);
 	float ** ouput = vi->vsti_outputs;
 	vi->vsti_plugins->processReplacing(vi->vsti_plugins, NULL, ouput, nbfloat);
-	float *pt[10];
-	for (int nr_channel = 0; nr_channel < vi->vsti_nb_outputs; nr_channel++)
-		pt[nr_channel] = ouput[0];
-	for (long frame = 0; frame < nbfloat; ++frame)
-	{
-		for (int nr_channel = 0; nr_channel < vi->vsti_nb_outputs; nr_channel++)
-		{
-			*fbuf = *(pt[nr_channel]);
-			(pt[nr_channel]) ++;
-			fbuf++;
-		}
-	}
-	return length;
+	// output #c of the VSTi in the channel #c of the stream
+	audio_kernels()->interleave(fbuf, ouput, vi->vsti_nb_outputs, nbfloat);
 }
-static void sf2_send_shortmsg(int nr_device, T_midimsg msg)
+static void sf2_event(T_vi_opened *vi, T_midimsg msg)
 {
+	// apply a midi msg to the BASSMIDI stream of the SF2
 	BYTE channel = msg.bData[0] & 0x0F;
-	HSTREAM mstream = g_vi_opened[nr_device].mstream;
-	// mlog("vi_send nr_device = %d , channel =%d", nr_device, channel);
-	static int vi_rpn_msb = 0;
-	static int vi_rpn_lsb = 0;
+	HSTREAM mstream = vi->sf2_stream;
 	switch (msg.bData[0] >> 4)
 	{
 	case MIDI_NOTEON: BASS_MIDI_StreamEvent(mstream, channel, MIDI_EVENT_NOTE, MAKEWORD(msg.bData[1], msg.bData[2])); break;
@@ -1218,12 +1754,12 @@ static void sf2_send_shortmsg(int nr_device, T_midimsg msg)
 		case 126: BASS_MIDI_StreamEvent(mstream, channel, MIDI_EVENT_MODE, msg.bData[2]); break;
 		case 127: BASS_MIDI_StreamEvent(mstream, channel, MIDI_EVENT_MODE, msg.bData[2]); break;
 
-		case 100: vi_rpn_msb = msg.bData[2]; break;
-		case 101: vi_rpn_lsb = msg.bData[2]; break;
+		case 100: vi->sf2_rpn_msb = msg.bData[2]; break;
+		case 101: vi->sf2_rpn_lsb = msg.bData[2]; break;
 		case 6:
-			if (vi_rpn_msb == 0)
+			if (vi->sf2_rpn_msb == 0)
 			{
-				switch (vi_rpn_lsb)
+				switch (vi->sf2_rpn_lsb)
 				{
 				case 0:BASS_MIDI_StreamEvent(mstream, channel, MIDI_EVENT_PITCHRANGE, msg.bData[2]); break;
 				case 1:BASS_MIDI_StreamEvent(mstream, channel, MIDI_EVENT_FINETUNE, msg.bData[2]); break;
@@ -1238,6 +1774,341 @@ static void sf2_send_shortmsg(int nr_device, T_midimsg msg)
 	default: break;
 	}
 }
+static void sf2_send_shortmsg(int nr_device, T_midimsg msg)
+{
+	// the msg is applied by sf2_streamProc, at its frame in the next block
+	vi_pending(&(g_vi_opened[nr_device]), msg);
+}
+static void sf2_render(T_vi_opened *vi, void *buffer, DWORD length, long long now)
+{
+	// render a block of the BASSMIDI stream of the SF2, in parts split at the frame of the pending midi msg
+	DWORD sizeFrame = 2 * sizeof(float);
+	int nbFrames = length / sizeFrame;
+	T_vi_event events[MAX_VSTI_PENDING_MIDIMSG];
+	int offsets[MAX_VSTI_PENDING_MIDIMSG];
+
+	// audio thread : no lock. The midi msg are popped from the ring of the SF2
+	timing_block(&(vi->vi_clock), now, nbFrames);
+	int nbEvents = vi_pop(vi, events, MAX_VSTI_PENDING_MIDIMSG);
+	for (int nrEvent = 0; nrEvent < nbEvents; nrEvent++)
+		offsets[nrEvent] = timing_offset(&(vi->vi_clock), events[nrEvent].t);
+
+	char *pt = (char *)buffer;
+	DWORD done = 0;
+	for (int nrEvent = 0; nrEvent <= nbEvents; nrEvent++)
+	{
+		DWORD to = (nrEvent < nbEvents) ? (offsets[nrEvent] * sizeFrame) : (nbFrames * sizeFrame);
+		if (to > done)
+		{
+			DWORD got = BASS_ChannelGetData(vi->sf2_stream, pt + done, to - done);
+			if (got == (DWORD)-1)
+				got = 0;
+			if (got < to - done)
+				memset(pt + done + got, 0, to - done - got);
+			done = to;
+		}
+		if (nrEvent < nbEvents)
+			sf2_event(vi, events[nrEvent].midimsg);
+	}
+}
+static int vi_nb_channels(T_vi_opened *vi)
+{
+	return ((vi->sf2_stream != 0) ? 2 : vi->vsti_nb_outputs);
+}
+static void vi_render(T_vi_opened *vi, void *buffer, DWORD length, long long now)
+{
+	// render a block of the VI, and measure its duration
+	long long start = clock_real_us();
+	if (vi->sf2_stream != 0)
+		sf2_render(vi, buffer, length, now);
+	else
+		vsti_render(vi, buffer, length, now);
+	vi_render_time(vi, start, length / (sizeof(float) * vi_nb_channels(vi)));
+}
+#ifdef V_PC
+DWORD WINAPI vi_pool_worker(LPVOID lpParam);
+#else
+void *vi_pool_worker(void *info);
+#endif
+static void vi_pool_wakeup()
+{
+	// wake-up the workers, without waiting
+#ifdef V_PC
+	for (int n = 0; n < g_vi_pool.nbThreads; n++)
+		SetEvent(g_vi_pool.events[n]);
+#else
+	// A worker between its test and its wait misses the signal : its jobs are then rendered by the other
+	// threads ( the jobs are not assigned ), and it is woken-up by the next block.
+	g_vi_pool.generation.fetch_add(1, std::memory_order_release);
+	if (pthread_mutex_trylock(&(g_vi_pool.mutex)) == 0)
+	{
+		pthread_cond_broadcast(&(g_vi_pool.cond));
+		pthread_mutex_unlock(&(g_vi_pool.mutex));
+	}
+	else
+		pthread_cond_broadcast(&(g_vi_pool.cond));
+#endif
+}
+static void vi_pool_yield()
+{
+#ifdef V_PC
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+static void vi_pool_run()
+{
+	// render the jobs of the batch not yet taken. Called by the workers, and by the audio thread which waits the batch
+	while (true)
+	{
+		unsigned int next = g_vi_pool.next.fetch_add(1, std::memory_order_acq_rel);
+		unsigned int nr_job = next & 0xFFFF;
+		if (nr_job >= (next >> 16))
+			return;
+		T_vi_job *job = &(g_vi_pool.jobs[nr_job]);
+		T_vi_opened *vi = job->vi;
+		vi_render(vi, vi->vi_pre_buffer, job->length, job->now);
+		vi->vi_pre_length = job->length;
+		vi->vi_pre_seq = job->seq;
+		g_vi_pool.done.fetch_add(1, std::memory_order_release);
+	}
+}
+#ifdef V_PC
+DWORD WINAPI vi_pool_worker(LPVOID lpParam)
+{
+	// worker of the pool : wait for a batch, and render its jobs
+	VstIntPtr intptr = (VstIntPtr)lpParam;
+	HANDLE event = g_vi_pool.events[(int)intptr];
+	while (true)
+	{
+		WaitForSingleObject(event, INFINITE);
+		if (!g_vi_pool.running.load(std::memory_order_acquire))
+			break;
+		vi_pool_run();
+	}
+	return 0;
+}
+#else
+void *vi_pool_worker(void *info)
+{
+	// worker of the pool : wait for a batch, and render its jobs
+	unsigned int seen = g_vi_pool.generation.load(std::memory_order_acquire);
+	while (true)
+	{
+		pthread_mutex_lock(&(g_vi_pool.mutex));
+		while (g_vi_pool.running.load(std::memory_order_acquire) && (g_vi_pool.generation.load(std::memory_order_acquire) == seen))
+			pthread_cond_wait(&(g_vi_pool.cond), &(g_vi_pool.mutex));
+		seen = g_vi_pool.generation.load(std::memory_order_acquire);
+		pthread_mutex_unlock(&(g_vi_pool.mutex));
+		if (!g_vi_pool.running.load(std::memory_order_acquire))
+			break;
+		vi_pool_run();
+	}
+	return NULL;
+}
+#endif
+static void vi_pool_lock()
+{
+	// take the pool for its configuration : wait the end of the batch in progress
+	bool expected = false;
+	while (!g_vi_pool.busy.compare_exchange_weak(expected, true, std::memory_order_acquire))
+	{
+		expected = false;
+		vi_pool_yield();
+	}
+}
+static void vi_pool_start(int nbThreads)
+{
+	// start the workers, with a real-time priority when the system allows it. Called with the pool locked
+	if (nbThreads > VI_POOL_MAX)
+		nbThreads = VI_POOL_MAX;
+	g_vi_pool.nbThreads = 0;
+	g_vi_pool.running.store(true);
+	g_vi_pool.next.store(0);
+	g_vi_pool.done.store(0);
+#if defined(V_MAC) || defined(V_LINUX)
+	pthread_mutex_init(&(g_vi_pool.mutex), NULL);
+	pthread_cond_init(&(g_vi_pool.cond), NULL);
+#endif
+	for (int n = 0; n < nbThreads; n++)
+	{
+#ifdef V_PC
+		VstIntPtr intptr = n;
+		g_vi_pool.events[n] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		g_vi_pool.threads[n] = CreateThread(NULL, 0, vi_pool_worker, (void*)intptr, 0, NULL);
+		if ((g_vi_pool.events[n] == NULL) || (g_vi_pool.threads[n] == NULL))
+		{
+			mlog("Error vi_pool_start thread #%d", n + 1);
+			if (g_vi_pool.events[n] != NULL)
+				CloseHandle(g_vi_pool.events[n]);
+			break;
+		}
+		SetThreadPriority(g_vi_pool.threads[n], THREAD_PRIORITY_TIME_CRITICAL);
+#else
+		int err;
+#ifdef V_LINUX
+		pthread_attr_t tattr;
+		struct sched_param param;
+		pthread_attr_init(&tattr);
+		pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&tattr, SCHED_FIFO);
+		param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+		pthread_attr_setschedparam(&tattr, &param);
+		err = pthread_create(&(g_vi_pool.threads[n]), &tattr, vi_pool_worker, NULL);
+		if (err == EPERM)
+			err = pthread_create(&(g_vi_pool.threads[n]), NULL, vi_pool_worker, NULL); // no real-time priority for this user
+		pthread_attr_destroy(&tattr);
+#else
+		err = pthread_create(&(g_vi_pool.threads[n]), NULL, vi_pool_worker, NULL);
+#endif
+		if (err != 0)
+		{
+			mlog("Error vi_pool_start thread #%d, err=%d", n + 1, err);
+			break;
+		}
+#endif
+		g_vi_pool.nbThreads++;
+	}
+	mlogl(LOG_INFO, "vi : pool of %d workers", g_vi_pool.nbThreads);
+}
+static void vi_pool_stop()
+{
+	// stop the workers. Called with the pool locked
+	if (!g_vi_pool.running.load())
+		return;
+	g_vi_pool.running.store(false);
+#ifdef V_PC
+	for (int n = 0; n < g_vi_pool.nbThreads; n++)
+		SetEvent(g_vi_pool.events[n]);
+	for (int n = 0; n < g_vi_pool.nbThreads; n++)
+	{
+		WaitForSingleObject(g_vi_pool.threads[n], INFINITE);
+		CloseHandle(g_vi_pool.threads[n]);
+		CloseHandle(g_vi_pool.events[n]);
+	}
+#else
+	pthread_mutex_lock(&(g_vi_pool.mutex));
+	pthread_cond_broadcast(&(g_vi_pool.cond));
+	pthread_mutex_unlock(&(g_vi_pool.mutex));
+	for (int n = 0; n < g_vi_pool.nbThreads; n++)
+		pthread_join(g_vi_pool.threads[n], NULL);
+	pthread_cond_destroy(&(g_vi_pool.cond));
+	pthread_mutex_destroy(&(g_vi_pool.mutex));
+#endif
+	g_vi_pool.nbThreads = 0;
+}
+static int vi_pool_default()
+{
+	// default number of workers : one per CPU, except the audio thread
+	int nbCpu;
+#ifdef V_PC
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	nbCpu = (int)(info.dwNumberOfProcessors);
+#else
+	nbCpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nbCpu < 1)
+		nbCpu = 1;
+	return ((nbCpu - 1 > VI_POOL_MAX) ? VI_POOL_MAX : nbCpu - 1);
+}
+static bool vi_parallel(T_vi_opened *vi, void *buffer, DWORD length, long long now)
+{
+	// First VI of the audio-device pulled by its mixer for this block : when the sum of the render times of
+	// the VI of the audio-device exceeds the share of the block duration, the other VI are rendered in advance
+	// on the pool, while this one is rendered by the audio thread. The audio thread then helps the workers
+	// with the jobs not yet taken, and waits the end of the batch, before the mix.
+	// The next pulls of the mixer for this block copy the blocks rendered in advance ( cf. vi_stream ).
+	// Return false if the block of the VI is not rendered here.
+	int share = g_vi_parallel_share.load(std::memory_order_relaxed);
+	int nr_device = vi->nr_device_audio;
+	if ((share <= 0) || (nr_device < 0) || (nr_device >= MAX_AUDIO_DEVICE))
+		return false;
+	int nbFrames = length / (sizeof(float) * vi_nb_channels(vi));
+	long long block_us = ((long long)nbFrames * 1000000) / M_SAMPLE_RATE;
+	long long sum_us = 0;
+	int nbOthers = 0;
+	for (int nr_vi = 0; nr_vi < g_vi_opened_nb; nr_vi++)
+	{
+		T_vi_opened *other = &(g_vi_opened[nr_vi]);
+		if ((other->mstream == 0) || (other->nr_device_audio != nr_device))
+			continue;
+		sum_us += other->vi_render_us.load(std::memory_order_relaxed);
+		if (other != vi)
+			nbOthers++;
+	}
+	if ((nbOthers == 0) || (sum_us * 100 <= block_us * share))
+		return false;
+	// a single batch at a time : the other audio-devices render their VI serially meanwhile
+	bool expected = false;
+	if (!g_vi_pool.busy.compare_exchange_strong(expected, true, std::memory_order_acquire))
+	{
+		g_vi_pool.nbSerial.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	if (g_vi_pool.nbThreads == 0)
+	{
+		g_vi_pool.busy.store(false, std::memory_order_release);
+		return false;
+	}
+	long long seq = ++(g_vi_block_seq[nr_device]);
+	int nbJobs = 0;
+	for (int nr_vi = 0; nr_vi < g_vi_opened_nb; nr_vi++)
+	{
+		T_vi_opened *other = &(g_vi_opened[nr_vi]);
+		if ((other == vi) || (other->mstream == 0) || (other->nr_device_audio != nr_device))
+			continue;
+		DWORD otherLength = nbFrames * sizeof(float) * vi_nb_channels(other);
+		if ((other->vi_pre_buffer == NULL) || (otherLength > other->vi_pre_size))
+			continue;
+		T_vi_job *job = &(g_vi_pool.jobs[nbJobs]);
+		job->vi = other;
+		job->length = otherLength;
+		job->now = now;
+		job->seq = seq;
+		nbJobs++;
+	}
+	g_vi_pool.done.store(0, std::memory_order_relaxed);
+	g_vi_pool.next.store((unsigned int)nbJobs << 16, std::memory_order_release);
+	vi_pool_wakeup();
+	vi_render(vi, buffer, length, now);
+	vi_pool_run();
+	// barrier : a job taken is always finished by its thread
+	while (g_vi_pool.done.load(std::memory_order_acquire) < nbJobs)
+		vi_pool_yield();
+	g_vi_pool.nbParallel.fetch_add(1, std::memory_order_relaxed);
+	g_vi_pool.busy.store(false, std::memory_order_release);
+	return true;
+}
+static void vi_stream(int nr_vi, void *buffer, DWORD length)
+{
+	// block of a VI pulled by the mixer of its audio-device : copied if it was rendered in advance by the pool
+	// for this block, else rendered here ( and the other VI of the audio-device in parallel, if needed )
+	T_vi_opened *vi = &(g_vi_opened[nr_vi]);
+	if ((vi->vi_pre_seq != 0) && (vi->vi_pre_seq == g_vi_block_seq[vi->nr_device_audio]) && (vi->vi_pre_length == length))
+	{
+		memcpy(buffer, vi->vi_pre_buffer, length);
+		vi->vi_pre_seq = 0;
+		return;
+	}
+	vi->vi_pre_seq = 0;
+	long long now = clock_us();
+	if (!vi_parallel(vi, buffer, length, now))
+		vi_render(vi, buffer, length, now);
+}
+DWORD CALLBACK vsti_streamProc(HSTREAM handle, void *buffer, DWORD length, void * pvsti_nr)
+{
+    VstIntPtr intptr = (VstIntPtr)pvsti_nr ;
+	vi_stream((int)intptr, buffer, length);
+	return length;
+}
+DWORD CALLBACK sf2_streamProc(HSTREAM handle, void *buffer, DWORD length, void *pvi_nr)
+{
+	VstIntPtr intptr = (VstIntPtr)pvi_nr;
+	vi_stream((int)intptr, buffer, length);
+	return length;
+}
 static bool sf2_create_list_prog(const char *fname)
 {
 	HSOUNDFONT hvi = BASS_MIDI_FontInit((void*)fname, 0);
@@ -1355,9 +2226,37 @@ static void sf2_stop(int vsti_nr)
 	vi->sf2_midifont = 0;
 	BASS_StreamFree(vi->mstream);
 	vi->mstream = 0;
+	BASS_StreamFree(vi->sf2_stream);
+	vi->sf2_stream = 0;
+	vi_pre_free(vi);
+}
+static int mixer_create_offline(int nr_deviceaudio)
+{
+	// offline render : the mixer of the audio-device is a decoding stream, pulled by audioOfflineRender
+	if ((nr_deviceaudio < 0) || (nr_deviceaudio >= MAX_AUDIO_DEVICE))
+		return(-1);
+	if (g_mixer_stream[nr_deviceaudio])
+		return nr_deviceaudio;
+	// "no sound" device : nothing is played by BASS
+	if ((BASS_Init(0, M_SAMPLE_RATE, 0, 0, NULL) == FALSE) && (BASS_ErrorGetCode() != BASS_ERROR_ALREADY))
+	{
+		mlog("Error BASS_Init offline, err=%d\n", BASS_ErrorGetCode());
+		return(-1);
+	}
+	g_mixer_stream[nr_deviceaudio] = BASS_Mixer_StreamCreate(M_SAMPLE_RATE, 2, BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT);
+	if (g_mixer_stream[nr_deviceaudio] == 0)
+	{
+		mlog("Error offline BASS_Mixer_StreamCreate, err=%d\n", BASS_ErrorGetCode());
+		return(-1);
+	}
+	g_audio_open[nr_deviceaudio] = true;
+	mlogl(LOG_INFO, "Information : offline audio mixer device#%d create : OK", nr_deviceaudio + 1);
+	return(nr_deviceaudio);
 }
 static int mixer_create(int nr_deviceaudio)
 {
+	if (g_offline.load())
+		return mixer_create_offline(nr_deviceaudio);
 #ifdef V_PC
 	if (g_audio_open[nr_deviceaudio])
 		return nr_deviceaudio;
@@ -1395,7 +2294,7 @@ static int mixer_create(int nr_deviceaudio)
 		return -1;
 	}
 	else
-		mlog("Information : ASIO start #device %d OK", nr_deviceaudio + 1);
+		mlogl(LOG_INFO, "Information : ASIO start #device %d OK", nr_deviceaudio + 1);
 #else
 	if (!g_mixer_stream[nr_deviceaudio])
 	{
@@ -1418,7 +2317,7 @@ static int mixer_create(int nr_deviceaudio)
 		}
 	}
 #endif
-	mlog("Information : audio mixer device#%d create : OK", nr_deviceaudio + 1);
+	mlogl(LOG_INFO, "Information : audio mixer device#%d create : OK", nr_deviceaudio + 1);
 	return(nr_deviceaudio);
 }
 static void mixer_init()
@@ -1432,7 +2331,7 @@ static void mixer_init()
 	char name_audio[MAXBUFCHAR];
 	while (audio_name(nr_device, name_audio))
 	{
-		mlog("Information : Audio asio interface <%s> #%d", name_audio, nr_device + 1);
+		mlogl(LOG_INFO, "Information : Audio asio interface <%s> #%d", name_audio, nr_device + 1);
 		nr_device++;
 	}
 }
@@ -1447,17 +2346,20 @@ static void mixer_free()
 			if (BASS_StreamFree(g_mixer_stream[n]) == FALSE)
 				mlog("Error free mixer on device audio #%d Err=%d", n + 1, BASS_ErrorGetCode());
 			else
-				mlog("Information : free mixer on device audio #%d OK", n + 1);
+				mlogl(LOG_INFO, "Information : free mixer on device audio #%d OK", n + 1);
 #ifdef V_PC
-			BASS_ASIO_SetDevice(n);
-			if (BASS_ASIO_Stop() == FALSE)
-				mlog("Error stop ASIO device audio #%d Err=%d", n + 1, BASS_ErrorGetCode());
-			else
-				mlog("Information : stop ASIO device#%d OK", n + 1);
-			if (BASS_ASIO_Free() == FALSE)
-				mlog("Error free ASIO device#%d Err=%d", n + 1, BASS_ErrorGetCode());
-			else
-				mlog("Information : free ASIO device#%d  OK", n + 1);
+			if (!g_offline.load()) // the offline mixers are decoding streams, without ASIO
+			{
+				BASS_ASIO_SetDevice(n);
+				if (BASS_ASIO_Stop() == FALSE)
+					mlog("Error stop ASIO device audio #%d Err=%d", n + 1, BASS_ErrorGetCode());
+				else
+					mlogl(LOG_INFO, "Information : stop ASIO device#%d OK", n + 1);
+				if (BASS_ASIO_Free() == FALSE)
+					mlog("Error free ASIO device#%d Err=%d", n + 1, BASS_ErrorGetCode());
+				else
+					mlogl(LOG_INFO, "Information : free ASIO device#%d  OK", n + 1);
+			}
 #endif
 		}
 		g_mixer_stream[n] = 0;
@@ -1466,7 +2368,8 @@ static void mixer_free()
 	if (found)
 	{
 		BASS_Free();
-		Sleep(2000);
+		if (!g_offline.load())
+			Sleep(2000);
 	}
 
 #else
@@ -1484,7 +2387,7 @@ static int vi_open(const char *fname, int nr_deviceaudio, bool sf2)
 		if ((strcmp(vi->filename, fname) == 0) && (vi->nr_device_audio == nr_deviceaudio))
 		{
 			// VI allready opened in the same audio channel
-			mlog("Information : open vi<%s> audio-device#%d : already open", fname, nr_deviceaudio + 1);
+			mlogl(LOG_INFO, "Information : open vi<%s> audio-device#%d : already open", fname, nr_deviceaudio + 1);
 			return (nr_vi);
 		}
 	}
@@ -1494,17 +2397,26 @@ static int vi_open(const char *fname, int nr_deviceaudio, bool sf2)
 	// new VI stream to create open vi
 	strcpy(vi->filename, fname);
 	vi->nr_device_audio = nr_deviceaudio;
+	// no stream pulls this VI yet : the ring starts empty, without the msg and the counters of a previous VI
+	vi_ring_init(vi);
 
 	if (mixer_create(nr_deviceaudio) == -1) return(-1);
 	if (sf2)
 	{
-		// connect a midi-channel on the mixer-device
-		vi->mstream = BASS_MIDI_StreamCreate(MAXCHANNEL, BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT, M_SAMPLE_RATE);
-		if (vi->mstream == 0)
+		// connect a midi-channel on the mixer-device, via a callback sf2_streamProc which applies the midi msg at their frame
+		vi->sf2_stream = BASS_MIDI_StreamCreate(MAXCHANNEL, BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT, M_SAMPLE_RATE);
+		if (vi->sf2_stream == 0)
 		{
 			mlog("Error BASS_MIDI_StreamCreate VI, err=%d", BASS_ErrorGetCode());
 			return(-1);
 		}
+		VstIntPtr intptr = nr_vi;
+		vi->mstream = BASS_StreamCreate(M_SAMPLE_RATE, 2, BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT, &sf2_streamProc, (void*)intptr);
+		if (vi->mstream == 0)
+		{
+			mlog("Error BASS_StreamCreate VI, err=%d", BASS_ErrorGetCode());
+			return(-1);
+		}
 		if (BASS_Mixer_StreamAddChannel(g_mixer_stream[nr_deviceaudio], vi->mstream, 0) == FALSE)
 		{
 			mlog("Error BASS_Mixer_StreamAddChannel VI , err=%d", BASS_ErrorGetCode());
@@ -1526,7 +2438,7 @@ static int vi_open(const char *fname, int nr_deviceaudio, bool sf2)
 		mfont.font = vi->sf2_midifont;
 		mfont.preset = -1;
 		mfont.bank = 0;
-		if (BASS_MIDI_StreamSetFonts(vi->mstream, &mfont, 1) == FALSE)
+		if (BASS_MIDI_StreamSetFonts(vi->sf2_stream, &mfont, 1) == FALSE)
 		{
 			mlog("Error BASS_MIDI_StreamSetFonts <%s> , err=%d", fname, BASS_ErrorGetCode());
 			return -1;
@@ -1556,7 +2468,12 @@ static int vi_open(const char *fname, int nr_deviceaudio, bool sf2)
 			return(-1);
 		}
 	}
-	mlog("Information : open vi<%s> audio-device#%d : OK", fname, nr_deviceaudio + 1);
+	// buffer for the blocks rendered in advance by the pool of workers
+	vi->vi_pre_size = VSTI_BUFSIZE * sizeof(float) * vi_nb_channels(vi);
+	vi->vi_pre_buffer = (float *)malloc(vi->vi_pre_size);
+	if (vi->vi_pre_buffer == NULL)
+		vi->vi_pre_size = 0;
+	mlogl(LOG_INFO, "Information : open vi<%s> audio-device#%d : OK", fname, nr_deviceaudio + 1);
 	return nr_vi;
 }
 static void vi_init()
@@ -1567,18 +2484,34 @@ static void vi_init()
 	{
 		g_vi_opened[n].mstream = 0;
 		g_vi_opened[n].sf2_midifont = 0;
+		g_vi_opened[n].sf2_stream = 0;
+		g_vi_opened[n].sf2_rpn_msb = 0;
+		g_vi_opened[n].sf2_rpn_lsb = 0;
 		g_vi_opened[n].filename[0] = '\0';
 		g_vi_opened[n].nr_device_audio = -1;
 		g_vi_opened[n].vsti_plugins = NULL;
 		g_vi_opened[n].vsti_modulePtr = NULL;
 		g_vi_opened[n].vsti_outputs = NULL;
 		g_vi_opened[n].vsti_last_prog = -1;
-		g_vi_opened[n].vsti_todo_prog = false;
-		g_vi_opened[n].vsti_nb_pending_midimsg = 0;
+		g_vi_opened[n].vsti_todo_prog.store(-1);
+		g_vi_opened[n].vsti_events = NULL;
+		vi_ring_init(&(g_vi_opened[n]));
+		g_vi_opened[n].vi_render_us.store(0);
+		g_vi_opened[n].vi_pre_buffer = NULL;
+		g_vi_opened[n].vi_pre_size = 0;
+		g_vi_opened[n].vi_pre_length = 0;
+		g_vi_opened[n].vi_pre_seq = 0;
+		timing_init(&(g_vi_opened[n].vi_clock), M_SAMPLE_RATE);
 		g_vi_opened[n].vsti_midi_prog = true;
 		g_vi_opened[n].vsti_nb_outputs = 2;
 	}
-	vsti_init();
+	mlogl(LOG_INFO, "vi : audio kernels %s", audio_kernels()->name);
+	for (int d = 0; d < MAX_AUDIO_DEVICE; d++)
+		g_vi_block_seq[d] = 0;
+	g_vi_pool.nbParallel.store(0);
+	g_vi_pool.nbSerial.store(0);
+	vi_pool_start(vi_pool_default());
+	g_vi_pool.busy.store(false);
 }
 static void vi_free()
 {
@@ -1588,9 +2521,13 @@ static void vi_free()
 			sf2_stop(nr_vi);
 		if (g_vi_opened[nr_vi].vsti_plugins != NULL)
 			vsti_stop(nr_vi);
+		// the stream is freed : the msg not rendered are dropped. Called under g_mutex_out, nothing is pushed meanwhile
+		vi_ring_init(&(g_vi_opened[nr_vi]));
 	}
 	g_vi_opened_nb = 0;
-	vsti_free();
+	vi_pool_lock();
+	vi_pool_stop();
+	g_vi_pool.busy.store(false, std::memory_order_release);
 }
 static int sound_play(const char*fname, int volume, int pan, int nr_deviceaudio)
 {
@@ -1636,149 +2573,364 @@ static void picth_init()
 		}
 	}
 }
-static int send_sysex(int nrTrack, const char *sysex)
+static void timer_wakeup()
 {
-	if ((nrTrack < 0) || (nrTrack >= MAXTRACK))
-		return -1;
-	int nr_device = g_tracks[nrTrack].device;
-	if ((nr_device < 0) || (nr_device >= MIDIOUT_MAX) || (g_midiopened[nr_device] == 0))
-		return -1;
-
-	// translate ASCII Hexa format to binary byffer
-	// e.g. GM-Modesysex = "F0 7E 7F 09 01 F7";
-
-	char *bufstr;
-	bufstr = (char*)malloc(strlen(sysex) + 2);
-	strcpy(bufstr, sysex);
-	bufstr[strlen(sysex)] = '\0';
+	// the next deadline has changed : the scheduler thread must recompute its sleep
+#ifdef V_PC
+	if (g_timer_event)
+		SetEvent(g_timer_event);
+#endif
+#if defined(V_MAC) || defined(V_LINUX)
+	if (g_timer_running)
+		pthread_cond_signal(&g_timer_cond);
+#endif
+}
+static int sysex_parse(const char *text, BYTE *buf)
+{
+	// translate ASCII Hexa format to binary, in one pass. Return the number of bytes
+	// e.g. GM-Modesysex = "F0 7E 7F 09 01 F7" or "F07E7F0901F7"
 	int nbByte = 0;
-	char * pch;
-	char *next_token = NULL;
-    pch = strtok_s(bufstr, " ,;.-", &next_token);
-	while (pch != NULL)
-	{
-		nbByte++;
-        pch = strtok_s(NULL, " ,.-", &next_token);
-	}
-	BYTE *buf;
-	buf = (BYTE*)malloc(nbByte + 1);
-	strcpy(bufstr, sysex);
-	bufstr[strlen(sysex)] = '\0';
-    pch = strtok_s(bufstr, " ,;.-", &next_token);
-	nbByte = 0;
-	while (pch != NULL)
-	{
-		buf[nbByte] = (BYTE)strtol(pch, NULL, 16);
-		nbByte++;
-        pch = strtok_s(NULL, " ,.-", &next_token);
-	}
-	free(bufstr);
-	if (nbByte < 4)
-	{
-		free(buf);
-		return -1;
+	int value = 0;
+	int nbDigit = 0;
+	for (const char *c = text; ; c++)
+	{
+		int digit = -1;
+		if ((*c >= '0') && (*c <= '9'))
+			digit = *c - '0';
+		else if ((*c >= 'A') && (*c <= 'F'))
+			digit = *c - 'A' + 10;
+		else if ((*c >= 'a') && (*c <= 'f'))
+			digit = *c - 'a' + 10;
+		if (digit >= 0)
+		{
+			value = value * 16 + digit;
+			nbDigit++;
+		}
+		if ((nbDigit > 0) && ((digit < 0) || (nbDigit == 2)))
+		{
+			buf[nbByte++] = (BYTE)value;
+			value = 0;
+			nbDigit = 0;
+		}
+		if (*c == '\0')
+			break;
 	}
-	// send the sysex in binary
+	return nbByte;
+}
+#ifdef V_MAC
+static void sysex_completion(MIDISysexSendRequest *request)
+{
+	// called by CoreMIDI when the sysex is sent, or aborted
+	T_sysex_out *sx = (T_sysex_out *)(request->completionRefCon);
+	sx->completed.store(true);
+}
+#endif
+static void sysex_start(T_sysex_out *sx)
+{
+	// give the next part of the sysex to the driver. It does not wait
+	int nbByte = sx->length - sx->sent;
+	sx->status = SYSEX_SENDING;
 #ifdef V_PC
-	MIDIHDR midiHdr;
-	midiHdr.lpData = (LPSTR)(malloc(nbByte + 1));
-	midiHdr.dwBufferLength = (DWORD)(nbByte);
-	midiHdr.dwFlags = 0;
-	memcpy(midiHdr.lpData, buf, nbByte);
-	if (midiOutPrepareHeader(g_midiopened[nr_device], &midiHdr, sizeof(MIDIHDR)) == MMSYSERR_NOERROR)
-	{
-		int antiloop = 0;
-		while ((midiHdr.dwFlags & MHDR_PREPARED) != MHDR_PREPARED)
+	if (nbByte > SYSEX_PART)
+		nbByte = SYSEX_PART;
+	sx->hdr.lpData = (LPSTR)(sx->data + sx->sent);
+	sx->hdr.dwBufferLength = (DWORD)nbByte;
+	sx->hdr.dwFlags = 0;
+	if (midiOutPrepareHeader(g_midiopened[sx->nr_device], &(sx->hdr), sizeof(MIDIHDR)) != MMSYSERR_NOERROR)
+	{
+		sx->status = SYSEX_ERROR;
+		return;
+	}
+	if (midiOutLongMsg(g_midiopened[sx->nr_device], &(sx->hdr), sizeof(MIDIHDR)) != MMSYSERR_NOERROR)
+	{
+		midiOutUnprepareHeader(g_midiopened[sx->nr_device], &(sx->hdr), sizeof(MIDIHDR));
+		sx->status = SYSEX_ERROR;
+	}
+#endif
+#ifdef V_MAC
+	sx->completed.store(false);
+	sx->request.destination = g_midiopened[sx->nr_device];
+	sx->request.data = sx->data;
+	sx->request.bytesToSend = (UInt32)nbByte;
+	sx->request.complete = false;
+	sx->request.completionProc = sysex_completion;
+	sx->request.completionRefCon = sx;
+	if (MIDISendSysex(&(sx->request)) != 0)
+		sx->status = SYSEX_ERROR;
+#endif
+#ifdef V_LINUX
+	// a burst of packets : the next ones are written at the next pass of the scheduler
+	for (int n = 0; (n < SYSEX_BURST) && (sx->sent < sx->length); n++)
+	{
+		nbByte = sx->length - sx->sent;
+		if (nbByte > SYSEX_PACKET)
+			nbByte = SYSEX_PACKET;
+		if (!alsa_send_sysex(sx->nr_device, sx->data + sx->sent, nbByte))
 		{
-			if (antiloop > 500)
-			{
-				midiOutUnprepareHeader(g_midiopened[nr_device], &midiHdr, sizeof(MIDIHDR));
-				free(midiHdr.lpData);
-				free(buf);
-				// mlog("sysex : mlog timeout midiOutPrepareHeader flags=%d\n", midiHdr.dwFlags);
-				return(-1);
-			}
-			antiloop++;
+			sx->status = SYSEX_ERROR;
+			return;
 		}
-		if (midiOutLongMsg(g_midiopened[nr_device], &midiHdr, sizeof(MIDIHDR)) != MMSYSERR_NOERROR)
+		sx->sent += nbByte;
+	}
+	if (sx->sent == sx->length)
+		sx->status = SYSEX_DONE;
+#endif
+}
+static void sysex_poll(T_sysex_out *sx)
+{
+	// check the part in progress
+#ifdef V_PC
+	if ((sx->hdr.dwFlags & MHDR_DONE) != MHDR_DONE)
+		return;
+	midiOutUnprepareHeader(g_midiopened[sx->nr_device], &(sx->hdr), sizeof(MIDIHDR));
+	sx->sent += (int)(sx->hdr.dwBufferLength);
+	if (sx->sent < sx->length)
+		sysex_start(sx);
+	else
+		sx->status = SYSEX_DONE;
+#endif
+#ifdef V_MAC
+	if (!sx->completed.load())
+		return;
+	sx->sent = sx->length - (int)(sx->request.bytesToSend);
+	sx->status = (sx->sent == sx->length) ? SYSEX_DONE : SYSEX_ERROR;
+#endif
+#ifdef V_LINUX
+	sysex_start(sx);
+#endif
+}
+static void sysex_release(T_sysex_out *sx)
+{
+	if (sx->data)
+		free(sx->data);
+	sx->data = NULL;
+	sx->ref = LUA_NOREF;
+	sx->status = SYSEX_FREE;
+}
+static bool sysex_notify(T_sysex_out *sx)
+{
+	// queue the call of the LUA function of a sysex ended. Return false if the FIFO is full
+	if (g_sysex_done_head - g_sysex_done_tail >= SYSEX_DONE_QUEUE)
+		return false;
+	T_sysex_done *d = &(g_sysex_done[g_sysex_done_head & (SYSEX_DONE_QUEUE - 1)]);
+	d->id = sx->id;
+	d->ok = (sx->status == SYSEX_DONE);
+	d->ref = sx->ref;
+	d->owner = sx->owner;
+	g_sysex_done_head++;
+	return true;
+}
+static long long sysex_pump()
+{
+	// start or check the sysex, one at a time per device. Called with the mutex locked
+	// return the delay in micro-seconds up to the next check, -1 if no sysex is in progress
+	if (g_sysex_tail == g_sysex_head)
+		return -1;
+	bool busy[MIDIOUT_MAX];
+	for (int n = 0; n < MIDIOUT_MAX; n++)
+		busy[n] = false;
+	bool pending = false;
+	for (unsigned int i = g_sysex_tail; i != g_sysex_head; i++)
+	{
+		T_sysex_out *sx = &(g_sysex[i & (SYSEX_QUEUE - 1)]);
+		if (sx->status == SYSEX_SENDING)
+			sysex_poll(sx);
+		else if ((sx->status == SYSEX_WAITING) && (!busy[sx->nr_device]))
+			sysex_start(sx);
+		if ((sx->status == SYSEX_WAITING) || (sx->status == SYSEX_SENDING))
 		{
-			midiOutUnprepareHeader(g_midiopened[nr_device], &midiHdr, sizeof(MIDIHDR));
-			free(midiHdr.lpData);
-			free(buf);
-			// mlog("sysex : mlog creation midiOutLongMsg\n");
-			return(-1);
+			busy[sx->nr_device] = true;
+			pending = true;
 		}
-		antiloop = 0;
-		while ((midiHdr.dwFlags & MHDR_DONE) != MHDR_DONE)
+		else if ((sx->status != SYSEX_FREE) && ((sx->ref == LUA_NOREF) || (sysex_notify(sx))))
+			sysex_release(sx); // else, kept up to the next pass, when outSysexDone empties the FIFO
+	}
+	while ((g_sysex_tail != g_sysex_head) && (g_sysex[g_sysex_tail & (SYSEX_QUEUE - 1)].status == SYSEX_FREE))
+		g_sysex_tail++;
+	return (pending ? SYSEX_POLL : -1);
+}
+static void sysex_cancel(int nr_device)
+{
+	// abort the sysex of a device which is closed
+	for (unsigned int i = g_sysex_tail; i != g_sysex_head; i++)
+	{
+		T_sysex_out *sx = &(g_sysex[i & (SYSEX_QUEUE - 1)]);
+		if ((sx->nr_device != nr_device) || ((sx->status != SYSEX_WAITING) && (sx->status != SYSEX_SENDING)))
+			continue;
+#ifdef V_PC
+		if (sx->status == SYSEX_SENDING)
 		{
-			if (antiloop > 500)
-			{
-				midiOutUnprepareHeader(g_midiopened[nr_device], &midiHdr, sizeof(MIDIHDR));
-				free(midiHdr.lpData);
-				free(buf);
-				return(-1);
-			}
-			antiloop++;
+			midiOutReset(g_midiopened[nr_device]); // the part in progress is returned to this module
+			midiOutUnprepareHeader(g_midiopened[nr_device], &(sx->hdr), sizeof(MIDIHDR));
 		}
-		if (midiOutUnprepareHeader(g_midiopened[nr_device], &midiHdr, sizeof(MIDIHDR)) != MMSYSERR_NOERROR)
+#endif
+#ifdef V_MAC
+		if (sx->status == SYSEX_SENDING)
 		{
-			free(midiHdr.lpData);
-			free(buf);
-			return(-1);
+			// CoreMIDI stops the transfer, and releases the buffer in its completion
+			sx->request.complete = true;
+			continue;
 		}
-		free(midiHdr.lpData);
-		free(buf);
-		return(0);
+#endif
+		sx->status = SYSEX_ERROR;
 	}
-	else
+}
+static void sysex_free()
+{
+	for (int n = 0; n < SYSEX_QUEUE; n++)
+		sysex_release(&(g_sysex[n]));
+	g_sysex_head = g_sysex_tail = 0;
+	g_sysex_done_head = g_sysex_done_tail = 0;
+}
+static int send_sysex(int nrTrack, BYTE *data, int nbByte, int ref, lua_State *owner)
+{
+	// queue a sysex for the device of the track. The buffer data is owned by the queue
+	// return the identifier of the sysex, -1 if error
+	int nr_device = -1;
+	if ((nrTrack >= 0) && (nrTrack < MAXTRACK))
+		nr_device = g_tracks[nrTrack].device;
+	if ((nr_device < 0) || (nr_device >= MIDIOUT_MAX) || (g_midiopened[nr_device] == 0) || (nbByte < 1)
+		|| (g_sysex_head - g_sysex_tail >= SYSEX_QUEUE))
+	{
+		free(data);
+		return -1;
+	}
+	T_sysex_out *sx = &(g_sysex[g_sysex_head & (SYSEX_QUEUE - 1)]);
+	g_sysex_id++;
+	sx->id = g_sysex_id;
+	sx->nr_device = nr_device;
+	sx->data = data;
+	sx->length = nbByte;
+	sx->sent = 0;
+	sx->ref = ref;
+	sx->owner = owner;
+	sx->status = SYSEX_WAITING;
+	g_sysex_head++;
+	sysex_pump(); // the first part starts now
+	timer_wakeup();
+	return sx->id;
+}
+static bool queue_before(int a, int b)
+{
+	// true if slot a must be sent before slot b
+	if (g_queue_msg[a].t != g_queue_msg[b].t)
+		return (g_queue_msg[a].t < g_queue_msg[b].t);
+	return (g_queue_msg[a].seq < g_queue_msg[b].seq);
+}
+static void queue_heap_up(int pos)
+{
+	int n = g_queue_heap[pos];
+	while (pos > 0)
+	{
+		int parent = (pos - 1) / 2;
+		if (!queue_before(n, g_queue_heap[parent]))
+			break;
+		g_queue_heap[pos] = g_queue_heap[parent];
+		pos = parent;
+	}
+	g_queue_heap[pos] = n;
+}
+static void queue_heap_down(int pos)
+{
+	int n = g_queue_heap[pos];
+	while (true)
 	{
-		free(midiHdr.lpData);
-		free(buf);
-		return(-1);
+		int child = 2 * pos + 1;
+		if (child >= g_queue_nb)
+			break;
+		if ((child + 1 < g_queue_nb) && queue_before(g_queue_heap[child + 1], g_queue_heap[child]))
+			child++;
+		if (!queue_before(g_queue_heap[child], n))
+			break;
+		g_queue_heap[pos] = g_queue_heap[child];
+		pos = child;
 	}
-	free(buf);
-	return(-1);
-#endif
-#ifdef V_MAC
-    // envoi du message version Mac
-    BYTE  *bufferData;
-    bufferData = (BYTE*)(malloc(nbByte + 1)); // sera libere dans le callback completionSysex
-    memcpy(bufferData, buf, nbByte);
-    MIDISysexSendRequest *request = (MIDISysexSendRequest *)(malloc(sizeof(MIDISysexSendRequest)+1)); // sera libere dans le callback completionSysex
-    request->destination = g_midiopened[nr_device];
-    request->data = bufferData;
-    request->bytesToSend = nbByte;
-    request->complete = false;
-    request->completionProc = NULL;
-    request->completionRefCon = NULL;
-    MIDISendSysex(request);
-    free(buf);
-    return(0);
-#endif
+	g_queue_heap[pos] = n;
 }
-static void queue_insert(const T_midioutmsg midioutmsg)
+static bool queue_grow()
 {
-	T_queue_msg* pt = g_queue_msg;
-	bool found = false;
-	for (int n = 0; n < OUT_QUEUE_MAX_MSG; n++ , pt ++)
+	// double the number of slots, and chain the new ones in the free list
+	int size = (g_queue_size == 0) ? OUT_QUEUE_INIT_MSG : 2 * g_queue_size;
+	T_queue_msg *queue_msg = (T_queue_msg *)realloc(g_queue_msg, size * sizeof(T_queue_msg));
+	if (queue_msg == NULL)
+		return false;
+	g_queue_msg = queue_msg;
+	int *queue_heap = (int *)realloc(g_queue_heap, size * sizeof(int));
+	if (queue_heap == NULL)
+		return false;
+	g_queue_heap = queue_heap;
+	for (int n = size - 1; n >= g_queue_size; n--)
 	{
-		if (pt->free)
-		{
-			if (n >= g_end_queue_msg)
-				g_end_queue_msg = n + 1;
-			found = true;
-			break;
-		}
+		g_queue_msg[n].free = true;
+		g_queue_msg[n].next_free = g_queue_free;
+		g_queue_free = n;
 	}
-	if (! found)
+	g_queue_size = size;
+	return true;
+}
+static void queue_unlink_pitch(int n)
+{
+	// remove the slot n from the index of pending note-on
+	T_queue_msg *pt = &(g_queue_msg[n]);
+	if (pt->prev_pitch != OUT_QUEUE_NIL)
+		g_queue_msg[pt->prev_pitch].next_pitch = pt->next_pitch;
+	else if ((pt->midioutmsg.track >= 0) && (pt->midioutmsg.track < MAXTRACK) && (g_queue_pitch[pt->midioutmsg.track][pt->midioutmsg.midimsg.bData[1] & 0x7F] == n))
+		g_queue_pitch[pt->midioutmsg.track][pt->midioutmsg.midimsg.bData[1] & 0x7F] = pt->next_pitch;
+	if (pt->next_pitch != OUT_QUEUE_NIL)
+		g_queue_msg[pt->next_pitch].prev_pitch = pt->prev_pitch;
+	pt->prev_pitch = OUT_QUEUE_NIL;
+	pt->next_pitch = OUT_QUEUE_NIL;
+}
+static void queue_insert(const T_midioutmsg midioutmsg)
+{
+	if ((g_queue_free == OUT_QUEUE_NIL) && (queue_grow() == false))
 	{
+		mlog("Error queue_insert : no more memory for %d delayed messages. Message dropped", g_queue_size);
 		return;
 	}
+	int n = g_queue_free;
+	T_queue_msg* pt = &(g_queue_msg[n]);
+	g_queue_free = pt->next_free;
 	pt->free = false;
 	pt->midioutmsg = midioutmsg;
-	pt->t = g_current_t + midioutmsg.dt;
-	if (g_end_queue_msg > g_max_queue_msg)
-		g_max_queue_msg = g_end_queue_msg;
+	pt->t = g_current_us + (long long)(midioutmsg.dt) * 1000;
+	pt->seq = g_queue_seq++;
+	pt->prev_pitch = OUT_QUEUE_NIL;
+	pt->next_pitch = OUT_QUEUE_NIL;
+	if ((((midioutmsg.midimsg.bData[0]) & 0xF0) == (MIDI_NOTEON << 4)) && (midioutmsg.track >= 0) && (midioutmsg.track < MAXTRACK))
+	{
+		// index the note-on, to cancel it quickly with a note-off
+		int *first = &(g_queue_pitch[midioutmsg.track][midioutmsg.midimsg.bData[1] & 0x7F]);
+		pt->next_pitch = *first;
+		if (*first != OUT_QUEUE_NIL)
+			g_queue_msg[*first].prev_pitch = n;
+		*first = n;
+	}
+	g_queue_heap[g_queue_nb] = n;
+	g_queue_nb++;
+	queue_heap_up(g_queue_nb - 1);
+	if (g_queue_nb > g_max_queue_msg)
+		g_max_queue_msg = g_queue_nb;
+	if (g_queue_heap[0] == n)
+		timer_wakeup();
+}
+static int queue_pop()
+{
+	// remove the first slot of the heap. It is given back to the free list by the caller
+	int n = g_queue_heap[0];
+	g_queue_nb--;
+	if (g_queue_nb > 0)
+	{
+		g_queue_heap[0] = g_queue_heap[g_queue_nb];
+		queue_heap_down(0);
+	}
+	return n;
+}
+static void queue_release(int n)
+{
+	g_queue_msg[n].free = true;
+	g_queue_msg[n].next_free = g_queue_free;
+	g_queue_free = n;
 }
 static bool sendmidimsg(T_midioutmsg midioutmsg, bool first);
 static bool processPostMidiOut(T_midioutmsg midioutmsg)
@@ -1927,8 +3079,8 @@ static bool processPostMidiOut(T_midioutmsg midioutmsg)
 }
 static bool sendshortmsg(T_midioutmsg midioutmsg, bool first)
 {
-	if (g_collectLog)
-		mlog("sendshortmsg device=%d msg=%d ch=%d p=%d v=%d", g_tracks[midioutmsg.track].device, midioutmsg.midimsg.bData[0] >> 4, midioutmsg.midimsg.bData[0] & 0xF, midioutmsg.midimsg.bData[1], midioutmsg.midimsg.bData[2]);
+	if (g_log->collect.load(std::memory_order_relaxed))
+		mlogl(LOG_TRACE, "sendshortmsg device=%d msg=%d ch=%d p=%d v=%d", g_tracks[midioutmsg.track].device, midioutmsg.midimsg.bData[0] >> 4, midioutmsg.midimsg.bData[0] & 0xF, midioutmsg.midimsg.bData[1], midioutmsg.midimsg.bData[2]);
 	int nr_device = g_tracks[midioutmsg.track].device;
 	if (nr_device >= VI_ZERO) 
     {
@@ -1941,6 +3093,8 @@ static bool sendshortmsg(T_midioutmsg midioutmsg, bool first)
     }
 	else
 	{
+		if (g_offline.load(std::memory_order_relaxed))
+			return true; // offline render : only the VI are rendered
 #ifdef V_PC
 		if (midiOutShortMsg(g_midiopened[nr_device], midioutmsg.midimsg.dwData) != MMSYSERR_NOERROR)
 			return false;
@@ -1955,6 +3109,10 @@ static bool sendshortmsg(T_midioutmsg midioutmsg, bool first)
 		err = MIDISend(g_midiOutPortRef, g_midiopened[nr_device], pktlist);
 		if (err != 0)
 			return false;
+#endif
+#ifdef V_LINUX
+		if (!alsa_send(nr_device, &(midioutmsg.midimsg.bData[0]), midioutmsg.nbbyte))
+			return false;
 #endif
 	}
 	return true;
@@ -2084,55 +3242,115 @@ static bool sendmsg(T_midioutmsg midioutmsg)
                 return_code = sendmidimsg(midioutmsg,true);
         }
     }
+	if (return_code)
+		g_out_count++;
     return(return_code);
 }
+static int unqueue_noteoff(int first, const T_midioutmsg *midioutmsg, long long tmsg)
+{
+	// cancel the pending note-on of the list first, which would be played after the required note-off
+	int retCode = 0;
+	int n = first;
+	while (n != OUT_QUEUE_NIL)
+	{
+		T_queue_msg *pt = &(g_queue_msg[n]);
+		int next = pt->next_pitch;
+		if ((((pt->midioutmsg.midimsg.bData[0]) & 0xF) == ((midioutmsg->midimsg.bData[0]) & 0xF)) // on same channel
+			&& (pt->midioutmsg.id == midioutmsg->id) // with same id
+			&& (pt->t >= tmsg) // after the required note-off
+			)
+		{
+			// the slot stays in the heap, flagged free. It is released when it reaches the top of the heap
+			queue_unlink_pitch(n);
+			pt->free = true;
+			retCode = 1;
+		}
+		n = next;
+	}
+	return retCode;
+}
+static void jitter_add(long long t)
+{
+	// add the delay of a message planned at time t, in the histogram
+	long long dt = clock_us() - t;
+	if (dt < 0)
+		dt = 0;
+	int n;
+	for (n = 0; n < (OUT_JITTER_MAX - 1); n++)
+	{
+		if (dt < g_jitter_limit[n])
+			break;
+	}
+	g_jitter[n]++;
+	g_jitter_nb++;
+	g_jitter_sum += dt;
+	if (dt > g_jitter_max)
+		g_jitter_max = dt;
+}
+static void jitter_init()
+{
+	for (int n = 0; n < OUT_JITTER_MAX; n++)
+		g_jitter[n] = 0;
+	g_jitter_nb = 0;
+	g_jitter_sum = 0;
+	g_jitter_max = 0;
+}
+static void queue_flush(long long t, bool measure)
+{
+	// send all messages planned up to time t ( micro-seconds )
+	while ((g_queue_nb > 0) && (g_queue_msg[g_queue_heap[0]].t <= t))
+	{
+		int n = queue_pop();
+		T_queue_msg *pt = &(g_queue_msg[n]);
+		if (pt->free)
+		{
+			// cancelled message
+			queue_release(n);
+			continue;
+		}
+		T_midioutmsg msg = pt->midioutmsg;
+		long long tmsg = pt->t;
+		queue_unlink_pitch(n);
+		queue_release(n);
+		// the virtual instruments render the message at its planned time
+		g_out_us = tmsg;
+		sendmsg(msg);
+		g_out_us = -1;
+		if (measure)
+			jitter_add(tmsg);
+		if (g_latency->enabled.load(std::memory_order_relaxed))
+			lat_add(g_latency, LAT_UNQUEUE, clock_us() - tmsg);
+	}
+}
 static int unqueue(int critere, T_midioutmsg midioutmsg)
 {
-	if (critere == OUT_QUEUE_FLUSH)
-		g_current_t += timer_dt;
-	long tmsg = g_current_t + midioutmsg.dt;
-	int nb_waiting = 0;
 	int retCode = 0;
-	T_queue_msg *pt = g_queue_msg;
-	for (int n = 0; n < g_end_queue_msg; n++, pt++)
+	switch (critere)
 	{
-		if (!(pt->free))
+	case OUT_QUEUE_FLUSH:
+		// flush all messages which are in the past
+		queue_flush(g_current_us, true);
+		break;
+	case OUT_QUEUE_NOTEOFF:
+	{
+		// search the note-on on the same track, and same pitch ( or any pitch if pitch is 0 )
+		if ((midioutmsg.track < 0) || (midioutmsg.track >= MAXTRACK))
+			break;
+		long long tmsg = g_current_us + (long long)(midioutmsg.dt) * 1000;
+		if (midioutmsg.midimsg.bData[1] == 0)
 		{
-			nb_waiting++;
-			switch (critere)
-			{
-			case OUT_QUEUE_FLUSH:
-			{	// flush all messages
-									if (pt->t <= g_current_t) // which are in the past
-									{
-										// remove the message from the waiting queue
-										pt->free = true;
-										sendmsg(pt->midioutmsg);
-									}
-									break;
-			}
-			case OUT_QUEUE_NOTEOFF:
+			for (int p = 0; p < MAXPITCH; p++)
 			{
-									  if ((((pt->midioutmsg.midimsg.bData[0]) & 0xF0) == (MIDI_NOTEON << 4)) // search a note-on 
-										  && (((pt->midioutmsg.midimsg.bData[0]) & 0xF) == ((midioutmsg.midimsg.bData[0]) & 0xF)) // on same channel
-										  && ((pt->midioutmsg.midimsg.bData[1] == midioutmsg.midimsg.bData[1]) || (midioutmsg.midimsg.bData[1] == 0)) //  and same pitch
-										  && (pt->midioutmsg.track == midioutmsg.track) // on same track
-										  && (pt->midioutmsg.id == midioutmsg.id) // with same id
-										  && (pt->t >= tmsg) // after the required note-off
-										  )
-									  {
-										  pt->free = true;
-										  retCode = 1;
-									  }
-									  break;
-			}
-			default: break;
+				if (unqueue_noteoff(g_queue_pitch[midioutmsg.track][p], &midioutmsg, tmsg))
+					retCode = 1;
 			}
 		}
+		else
+			retCode = unqueue_noteoff(g_queue_pitch[midioutmsg.track][midioutmsg.midimsg.bData[1] & 0x7F], &midioutmsg, tmsg);
+		break;
+	}
+	default: break;
 	}
-	if (nb_waiting == 0)
-		g_end_queue_msg = 0; // no more waintig slot
-
 	return retCode;
 }
 static bool sendmsgdt(const T_midioutmsg midioutmsg)
@@ -2144,6 +3362,10 @@ static bool sendmsgdt(const T_midioutmsg midioutmsg)
 		retCode = sendmsg(midioutmsg);
     else
         queue_insert(midioutmsg);
+	// latency from the midiin message which triggered this midiout message, if measured by basslua
+	long long stamp = g_latency->input.load(std::memory_order_relaxed);
+	if (stamp)
+		lat_add(g_latency, (midioutmsg.dt == 0) ? LAT_SEND : LAT_QUEUE, lat_now() - stamp);
 
 	return(retCode);
 }
@@ -2438,6 +3660,7 @@ static void midiclose_device(int nr_device)
 {
 	if (g_midiopened[nr_device])
 	{
+		sysex_cancel(nr_device);
         T_midimsg midimsg1;
         midimsg1.bData[0] = (MIDI_CONTROL << 4);
         midimsg1.bData[1] = 123;// all note off
@@ -2468,6 +3691,12 @@ static void midiclose_device(int nr_device)
         curPacket = MIDIPacketListAdd(pktlist, sizeof(buffer), curPacket, 0, 3, & (midimsg2.bData[0] ));
         curPacket = MIDIPacketListAdd(pktlist, sizeof(buffer), curPacket, 0, 3, & (midimsg3.bData[0] ));
         err = MIDISend(g_midiOutPortRef, g_midiopened[nr_device], pktlist);
+#endif
+#ifdef V_LINUX
+		alsa_send(nr_device, midimsg1.bData, 3);
+		alsa_send(nr_device, midimsg2.bData, 3);
+		alsa_send(nr_device, midimsg3.bData, 3);
+		alsa_drain();
 #endif
         BASS_MIDI_OutFree(nr_device);
 		g_midiopened[nr_device] = 0;
@@ -2532,47 +3761,47 @@ static void onMidiOut_filter_set()
 	// validate the LUA functions available to process the MIDI messages
 	//g_process_Sysex = (lua_getglobal(g_LUAoutState, LUAFunctionSysex) == LUA_TFUNCTION);
 	//lua_pop(g_LUAoutState, 1);
-	//if (g_process_Sysex) mlog("Information : onMidiOut function %s registered", LUAFunctionSysex);
+	//if (g_process_Sysex) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionSysex);
 
 	//g_process_Activesensing = (lua_getglobal(g_LUAoutState, LUAFunctionActive) == LUA_TFUNCTION);
 	//lua_pop(g_LUAoutState, 1);
-	//if (g_process_Activesensing) mlog("Information : onMidiOut function %s registered", LUAFunctionActive);
+	//if (g_process_Activesensing) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionActive);
 
 	g_process_Clock = (lua_getglobal(g_LUAoutState, LUAFunctionClock) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_Clock) mlog("Information : onMidiOut function %s registered", LUAFunctionClock);
+	if (g_process_Clock) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionClock);
 
 	g_process_ChannelPressure = (lua_getglobal(g_LUAoutState, LUAFunctionChannelPressure) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_ChannelPressure) mlog("Information : onMidiOut function %s registered", LUAFunctionChannelPressure);
+	if (g_process_ChannelPressure) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionChannelPressure);
 
 	g_process_KeyPressure = (lua_getglobal(g_LUAoutState, LUAFunctionKeyPressure) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_KeyPressure) mlog("Information : onMidiOut function %s registered", LUAFunctionKeyPressure);
+	if (g_process_KeyPressure) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionKeyPressure);
 
 	g_process_Control = (lua_getglobal(g_LUAoutState, LUAFunctionControl) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_Control) mlog("Information : onMidiOut function %s registered", LUAFunctionControl);
+	if (g_process_Control) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionControl);
 
 	g_process_SystemCommon = (lua_getglobal(g_LUAoutState, LUAFunctionSystemCommon) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_SystemCommon) mlog("Information : onMidiOut function %s registered", LUAFunctionSystemCommon);
+	if (g_process_SystemCommon) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionSystemCommon);
 
 	g_process_Program = (lua_getglobal(g_LUAoutState, LUAFunctionProgram) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_Program) mlog("Information : onMidiOut function %s registered", LUAFunctionProgram);
+	if (g_process_Program) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionProgram);
 
 	g_process_NoteOff = (lua_getglobal(g_LUAoutState, LUAFunctionNoteOff) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_NoteOff) mlog("Information : onMidiOut function %s registered", LUAFunctionNoteOff);
+	if (g_process_NoteOff) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionNoteOff);
 
 	g_process_NoteOn = (lua_getglobal(g_LUAoutState, LUAFunctionNoteOn) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_NoteOn) mlog("Information : onMidiOut function %s registered", LUAFunctionNoteOn);
+	if (g_process_NoteOn) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionNoteOn);
 
 	g_process_PitchBend = (lua_getglobal(g_LUAoutState, LUAFunctionPitchBend) == LUA_TFUNCTION);
 	lua_pop(g_LUAoutState, 1);
-	if (g_process_PitchBend) mlog("Information : onMidiOut function %s registered", LUAFunctionPitchBend);
+	if (g_process_PitchBend) mlogl(LOG_INFO, "Information : onMidiOut function %s registered", LUAFunctionPitchBend);
 }
 static bool onMidiout_open(const char* fname)
 {
@@ -2600,7 +3829,7 @@ static bool onMidiout_open(const char* fname)
 		g_LUAoutState = NULL;
 		return false;
 	}
-	mlog("Information : onMidiOutOpen(%s) OK", fname);
+	mlogl(LOG_INFO, "Information : onMidiOutOpen(%s) OK", fname);
 	onMidiOut_filter_set();
 	return true;
 }
@@ -2719,21 +3948,42 @@ static void midi_init()
 	char name_device[MAXBUFCHAR];
 	while (midi_in_name(nrDevice, name_device))
 	{
-		mlog("Information : midiin <%s> #%d", name_device, nrDevice + 1);
+		mlogl(LOG_INFO, "Information : midiin <%s> #%d", name_device, nrDevice + 1);
 		nrDevice++;
 	}
 	nrDevice = 0;
 	while (midi_out_name(nrDevice, name_device))
 	{
-		mlog("Information : midiout <%s> #%d", name_device, nrDevice + 1);
+		mlogl(LOG_INFO, "Information : midiout <%s> #%d", name_device, nrDevice + 1);
 		nrDevice++;
 	}
 }
 static void fifo_init()
 {
-	for (int n = 0; n < OUT_QUEUE_MAX_MSG; n++)
-		g_queue_msg[n].free = true;
-	g_end_queue_msg = 0;
+	// all slots are free
+	g_queue_free = OUT_QUEUE_NIL;
+	for (int n = g_queue_size - 1; n >= 0; n--)
+		queue_release(n);
+	g_queue_nb = 0;
+	if (g_queue_size == 0)
+		queue_grow();
+	for (int nrTrack = 0; nrTrack < MAXTRACK; nrTrack++)
+	{
+		for (int p = 0; p < MAXPITCH; p++)
+			g_queue_pitch[nrTrack][p] = OUT_QUEUE_NIL;
+	}
+}
+static void fifo_free()
+{
+	if (g_queue_msg)
+		free(g_queue_msg);
+	g_queue_msg = NULL;
+	if (g_queue_heap)
+		free(g_queue_heap);
+	g_queue_heap = NULL;
+	g_queue_size = 0;
+	g_queue_nb = 0;
+	g_queue_free = OUT_QUEUE_NIL;
 }
 static void init_mutex()
 {
@@ -2743,10 +3993,15 @@ static void init_mutex()
 	if (g_mutex_out == NULL)
 		mlog("mlog init_mutex");
 #endif
-#ifdef V_MAC
+#if defined(V_MAC) || defined(V_LINUX)
 	// create a mutex to manipulae safely the queued midiout msg
-	if (pthread_mutex_init(&g_mutex_out, NULL) != 0)
+	// recursive, like the mutex of Windows : a locked function can call another one
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (pthread_mutex_init(&g_mutex_out, &attr) != 0)
 		mlog("mlog init_mutex");
+	pthread_mutexattr_destroy(&attr);
 #endif
 }
 static void free_mutex()
@@ -2754,52 +4009,187 @@ static void free_mutex()
 #ifdef V_PC
 	CloseHandle(g_mutex_out);
 #endif
-#ifdef V_MAC
+#if defined(V_MAC) || defined(V_LINUX)
 	pthread_mutex_destroy(&g_mutex_out);
 #endif
 }
-#ifdef V_PC
-VOID CALLBACK timer(PVOID lpParam, BOOLEAN TimerOrWaitFired)
+static long long timer_next()
 {
-	lock_mutex_out();
+	// return the delay in micro-seconds up to the next deadline of the queue, -1 if the queue is empty
+	// called with the mutex locked
+	if (g_offline.load(std::memory_order_relaxed))
+		return -1; // offline render : the queue is flushed by audioOfflineRender, block per block
 	T_midioutmsg msg;
 	msg.midimsg.dwData = 0;
 	unqueue(OUT_QUEUE_FLUSH, msg);
-	unlock_mutex_out();
+	long long dsysex = sysex_pump();
+	if (g_queue_nb == 0)
+		return dsysex;
+	long long dt = g_queue_msg[g_queue_heap[0]].t - clock_us();
+	if (dt < 0)
+		dt = 0;
+	return (((dsysex >= 0) && (dsysex < dt)) ? dsysex : dt);
+}
+#ifdef V_PC
+DWORD WINAPI timer(LPVOID lpParam)
+{
+	// scheduler thread : sleep up to the next deadline of the queue, and flush-out the messages
+	while (true)
+	{
+		lock_mutex_out();
+		if (!g_timer_running)
+		{
+			unlock_mutex_out();
+			break;
+		}
+		long long dt = timer_next();
+		unlock_mutex_out();
+		if (dt < 0)
+			WaitForSingleObject(g_timer_event, INFINITE);
+		else if (dt >= 1500)
+			WaitForSingleObject(g_timer_event, (DWORD)(dt / 1000) - 1); // wake-up a bit before, to finish with a short yield
+		else if (dt > 0)
+			SwitchToThread();
+	}
+	return 0;
 }
 #endif
 #ifdef V_MAC
-// void (*CFRunLoopTimerCallBack) ( CFRunLoopTimerRef timer, void *info );
-void timer(CFRunLoopTimerRef timer, void *info)
+void *timer(void *info)
 {
-	lock_mutex_out();
-	T_midioutmsg msg;
-	msg.midimsg.dwData = 0;
-	unqueue(OUT_QUEUE_FLUSH, msg);
-	unlock_mutex_out();
+	// scheduler thread : sleep up to the next deadline of the queue, and flush-out the messages
+	pthread_mutex_lock(&g_mutex_out);
+	while (g_timer_running)
+	{
+		clock_update();
+		long long dt = timer_next();
+		if (dt < 0)
+			pthread_cond_wait(&g_timer_cond, &g_mutex_out);
+		else if (dt > 0)
+		{
+			struct timespec ts;
+			ts.tv_sec = (time_t)(dt / 1000000);
+			ts.tv_nsec = (long)((dt % 1000000) * 1000);
+			pthread_cond_timedwait_relative_np(&g_timer_cond, &g_mutex_out, &ts);
+		}
+	}
+	pthread_mutex_unlock(&g_mutex_out);
+	return NULL;
+}
+#endif
+#ifdef V_LINUX
+void *timer(void *info)
+{
+	// scheduler thread : sleep up to the next deadline of the queue, and flush-out the messages
+	pthread_mutex_lock(&g_mutex_out);
+	while (g_timer_running)
+	{
+		clock_update();
+		long long dt = timer_next();
+		alsa_drain(); // the messages due at this deadline are sent in one batch
+		if (dt < 0)
+			pthread_cond_wait(&g_timer_cond, &g_mutex_out);
+		else if (dt > 0)
+		{
+			// the condition uses the monotonic clock
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_sec += (time_t)(dt / 1000000);
+			ts.tv_nsec += (long)((dt % 1000000) * 1000);
+			if (ts.tv_nsec >= 1000000000)
+			{
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&g_timer_cond, &g_mutex_out, &ts);
+		}
+	}
+	pthread_mutex_unlock(&g_mutex_out);
+	return NULL;
 }
 #endif
 static void timer_init()
 {
-	// create a periodic timer to flush-out the queud midiout msg
+	// create the scheduler thread to flush-out the queud midiout msg at their deadline
+	clock_init();
+	jitter_init();
+	g_timer_running = true;
 #ifdef V_PC
-	if (!CreateTimerQueueTimer(&g_timer, NULL, timer, 0, timer_dt, timer_dt, 0))
+	timeBeginPeriod(1);
+	g_timer_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	g_timer = CreateThread(NULL, 0, timer, NULL, 0, NULL);
+	if ((g_timer_event == NULL) || (g_timer == NULL))
+	{
+		g_timer_running = false;
 		mlog("mlog timer_init");
+		return;
+	}
+	SetThreadPriority(g_timer, THREAD_PRIORITY_TIME_CRITICAL);
 #endif
 #ifdef V_MAC
-	CFRunLoopTimerCreate(NULL, (float)(timer_dt) / 1000.0, (float)(timer_dt) / 1000.0, 0, 0, timer, NULL);
+	pthread_cond_init(&g_timer_cond, NULL);
+	if (pthread_create(&g_timer, NULL, timer, NULL) != 0)
+	{
+		g_timer_running = false;
+		mlog("mlog timer_init");
+		return;
+	}
+#endif
+#ifdef V_LINUX
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&g_timer_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_attr_t tattr;
+	struct sched_param param;
+	pthread_attr_init(&tattr);
+	pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&tattr, SCHED_FIFO);
+	param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+	pthread_attr_setschedparam(&tattr, &param);
+	int err = pthread_create(&g_timer, &tattr, timer, NULL);
+	if (err == EPERM)
+		err = pthread_create(&g_timer, NULL, timer, NULL); // no real-time priority for this user
+	pthread_attr_destroy(&tattr);
+	if (err != 0)
+	{
+		g_timer_running = false;
+		mlog("mlog timer_init");
+		return;
+	}
 #endif
 }
 static void free_timer()
 {
+	if (!g_timer_running)
+		return;
+	lock_mutex_out();
+	g_timer_running = false;
 #ifdef V_PC
-    
-	DeleteTimerQueueTimer(NULL, g_timer, NULL);
+	SetEvent(g_timer_event);
+#endif
+#if defined(V_MAC) || defined(V_LINUX)
+	pthread_cond_signal(&g_timer_cond);
+#endif
+	unlock_mutex_out();
+#ifdef V_PC
+	WaitForSingleObject(g_timer, INFINITE);
+	CloseHandle(g_timer);
+	g_timer = NULL;
+	CloseHandle(g_timer_event);
+	g_timer_event = NULL;
+	timeEndPeriod(1);
+#endif
+#if defined(V_MAC) || defined(V_LINUX)
+	pthread_join(g_timer, NULL);
+	pthread_cond_destroy(&g_timer_cond);
 #endif
 }
-static void init(const char *fname)
+static void init(lua_State *L, const char *fname)
 {
-	log_init(fname);
+	log_init(L, fname);
+	latency_init(L);
 	picth_init();
 	midi_init();
 	fifo_init();
@@ -2815,16 +4205,21 @@ static void init(const char *fname)
 }
 static void free()
 {
-	free_timer();
 	free_mutex();
 	vi_free();
 	midiclose_devices();
+	sysex_free();
+#ifdef V_LINUX
+	alsa_out_free();
+#endif
 	mixer_free();
+	fifo_free();
 	if (g_LUAoutState)
 	{
 		lua_close(g_LUAoutState);
 	}
 	g_LUAoutState = 0;
+	log_free();
 }
 
 static int LoutTrackMute(lua_State *L)
@@ -3612,20 +5007,99 @@ static int LoutSystem(lua_State *L)
 	unlock_mutex_out();
 	return (1);
 }
+static lua_State *lua_owner(lua_State *L)
+{
+	// main thread of the LUA state : the registry, and so the references, are shared by all its threads
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	lua_State *owner = lua_tothread(L, -1);
+	lua_pop(L, 1);
+	return owner;
+}
 static int LoutSysex(lua_State *L)
 {
-    // parameter #1 : message sysex
-	// parameter #2 : optional integer track ( default 0  )
-	lock_mutex_out();
-
-	const char *sysex = lua_tostring(L, 1);
+	// parameter #1 : message sysex, in ASCII hexa ( e.g. "F0 7E 7F 09 01 F7" ), or in bytes if it starts with byte F0
+	// parameter #2 : optional integer track ( default 1 )
+	// parameter #3 : optional function(id, ok) called when the sysex is sent ( cf. outSysexDone )
+	// parameter #4 : optional boolean : parameter #1 is bytes, next part of a sysex ( without F0 )
+	// return the identifier of the sysex, -1 if error. The sysex is sent in background
+	size_t len = 0;
+	const char *sysex = luaL_checklstring(L, 1, &len);
 	int nrTrack = cap((int)luaL_optinteger(L, 2, 1), 0, MAXTRACK, 1);
-	int retCode = send_sysex(nrTrack, sysex);
-	lua_pushinteger(L, retCode);
+	bool raw = (lua_toboolean(L, 4) != 0) || ((len > 0) && ((BYTE)(sysex[0]) == 0xF0));
+	BYTE *buf = (BYTE*)malloc(len + 1);
+	if (buf == NULL)
+	{
+		lua_pushinteger(L, -1);
+		return (1);
+	}
+	int nbByte;
+	if (raw)
+	{
+		memcpy(buf, sysex, len);
+		nbByte = (int)len;
+	}
+	else
+	{
+		nbByte = sysex_parse(sysex, buf);
+		if ((nbByte < 4) || (buf[0] != 0xF0))
+			nbByte = 0;
+	}
+	int ref = LUA_NOREF;
+	if (lua_isfunction(L, 3))
+	{
+		lua_pushvalue(L, 3);
+		ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
 
+	lock_mutex_out();
+	int id = send_sysex(nrTrack, buf, nbByte, ref, lua_owner(L));
 	unlock_mutex_out();
+
+	if ((id < 0) && (ref != LUA_NOREF))
+		luaL_unref(L, LUA_REGISTRYINDEX, ref);
+	lua_pushinteger(L, id);
 	return (1);
 }
+static int LoutSysexDone(lua_State *L)
+{
+	// call the LUA functions of the sysex sent ( or aborted ), with parameters ( id, ok )
+	// basslua calls it at each timer tick. Only the functions given by this LUA state are called
+	int id[SYSEX_DONE_QUEUE], ref[SYSEX_DONE_QUEUE];
+	bool ok[SYSEX_DONE_QUEUE];
+	int nb = 0;
+	lua_State *owner = lua_owner(L);
+	lock_mutex_out();
+	for (unsigned int i = g_sysex_done_tail; i != g_sysex_done_head; i++)
+	{
+		T_sysex_done *d = &(g_sysex_done[i & (SYSEX_DONE_QUEUE - 1)]);
+		if ((d->ref == LUA_NOREF) || (d->owner != owner))
+			continue;
+		id[nb] = d->id;
+		ref[nb] = d->ref;
+		ok[nb] = d->ok;
+		nb++;
+		d->ref = LUA_NOREF;
+	}
+	while ((g_sysex_done_tail != g_sysex_done_head) && (g_sysex_done[g_sysex_done_tail & (SYSEX_DONE_QUEUE - 1)].ref == LUA_NOREF))
+		g_sysex_done_tail++;
+	if (nb > 0)
+		sysex_pump(); // the sysex kept while the FIFO was full
+	unlock_mutex_out();
+	// the functions are called without the mutex : they can send other messages
+	for (int n = 0; n < nb; n++)
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, ref[n]);
+		luaL_unref(L, LUA_REGISTRYINDEX, ref[n]);
+		lua_pushinteger(L, id[n]);
+		lua_pushboolean(L, ok[n]);
+		if (lua_pcall(L, 2, 0, 0) != LUA_OK)
+		{
+			mlog("erreur calling LUA outSysex function, err: %s", lua_tostring(L, -1));
+			lua_pop(L, 1);
+		}
+	}
+	return (0);
+}
 static int LaudioClose(lua_State *L)
 {
 	// close audio
@@ -3637,6 +5111,161 @@ static int LaudioClose(lua_State *L)
 	unlock_mutex_out();
 	return(0);
 }
+static void wav_put(FILE *f, unsigned long v, int nbByte)
+{
+	// little-endian integer of the WAV header
+	for (int n = 0; n < nbByte; n++)
+		fputc((int)((v >> (8 * n)) & 0xFF), f);
+}
+static void wav_header(FILE *f, int nbChannels, DWORD nbFrames)
+{
+	// header of a WAV file, 32 bits float ( WAVE_FORMAT_IEEE_FLOAT ), at M_SAMPLE_RATE
+	// the sizes are 32 bits : nbFrames is up to WAV_MAX_FRAMES in stereo
+	DWORD sizeData = nbFrames * nbChannels * sizeof(float);
+	fwrite("RIFF", 1, 4, f);
+	wav_put(f, 4 + (8 + 18) + (8 + 4) + (8 + sizeData), 4);
+	fwrite("WAVE", 1, 4, f);
+	fwrite("fmt ", 1, 4, f);
+	wav_put(f, 18, 4);
+	wav_put(f, 3, 2); // WAVE_FORMAT_IEEE_FLOAT
+	wav_put(f, nbChannels, 2);
+	wav_put(f, M_SAMPLE_RATE, 4);
+	wav_put(f, M_SAMPLE_RATE * nbChannels * sizeof(float), 4);
+	wav_put(f, nbChannels * sizeof(float), 2);
+	wav_put(f, 8 * sizeof(float), 2);
+	wav_put(f, 0, 2);
+	fwrite("fact", 1, 4, f);
+	wav_put(f, 4, 4);
+	wav_put(f, nbFrames, 4);
+	fwrite("data", 1, 4, f);
+	wav_put(f, sizeData, 4);
+}
+static int LaudioOfflineStart(lua_State *L)
+{
+	// start the offline render : the audio-devices are closed, the time of the output becomes a virtual clock.
+	// The VI opened next ( outTrackOpenVi ) are rendered by audioOfflineRender, without audio-device.
+	// The midi-out messages are not sent.
+	lock_mutex_out();
+	mixer_free();
+	vi_free();
+	g_offline_us.store(clock_real_us());
+	g_offline.store(true);
+	vi_init();
+	mixer_init();
+	clock_update();
+	unlock_mutex_out();
+	mlogl(LOG_INFO, "Information : offline render start");
+	return(0);
+}
+static int LaudioOfflineRender(lua_State *L)
+{
+	// render the VI offline, as fast as possible, in a WAV file ( 32 bits float, stereo, M_SAMPLE_RATE )
+	// The virtual clock advances block per block : the messages planned in a block ( e.g. sent with a delay
+	// before the render ) are sent to the VI before the render of the block, at their planned time.
+	// The mixers of all the audio-devices are summed. The samples are written in the byte order of the CPU ( little-endian )
+	// parameter #1 : WAV file name
+	// parameter #2 : duration in ms, up to the size of a WAV file ( 12173943 ms, about 3h22 )
+	// parameter #3 : optional frames per block ( default 441, max 4096 ). With a multiple of 441 frames, the output does not depend
+	//    on the size of the blocks. Otherwise, an event can move by one frame, with the rounding of the virtual clock in micro-seconds
+	// return : frames rendered, duration of the render in ms, speed ( duration rendered / duration of the render )
+	//    nil if the offline render is not started ( audioOfflineStart ), if the duration is too long, or if the file cannot be written
+	if (!g_offline.load())
+	{
+		mlog("Error audioOfflineRender : offline render not started");
+		return(0);
+	}
+	const char *fname = luaL_checkstring(L, 1);
+	long long duration_ms = (long long)luaL_checkinteger(L, 2);
+	long long max_ms = ((long long)WAV_MAX_FRAMES * 1000) / M_SAMPLE_RATE;
+	if (duration_ms > max_ms)
+	{
+		mlog("Error audioOfflineRender %s : %lld ms is over the size of a WAV file ( %lld ms )", fname, duration_ms, max_ms);
+		return(0);
+	}
+	int nbFrames = cap((int)luaL_optinteger(L, 3, OFFLINE_BLOCK), 1, VSTI_BUFSIZE + 1, 0);
+	FILE *f = fopen(fname, "wb");
+	if (f == NULL)
+	{
+		mlog("Error audioOfflineRender opening %s, err=%d", fname, errno);
+		return(0);
+	}
+	long long totalFrames = (duration_ms > 0) ? (duration_ms * M_SAMPLE_RATE) / 1000 : 0;
+	wav_header(f, 2, (DWORD)totalFrames);
+	float *mix = (float *)malloc(2 * nbFrames * sizeof(float));
+	float *buf = (float *)malloc(2 * nbFrames * sizeof(float));
+	long long start_us = g_offline_us.load();
+	long long real_start = clock_real_us();
+	long long done = 0;
+	while (done < totalFrames)
+	{
+		int n = (totalFrames - done < nbFrames) ? (int)(totalFrames - done) : nbFrames;
+		done += n;
+		// the block covers [now - n frames, now[ : its messages are sent before its render
+		lock_mutex_out();
+		g_offline_us.store(start_us + (done * 1000000) / M_SAMPLE_RATE);
+		clock_update();
+		queue_flush(g_current_us - 1, false);
+		unlock_mutex_out();
+		DWORD length = 2 * n * sizeof(float);
+		memset(mix, 0, length);
+		for (int d = 0; d < MAX_AUDIO_DEVICE; d++)
+		{
+			if (g_mixer_stream[d] == 0)
+				continue;
+			DWORD got = BASS_ChannelGetData(g_mixer_stream[d], buf, length);
+			if (got == (DWORD)-1)
+				got = 0;
+			if (got < length)
+				memset((char *)buf + got, 0, length - got);
+			audio_kernels()->sum(mix, buf, 2 * n);
+		}
+		fwrite(mix, sizeof(float), 2 * n, f);
+	}
+	free(mix);
+	free(buf);
+	fclose(f);
+	long long real_us = clock_real_us() - real_start;
+	mlogl(LOG_INFO, "Information : offline render %s , %lld frames in %lld ms", fname, done, real_us / 1000);
+	lua_pushinteger(L, (lua_Integer)done);
+	lua_pushinteger(L, (lua_Integer)(real_us / 1000));
+	lua_pushnumber(L, (real_us > 0) ? ((double)done * 1000000.0) / ((double)M_SAMPLE_RATE * (double)real_us) : 0.0);
+	return(3);
+}
+static int LaudioOfflineStop(lua_State *L)
+{
+	// stop the offline render : the VI are closed, the messages still planned are cancelled,
+	// and the time of the output is the monotonic clock again
+	lock_mutex_out();
+	mixer_free();
+	vi_free();
+	vi_init();
+	queue_flush(LLONG_MAX, false); // midi-out are not sent, and the VI are closed
+	// the virtual clock was ahead of the monotonic clock : the times of the filters of flooding are cleared,
+	// and the notes of the VI closed are off. The notes of the midi-out, played before the offline render, are kept
+	for (int n = 0; n < OUT_MAX_DEVICE; n++)
+	{
+		for (int c = 0; c < MAXCHANNEL; c++)
+		{
+			for (int p = 0; p < MAXPITCH; p++)
+			{
+				if (n >= VI_ZERO)
+				{
+					g_midistatuspitch[n][c][p] = -1;
+					g_midistatuscontrol[n][c][p] = -1;
+				}
+				g_miditimepitch[n][c][p] = 0;
+				g_miditimecontrol[n][c][p] = 0;
+			}
+		}
+	}
+	g_offline.store(false);
+	mixer_init();
+	clock_update();
+	timer_wakeup();
+	unlock_mutex_out();
+	mlogl(LOG_INFO, "Information : offline render stop");
+	return(0);
+}
 static int LaudioList(lua_State *L)
 {
 	// return list of audio devices available
@@ -3896,7 +5525,7 @@ static int LoutTrackOpenVi(lua_State *L)
 			g_tracks[nrTrack].volume = 64;
 			string_to_control(nrTrack, tuning);
 			retCode = true;
-			mlog("Information : vi open file %s for track#%d : OK", fname, nrTrack + 1);
+			mlogl(LOG_INFO, "Information : vi open file %s for track#%d : OK", fname, nrTrack + 1);
 		}
 		else
 			mlog("Error : midi vi open file %s for track#%d", fname, nrTrack + 1);
@@ -3937,7 +5566,7 @@ static int LoutTrackOpenMidi(lua_State *L)
 		string_to_control(nrTrack, tuning);
 		char name_device[MAXBUFCHAR] = "";
 		midi_out_name(nr_device, name_device);
-		mlog("Information : midiOut open device#%d<%s> for track#%d<%s> %s : OK", nr_device + 1, name_device, nrTrack + 1, trackName,localoff?"with localoff":"");
+		mlogl(LOG_INFO, "Information : midiOut open device#%d<%s> for track#%d<%s> %s : OK", nr_device + 1, name_device, nrTrack + 1, trackName,localoff?"with localoff":"");
 	}
 	else
 		mlog("Error : midiOut open device#%d for track#%d<%s>", nr_device + 1, nrTrack + 1, trackName);
@@ -3965,12 +5594,14 @@ static int Linit(lua_State *L)
 	// parameter #1 : fullpath of log file
 	lock_mutex_out();
 	const char *fname = lua_tostring(L, 1);
-	init(fname);
+	init(L, fname);
 	unlock_mutex_out();
 	return (0);
 }
 static int Lfree(lua_State *L)
 {
+	// the scheduler thread takes the mutex to stop : it is joined before to lock
+	free_timer();
 	lock_mutex_out();
 	free();
 	unlock_mutex_out();
@@ -4023,33 +5654,201 @@ static int LsetVarMidiOut(lua_State *L)
 
 static int Llog(lua_State *L)
 {
+	// parameter #1 : message
+	// parameter #2 : optional severity level ( default 2 : information )
 	const char* s = lua_tostring(L, 1);
-	lock_mutex_out();
-	mlog(s);
-	unlock_mutex_out();
+	if (s == NULL)
+		return(0);
+	// the rate limiter follows the LUA call site ( source and line ), else the message itself
+	unsigned long long key = 0;
+	lua_Debug ar;
+	if ((lua_getstack(L, 1, &ar)) && (lua_getinfo(L, "Sl", &ar)) && (ar.currentline >= 0))
+		key = (unsigned long long)(size_t)(ar.source) * 31 + (unsigned long long)(ar.currentline);
+	else
+	{
+		for (const char *c = s; *c; c++)
+			key = key * 31 + (unsigned char)(*c);
+	}
+	mlogk((int)luaL_optinteger(L, 2, LOG_INFO), key, "%s", s);
 	return(0);
 }
 static int LoutGetLog(lua_State *L)
 {
-	lock_mutex_out();
-	g_collectLog = lua_tointeger(L, 1) ? true : false;
-	if ((g_collectLog) && (nrOutBufLog != nrInBufLog))
+	// read the next message of the log shared with basslua
+	// parameter #1 : 0 to stop the collect of the traces
+	// return true and the message, or false if no message is waiting
+	char buf[LOG_MAXMSG];
+	bool collect = lua_tointeger(L, 1) ? true : false;
+	log_collect(g_log, collect);
+	if ((collect) && (log_read(g_log, &(g_log->tail_gui), buf, NULL)))
 	{
 		lua_pushboolean(L, true);
-		//lua_pushinteger(L, 3);
-		lua_pushstring(L, bufLog[nrOutBufLog]);
-		nrOutBufLog++;
-		if (nrOutBufLog >= MAXNBLOGOUT)
-			nrOutBufLog = 0;
+		lua_pushstring(L, buf);
 	}
 	else
 	{
 		lua_pushboolean(L, false);
 		lua_pushstring(L, "");
 	}
+	return(2);
+}
+static int LoutSetLogLevel(lua_State *L)
+{
+	// set the max severity level written in the log shared with basslua
+	// parameter #1 : 0 error, 1 warning, 2 information, 3 trace
+	// return the previous level
+	int level = cap((int)lua_tointeger(L, 1), LOG_ERROR, LOG_TRACE + 1, 0);
+	lua_pushinteger(L, g_log->level.exchange(level));
+	return(1);
+}
+static int LoutCount(lua_State *L)
+{
+	// return the number of messages sent on the outputs ( e.g. to measure a replay of midiin )
+	// parameter #1 : optional reset of the count after the read ( default false )
+	lock_mutex_out();
+	lua_pushinteger(L, g_out_count);
+	if (lua_toboolean(L, 1))
+		g_out_count = 0;
 	unlock_mutex_out();
+	return (1);
+}
+static int LoutGetJitter(lua_State *L)
+{
+	// return the histogram of the delay between the planned time and the actual time of the queued messages
+	// parameter #1 : optional reset of the histogram after the read ( default false )
+	// return : number of messages, average delay in micro-seconds, max delay in micro-seconds,
+	//    table of the number of messages per range, table of the upper limits of the ranges in micro-seconds ( 0 : no limit )
+	lock_mutex_out();
 
-	return(2);
+	bool reset = lua_toboolean(L, 1) ? true : false;
+	lua_pushinteger(L, g_jitter_nb);
+	lua_pushinteger(L, (g_jitter_nb > 0) ? (lua_Integer)(g_jitter_sum / g_jitter_nb) : 0);
+	lua_pushinteger(L, (lua_Integer)g_jitter_max);
+	lua_newtable(L);
+	for (int n = 0; n < OUT_JITTER_MAX; n++)
+	{
+		lua_pushinteger(L, n + 1);
+		lua_pushinteger(L, g_jitter[n]);
+		lua_settable(L, -3);
+	}
+	lua_newtable(L);
+	for (int n = 0; n < OUT_JITTER_MAX; n++)
+	{
+		lua_pushinteger(L, n + 1);
+		lua_pushinteger(L, g_jitter_limit[n]);
+		lua_settable(L, -3);
+	}
+	if (reset)
+		jitter_init();
+
+	unlock_mutex_out();
+	return (5);
+}
+
+static int LoutGetViStat(lua_State *L)
+{
+	// return the statistics of the ring of the midi msg waiting to be rendered by a VI
+	// parameter #1 : VI track ( returned by vi_open )
+	// parameter #2 : optional reset of the max and of the counters after the read ( default false )
+	// return : number of waiting msg, max number of waiting msg, number of msg lost because the ring was full,
+	//    number of blocks rendered slower than real time ( xrun ), max duration of the render of a block in micro-seconds
+	//    nil if the VI is not open
+	// No lock : the counters are atomic
+	int vi_nr = (int)lua_tointeger(L, 1) - VI_ZERO;
+	if ((vi_nr < 0) || (vi_nr >= g_vi_opened_nb))
+		return (0);
+	T_vi_ring *ring = &(g_vi_opened[vi_nr].vi_ring);
+	lua_pushinteger(L, (lua_Integer)(ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_acquire)));
+	lua_pushinteger(L, (lua_Integer)(ring->max_depth.load(std::memory_order_relaxed)));
+	lua_pushinteger(L, (lua_Integer)(ring->overflow.load(std::memory_order_relaxed)));
+	lua_pushinteger(L, (lua_Integer)(ring->xrun.load(std::memory_order_relaxed)));
+	lua_pushinteger(L, (lua_Integer)(ring->max_render_us.load(std::memory_order_relaxed)));
+	if (lua_toboolean(L, 2))
+	{
+		ring->max_depth.store(0, std::memory_order_relaxed);
+		ring->overflow.store(0, std::memory_order_relaxed);
+		ring->xrun.store(0, std::memory_order_relaxed);
+		ring->max_render_us.store(0, std::memory_order_relaxed);
+	}
+	return (5);
+}
+static int LoutSetViParallel(lua_State *L)
+{
+	// set the render of the VI of an audio-device in parallel, on a pool of workers
+	// parameter #1 : share of the block duration, in percent ( default 50 ). When the sum of the render times of
+	//    the VI of an audio-device exceeds this share, the VI are rendered in parallel. 0 : never in parallel
+	// parameter #2 : optional number of workers ( default : one per CPU, except the audio thread , max 8 )
+	int share = (int)luaL_optinteger(L, 1, VI_PARALLEL_SHARE);
+	g_vi_parallel_share.store((share < 0) ? 0 : share);
+	if (lua_isnumber(L, 2))
+	{
+		int nbThreads = (int)lua_tointeger(L, 2);
+		vi_pool_lock();
+		vi_pool_stop();
+		vi_pool_start((nbThreads < 0) ? 0 : nbThreads);
+		g_vi_pool.busy.store(false, std::memory_order_release);
+	}
+	return (0);
+}
+static int LoutSetLatency(lua_State *L)
+{
+	// start or stop the latency measure, from the midiin driver callback up to the send of the midiout messages
+	// parameter #1 : true to start the measure, false to stop it
+	// parameter #2 : optional reset of the histograms ( default false )
+	// The stamps of the midiin messages are given by basslua. Without basslua, only the unqueue stage is measured
+	if (lua_toboolean(L, 2))
+		lat_reset(g_latency);
+	g_latency->enabled.store(lua_toboolean(L, 1) ? true : false);
+	return (0);
+}
+static int LoutGetLatency(lua_State *L)
+{
+	// return the histograms of the latency measure
+	// parameter #1 : optional reset of the histograms after the read ( default false )
+	// return : table of the stages { name = { nb = , average = , max = , counts = {...} , limits = {...} } }
+	//    delays in micro-seconds. The last limit is 0 : no limit
+	//    stages : dispatch ( driver callback -> dispatch ), lua ( dispatch -> return of the LUA handler ),
+	//       total ( driver callback -> return of the LUA handler ), queue ( driver callback -> queue_insert ),
+	//       send ( driver callback -> send to the device ), unqueue ( planned time -> send of a delayed message )
+	lua_newtable(L);
+	for (int stage = 0; stage < LAT_NBSTAGE; stage++)
+	{
+		T_lat_stage *s = &(g_latency->stage[stage]);
+		long long nb = s->nb.load(std::memory_order_relaxed);
+		lua_newtable(L);
+		lua_pushinteger(L, (lua_Integer)nb);
+		lua_setfield(L, -2, "nb");
+		lua_pushinteger(L, (nb > 0) ? (lua_Integer)(s->sum.load(std::memory_order_relaxed) / nb) : 0);
+		lua_setfield(L, -2, "average");
+		lua_pushinteger(L, (lua_Integer)(s->max.load(std::memory_order_relaxed)));
+		lua_setfield(L, -2, "max");
+		lua_newtable(L);
+		for (int b = 0; b < LAT_BUCKET; b++)
+		{
+			lua_pushinteger(L, (lua_Integer)(s->count[b].load(std::memory_order_relaxed)));
+			lua_rawseti(L, -2, b + 1);
+		}
+		lua_setfield(L, -2, "counts");
+		lua_newtable(L);
+		for (int b = 0; b < LAT_BUCKET; b++)
+		{
+			lua_pushinteger(L, (lua_Integer)lat_limit(b));
+			lua_rawseti(L, -2, b + 1);
+		}
+		lua_setfield(L, -2, "limits");
+		lua_setfield(L, -2, g_lat_name[stage]);
+	}
+	if (lua_toboolean(L, 1))
+		lat_reset(g_latency);
+	return (1);
+}
+static int LoutInspect(lua_State *L)
+{
+	// write the state of the module in the log : devices, extended channels, notes on, queue, latency
+	lock_mutex_out();
+	inspect();
+	unlock_mutex_out();
+	return (0);
 }
 
 // publication of functions visible from LUA script
@@ -4067,6 +5866,7 @@ static const struct luaL_Reg luabass[] =
 
 	{ "logmsg", Llog }, // log a string in mlog file
 	{ soutGetLog, LoutGetLog }, // get log
+	{ "outSetLogLevel", LoutSetLogLevel }, // set the severity level of the log
 
 
 	////// in ///////
@@ -4115,12 +5915,23 @@ static const struct luaL_Reg luabass[] =
 	{ soutAllNoteOff, LoutAllNoteOff }, // switch off all current notes on a track
 	
 	{ "outSysex", LoutSysex }, // send a sysex message on a track ( midi only )
+	{ soutSysexDone, LoutSysexDone }, // call the functions of the sysex sent
 	{ "outClock", LoutClock }, // send a timing-clock message on a track ( midi only )
 	{ "outSystem", LoutSystem }, // send a free-format short midi message on a track ( midi only )
+	{ "outGetJitter", LoutGetJitter }, // histogram of the delay of the queued messages
+	{ soutCount, LoutCount }, // number of messages sent
+	{ "outSetLatency", LoutSetLatency }, // start or stop the latency measure
+	{ "outGetLatency", LoutGetLatency }, // histograms of the latency measure, per stage
+	{ "outGetViStat", LoutGetViStat }, // statistics of the ring of the midi msg of a VI ( high-water mark, overflow, xrun )
+	{ "outSetViParallel", LoutSetViParallel }, // render the VI of an audio-device in parallel, above a share of the block duration
+	{ "outInspect", LoutInspect }, // write the state of the module in the log
 
 	{ "audioList", LaudioList }, // list audio device
 	{ "audioName", LaudioName }, // name audio device
 	{ "audioClose", LaudioClose }, // close audio device
+	{ "audioOfflineStart", LaudioOfflineStart }, // start the offline render, without audio device, on a virtual clock
+	{ "audioOfflineRender", LaudioOfflineRender }, // render the VI in a WAV file, as fast as possible
+	{ "audioOfflineStop", LaudioOfflineStop }, // stop the offline render
 	{ "audioAsioSet", LaudioAsioSet }, // open audio asio device settings
 	{ "audioAsioBuflenSet", LaudioAsioBuflenSet }, // set audio asio device buffer length 
 	{ "audioDefaultDevice", LaudioDefaultDevice }, // set audio default device 
@@ -4131,6 +5942,9 @@ static const struct luaL_Reg luabass[] =
 
 	{ NULL, NULL }
 };
+#ifdef V_LINUX
+extern "C" // found by require "luabass" in luabass.so
+#endif
 int luaopen_luabass(lua_State *L)
 {
     // used by LUA funtion : luabass = require "luabass"
@@ -23,4 +23,6 @@
 #define soutSetRandomDelay "outSetRandomDelay"
 #define soutSetRandomVelocity "outSetRandomVelocity"
 #define soutGetLog "outGetLog"
-#define sinGetMidiName "inGetMidiName"
\ No newline at end of file
+#define sinGetMidiName "inGetMidiName"
+#define soutSysexDone "outSysexDone"
+#define soutCount "outCount"
\ No newline at end of file
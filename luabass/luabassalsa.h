@@ -0,0 +1,83 @@
+// ALSA sequencer, shared by basslua ( midi-in ) and luabass ( midi-out ), for Linux
+//
+// The MIDI devices are the ports of the sequencer clients ( except the system client ),
+// numbered in the order of the clients and of their ports :
+//    midi-in devices : readable ports
+//    midi-out devices : writable ports
+// Each module opens its own client, with one virtual port and one real-time queue :
+//    basslua : port "in", writable. Receives the opened midi-in devices, timestamped by its queue
+//    luabass : port "out", readable. Sends the midi-out messages, through its queue
+// basslua:in is a midi-out device, and luabass:out is a midi-in device : the chain can be tested
+// without hardware, by sending to basslua:in.
+// update : 16/10/2026
+//////////////////////////////////////////////
+
+#define ALSA_CAP_IN (SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ) // capabilities of a midi-in device
+#define ALSA_CAP_OUT (SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE) // capabilities of a midi-out device
+#define ALSA_MAXNAME 256
+
+static int alsa_port(snd_seq_t *seq, unsigned int caps, int nr_device, snd_seq_addr_t *addr, char *name)
+{
+	// search the device nr_device, within the ports with the capabilities caps
+	// return nr_device if found, -1 if not found
+	// nr_device < 0 : return the number of devices
+	snd_seq_client_info_t *cinfo;
+	snd_seq_port_info_t *pinfo;
+	snd_seq_client_info_alloca(&cinfo);
+	snd_seq_port_info_alloca(&pinfo);
+	int n = 0;
+	snd_seq_client_info_set_client(cinfo, -1);
+	while (snd_seq_query_next_client(seq, cinfo) >= 0)
+	{
+		int client = snd_seq_client_info_get_client(cinfo);
+		if (client == SND_SEQ_CLIENT_SYSTEM)
+			continue;
+		snd_seq_port_info_set_client(pinfo, client);
+		snd_seq_port_info_set_port(pinfo, -1);
+		while (snd_seq_query_next_port(seq, pinfo) >= 0)
+		{
+			unsigned int cap = snd_seq_port_info_get_capability(pinfo);
+			if (((cap & caps) != caps) || (cap & SND_SEQ_PORT_CAP_NO_EXPORT))
+				continue;
+			if (n == nr_device)
+			{
+				if (addr)
+				{
+					addr->client = (unsigned char)client;
+					addr->port = (unsigned char)snd_seq_port_info_get_port(pinfo);
+				}
+				if (name)
+					snprintf(name, ALSA_MAXNAME, "%s:%s", snd_seq_client_info_get_name(cinfo), snd_seq_port_info_get_name(pinfo));
+				return nr_device;
+			}
+			n++;
+		}
+	}
+	return ((nr_device < 0) ? n : -1);
+}
+static snd_seq_t *alsa_open(const char *client_name, const char *port_name, unsigned int caps, int *port, int *queue)
+{
+	// open a sequencer client, with one virtual port, and one started real-time queue
+	// return NULL if error
+	snd_seq_t *seq = NULL;
+	if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0)
+		return NULL;
+	snd_seq_set_client_name(seq, client_name);
+	*port = snd_seq_create_simple_port(seq, port_name, caps, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+	*queue = snd_seq_alloc_named_queue(seq, client_name);
+	if ((*port < 0) || (*queue < 0))
+	{
+		snd_seq_close(seq);
+		return NULL;
+	}
+	snd_seq_start_queue(seq, *queue, NULL);
+	snd_seq_drain_output(seq);
+	return seq;
+}
+static void alsa_close(snd_seq_t *seq, int queue)
+{
+	snd_seq_stop_queue(seq, queue, NULL);
+	snd_seq_drain_output(seq);
+	snd_seq_free_queue(seq, queue);
+	snd_seq_close(seq);
+}
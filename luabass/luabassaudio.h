@@ -0,0 +1,345 @@
+// Audio kernels of the virtual instruments : interleave, deinterleave, gain and sum of float buffers
+//
+// The VSTi render one planar buffer per output, the BASS streams are interleaved : output #c of the VSTi
+// goes to the channel #c of its stream.
+// Each kernel has a scalar version, and SSE2 / AVX2 ( x86 ) or NEON ( ARM ) versions for the stereo case
+// and for the flat buffers. The other numbers of channels use the scalar version.
+// The best version supported by the CPU is chosen once, at runtime ( audio_kernels() ).
+// The SIMD versions do the same float operations as the scalar ones, sample per sample : the results are
+// bit-exact ( cf. luabass/bench/audiobench.cpp ).
+// Only arithmetic : no dependency on BASS or on the VST SDK.
+// update : 16/10/2026
+//////////////////////////////////////////////
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AUDIO_HAS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AUDIO_SSE2_TARGET
+#define AUDIO_AVX2_TARGET
+#else
+#define AUDIO_SSE2_TARGET __attribute__((target("sse2")))
+#define AUDIO_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__)
+#define AUDIO_HAS_NEON
+#include <arm_neon.h>
+#endif
+
+typedef struct t_audio_kernels
+{
+	const char *name;
+	// dst[frame * nbChannels + c] = src[c][frame]
+	void(*interleave)(float *dst, float * const *src, int nbChannels, int nbFrames);
+	// dst[c][frame] = src[frame * nbChannels + c]
+	void(*deinterleave)(float * const *dst, const float *src, int nbChannels, int nbFrames);
+	// buf[n] = buf[n] * gain
+	void(*gain)(float *buf, float gain, int nb);
+	// dst[n] = dst[n] + src[n]
+	void(*sum)(float *dst, const float *src, int nb);
+} T_audio_kernels;
+
+#define AUDIO_SCALAR 0
+#define AUDIO_SSE2 1
+#define AUDIO_AVX2 2
+#define AUDIO_NEON 3
+#define AUDIO_NBKERNELS 4
+
+static void audio_interleave_scalar(float *dst, float * const *src, int nbChannels, int nbFrames)
+{
+	for (int c = 0; c < nbChannels; c++)
+	{
+		const float *s = src[c];
+		float *d = dst + c;
+		for (int frame = 0; frame < nbFrames; frame++, d += nbChannels)
+			*d = s[frame];
+	}
+}
+static void audio_deinterleave_scalar(float * const *dst, const float *src, int nbChannels, int nbFrames)
+{
+	for (int c = 0; c < nbChannels; c++)
+	{
+		float *d = dst[c];
+		const float *s = src + c;
+		for (int frame = 0; frame < nbFrames; frame++, s += nbChannels)
+			d[frame] = *s;
+	}
+}
+static void audio_gain_scalar(float *buf, float gain, int nb)
+{
+	for (int n = 0; n < nb; n++)
+		buf[n] = buf[n] * gain;
+}
+static void audio_sum_scalar(float *dst, const float *src, int nb)
+{
+	for (int n = 0; n < nb; n++)
+		dst[n] = dst[n] + src[n];
+}
+static const T_audio_kernels g_audio_scalar = { "scalar", audio_interleave_scalar, audio_deinterleave_scalar, audio_gain_scalar, audio_sum_scalar };
+
+#ifdef AUDIO_HAS_X86
+AUDIO_SSE2_TARGET static void audio_interleave_sse2(float *dst, float * const *src, int nbChannels, int nbFrames)
+{
+	if (nbChannels != 2)
+	{
+		audio_interleave_scalar(dst, src, nbChannels, nbFrames);
+		return;
+	}
+	const float *l = src[0];
+	const float *r = src[1];
+	int frame = 0;
+	for (; frame + 4 <= nbFrames; frame += 4)
+	{
+		__m128 a = _mm_loadu_ps(l + frame);
+		__m128 b = _mm_loadu_ps(r + frame);
+		_mm_storeu_ps(dst + 2 * frame, _mm_unpacklo_ps(a, b));
+		_mm_storeu_ps(dst + 2 * frame + 4, _mm_unpackhi_ps(a, b));
+	}
+	for (; frame < nbFrames; frame++)
+	{
+		dst[2 * frame] = l[frame];
+		dst[2 * frame + 1] = r[frame];
+	}
+}
+AUDIO_SSE2_TARGET static void audio_deinterleave_sse2(float * const *dst, const float *src, int nbChannels, int nbFrames)
+{
+	if (nbChannels != 2)
+	{
+		audio_deinterleave_scalar(dst, src, nbChannels, nbFrames);
+		return;
+	}
+	float *l = dst[0];
+	float *r = dst[1];
+	int frame = 0;
+	for (; frame + 4 <= nbFrames; frame += 4)
+	{
+		__m128 a = _mm_loadu_ps(src + 2 * frame);
+		__m128 b = _mm_loadu_ps(src + 2 * frame + 4);
+		_mm_storeu_ps(l + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(r + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	for (; frame < nbFrames; frame++)
+	{
+		l[frame] = src[2 * frame];
+		r[frame] = src[2 * frame + 1];
+	}
+}
+AUDIO_SSE2_TARGET static void audio_gain_sse2(float *buf, float gain, int nb)
+{
+	__m128 g = _mm_set1_ps(gain);
+	int n = 0;
+	for (; n + 4 <= nb; n += 4)
+		_mm_storeu_ps(buf + n, _mm_mul_ps(_mm_loadu_ps(buf + n), g));
+	for (; n < nb; n++)
+		buf[n] = buf[n] * gain;
+}
+AUDIO_SSE2_TARGET static void audio_sum_sse2(float *dst, const float *src, int nb)
+{
+	int n = 0;
+	for (; n + 4 <= nb; n += 4)
+		_mm_storeu_ps(dst + n, _mm_add_ps(_mm_loadu_ps(dst + n), _mm_loadu_ps(src + n)));
+	for (; n < nb; n++)
+		dst[n] = dst[n] + src[n];
+}
+static const T_audio_kernels g_audio_sse2 = { "sse2", audio_interleave_sse2, audio_deinterleave_sse2, audio_gain_sse2, audio_sum_sse2 };
+
+AUDIO_AVX2_TARGET static void audio_interleave_avx2(float *dst, float * const *src, int nbChannels, int nbFrames)
+{
+	if (nbChannels != 2)
+	{
+		audio_interleave_scalar(dst, src, nbChannels, nbFrames);
+		return;
+	}
+	const float *l = src[0];
+	const float *r = src[1];
+	int frame = 0;
+	for (; frame + 8 <= nbFrames; frame += 8)
+	{
+		__m256 a = _mm256_loadu_ps(l + frame);
+		__m256 b = _mm256_loadu_ps(r + frame);
+		__m256 lo = _mm256_unpacklo_ps(a, b); // l0 r0 l1 r1 | l4 r4 l5 r5
+		__m256 hi = _mm256_unpackhi_ps(a, b); // l2 r2 l3 r3 | l6 r6 l7 r7
+		_mm256_storeu_ps(dst + 2 * frame, _mm256_permute2f128_ps(lo, hi, 0x20));
+		_mm256_storeu_ps(dst + 2 * frame + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+	}
+	for (; frame < nbFrames; frame++)
+	{
+		dst[2 * frame] = l[frame];
+		dst[2 * frame + 1] = r[frame];
+	}
+}
+AUDIO_AVX2_TARGET static void audio_deinterleave_avx2(float * const *dst, const float *src, int nbChannels, int nbFrames)
+{
+	if (nbChannels != 2)
+	{
+		audio_deinterleave_scalar(dst, src, nbChannels, nbFrames);
+		return;
+	}
+	float *l = dst[0];
+	float *r = dst[1];
+	int frame = 0;
+	for (; frame + 8 <= nbFrames; frame += 8)
+	{
+		__m256 a = _mm256_loadu_ps(src + 2 * frame); // l0 r0 l1 r1 | l2 r2 l3 r3
+		__m256 b = _mm256_loadu_ps(src + 2 * frame + 8); // l4 r4 l5 r5 | l6 r6 l7 r7
+		__m256 lo = _mm256_permute2f128_ps(a, b, 0x20); // l0 r0 l1 r1 | l4 r4 l5 r5
+		__m256 hi = _mm256_permute2f128_ps(a, b, 0x31); // l2 r2 l3 r3 | l6 r6 l7 r7
+		_mm256_storeu_ps(l + frame, _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm256_storeu_ps(r + frame, _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	for (; frame < nbFrames; frame++)
+	{
+		l[frame] = src[2 * frame];
+		r[frame] = src[2 * frame + 1];
+	}
+}
+AUDIO_AVX2_TARGET static void audio_gain_avx2(float *buf, float gain, int nb)
+{
+	__m256 g = _mm256_set1_ps(gain);
+	int n = 0;
+	for (; n + 8 <= nb; n += 8)
+		_mm256_storeu_ps(buf + n, _mm256_mul_ps(_mm256_loadu_ps(buf + n), g));
+	for (; n < nb; n++)
+		buf[n] = buf[n] * gain;
+}
+AUDIO_AVX2_TARGET static void audio_sum_avx2(float *dst, const float *src, int nb)
+{
+	int n = 0;
+	for (; n + 8 <= nb; n += 8)
+		_mm256_storeu_ps(dst + n, _mm256_add_ps(_mm256_loadu_ps(dst + n), _mm256_loadu_ps(src + n)));
+	for (; n < nb; n++)
+		dst[n] = dst[n] + src[n];
+}
+static const T_audio_kernels g_audio_avx2 = { "avx2", audio_interleave_avx2, audio_deinterleave_avx2, audio_gain_avx2, audio_sum_avx2 };
+
+static bool audio_cpu_sse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return ((info[3] >> 26) & 1) != 0;
+#else
+	return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+static bool audio_cpu_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	if (((info[2] >> 27) & 1) == 0) // OSXSAVE
+		return false;
+	if ((_xgetbv(0) & 6) != 6) // the OS saves the ymm registers
+		return false;
+	__cpuidex(info, 7, 0);
+	return ((info[1] >> 5) & 1) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#ifdef AUDIO_HAS_NEON
+static void audio_interleave_neon(float *dst, float * const *src, int nbChannels, int nbFrames)
+{
+	if (nbChannels != 2)
+	{
+		audio_interleave_scalar(dst, src, nbChannels, nbFrames);
+		return;
+	}
+	const float *l = src[0];
+	const float *r = src[1];
+	int frame = 0;
+	for (; frame + 4 <= nbFrames; frame += 4)
+	{
+		float32x4x2_t lr;
+		lr.val[0] = vld1q_f32(l + frame);
+		lr.val[1] = vld1q_f32(r + frame);
+		vst2q_f32(dst + 2 * frame, lr);
+	}
+	for (; frame < nbFrames; frame++)
+	{
+		dst[2 * frame] = l[frame];
+		dst[2 * frame + 1] = r[frame];
+	}
+}
+static void audio_deinterleave_neon(float * const *dst, const float *src, int nbChannels, int nbFrames)
+{
+	if (nbChannels != 2)
+	{
+		audio_deinterleave_scalar(dst, src, nbChannels, nbFrames);
+		return;
+	}
+	float *l = dst[0];
+	float *r = dst[1];
+	int frame = 0;
+	for (; frame + 4 <= nbFrames; frame += 4)
+	{
+		float32x4x2_t lr = vld2q_f32(src + 2 * frame);
+		vst1q_f32(l + frame, lr.val[0]);
+		vst1q_f32(r + frame, lr.val[1]);
+	}
+	for (; frame < nbFrames; frame++)
+	{
+		l[frame] = src[2 * frame];
+		r[frame] = src[2 * frame + 1];
+	}
+}
+static void audio_gain_neon(float *buf, float gain, int nb)
+{
+	int n = 0;
+	for (; n + 4 <= nb; n += 4)
+		vst1q_f32(buf + n, vmulq_n_f32(vld1q_f32(buf + n), gain));
+	for (; n < nb; n++)
+		buf[n] = buf[n] * gain;
+}
+static void audio_sum_neon(float *dst, const float *src, int nb)
+{
+	int n = 0;
+	for (; n + 4 <= nb; n += 4)
+		vst1q_f32(dst + n, vaddq_f32(vld1q_f32(dst + n), vld1q_f32(src + n)));
+	for (; n < nb; n++)
+		dst[n] = dst[n] + src[n];
+}
+static const T_audio_kernels g_audio_neon = { "neon", audio_interleave_neon, audio_deinterleave_neon, audio_gain_neon, audio_sum_neon };
+#endif
+
+static const T_audio_kernels *audio_kernels_get(int level)
+{
+	// kernels of a level ( AUDIO_SCALAR ... ), NULL if this build or this CPU does not support it
+	switch (level)
+	{
+	case AUDIO_SCALAR: return &g_audio_scalar;
+#ifdef AUDIO_HAS_X86
+	case AUDIO_SSE2: return audio_cpu_sse2() ? &g_audio_sse2 : NULL;
+	case AUDIO_AVX2: return audio_cpu_avx2() ? &g_audio_avx2 : NULL;
+#endif
+#ifdef AUDIO_HAS_NEON
+	case AUDIO_NEON: return &g_audio_neon;
+#endif
+	default: return NULL;
+	}
+}
+static const T_audio_kernels *audio_kernels_best()
+{
+	for (int level = AUDIO_NBKERNELS - 1; level > AUDIO_SCALAR; level--)
+	{
+		const T_audio_kernels *k = audio_kernels_get(level);
+		if (k != NULL)
+			return k;
+	}
+	return &g_audio_scalar;
+}
+static const T_audio_kernels *audio_kernels()
+{
+	// best kernels for this CPU, chosen at the first call
+	static const T_audio_kernels *best = audio_kernels_best();
+	return best;
+}
@@ -0,0 +1,103 @@
+// Latency measurement shared by basslua and luabass
+//
+// Optional timestamps along the path of a midiin message, aggregated in lock-free histograms, per stage :
+//    driver callback ( basslua ) -> dispatch start ( basslua ) -> LUA handler return ( basslua )
+//    LUA handler -> queue_insert or send to the device ( luabass ) -> unqueue of the delayed messages ( luabass )
+// The driver callback stamps the message only when the measure is enabled. The other points test this stamp :
+// when disabled, the cost is one relaxed load and one branch per point.
+// basslua owns the measure, and gives it to luabass in the LUA registry ( LATENCY_REGISTRY ).
+// luabass loaded without basslua uses its own measure ( only the unqueue stage is then fed ).
+// update : 16/10/2026
+//////////////////////////////////////////////
+
+#define LATENCY_REGISTRY "basslua_latency"
+
+// stages of the measure
+#define LAT_DISPATCH 0 // driver callback -> start of the dispatch
+#define LAT_LUA 1 // start of the dispatch -> return of the LUA handler
+#define LAT_TOTAL 2 // driver callback -> return of the LUA handler
+#define LAT_QUEUE 3 // driver callback -> queue_insert of a delayed midiout message
+#define LAT_SEND 4 // driver callback -> send of an immediate midiout message to the device
+#define LAT_UNQUEUE 5 // planned time -> send of a delayed midiout message
+#define LAT_NBSTAGE 6
+
+#define LAT_BUCKET 24 // buckets of the histograms : < 1us, < 2us, < 4us, ... , the last one without limit
+
+static const char *g_lat_name[LAT_NBSTAGE] = { "dispatch", "lua", "total", "queue", "send", "unqueue" };
+
+typedef struct t_lat_stage
+{
+	std::atomic<long long> count[LAT_BUCKET]; // number of measures per bucket
+	std::atomic<long long> nb; // number of measures
+	std::atomic<long long> sum; // sum of the measures in micro-seconds
+	std::atomic<long long> max; // max measure in micro-seconds
+} T_lat_stage;
+typedef struct t_latency
+{
+	std::atomic<bool> enabled; // the driver callbacks stamp the messages
+	std::atomic<long long> input; // stamp of the midiin message processed by the LUA handler, 0 if none
+	T_lat_stage stage[LAT_NBSTAGE];
+} T_latency;
+
+static long long lat_now()
+{
+	// return the absolute high-resolution time, in micro-seconds, comparable between the modules
+#ifdef V_PC
+	static LARGE_INTEGER freq = { 0 };
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER c;
+	QueryPerformanceCounter(&c);
+	return ((c.QuadPart / freq.QuadPart) * 1000000 + ((c.QuadPart % freq.QuadPart) * 1000000) / freq.QuadPart);
+#endif
+#ifdef V_MAC
+	static mach_timebase_info_data_t freq = { 0, 0 };
+	if (freq.denom == 0)
+		mach_timebase_info(&freq);
+	return ((long long)((mach_absolute_time() * freq.numer) / freq.denom / 1000));
+#endif
+#ifdef V_LINUX
+	struct timespec c;
+	clock_gettime(CLOCK_MONOTONIC, &c);
+	return ((long long)c.tv_sec * 1000000 + c.tv_nsec / 1000);
+#endif
+}
+static inline long long lat_stamp(T_latency *lat)
+{
+	// stamp of a driver callback : 0 when the measure is disabled
+	return (lat->enabled.load(std::memory_order_relaxed) ? lat_now() : 0);
+}
+static long long lat_limit(int bucket)
+{
+	// upper limit of a bucket in micro-seconds. 0 : no limit
+	return ((bucket < (LAT_BUCKET - 1)) ? (1LL << bucket) : 0);
+}
+static void lat_add(T_latency *lat, int stage, long long dt)
+{
+	// add a measure in the histogram of a stage. Never blocks
+	if (dt < 0)
+		dt = 0;
+	int b = 0;
+	while ((b < (LAT_BUCKET - 1)) && (dt >= (1LL << b)))
+		b++;
+	T_lat_stage *s = &(lat->stage[stage]);
+	s->count[b].fetch_add(1, std::memory_order_relaxed);
+	s->nb.fetch_add(1, std::memory_order_relaxed);
+	s->sum.fetch_add(dt, std::memory_order_relaxed);
+	long long m = s->max.load(std::memory_order_relaxed);
+	while ((dt > m) && (!s->max.compare_exchange_weak(m, dt, std::memory_order_relaxed)))
+		;
+}
+static void lat_reset(T_latency *lat)
+{
+	// clear the histograms. Measures added during the reset can be partially lost
+	for (int stage = 0; stage < LAT_NBSTAGE; stage++)
+	{
+		T_lat_stage *s = &(lat->stage[stage]);
+		for (int b = 0; b < LAT_BUCKET; b++)
+			s->count[b].store(0, std::memory_order_relaxed);
+		s->nb.store(0, std::memory_order_relaxed);
+		s->sum.store(0, std::memory_order_relaxed);
+		s->max.store(0, std::memory_order_relaxed);
+	}
+}
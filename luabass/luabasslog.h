@@ -0,0 +1,277 @@
+// Log shared by basslua and luabass
+//
+// Any thread writes its messages in a lock-free ring, without file access.
+// A flusher thread writes the ring to the log files, with one persistent buffered handle per file.
+// The GUI reads the same ring with its own cursor ( basslua_getLog, luabass.outGetLog ).
+// basslua owns the log, and gives it to luabass in the LUA registry ( LOG_REGISTRY ).
+// luabass loaded without basslua uses its own log.
+// update : 16/10/2026
+//////////////////////////////////////////////
+
+#define LOG_REGISTRY "basslua_log"
+
+// severity levels
+#define LOG_ERROR 0
+#define LOG_WARNING 1
+#define LOG_INFO 2
+#define LOG_TRACE 3
+
+// sources of the messages, each one in its own file
+#define LOG_SOURCE_IN 0 // basslua
+#define LOG_SOURCE_OUT 1 // luabass
+#define LOG_NBSOURCE 2
+
+#define LOG_MAXMSG 512 // max length of a message
+#define LOG_RING 1024 // number of messages in the ring ( power of 2 )
+#define LOG_PATH 1024 // max length of a file name
+#define LOG_RATE_SLOT 64 // number of call sites followed by the rate limiter
+#define LOG_RATE_MAX 50 // max messages per second from the same call site
+#define LOG_FLUSH_DT 50 // period of the flusher thread in ms
+
+typedef struct t_log_entry
+{
+	std::atomic<unsigned long> seq; // index+1 of the message, 0 while written
+	char source;
+	char level;
+	char msg[LOG_MAXMSG];
+} T_log_entry;
+typedef struct t_log_rate
+{
+	std::atomic<unsigned long long> key; // call site of the messages counted ( format in C, source line in LUA )
+	std::atomic<long long> second; // second of the count
+	std::atomic<int> count; // messages in this second
+	std::atomic<int> suppressed; // messages not written in this second
+} T_log_rate;
+typedef struct t_log
+{
+	T_log_entry ring[LOG_RING];
+	std::atomic<unsigned long> head; // index of the next message to write
+	std::atomic<unsigned long> tail_gui; // index of the next message for the GUI, set to head when the GUI starts to read
+	std::atomic<unsigned long> tail_flush; // index of the next message for the files
+	std::atomic<long> lost; // messages overwritten before being written in the files
+	std::atomic<int> level; // max severity level written
+	std::atomic<bool> collect; // the GUI reads the log : traces are written
+	T_log_rate rate[LOG_RATE_SLOT];
+	char path[LOG_NBSOURCE][LOG_PATH];
+	std::atomic<bool> reopen[LOG_NBSOURCE]; // path changed : the flusher reopens the file
+	FILE *file[LOG_NBSOURCE]; // used only by the flusher thread
+	std::atomic<bool> running;
+#ifdef V_PC
+	HANDLE thread;
+#endif
+#if defined(V_MAC) || defined(V_LINUX)
+	pthread_t thread;
+#endif
+} T_log;
+
+static bool log_rate(T_log *lg, unsigned long long key, int *suppressed)
+{
+	// rate limiter of the messages from the same call site
+	// return false if the message must not be written
+	T_log_rate *r = &(lg->rate[((key * 0x9E3779B97F4A7C15ULL) >> 32) % LOG_RATE_SLOT]);
+	long long second = (long long)time(NULL);
+	*suppressed = 0;
+	if ((r->key.load(std::memory_order_relaxed) != key) || (r->second.load(std::memory_order_relaxed) != second))
+	{
+		r->key.store(key, std::memory_order_relaxed);
+		r->second.store(second, std::memory_order_relaxed);
+		r->count.store(0, std::memory_order_relaxed);
+		*suppressed = r->suppressed.exchange(0);
+	}
+	if (r->count.fetch_add(1, std::memory_order_relaxed) < LOG_RATE_MAX)
+		return true;
+	r->suppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+static void log_push(T_log *lg, int source, int level, const char *format, va_list args)
+{
+	// write a message in the ring. Never blocks
+	unsigned long i = lg->head.fetch_add(1);
+	T_log_entry *e = &(lg->ring[i % LOG_RING]);
+	e->seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	e->source = (char)source;
+	e->level = (char)level;
+	vsnprintf(e->msg, LOG_MAXMSG, format, args);
+	e->seq.store(i + 1, std::memory_order_release);
+}
+static void log_pushf(T_log *lg, int source, int level, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	log_push(lg, source, level, format, args);
+	va_end(args);
+}
+static void log_write_key(T_log *lg, int source, int level, unsigned long long key, const char *format, va_list args)
+{
+	// write a message, according to the level and to the rate limiter of its call site key
+	if (level > lg->level.load(std::memory_order_relaxed))
+		return;
+	int suppressed;
+	if (!log_rate(lg, key, &suppressed))
+		return;
+	if (suppressed > 0)
+		log_pushf(lg, source, LOG_WARNING, "log : %d repeated messages suppressed", suppressed);
+	log_push(lg, source, level, format, args);
+}
+static void log_write(T_log *lg, int source, int level, const char *format, va_list args)
+{
+	// write a message : in C, the format is the call site
+	log_write_key(lg, source, level, (unsigned long long)(size_t)format, format, args);
+}
+static void log_collect(T_log *lg, bool collect)
+{
+	// start or stop the collect of the traces for the GUI. The GUI starts with the messages written from now
+	if (!collect)
+		lg->collect.store(false);
+	else if (!lg->collect.exchange(true))
+		lg->tail_gui.store(lg->head.load(std::memory_order_acquire), std::memory_order_release);
+}
+static bool log_read(T_log *lg, std::atomic<unsigned long> *tail, char *buf, int *source)
+{
+	// read the next message for the consumer of tail
+	// return false if no message is available
+	while (true)
+	{
+		unsigned long t = tail->load(std::memory_order_acquire);
+		unsigned long h = lg->head.load(std::memory_order_acquire);
+		if (t == h)
+			return false;
+		if (h - t > LOG_RING)
+		{
+			// the consumer is too late : the oldest messages are overwritten
+			if (tail == &(lg->tail_flush))
+				lg->lost.fetch_add((long)(h - t - LOG_RING));
+			tail->compare_exchange_strong(t, h - LOG_RING);
+			continue;
+		}
+		T_log_entry *e = &(lg->ring[t % LOG_RING]);
+		unsigned long seq = e->seq.load(std::memory_order_acquire);
+		if (seq != t + 1)
+		{
+			if ((seq == 0) || ((long)(seq - (t + 1)) < 0))
+				return false; // message still written
+			// message overwritten
+			if (tail->compare_exchange_strong(t, t + 1) && (tail == &(lg->tail_flush)))
+				lg->lost.fetch_add(1);
+			continue;
+		}
+		int s = e->source;
+		strncpy(buf, e->msg, LOG_MAXMSG);
+		buf[LOG_MAXMSG - 1] = '\0';
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (e->seq.load(std::memory_order_relaxed) != seq)
+			continue; // overwritten during the copy
+		if (tail->compare_exchange_strong(t, t + 1))
+		{
+			if (source)
+				*source = s;
+			return true;
+		}
+	}
+}
+static void log_flush(T_log *lg)
+{
+	// write the waiting messages in the files. Used only by the flusher thread
+	for (int source = 0; source < LOG_NBSOURCE; source++)
+	{
+		if (lg->reopen[source].exchange(false))
+		{
+			if (lg->file[source])
+				fclose(lg->file[source]);
+			lg->file[source] = fopen(lg->path[source], "w");
+			if (lg->file[source])
+				fprintf(lg->file[source], (source == LOG_SOURCE_IN) ? "log luabass in\n" : "log luabass out\n");
+		}
+	}
+	char msg[LOG_MAXMSG];
+	int source;
+	bool written[LOG_NBSOURCE] = { false, false };
+	while (log_read(lg, &(lg->tail_flush), msg, &source))
+	{
+		if ((source < 0) || (source >= LOG_NBSOURCE) || (lg->file[source] == NULL))
+			continue;
+		fprintf(lg->file[source], "%s\n", msg);
+		written[source] = true;
+	}
+	long lost = lg->lost.exchange(0);
+	if ((lost > 0) && (lg->file[LOG_SOURCE_IN]))
+	{
+		fprintf(lg->file[LOG_SOURCE_IN], "log : %ld messages lost\n", lost);
+		written[LOG_SOURCE_IN] = true;
+	}
+	for (source = 0; source < LOG_NBSOURCE; source++)
+	{
+		if (written[source])
+			fflush(lg->file[source]);
+	}
+}
+#ifdef V_PC
+static DWORD WINAPI log_flusher(LPVOID lpParam)
+{
+	T_log *lg = (T_log *)lpParam;
+	while (lg->running.load())
+	{
+		log_flush(lg);
+		Sleep(LOG_FLUSH_DT);
+	}
+	log_flush(lg);
+	return 0;
+}
+#endif
+#if defined(V_MAC) || defined(V_LINUX)
+static void *log_flusher(void *param)
+{
+	T_log *lg = (T_log *)param;
+	while (lg->running.load())
+	{
+		log_flush(lg);
+		usleep(LOG_FLUSH_DT * 1000);
+	}
+	log_flush(lg);
+	return NULL;
+}
+#endif
+static void log_path(T_log *lg, int source, const char *fname)
+{
+	// set the file of a source. It is (re)opened by the flusher thread
+	snprintf(lg->path[source], LOG_PATH, "%s", fname);
+	lg->reopen[source].store(true);
+}
+static void log_start(T_log *lg)
+{
+	// start the flusher thread
+	if (lg->running.load())
+		return;
+	lg->running.store(true);
+#ifdef V_PC
+	lg->thread = CreateThread(NULL, 0, log_flusher, lg, 0, NULL);
+	if (lg->thread == NULL)
+		lg->running.store(false);
+#endif
+#if defined(V_MAC) || defined(V_LINUX)
+	if (pthread_create(&(lg->thread), NULL, log_flusher, lg) != 0)
+		lg->running.store(false);
+#endif
+}
+static void log_stop(T_log *lg)
+{
+	// stop the flusher thread, after the flush of the waiting messages
+	if (!lg->running.exchange(false))
+		return;
+#ifdef V_PC
+	WaitForSingleObject(lg->thread, INFINITE);
+	CloseHandle(lg->thread);
+	lg->thread = NULL;
+#endif
+#if defined(V_MAC) || defined(V_LINUX)
+	pthread_join(lg->thread, NULL);
+#endif
+	for (int source = 0; source < LOG_NBSOURCE; source++)
+	{
+		if (lg->file[source])
+			fclose(lg->file[source]);
+		lg->file[source] = NULL;
+		lg->reopen[source].store(lg->path[source][0] != '\0');
+	}
+}
@@ -0,0 +1,60 @@
+// Sample-accurate timing of the events rendered by the virtual instruments ( VSTi, SF2 )
+//
+// The events are stamped with the time of the output clock ( micro-seconds ) when they are sent.
+// A block of n frames, rendered at time now, covers the window [now - n frames, now[ :
+// an event is placed at its offset in this window ( deltaFrames of VST2, split of the block for BASSMIDI ).
+// The latency is one block, constant, instead of a jitter up to one block when all the events
+// were applied at the start of the next block.
+// Only arithmetic : no dependency on BASS or on the VST SDK ( cf. luabass/bench/timingbench.cpp ).
+// update : 16/10/2026
+//////////////////////////////////////////////
+
+typedef struct t_vi_clock
+{
+	long long start_us; // time of the first frame of the current block
+	int nbFrames; // frames of the current block
+	int sampleRate;
+	int last; // offset of the last event placed : the offsets never decrease in a block
+	long long nb; // events placed
+	long long late; // events stamped before their window, placed on its first frame
+} T_vi_clock;
+
+static void timing_init(T_vi_clock *c, int sampleRate)
+{
+	c->start_us = 0;
+	c->nbFrames = 0;
+	c->sampleRate = sampleRate;
+	c->last = 0;
+	c->nb = 0;
+	c->late = 0;
+}
+static void timing_block(T_vi_clock *c, long long now_us, int nbFrames)
+{
+	// start a block of nbFrames, rendered at time now_us
+	c->nbFrames = nbFrames;
+	c->start_us = now_us - ((long long)nbFrames * 1000000) / c->sampleRate;
+	c->last = 0;
+}
+static int timing_offset(T_vi_clock *c, long long t_us)
+{
+	// offset in the current block of an event stamped at t_us, in frames
+	c->nb++;
+	if (c->nbFrames <= 0)
+		return 0;
+	long long dt = t_us - c->start_us;
+	int offset;
+	if (dt < 0)
+	{
+		c->late++;
+		offset = 0;
+	}
+	else
+	{
+		long long f = (dt * c->sampleRate) / 1000000;
+		offset = (f >= c->nbFrames) ? (c->nbFrames - 1) : (int)f;
+	}
+	if (offset < c->last)
+		offset = c->last;
+	c->last = offset;
+	return offset;
+}
@@ -165,6 +165,98 @@ function sound(wavfile)
   luabass.outSoundPlay(wavfile)
 end
 
+function jitter(reset)
+  local nb, average, max, counts, limits = luabass.outGetJitter(reset == "reset")
+  print("delayed events sent : " .. nb .. " , average delay : " .. average .. " us , max delay : " .. max .. " us")
+  for i = 1, #counts do
+    if limits[i] > 0 then
+      print("  < " .. limits[i] .. " us : " .. counts[i])
+    else
+      print("  more : " .. counts[i])
+    end
+  end
+end
+
+local latencyStages = { "dispatch", "lua", "total", "queue", "send", "unqueue" }
+function latency(action)
+  -- latency on|off|reset : start or stop the measure, latency : print the histograms
+  if action == "on" or action == "off" or action == "reset" then
+    luabass.outSetLatency(action ~= "off", action == "reset")
+    return
+  end
+  local stages = luabass.outGetLatency(false)
+  for _, name in ipairs(latencyStages) do
+    local s = stages[name]
+    if s.nb > 0 then
+      print(name .. " : " .. s.nb .. " events , average : " .. s.average .. " us , max : " .. s.max .. " us")
+      for i = 1, #s.counts do
+        if s.counts[i] > 0 then
+          if s.limits[i] > 0 then
+            print("  < " .. s.limits[i] .. " us : " .. s.counts[i])
+          else
+            print("  more : " .. s.counts[i])
+          end
+        end
+      end
+    end
+  end
+end
+function inspect()
+  luabass.outInspect()
+end
+
+function render(wavfile, vi, eventfile, block)
+  -- render <file.wav> <vi> [events.txt] [frames of a block] : render offline the events on a VSTi or SF2, as fast as possible
+  -- a line of events.txt : <ms> note|off|control|program <data1> [data2]
+  -- without events.txt, a pattern of chords is rendered
+  local events = {}
+  if eventfile and eventfile ~= "" then
+    for line in io.lines(eventfile) do
+      local t, kind, d1, d2 = string.match(line, "^%s*(%d+)%s+(%a+)%s+(%d+)%s*(%d*)")
+      if t then
+        table.insert(events, { t = tonumber(t), kind = kind, d1 = tonumber(d1), d2 = tonumber(d2) or 64 })
+      end
+    end
+  else
+    local chords = { { 60, 64, 67 }, { 57, 60, 64 }, { 53, 57, 60 }, { 55, 59, 62 } }
+    for i = 0, 15 do
+      for _, p in ipairs(chords[(i % 4) + 1]) do
+        table.insert(events, { t = 100 + i * 500, kind = "note", d1 = p, d2 = 80 })
+        table.insert(events, { t = 550 + i * 500, kind = "off", d1 = p, d2 = 0 })
+      end
+    end
+  end
+  local duration = 0
+  luabass.audioOfflineStart()
+  if luabass.outTrackOpenVi(1, 1, "", vi) == 0 then
+    print("error opening " .. vi)
+    luabass.audioOfflineStop()
+    return
+  end
+  for _, e in ipairs(events) do
+    if e.kind == "note" then
+      luabass.outNoteOn(e.d1, e.d2, e.d1, e.t)
+    elseif e.kind == "off" then
+      luabass.outNoteOff(e.d1, 0, e.d1, e.t)
+    elseif e.kind == "control" then
+      luabass.outControl(e.d1, e.d2, e.t)
+    elseif e.kind == "program" then
+      luabass.outProgram(e.d1, e.t)
+    end
+    if e.t > duration then
+      duration = e.t
+    end
+  end
+  -- two seconds for the release of the last notes
+  local frames, ms, speed = luabass.audioOfflineRender(wavfile, duration + 2000, tonumber(block) or 441)
+  luabass.audioOfflineStop()
+  if frames then
+    print(#events .. " events , " .. frames .. " frames rendered in " .. ms .. " ms , x" .. string.format("%.1f", speed) .. " real-time")
+  else
+    print("error rendering " .. wavfile)
+  end
+end
+
 function help()
   print("openin <name or #>" )
   print("openout <name or #>" )
@@ -176,6 +268,10 @@ function help()
   end
   print("transpose [-12..12]" )
   print("sound <file.wav>")
+  print("jitter [reset]")
+  print("latency [on|off|reset]")
+  print("inspect")
+  print("render <file.wav> <vi> [events.txt] [frames of a block]")
   print("exit")
   print("help")
 end
@@ -14,9 +14,12 @@ Basslua loads in addition, by default, these modules, accessible as global :
 
 Function onStart(param) : called by basslua ,when this LUA script is started.
 Function onStop() : called by basslua , before to close this LUA script.
+Function onDeviceAdded(deviceNr, name) : called by basslua, when a midiIn device is plugged.
+Function onDeviceRemoved(deviceNr, name) : called by basslua, when a midiIn device is unplugged.
 
 basslua uses these tables :
 - midiinOpen = { 1, 3 } : LUA table which contains midiIn deviceNrs to open. Checked regularly by basslua.
+    Only the changes are applied. A device which is unplugged is opened again when it is plugged again.
 - info.value = "text to display in the gui" : LUA string, to be displayed in the GUI. Checked regularly by basslua.
 - info.next = 1 : LUA value to increment-decrement the file in the GUI list. Checked regularly by basslua.
 - values = { {},..} : table of values which can be tuned in the GUI. 
@@ -68,7 +71,8 @@ Functions on<event>(...) : LUA functions to take actions on midi events
     onChannelPressure(integer deviceNr 1.. , float timestamp, integer channel 1..16, integer value 0..127 )
     onPitchBend(integer deviceNr 1.. , float timestamp, integer channel 1..16, integer value 0..127*127 )
     onSystemeCommon(integer deviceNr 1.. , float timestamp, integer value1 0..127, integer value2 0..127 , integer value3 0..127 )
-    onSysex(integer deviceNr 1.. , float timestamp , string asciiHexSysex e.g. FE4F7C4A... )
+    onSysex(integer deviceNr 1.. , float timestamp , string sysex ) : the bytes of the whole sysex, from F0 to F7. e.g. sysex:byte(2)
+    onSysexPart(integer deviceNr 1.. , float timestamp , string bytes , boolean last ) : each part of a sysex as it arrives ( e.g. sample dumps ). onSysex is not called
     onActive(integer deviceNr 1.. , float timestamp )
     onClock(integer deviceNr 1.. , float timestamp )
     onTimer(float timestamp)
@@ -2,17 +2,42 @@ local E={} -- to export the functions
 
 local listMidi = {}
 local idchord = 1
+local nbOut = 0 -- number of messages "sent"
+local maxListMidi = 10000 -- messages kept for dumpListMidi
+
+local function out(s)
+  nbOut = nbOut + 1
+  if #listMidi < maxListMidi then
+    table.insert(listMidi,s)
+  end
+end
+
+-- functions called by basslua
+function E.init(logpath)
+end
+function E.free()
+end
+function E.outAllNoteOff(mode)
+end
+function E.outSysexDone()
+end
+function E.outCount(reset)
+  local nb = nbOut
+  if reset then nbOut = 0 end
+  return nb
+end
+
 function E.outControl(ctrlnumber,value,delay,track)
-  table.insert(listMidi,"ct#"..ctrl.."/"..value.."@"..track.."+"..delay)
+  out("ct#"..ctrlnumber.."/"..value.."@"..(track or 1).."+"..(delay or 0))
 end
 function E.outSetTrackInstrument(instrument,track)
-  table.insert(listMidi,"is#"..instrument.."@"..track)
+  table.insert(listMidi,"is#"..instrument.."@"..(track or 1))
 end
 function E.outNoteOff(pitch,velo,id,delay,track)
-  table.insert(listMidi,"of#"..pitch.."@"..track.."+"..delay)
+  out("of#"..pitch.."@"..(track or 1).."+"..(delay or 0))
 end
 function E.outNoteOn(pitch,velo,id,delay,track)
-  table.insert(listMidi,"on#"..pitch.."v"..velo.."@"..track.."+"..delay)
+  out("on#"..pitch.."v"..velo.."@"..(track or 1).."+"..(delay or 0))
 end
 function E.outChordSet(id,transpose,delay,decay,pstart,pend,p1,p2,p3,p4)
   local idreturned = id
@@ -24,10 +49,10 @@ function E.outChordSet(id,transpose,delay,decay,pstart,pend,p1,p2,p3,p4)
   return idreturned
 end
 function E.outChordOn(id,velocity,dt,track)
-  table.insert(listMidi,"chordon id#"..id.." velocity="..velocity.." dt="..dt.." track#"..track)
+  out("chordon id#"..id.." velocity="..velocity.." dt="..(dt or 0).." track#"..(track or 1))
 end
 function E.outChordOff(id,velocity,dt)
-  table.insert(listMidi,"chordof id#"..id.." velocity="..(velocity or "").." dt="..(dt or ""))
+  out("chordof id#"..id.." velocity="..(velocity or "").." dt="..(dt or ""))
 end
 
 function E.dumpListMidi()
@@ -37,4 +62,11 @@ function E.dumpListMidi()
   listMidi = {}
 end
 
+-- the other functions of luabass are simulated : they count as one message "sent"
+setmetatable(E, { __index = function(t, name)
+  return function(...)
+    out(name)
+  end
+end })
+
 return E
\ No newline at end of file
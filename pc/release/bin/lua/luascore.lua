@@ -1,6 +1,6 @@
 --[[
 Created: 13/10/2016
--- update : 01/12/2016 21:00 
+-- update : 16/10/2026
 
 This LUA-module is loaded by default by the bassLUA-eMidi-driver.
 This LUA-module contains functions which are driven by the GUI over bassLUA-eMidi-driver :
@@ -8,6 +8,7 @@ This LUA-module contains functions which are driven by the GUI over bassLUA-eMid
   - addEvent
   - addEventStarts
   - addEventStops
+  - addEvents
   - addTracks
   - getNrEvent
   
@@ -733,6 +734,50 @@ function E.addEventStops(stop_nr_musicxmlevent)
  table.insert(currentEventStops , stop_nr_musicxmlevent)
 end
 
+function E.addEvents(events)
+  -- add a list of events, decoded by basslua from the packed buffer of the GUI
+  -- each event has the structure built by addEvent, with its starts and stops
+  table.move(events, 1, #events, #(score.events) + 1, score.events)
+end
+
+function E.patchEvents(nbEvents, first, nbReplaced, events)
+  -- replace the events [first, first+nbReplaced-1] by the events, decoded by basslua from the packed buffer of the GUI
+  -- the starts and stops of events are the numbers of the events after the patch
+  -- the numbers of the events after the events replaced, referred by the events kept, are shifted
+  -- return false if the score has not nbEvents
+  if (#(score.events) ~= nbEvents) or (first < 1) or (nbReplaced < 0) or (first + nbReplaced - 1 > nbEvents) then
+    return false
+  end
+  local delta = #events - nbReplaced
+  local limit = first + nbReplaced
+  local function shift(nr)
+    if nr >= limit then return nr + delta end
+    return nr
+  end
+  local patched = {}
+  for nrEvent = 1, nbEvents do
+    local t = score.events[nrEvent]
+    if nrEvent == first then
+      table.move(events, 1, #events, #patched + 1, patched)
+    end
+    if (nrEvent < first) or (nrEvent >= limit) then
+      for i, nr in ipairs(t[eStarts]) do t[eStarts][i] = shift(nr) end
+      for i, nr in ipairs(t[eStops]) do t[eStops][i] = shift(nr) end
+      t[eWillStopIndex] = shift(t[eWillStopIndex])
+      t[eStopIndex] = shift(t[eStopIndex])
+      table.insert(patched, t)
+    end
+  end
+  if first > nbEvents then
+    table.move(events, 1, #events, #patched + 1, patched)
+  end
+  score.events = patched
+  noteOffStops = {}
+  -- the position goes to the beginning of the patched score
+  E.firstPart()
+  return true
+end
+
 function E.addTrack(track_name)
   table.insert(score.tracks,{track_name , 0 , 128 ,  0 })
 end
@@ -858,4 +903,17 @@ E.load("testserialize")
 testEvent()
 --]]
 
+-- native score engine, registered by basslua ( module scoreengine ) :
+-- it holds the events in C arrays, and takes over the same entry points.
+-- The LUA implementation above is used when luascore runs without basslua.
+local scoreengine = package.loaded["scoreengine"]
+if scoreengine then
+  scoreengine.init(luabass, applyLua)
+  for inil, name in ipairs({ "initScore", "addEvent", "addEventStarts", "addEventStops", "addEvents", "patchEvents", "addTrack", "finishScore",
+      "play", "previousPos", "firstPart", "nextEvent", "nextMeasure", "nextPart", "lastPart",
+      "previousPart", "previousMeasure", "previousEvent", "gotoNrEvent", "getPosition", "save", "load" }) do
+    E[name] = scoreengine[name]
+  end
+end
+
 return E -- to export the functions
\ No newline at end of file